@@ -98,6 +98,13 @@ typedef void (*AML_DMX_DataCb)(int dev_no, int fd, const uint8_t *data, int len,
  */
 	DVB_RESULT AML_DMX_SetCallback(int dev_no, int fhandle, AML_DMX_DataCb cb, void *user_data);
 
+	/**\brief wait for the filters freed before to be released, their callbacks
+ * are no longer called once it returns, shall not be called from a callback
+ * \param dmx device number
+ * \return DVB_SUCCESS On success, DVB_FAILURE on error.
+ */
+	DVB_RESULT AML_DMX_Sync(int dev_no);
+
 #ifdef __cplusplus
 }
 #endif
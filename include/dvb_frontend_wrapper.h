@@ -265,13 +265,70 @@ extern "C"
     } desc;
   } dmd_terrestrial_desc_t;
 
+  /**\brief satellite switch target*/
+  typedef struct
+  {
+    dmd_polarization_t polarization; /* horizontal and circular left select 18V, none switches the supply off, the others 13V */
+    int high_band;                   /* 22kHz tone, high band of a universal LNB */
+    dmd_diseqc_port_t port;          /* DiSEqC 1.0 committed port, DMD_DISEQC_DEFAULT for none */
+    int uncommitted;                 /* DiSEqC 1.1 uncommitted port 1 - 16, 0 for none */
+    int position;                    /* DiSEqC 1.2 positioner slot 1 - 255, 0 for none */
+    uint_t motor_delay;              /* ms for the positioner to reach a new slot */
+  } dmd_sec_target_t;
+
+  typedef enum
+  {
+    DMD_SEC_EVENT_VOLTAGE,
+    DMD_SEC_EVENT_TONE,
+    DMD_SEC_EVENT_DISEQC
+  } dmd_sec_event_type_t;
+
+  /**\brief satellite equipment command recorded by a virtual frontend*/
+  typedef struct
+  {
+    uint64_t time_us;                /* monotonic time */
+    dmd_sec_event_type_t type;
+    uint_t value;                    /* fe_sec_voltage_t or fe_sec_tone_mode_t */
+    uint8_t msg[6];                  /* DiSEqC message */
+    uint8_t msg_len;
+  } dmd_sec_event_t;
+
+  /**\brief tuner status event callback, called on the frontend monitor thread*/
+  typedef void (*dmd_tuner_event_cb_t)(int frontend_fd, dmd_tuner_event_t tune_event, void *user_data);
+
+  /**\brief signal parameters*/
+  typedef struct
+  {
+    uint_t strength; /* signal strength, 0 - 0xffff */
+    uint_t snr;      /* signal to noise ratio, 0 - 0xffff */
+    uint_t ber;      /* bit error rate */
+  } dmd_signal_t;
+
+  /**\brief virtual frontend parameters*/
+  typedef struct
+  {
+    uint_t lock_delay;   /* ms from a tune to its lock or timeout */
+    int no_lock;         /* tunes time out instead of locking */
+    dmd_signal_t signal; /* signal reported while locked */
+    int dmx_dev_id;      /* demux fed with ts_file while locked, -1 for none */
+    const char *ts_file; /* TS file received on the locked channel, NULL for none */
+    uint_t ts_bitrate;   /* bitrate of ts_file in bit/s, 0 means as fast as possible */
+  } dmd_virtual_desc_t;
+
   /**\brief open frontend device
- * \param FE device path
+ * \param FE device path, a name starting with "virtual" opens a virtual frontend with the default parameters
  * \param FE device fd
  * \return DVB_SUCCESS On success, DVB_FAILURE on error.
  */
   DVB_RESULT AML_FE_Open(const char *name, int *frontend_fd);
 
+  /**\brief open a virtual frontend, it simulates the tune and lock without hardware
+ * \param virtual frontend parameters
+ * \param FE device fd, it can be polled for the status events like a frontend device
+ * \return DVB_SUCCESS On success, DVB_FAILURE on error.
+ */
+  DVB_RESULT AML_FE_OpenVirtual(const dmd_virtual_desc_t *desc, int *frontend_fd);
+
   /**\brief close frontend device
  * \param FE device fd
  * \return DVB_SUCCESS On success, DVB_FAILURE on error.
@@ -284,6 +341,38 @@ extern "C"
  */
   dmd_tuner_event_t AML_FE_GetTuneStatus(int frontend_fd);
 
+  /**\brief wait for the pending tune to lock or time out, the status events are read instead of polling the status
+ * \param FE device fd
+ * \param timeout in ms, -1 to wait forever
+ * \param the tune status, TUNER_STATE_UNKNOW if the wait timed out
+ * \return DVB_SUCCESS On success, DVB_FAILURE on error or timeout.
+ */
+  DVB_RESULT AML_FE_WaitTuneStatus(int frontend_fd, int timeout, dmd_tuner_event_t *tune_event);
+
+  /**\brief set the status event callback, the events of all frontends are monitored by one thread
+ * \param FE device fd
+ * \param callback, NULL to remove it, it shall not set callbacks or close frontends
+ * \param callback user data
+ * \return DVB_SUCCESS On success, DVB_FAILURE on error.
+ */
+  DVB_RESULT AML_FE_SetEventCallback(int frontend_fd, dmd_tuner_event_cb_t cb, void *user_data);
+
+  /**\brief get the signal parameters
+ * \param FE device fd
+ * \param the signal parameters
+ * \return DVB_SUCCESS On success, DVB_FAILURE on error.
+ */
+  DVB_RESULT AML_FE_GetSignal(int frontend_fd, dmd_signal_t *signal);
+
+  /**\brief get the TS source of the virtual frontend feeding a demux
+ * \param demux device id
+ * \param buffer of the TS file path, NULL if not needed
+ * \param size of the path buffer
+ * \param bitrate of the TS file, NULL if not needed
+ * \return the tune status of the virtual frontend, TUNER_STATE_UNKNOW if none feeds the demux
+ */
+  dmd_tuner_event_t AML_FE_GetVirtualSource(int dmx_dev_id, char *ts_file, size_t size, uint_t *ts_bitrate);
+
   /**\brief tune DVB-C
  * \param FE device fd
  * \param  dvb cable parameter
@@ -327,6 +416,22 @@ extern "C"
  */
   DVB_RESULT AML_FE_SendDISEQCMessage(int frontend_fd, uint8_t *data, uint8_t size);
 
+  /**\brief switch the satellite equipment to a target, only the commands changing the cached state
+ * are sent and the waits are the DiSEqC bus minimum settle times
+ * \param FE device fd
+ * \param the target
+ * \return DVB_SUCCESS On success, DVB_FAILURE on error.
+ */
+  DVB_RESULT AML_FE_SetSec(int frontend_fd, const dmd_sec_target_t *target);
+
+  /**\brief get and clear the satellite equipment commands recorded by a virtual frontend
+ * \param FE device fd
+ * \param the commands, oldest first
+ * \param max commands to get, the commands got on return
+ * \return DVB_SUCCESS On success, DVB_FAILURE on error.
+ */
+  DVB_RESULT AML_FE_GetVirtualTimeline(int frontend_fd, dmd_sec_event_t *events, int *count);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,133 @@
+/***************************************************************************
+ * Copyright (c) 2014 Amlogic, Inc. All rights reserved.
+ *
+ * This source code is subject to the terms and conditions defined in the
+ * file 'LICENSE' which is part of this source code package.
+ *
+ * Description:
+ *
+ * @brief   channel scan on several tuners
+ * @file    dvb_scan.h
+ *
+ * The frequency list is shared by one thread per tuner, a tuner takes the
+ * next frequency as soon as it is done with the previous one, so the lock
+ * wait of a tuner overlaps the table collection of the others. A transponder
+ * is done as soon as all the sections of PAT, its PMTs and the actual SDT are
+ * received, the table timeout only applies to incomplete ones.
+ *
+ * Demux i shall be routed to frontend i. The tables of a virtual frontend
+ * feeding its demux are read from its TS file. Sorting the DVB-S frequencies
+ * by satellite equipment target saves the switch commands.
+ ***************************************************************************/
+
+#ifndef _AM_SCAN_H
+#define _AM_SCAN_H
+
+#include "dvb_frontend_wrapper.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define DVB_SCAN_MAX_TUNERS 4
+#define DVB_SCAN_MAX_SERVICES 64
+#define DVB_SCAN_MAX_ES 8
+
+  typedef enum
+  {
+    DVB_SCAN_DVB_C,
+    DVB_SCAN_DVB_T,
+    DVB_SCAN_DVB_S
+  } dvb_scan_delivery_t;
+
+  /**\brief frequency to scan*/
+  typedef struct
+  {
+    dvb_scan_delivery_t delivery;
+    union {
+      dmd_cable_desc_t cable;
+      dmd_terrestrial_desc_t terr;
+      dmd_satellite_desc_t sate;
+    } desc;
+    dmd_sec_target_t sec;   /* satellite switched to before a DVB-S tune, the polarization is the one of desc.sate */
+  } dvb_scan_freq_t;
+
+  /**\brief elementary stream of a service*/
+  typedef struct
+  {
+    uint16_t pid;
+    uint8_t type;         /* stream_type of the PMT */
+  } dvb_scan_es_t;
+
+  /**\brief service found on a transponder*/
+  typedef struct
+  {
+    uint16_t service_id;
+    uint16_t pmt_pid;     /* 0 if the service is only in the SDT */
+    uint16_t pcr_pid;
+    uint8_t service_type; /* from the SDT service descriptor */
+    char name[32];        /* from the SDT service descriptor, not converted */
+    int es_count;
+    dvb_scan_es_t es[DVB_SCAN_MAX_ES];
+  } dvb_scan_service_t;
+
+  /**\brief result of a transponder*/
+  typedef struct
+  {
+    int index;            /* index in the frequency list */
+    int tuner;            /* tuner which scanned it */
+    dmd_tuner_event_t status;
+    dmd_signal_t signal;
+    uint16_t ts_id;
+    uint16_t onid;
+    int complete;         /* all the tables were received before the timeout */
+    uint_t lock_ms;       /* time from the tune to the lock */
+    uint_t tables_ms;     /* time spent on the tables */
+    int service_count;
+    dvb_scan_service_t services[DVB_SCAN_MAX_SERVICES];
+  } dvb_scan_result_t;
+
+  /**\brief transponder result callback, the calls are serialized, it shall not stop the scan*/
+  typedef void (*AML_SCAN_ResultCb)(const dvb_scan_result_t *result, void *user_data);
+
+  /**\brief scan parameters*/
+  typedef struct
+  {
+    int tuner_count;
+    int frontend_fd[DVB_SCAN_MAX_TUNERS];
+    int dmx_dev_id[DVB_SCAN_MAX_TUNERS]; /* opened with AML_DMX_Open, routed to the frontend */
+    const dvb_scan_freq_t *freqs;
+    int freq_count;
+    int lock_timeout;     /* ms */
+    int table_timeout;    /* ms */
+    AML_SCAN_ResultCb cb;
+    void *user_data;
+  } dvb_scan_params_t;
+
+  typedef void *dvb_scan_handle_t;
+
+  /**\brief start a scan
+ * \param scan parameters, the frequency list is copied
+ * \param scan handle
+ * \return DVB_SUCCESS On success, DVB_FAILURE on error.
+ */
+  DVB_RESULT AML_SCAN_Start(const dvb_scan_params_t *params, dvb_scan_handle_t *handle);
+
+  /**\brief wait for all the frequencies to be scanned
+ * \param scan handle
+ * \param timeout in ms, -1 to wait forever
+ * \return DVB_SUCCESS when done, DVB_FAILURE on error or timeout.
+ */
+  DVB_RESULT AML_SCAN_Wait(dvb_scan_handle_t handle, int timeout);
+
+  /**\brief stop a scan and free it, the transponders being scanned are aborted
+ * \param scan handle
+ * \return DVB_SUCCESS On success, DVB_FAILURE on error.
+ */
+  DVB_RESULT AML_SCAN_Stop(dvb_scan_handle_t handle);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,95 @@
+/**
+ * \file
+ * \brief Demux device topology
+ *
+ * The demux driver generation and the demux/asyncfifo nodes are probed once.
+ * The demux sources and the asyncfifo attributes set through this module are
+ * cached, a setting equal to the cached one issues no syscall. The cache
+ * assumes the nodes are only written by this library, call
+ * dvb_topology_invalidate() after they were changed by another way.
+ */
+
+#ifndef DVB_TOPOLOGY_H_
+#define DVB_TOPOLOGY_H_
+
+#include "dvb_utils.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**Demux devices probed.*/
+#define DVB_TOPOLOGY_MAX_DEMUX 8
+/**Asyncfifos probed.*/
+#define DVB_TOPOLOGY_MAX_ASYNCFIFO 8
+
+  /**Demux device topology.*/
+  typedef struct
+  {
+    int new_dmx;          /**< 1 if the sources are set with demux ioctls, 0 with the stb sysfs nodes.*/
+    int demux_count;      /**< /dev/dvb0.demuxN devices present.*/
+    int asyncfifo_count;  /**< asyncfifoN sysfs nodes present, old driver only.*/
+  } DVB_Topology_t;
+
+/**
+ * Get the topology, probed on the first call.
+ * \return The topology, never NULL.
+ */
+const DVB_Topology_t *dvb_topology_get(void);
+
+/**
+ * Write a sysfs node unless the value is the last one written.
+ * \param node The sysfs node.
+ * \param val The value.
+ * \retval 0 On success.
+ * \retval -1 On error.
+ */
+int dvb_topology_write(const char *node, const char *val);
+
+/**
+ * Get the cached source of a demux.
+ * \param dmx_idx Demux device's index.
+ * \param src Return the demux's input source.
+ * \retval 0 On success.
+ * \retval -1 If the source is unknown.
+ */
+int dvb_topology_get_source(int dmx_idx, DVB_DemuxSource_t *src);
+
+/**
+ * Cache the source of a demux, once set or read from the driver.
+ * \param dmx_idx Demux device's index.
+ * \param src The demux's input source.
+ */
+void dvb_topology_set_source(int dmx_idx, DVB_DemuxSource_t src);
+
+/**
+ * Route an asyncfifo to a demux, old driver only, the new one has no asyncfifo node.
+ * \param fifo_idx Asyncfifo's index.
+ * \param dmx_idx Source demux's index.
+ * \param flush_size The flush size in bytes.
+ * \retval 0 On success.
+ * \retval -1 On error.
+ */
+int dvb_topology_set_asyncfifo(int fifo_idx, int dmx_idx, int flush_size);
+
+/**
+ * Set the secure buffer of an asyncfifo, old driver only.
+ * \param fifo_idx Asyncfifo's index.
+ * \param enable 1 to output to the secure buffer.
+ * \param addr The secure buffer's address, 0 if disabled.
+ * \param size The secure buffer's size, 0 if disabled.
+ * \retval 0 On success.
+ * \retval -1 On error.
+ */
+int dvb_topology_set_asyncfifo_secure(int fifo_idx, int enable, uint64_t addr, int size);
+
+/**
+ * Drop the cached sources and sysfs values, the next settings are all written.
+ */
+void dvb_topology_invalidate(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*DVB_TOPOLOGY_H_*/
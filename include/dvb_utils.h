@@ -7,6 +7,7 @@
 #define DVB_UTILS_H_
 
 #include <android/log.h>
+#include "dvr_log.h"
 #include <stdio.h>
 #include <inttypes.h>
 
@@ -23,7 +24,9 @@ extern "C" {
 /**Logcat TAG of dvb*/
 #define DVB_LOG_TAG "dvb_debug"
 /**Default debug level*/
+#ifndef DVB_DEBUG_LEVEL
 #define DVB_DEBUG_LEVEL 1
+#endif
 
 /**Log output*/
 #define dvb_log_print(...) __android_log_print(ANDROID_LOG_INFO, DVB_LOG_TAG, __VA_ARGS__)
@@ -32,12 +35,13 @@ extern "C" {
 typedef unsigned int uint_t;
 #endif
 
-/**Output debug message.*/
+/**Output debug message, filtered with the runtime level of DVR_LOG_MODULE_DVB.*/
 #define DVB_DEBUG(_level, _fmt...) \
   do                               \
   {                                \
-    if (_level <= DVB_DEBUG_LEVEL) \
-      dvb_log_print(_fmt);         \
+    if (_level <= DVB_DEBUG_LEVEL  \
+        && dvr_log_enabled(DVR_LOG_MODULE_DVB, _level)) \
+      dvr_log_output(DVR_LOG_MODULE_DVB, _level, _fmt); \
   } while (0)
 
   /**Demux input source.*/
@@ -21,6 +21,34 @@ typedef enum {
   DVR_CRYPTO_TYPE_DECRYPT  /**< Decrypt.*/
 } DVR_CryptoType_t;
 
+/**Crypto capability flags.*/
+typedef enum {
+  DVR_CRYPTO_FLAG_IN_PLACE = 0x1 /**< The function can transform 188 aligned data in place, the output buffer is the input buffer.*/
+} DVR_CryptoFlag_t;
+
+/**\brief DVR crypto parity flag*/
+typedef enum {
+  DVR_CRYPTO_PARITY_CLEAR,        /**< Current period is clear*/
+  DVR_CRYPTO_PARITY_ODD,          /**< Current period is ODD*/
+  DVR_CRYPTO_PARITY_EVEN,         /**< Current period is EVEN*/
+} DVR_CryptoParity_t;
+
+/**\brief DVR crypto filter type*/
+typedef enum {
+  DVR_CRYPTO_FILTER_TYPE_AUDIO,   /**< Indicate current notification concerns audio packets*/
+  DVR_CRYPTO_FILTER_TYPE_VIDEO,   /**< Indicate current notification concerns video packets*/
+} DVR_CryptoFilterType_t;
+
+/**Max crypto periods passed to the decrypt function.*/
+#define DVR_CRYPTO_MAX_PERIODS 4
+
+/**Crypto period of a segment, starting at a parity transition of an audio or video PID.*/
+typedef struct {
+  loff_t           offset;                          /**< Segment offset of the first packet in the period.*/
+  DVR_CryptoFilterType_t filter_type;               /**< Audio or video PID.*/
+  DVR_CryptoParity_t parity;                        /**< Parity of the period.*/
+} DVR_CryptoPeriodEntry_t;
+
 /**Crypto parameters.*/
 typedef struct DVR_CryptoParams_s {
   DVR_CryptoType_t type;                            /**< Work type.*/
@@ -30,6 +58,9 @@ typedef struct DVR_CryptoParams_s {
   DVR_Buffer_t     input_buffer;                    /**< Input data buffer.*/
   DVR_Buffer_t     output_buffer;                   /**< Output data buffer.*/
   size_t           output_size;                     /**< Output data size in bytes.*/
+  uint32_t         flags;                           /**< DVR_CRYPTO_FLAG_IN_PLACE when this call works in place.*/
+  int              nb_periods;                      /**< Decrypt only, number of valid entries in periods.*/
+  DVR_CryptoPeriodEntry_t periods[DVR_CRYPTO_MAX_PERIODS]; /**< Decrypt only, the periods in force at offset followed by the upcoming ones, used to prefetch keys.*/
 } DVR_CryptoParams_t;
 
 /**Crypto function.*/
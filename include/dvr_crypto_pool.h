@@ -0,0 +1,74 @@
+/**
+ * \file
+ * \brief Crypto worker pool
+ *
+ * Runs the crypto function of dvr_record and dvr_playback on several worker
+ * threads. Jobs are keyed by DVR_CryptoParams_t::offset, so they can be
+ * processed in any order, and are collected in submission order.
+ */
+
+#ifndef _DVR_CRYPTO_POOL_H_
+#define _DVR_CRYPTO_POOL_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "dvr_types.h"
+#include "dvr_crypto.h"
+
+/**\brief Max crypto worker count*/
+#define DVR_CRYPTO_POOL_MAX_WORKERS 8
+
+/**\brief Crypto worker pool handle*/
+typedef void* DVR_CryptoPoolHandle_t;
+
+/**\brief Open a crypto worker pool
+ * \param[out] p_handle crypto pool handle
+ * \param[in] workers worker thread count, 1 to DVR_CRYPTO_POOL_MAX_WORKERS
+ * \param[in] depth max jobs submitted and not yet collected
+ * \param[in] func the crypto function
+ * \param[in] userdata the crypto function userdata
+ * \retval DVR_SUCCESS On success
+ * \return Error code
+ */
+int dvr_crypto_pool_open(DVR_CryptoPoolHandle_t *p_handle, int workers, int depth,
+    DVR_CryptoFunction_t func, void *userdata);
+
+/**\brief Close a crypto worker pool, jobs not yet collected are finished and dropped
+ * \param[in] handle crypto pool handle
+ * \retval DVR_SUCCESS On success
+ * \return Error code
+ */
+int dvr_crypto_pool_close(DVR_CryptoPoolHandle_t handle);
+
+/**\brief Submit a crypto job, the buffers must stay valid until the job is collected
+ * \param[in] handle crypto pool handle
+ * \param[in] params crypto parameters, copied into the job
+ * \retval DVR_SUCCESS On success
+ * \return Error code, DVR_FAILURE when depth jobs are pending
+ */
+int dvr_crypto_pool_submit(DVR_CryptoPoolHandle_t handle, DVR_CryptoParams_t *params);
+
+/**\brief Collect the oldest submitted job
+ * \param[in] handle crypto pool handle
+ * \param[out] params crypto parameters of the job, with output_size filled in
+ * \param[out] p_result the crypto function result, can be NULL
+ * \param[in] timeout wait timeout in ms, 0 does not wait, negative waits forever
+ * \retval DVR_SUCCESS On success
+ * \return Error code, DVR_FAILURE when no job is pending or the oldest job is not finished
+ */
+int dvr_crypto_pool_collect(DVR_CryptoPoolHandle_t handle, DVR_CryptoParams_t *params,
+    DVR_Result_t *p_result, int timeout);
+
+/**\brief Get the count of jobs submitted and not yet collected
+ * \param[in] handle crypto pool handle
+ * \return The pending job count
+ */
+int dvr_crypto_pool_get_pending(DVR_CryptoPoolHandle_t handle);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*END _DVR_CRYPTO_POOL_H_*/
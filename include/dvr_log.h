@@ -0,0 +1,133 @@
+/**
+ * \file
+ * \brief Logging
+ *
+ * The log lines above DVR_DEBUG_LEVEL are removed at compile time, the
+ * remaining ones are filtered by a runtime level per module before their
+ * arguments are evaluated. Lines can also be kept in a lock free in-memory
+ * ring and dumped on demand.
+ *
+ * Levels: 1 for events and errors, 2 for per-block and per-notification
+ * lines of the record and playback loops, 3 for verbose tracing.
+ */
+
+#ifndef _DVR_LOG_H_
+#define _DVR_LOG_H_
+
+#include <stdint.h>
+#include <android/log.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**\brief Log modules*/
+typedef enum {
+  DVR_LOG_MODULE_COMMON,     /**< Common and utilities*/
+  DVR_LOG_MODULE_RECORD,     /**< dvr_record and the record devices*/
+  DVR_LOG_MODULE_PLAYBACK,   /**< dvr_playback and the sinks*/
+  DVR_LOG_MODULE_WRAPPER,    /**< dvr_wrapper*/
+  DVR_LOG_MODULE_SEGMENT,    /**< Segment and index files*/
+  DVR_LOG_MODULE_DVB,        /**< Frontend and demux*/
+  DVR_LOG_MODULE_COUNT
+} DVR_LogModule_t;
+
+/**Logcat TAG of libdvr*/
+#define DVR_LOG_TAG "libdvr"
+
+/**Compile time debug level, the lines above it are not built in*/
+#ifndef DVR_DEBUG_LEVEL
+#define DVR_DEBUG_LEVEL 1
+#endif
+
+/**Module of the log lines of a source file, define it before the includes*/
+#ifndef DVR_LOG_MODULE
+#define DVR_LOG_MODULE DVR_LOG_MODULE_COMMON
+#endif
+
+/**Log ring entries, power of 2*/
+#define DVR_LOG_RING_SIZE 512
+
+/**Runtime levels of the modules, use dvr_log_set_level() to change*/
+extern volatile int dvr_log_levels[DVR_LOG_MODULE_COUNT];
+/**Non zero if the log ring is enabled*/
+extern volatile int dvr_log_ring_on;
+
+/**\brief Rate limit state of a log site*/
+typedef struct {
+  volatile uint32_t last;      /**< Last time printed, in ms*/
+  volatile uint32_t missed;    /**< Lines suppressed since then*/
+} DVR_LogRateLimit_t;
+
+/**Check if a line is kept, the constant part is folded at compile time*/
+#define dvr_log_enabled(_mod, _level) \
+  ((_level) <= DVR_DEBUG_LEVEL \
+    && ((_level) <= dvr_log_levels[_mod] || dvr_log_ring_on))
+
+/**Output a log line of a module, no runtime check*/
+#define dvr_log_output(_mod, _level, _fmt...) \
+  dvr_log_write(_mod, _level, NULL, NULL, 0, _fmt)
+#define dvr_log_output_fl(_mod, _level, _tag, _fmt...) \
+  dvr_log_write(_mod, _level, _tag, __FUNCTION__, __LINE__, _fmt)
+
+/**Output a log line at most once per _interval ms, the suppressed count is printed with the next one*/
+#define DVR_DEBUG_RL_FL(_level, _interval, _tag, _fmt...) \
+  do {\
+    static DVR_LogRateLimit_t _dvr_rl;\
+    if (dvr_log_enabled(DVR_LOG_MODULE, _level)\
+        && dvr_log_ratelimit(&_dvr_rl, _interval, DVR_LOG_MODULE, _level))\
+      dvr_log_output_fl(DVR_LOG_MODULE, _level, _tag, _fmt);\
+  } while (0)
+#define DVR_DEBUG_RL(_level, _interval, _fmt...) \
+  DVR_DEBUG_RL_FL(_level, _interval, "", _fmt)
+
+/**\brief Write a log line, use the macros instead
+ * \param[in] module the module
+ * \param[in] level the level
+ * \param[in] tag the tag printed before the function, NULL if none
+ * \param[in] func the function name, NULL if none
+ * \param[in] line the line number
+ * \param[in] fmt the format
+ */
+void dvr_log_write(int module, int level, const char *tag, const char *func, int line,
+    const char *fmt, ...) __attribute__((format(printf, 6, 7)));
+
+/**\brief Check the rate limit of a log site, use DVR_DEBUG_RL instead
+ * \param[in] rl the rate limit state of the site
+ * \param[in] interval min interval of the lines in ms
+ * \param[in] module the module
+ * \param[in] level the level
+ * \return Non zero if the line shall be printed
+ */
+int dvr_log_ratelimit(DVR_LogRateLimit_t *rl, uint32_t interval, int module, int level);
+
+/**\brief Set the runtime level of a module
+ * \param[in] module the module, DVR_LOG_MODULE_COUNT for all
+ * \param[in] level the level, 0 disables the module, the levels above DVR_DEBUG_LEVEL are not built in
+ * \retval 0 On success
+ * \return Error code
+ */
+int dvr_log_set_level(int module, int level);
+
+/**\brief Get the runtime level of a module
+ * \param[in] module the module
+ * \return The level
+ */
+int dvr_log_get_level(int module);
+
+/**\brief Enable or disable the log ring, all the lines built in go to the ring when enabled
+ * \param[in] on non zero to enable
+ */
+void dvr_log_ring_enable(int on);
+
+/**\brief Dump the log ring, oldest first
+ * \param[in] fd the file to write to
+ * \return The lines dumped
+ */
+int dvr_log_ring_dump(int fd);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*END _DVR_LOG_H_*/
@@ -8,9 +8,9 @@
 #include "list.h"
 #include "dvr_types.h"
 #include "segment.h"
-#include "AmTsPlayer.h"
 #include "dvr_types.h"
 #include "dvr_crypto.h"
+#include "dvr_playback_sink.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -52,6 +52,7 @@ typedef struct
   DVR_PlaybackSegmentFlag_t flags; /**< Segment's flag */
   int key_data_id;                /**< ??? */
   int duration;                        /**< Segment dur time ms*/
+  DVR_SegmentSummary_t summary;   /**< Segment's stream summary, flags 0 if unknown*/
 } DVR_PlaybackSegmentInfo_t;
 
 /**\brief play flag, if set this flag, player need pause when decode first frame */
@@ -209,7 +210,7 @@ typedef struct
   int                    dmx_dev_id;      /**< playback used dmx device index*/
   int                    block_size;      /**< playback inject block size*/
   DVR_Bool_t             is_timeshift;    /**< 0:playback mode, 1 : is timeshift mode*/
-  am_tsplayer_handle     player_handle;   /**< am tsplayer handle.*/
+  DVR_PlaybackSinkHandle_t player_handle; /**< decoder sink handle, the am tsplayer handle with the default sink*/
   DVR_CryptoFunction_t   crypto_fn;       /**< Crypto function.*/
   void                  *crypto_data;     /**< Crypto function's user data.*/
   DVR_Bool_t             has_pids;        /**< has video audo pid fmt info*/
@@ -217,8 +218,23 @@ typedef struct
   void                        *event_userdata;    /**< event userdata*/
   DVR_PlaybackVendor_t         vendor;    /**< vendor type,default is 0*/
   DVR_Bool_t                 is_notify_time;  /**< notify play time info true or not*/
+  const DVR_PlaybackSinkOps_t  *sink_ops;   /**< decoder sink operations, NULL means AmTsPlayer*/
+  int                          crypto_workers; /**< Decrypt worker threads, 0 means decrypt in the playback thread*/
+  uint32_t                     crypto_flags;   /**< Decrypt function capability, see DVR_CryptoFlag_t*/
+  int                          readahead_size; /**< Read-ahead window in bytes, 0 means default, negative disables the read hints*/
 } DVR_PlaybackOpenParams_t;
 
+/**\brief playback page cache statistics*/
+typedef struct
+{
+  uint64_t               read_bytes;       /**< bytes read from the segments*/
+  uint64_t               readahead_bytes;  /**< bytes advised to read ahead or prefetched*/
+  uint64_t               dropped_bytes;    /**< bytes dropped from the page cache after being played*/
+  uint32_t               prefetch_count;   /**< trick mode prefetches*/
+  uint64_t               cached_bytes;     /**< bytes of the current segment in the page cache*/
+  uint64_t               live_bytes;       /**< bytes read from the recorder live cache*/
+} DVR_PlaybackCacheStats_t;
+
 /**\brief playback play state*/
 typedef enum
 {
@@ -277,7 +293,8 @@ typedef DVR_Result_t (*DVR_PlaybackDecryptFunction_t) (uint8_t *p_in,
 /**\brief playback struct*/
 typedef struct
 {
-  am_tsplayer_handle         handle;             /**< tsplayer handle */
+  DVR_PlaybackSinkHandle_t   handle;             /**< decoder sink handle */
+  const DVR_PlaybackSinkOps_t *sink;             /**< decoder sink operations*/
   DVR_Bool_t                 segment_is_open;  /**<segment is opend*/
   uint64_t                   cur_segment_id;        /**< Current segment id*/
   DVR_PlaybackSegmentInfo_t  cur_segment;          /**< Current playing segment*/
@@ -307,8 +324,6 @@ typedef struct
   int                        fffb_start_pcr;     /**< fffb start pcr time*/
   uint64_t                   next_fffb_time;/**< fffb start pcr time*/
   int                        seek_time;/**< fffb start pcr time*/
-  event_callback             player_callback_func;/**< tsplayer cb*/
-  void                       *player_callback_userdata;/**< tsplayer cb data*/
   uint64_t                   send_time;/**< send event time*/
   int                        first_frame;/**< show first frame*/
   DVR_CryptoFunction_t       dec_func;                             /**< Decrypt function*/
@@ -333,6 +348,9 @@ typedef struct
   int                        obsolete;         /**< rec obsolete time in ms*/
   uint64_t                   rec_start;        /**< rec start time in ms*/
   int                        limit;            /**< rec data limit time in ms*/
+
+  Segment_AccessMode_t       access_mode;      /**< read access pattern of the current segment*/
+  Segment_CacheStats_t       cache_stats;      /**< page cache statistics of the closed segments*/
 } DVR_Playback_t;
 /**\endcond*/
 
@@ -414,7 +432,7 @@ int dvr_playback_stop(DVR_PlaybackHandle_t handle, DVR_Bool_t clear);
  * \retval DVR_SUCCESS On success
  * \return Error code
  */
-int dvr_playback_audio_start(DVR_PlaybackHandle_t handle, am_tsplayer_audio_params *param, am_tsplayer_audio_params *adparam);
+int dvr_playback_audio_start(DVR_PlaybackHandle_t handle, DVR_PlaybackSinkAudioParams_t *param, DVR_PlaybackSinkAudioParams_t *adparam);
 
 
 /**\brief Stop audio playing
@@ -430,7 +448,7 @@ int dvr_playback_audio_stop(DVR_PlaybackHandle_t handle);
  * \retval DVR_SUCCESS On success
  * \return Error code
  */
-int dvr_playback_video_start(DVR_PlaybackHandle_t handle, am_tsplayer_video_params *params);
+int dvr_playback_video_start(DVR_PlaybackHandle_t handle, DVR_PlaybackSinkVideoParams_t *params);
 
 /**\brief Stop play video
  * \param[in] handle playback handle
@@ -488,6 +506,14 @@ int dvr_playback_set_speed(DVR_PlaybackHandle_t handle, DVR_PlaybackSpeed_t spee
  */
 int dvr_playback_get_status(DVR_PlaybackHandle_t handle, DVR_PlaybackStatus_t *p_status);
 
+/**\brief Get playback page cache statistics
+ * \param[in] handle playback handle
+ * \param[out] p_stats page cache statistics
+ * \retval DVR_SUCCESS On success
+ * \return Error code
+ */
+int dvr_playback_get_cache_stats(DVR_PlaybackHandle_t handle, DVR_PlaybackCacheStats_t *p_stats);
+
 /**\brief Get playback capabilities
  * \param[out] p_capability playback capability
  * \retval DVR_SUCCESS On success
@@ -503,7 +529,8 @@ int dvr_playback_get_capabilities(DVR_PlaybackCapability_t *p_capability);
  */
 int dvr_dump_segmentinfo(DVR_PlaybackHandle_t handle, uint64_t segment_id);
 
-/**\brief Set DVR playback decrypt function
+/**\brief Set DVR playback decrypt function, it can be changed while playing,
+ * the decrypt workers then restart with the new function from the next block
  * \param[in] handle, DVR playback session handle
  * \param[in] func, DVR playback encrypt function
  * \param[in] userdata, DVR playback userdata from the caller
@@ -0,0 +1,190 @@
+/**
+ * \file
+ * \brief Playback decoder sink
+ *
+ * The playback engine injects data and controls the decoders through a
+ * sink operation table using the types below. The default sink maps them on
+ * AmTsPlayer in dvr_playback_sink_tsplayer.c, the measuring sink simulates the
+ * decoder buffer and collects inject statistics, so playback can be profiled
+ * without the media hal headers and libraries.
+ */
+
+#ifndef _DVR_PLAYBACK_SINK_H_
+#define _DVR_PLAYBACK_SINK_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "dvr_types.h"
+
+/**\brief Sink handle, the player handle passed in DVR_PlaybackOpenParams_t*/
+typedef void *DVR_PlaybackSinkHandle_t;
+
+/**\brief Sink operation result*/
+typedef enum
+{
+  DVR_PLAYBACK_SINK_OK    = 0,    /**< success*/
+  DVR_PLAYBACK_SINK_ERROR = -1,   /**< failure*/
+  DVR_PLAYBACK_SINK_RETRY = -2    /**< the decoder buffer is full, write again later*/
+} DVR_PlaybackSinkResult_t;
+
+/**\brief Sink input buffer type*/
+typedef enum
+{
+  DVR_PLAYBACK_SINK_BUFFER_NORMAL,  /**< data in normal memory*/
+  DVR_PLAYBACK_SINK_BUFFER_SECURE   /**< data in the secure buffer*/
+} DVR_PlaybackSinkBufferType_t;
+
+/**\brief Sink input buffer*/
+typedef struct
+{
+  DVR_PlaybackSinkBufferType_t type;  /**< buffer type*/
+  void                        *data;  /**< data*/
+  int32_t                      size;  /**< data size in bytes*/
+} DVR_PlaybackSinkBuffer_t;
+
+/**\brief Sink video decoder parameters*/
+typedef struct
+{
+  int                    format;      /**< DVR_VideoFormat_t*/
+  int32_t                pid;         /**< video pid*/
+} DVR_PlaybackSinkVideoParams_t;
+
+/**\brief Sink audio decoder parameters*/
+typedef struct
+{
+  int                    format;      /**< DVR_AudioFormat_t*/
+  int32_t                pid;         /**< audio pid*/
+} DVR_PlaybackSinkAudioParams_t;
+
+/**\brief Sink video trick mode*/
+typedef enum
+{
+  DVR_PLAYBACK_SINK_TRICK_NONE,        /**< normal play*/
+  DVR_PLAYBACK_SINK_TRICK_PAUSE,       /**< pause*/
+  DVR_PLAYBACK_SINK_TRICK_PAUSE_NEXT,  /**< show the next frame and pause*/
+  DVR_PLAYBACK_SINK_TRICK_IONLY        /**< decode the I frames only*/
+} DVR_PlaybackSinkTrickMode_t;
+
+/**\brief Sink event type*/
+typedef enum
+{
+  DVR_PLAYBACK_SINK_EVENT_OTHER,             /**< event the playback does not handle*/
+  DVR_PLAYBACK_SINK_EVENT_VIDEO_CHANGED,     /**< video format changed*/
+  DVR_PLAYBACK_SINK_EVENT_FIRST_FRAME,       /**< first video frame shown*/
+  DVR_PLAYBACK_SINK_EVENT_AUDIO_FIRST_FRAME  /**< first audio frame decoded*/
+} DVR_PlaybackSinkEventType_t;
+
+/**\brief Sink event*/
+typedef struct
+{
+  DVR_PlaybackSinkEventType_t type;          /**< event type*/
+  int                    native_type;        /**< event type of the decoder, for the logs*/
+  uint32_t               frame_width;        /**< video width, DVR_PLAYBACK_SINK_EVENT_VIDEO_CHANGED*/
+  uint32_t               frame_height;       /**< video height, DVR_PLAYBACK_SINK_EVENT_VIDEO_CHANGED*/
+  uint32_t               frame_rate;         /**< video frame rate, DVR_PLAYBACK_SINK_EVENT_VIDEO_CHANGED*/
+} DVR_PlaybackSinkEvent_t;
+
+/**\brief Sink event callback*/
+typedef void (*DVR_PlaybackSinkEventFunction_t)(void *userdata, DVR_PlaybackSinkEvent_t *event);
+
+/**\brief Playback decoder sink operations, the handle is the one passed in DVR_PlaybackOpenParams_t.player_handle.
+ * The operations return a DVR_PlaybackSinkResult_t*/
+typedef struct
+{
+  const char *name;                                                                                  /**< sink name*/
+  int (*write_data)(DVR_PlaybackSinkHandle_t handle, DVR_PlaybackSinkBuffer_t *buf, uint64_t timeout_ms); /**< inject data*/
+  int (*get_delay_time)(DVR_PlaybackSinkHandle_t handle, int64_t *p_time);                          /**< get cached data time in ms*/
+  int (*register_cb)(DVR_PlaybackSinkHandle_t handle, DVR_PlaybackSinkEventFunction_t func, void *userdata); /**< register the event callback, NULL unregisters it. A callback the decoder had before still gets its events*/
+  int (*set_video_params)(DVR_PlaybackSinkHandle_t handle, DVR_PlaybackSinkVideoParams_t *params);  /**< set video params*/
+  int (*start_video_decoding)(DVR_PlaybackSinkHandle_t handle);                                     /**< start video decoding*/
+  int (*stop_video_decoding)(DVR_PlaybackSinkHandle_t handle);                                      /**< stop video decoding*/
+  int (*pause_video_decoding)(DVR_PlaybackSinkHandle_t handle);                                     /**< pause video decoding*/
+  int (*resume_video_decoding)(DVR_PlaybackSinkHandle_t handle);                                    /**< resume video decoding*/
+  int (*set_audio_params)(DVR_PlaybackSinkHandle_t handle, DVR_PlaybackSinkAudioParams_t *params);  /**< set audio params*/
+  int (*start_audio_decoding)(DVR_PlaybackSinkHandle_t handle);                                     /**< start audio decoding*/
+  int (*stop_audio_decoding)(DVR_PlaybackSinkHandle_t handle);                                      /**< stop audio decoding*/
+  int (*pause_audio_decoding)(DVR_PlaybackSinkHandle_t handle);                                     /**< pause audio decoding*/
+  int (*resume_audio_decoding)(DVR_PlaybackSinkHandle_t handle);                                    /**< resume audio decoding*/
+  int (*set_ad_params)(DVR_PlaybackSinkHandle_t handle, DVR_PlaybackSinkAudioParams_t *params);     /**< set audio description params*/
+  int (*enable_ad_mix)(DVR_PlaybackSinkHandle_t handle);                                            /**< enable audio description mix*/
+  int (*disable_ad_mix)(DVR_PlaybackSinkHandle_t handle);                                           /**< disable audio description mix*/
+  int (*set_trick_mode)(DVR_PlaybackSinkHandle_t handle, DVR_PlaybackSinkTrickMode_t trickmode);    /**< set video trick mode*/
+  int (*start_fast)(DVR_PlaybackSinkHandle_t handle, float scale);                                  /**< start fast play*/
+  int (*stop_fast)(DVR_PlaybackSinkHandle_t handle);                                                /**< stop fast play*/
+  int (*show_video)(DVR_PlaybackSinkHandle_t handle);                                               /**< show video*/
+  int (*hide_video)(DVR_PlaybackSinkHandle_t handle);                                               /**< hide video*/
+  int (*set_audio_mute)(DVR_PlaybackSinkHandle_t handle, int32_t analog_mute, int32_t digital_mute); /**< mute audio*/
+  int (*set_pcr_pid)(DVR_PlaybackSinkHandle_t handle, int32_t pid);                                 /**< set pcr pid*/
+  void (*notify_seek)(DVR_PlaybackSinkHandle_t handle);                                             /**< playback seek happened, optional*/
+} DVR_PlaybackSinkOps_t;
+
+/**\brief Measuring sink parameters*/
+typedef struct
+{
+  uint32_t               buf_size;        /**< simulated decoder buffer size in bytes, 0 means default*/
+  uint32_t               drain_bitrate;   /**< decoder consume bitrate in bit/s, 0 means a null sink without backpressure*/
+} DVR_PlaybackSinkMeasureParams_t;
+
+/**\brief Measuring sink statistics*/
+typedef struct
+{
+  uint64_t               write_bytes;         /**< bytes accepted*/
+  uint32_t               write_count;         /**< successful writes*/
+  uint32_t               write_retries;       /**< writes rejected because the buffer is full*/
+  uint32_t               buf_level;           /**< current buffer level in bytes*/
+  uint32_t               buf_level_max;       /**< max buffer level in bytes*/
+  uint32_t               underflows;          /**< times the buffer ran empty while decoding*/
+  uint64_t               inject_rate;         /**< average inject rate since the first write, in bytes/s*/
+  uint32_t               seek_count;          /**< seeks notified*/
+  uint32_t               seek_latency_last;   /**< last seek to first data latency in ms*/
+  uint32_t               seek_latency_max;    /**< max seek to first data latency in ms*/
+  uint32_t               seek_latency_avg;    /**< average seek to first data latency in ms*/
+} DVR_PlaybackSinkStats_t;
+
+/**\brief Get the AmTsPlayer sink operations, the default sink
+ * \return The sink operations, NULL if the library is built without AmTsPlayer
+ */
+const DVR_PlaybackSinkOps_t *dvr_playback_sink_tsplayer_ops(void);
+
+/**\brief Get the measuring sink operations
+ * \return The sink operations
+ */
+const DVR_PlaybackSinkOps_t *dvr_playback_sink_measure_ops(void);
+
+/**\brief Create a measuring sink
+ * \param[out] p_handle the sink handle, pass it as the playback player handle
+ * \param[in] params measuring sink parameters, NULL means default
+ * \retval DVR_SUCCESS On success
+ * \return Error code
+ */
+int dvr_playback_sink_measure_create(DVR_PlaybackSinkHandle_t *p_handle, DVR_PlaybackSinkMeasureParams_t *params);
+
+/**\brief Destroy a measuring sink
+ * \param[in] handle the sink handle
+ * \retval DVR_SUCCESS On success
+ * \return Error code
+ */
+int dvr_playback_sink_measure_destroy(DVR_PlaybackSinkHandle_t handle);
+
+/**\brief Get the measuring sink statistics
+ * \param[in] handle the sink handle
+ * \param[out] p_stats the statistics
+ * \retval DVR_SUCCESS On success
+ * \return Error code
+ */
+int dvr_playback_sink_measure_get_stats(DVR_PlaybackSinkHandle_t handle, DVR_PlaybackSinkStats_t *p_stats);
+
+/**\brief Reset the measuring sink statistics, the buffer level is kept
+ * \param[in] handle the sink handle
+ * \retval DVR_SUCCESS On success
+ * \return Error code
+ */
+int dvr_playback_sink_measure_reset_stats(DVR_PlaybackSinkHandle_t handle);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*END _DVR_PLAYBACK_SINK_H_*/
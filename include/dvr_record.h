@@ -39,19 +39,6 @@ typedef enum {
   DVR_RECORD_FLAG_ACCURATE  = (1 << 1),
 } DVR_RecordFlag_t;
 
-/**\brief DVR crypto parity flag*/
-typedef enum {
-  DVR_CRYPTO_PARITY_CLEAR,        /**< Current period is clear*/
-  DVR_CRYPTO_PARITY_ODD,          /**< Current period is ODD*/
-  DVR_CRYPTO_PARITY_EVEN,         /**< Current period is EVEN*/
-} DVR_CryptoParity_t;
-
-/**\brief DVR crypto filter type*/
-typedef enum {
-  DVR_CRYPTO_FILTER_TYPE_AUDIO,   /**< Indicate current notification concerns audio packets*/
-  DVR_CRYPTO_FILTER_TYPE_VIDEO,   /**< Indicate current notification concerns video packets*/
-} DVR_CryptoFilterType_t;
-
 /**\brief DVR record event*/
 typedef enum {
   DVR_RECORD_EVENT_ERROR              = 0x1000,         /**< Signal a critical DVR error*/
@@ -89,10 +76,22 @@ typedef struct {
   DVR_RecordEventFunction_t   event_fn;           /**< DVR record event callback function*/
   void                        *event_userdata;    /**< DVR event userdata*/
   size_t                      notification_size;  /**< DVR record notification size, record moudle would send a notifaction when the size of current segment is multiple of this value. Put 0 in this argument if you don't want to receive the notification*/
-  DVR_CryptoPeriod_t          crypto_period;      /**< DVR crypto period information*/
+  DVR_CryptoPeriod_t          crypto_period;      /**< DVR crypto period information, DVR_RECORD_EVENT_CRYPTO_STATUS is sent only when interval_bytes is not 0*/
   DVR_CryptoFunction_t        crypto_fn;          /**< DVR crypto callback function*/
   void                        *crypto_userdata;   /**< DVR crypto userdata*/
   int                         ringbuf_size;       /**< DVR record ring buf size*/
+  int                         dev_backend;        /**< Record device backend, see Record_DeviceBackend_t, 0 is the demux device*/
+  const char                  *dev_src_file;      /**< TS source file of the file backend*/
+  uint32_t                    dev_src_bitrate;    /**< Software backend bitrate in bit/s, 0 means as fast as possible*/
+  int                         crypto_workers;     /**< Encrypt worker threads, 0 means encrypt in the record thread*/
+  uint32_t                    crypto_flags;       /**< Encrypt function capability, see DVR_CryptoFlag_t*/
+  loff_t                      prealloc_size;      /**< Reserve the segment disk space in extents of this size, 0 disables*/
+  loff_t                      writeback_size;     /**< Write back and drop the recorded data from the page cache every writeback_size bytes, 0 syncs each write*/
+  DVR_Bool_t                  direct_io;          /**< Write the segments with O_DIRECT*/
+  uint32_t                    block_latency_ms;   /**< Size the read/write blocks to hold this many ms at the measured bitrate, 0 keeps the flush size*/
+  uint32_t                    block_min_size;     /**< Smallest adaptive block in bytes, 0 means 32 packets*/
+  uint32_t                    block_max_size;     /**< Largest adaptive block in bytes, 0 means the flush size*/
+  uint32_t                    crypto_block_size;  /**< Input alignment of the crypto function in bytes, the adaptive blocks are multiples of it and of 188, 0 means 188 only*/
 } DVR_RecordOpenParams_t;
 
 /**\brief DVR record segment start parameters*/
@@ -114,6 +113,8 @@ typedef DVR_Result_t (*DVR_RecordEncryptFunction_t) (uint8_t *p_in,
 typedef struct {
   DVR_RecordState_t state;                                        /**< DVR record state*/
   DVR_RecordSegmentInfo_t info;                                   /**< DVR record segment information*/
+  uint32_t bitrate;                                               /**< Measured input bitrate in bit/s, 0 until measured*/
+  uint32_t block_size;                                            /**< Current read/write block size in bytes*/
 } DVR_RecordStatus_t;
 
 /**\brief DVR record start parameters*/
@@ -176,7 +177,9 @@ int dvr_record_next_segment(DVR_RecordHandle_t handle, DVR_RecordStartParams_t *
  */
 int dvr_record_stop_segment(DVR_RecordHandle_t handle, DVR_RecordSegmentInfo_t *p_info);
 
-/**\brief Resume the recording on a segment
+/**\brief Resume the recording on a segment, appending to its files.
+ * The data is cut to whole packets and the index to its last entry inside the data,
+ * the time index continues from that entry, so a segment left by a crash can be resumed.
  * \param[in] handle DVR recording session handle
  * \param[in] params DVR start parameters
  * \param[inout] p_resume_size HAL propose a resume size as a input parameter and output is the real resume size
@@ -42,6 +42,43 @@ int dvr_segment_get_list(const char *location, uint32_t *p_segment_nb, uint64_t
  */
 int dvr_segment_del_by_location(const char *location);
 
+/**\brief Store the segments of a timeshift location in one preallocated ring file
+ * instead of creating and deleting a file set per segment.
+ * Must be called before the first segment is recorded.
+ * The ring reserves ceil(max_size / segment_size) + 2 slots of segment_size + 4MB,
+ * one for the segment being recorded and one for the segment being removed
+ * \param[in] location The record file's location
+ * \param[in] max_size The timeshift max size in bytes
+ * \param[in] segment_size The record segment size in bytes
+ * \return DVR_SUCCESS On success
+ * \return Error code On failure
+ */
+int dvr_segment_ring_create(const char *location, loff_t max_size, loff_t segment_size);
+
+/**\brief Release the timeshift ring of a location and remove its files
+ * \param[in] location The record file's location
+ * \return DVR_SUCCESS On success
+ * \return Error code On failure
+ */
+int dvr_segment_ring_destroy(const char *location);
+
+/**\brief Keep the data last recorded in a location in memory, so a timeshift
+ * playback near the live position does not read it back from the file.
+ * The recorder and the player must run in the same process
+ * \param[in] location The record file's location
+ * \param[in] size The cache size in bytes
+ * \return DVR_SUCCESS On success
+ * \return Error code On failure
+ */
+int dvr_segment_live_cache_create(const char *location, size_t size);
+
+/**\brief Release the live cache of a location
+ * \param[in] location The record file's location
+ * \return DVR_SUCCESS On success
+ * \return Error code On failure
+ */
+int dvr_segment_live_cache_destroy(const char *location);
+
 
 /**\brief Get the segment's information
  * \param[in] location The record file's location
@@ -52,6 +89,14 @@ int dvr_segment_del_by_location(const char *location);
  */
 int dvr_segment_get_info(const char *location, uint64_t segment_id, DVR_RecordSegmentInfo_t *p_info);
 
+/**\brief Set the stream summary of a segment from its pids
+ * \param[in,out] p_info The segment's information
+ * \param[in] p_prev The previous segment's information, NULL if none
+ * \return DVR_SUCCESS On success
+ * \return Error code On failure
+ */
+int dvr_segment_summarize(DVR_RecordSegmentInfo_t *p_info, const DVR_RecordSegmentInfo_t *p_prev);
+
 /**\brief Link a segment group as the record file's list
  * \param[in] location The record file's location
  * \param[in] nb_segments The number of segments
@@ -61,6 +106,25 @@ int dvr_segment_get_info(const char *location, uint64_t segment_id, DVR_RecordSe
  */
 int dvr_segment_link(const char *location, uint32_t nb_segments, uint64_t *p_segment_ids);
 
+/**\brief Repair the segments of a record file left by an interrupted recording,
+ * e.g. after a power cut. The data, index and information files of a segment still
+ * marked as ongoing are cut to their last consistent entries and its information
+ * is recomputed, so it can be played. Only the file tails are read.
+ * Shall not be called while the record file is recorded by another process
+ * \param[in] location The record file's location
+ * \return DVR_SUCCESS On success
+ * \return Error code On failure
+ */
+int dvr_segment_recover(const char *location);
+
+/**\brief Repair several record files in parallel, see dvr_segment_recover(),
+ * e.g. the whole library once at boot
+ * \param[in] locations The record files' locations
+ * \param[in] nb_locations The number of locations
+ * \return DVR_SUCCESS On success
+ * \return Error code If a record file could not be repaired
+ */
+int dvr_segment_recover_locations(const char **locations, int nb_locations);
 
 #define LSEG_OP_NEW 0
 #define LSEG_OP_ADD 1
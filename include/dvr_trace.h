@@ -0,0 +1,93 @@
+/**
+ * \file
+ * \brief Trace points
+ *
+ * Begin/end spans, counters and instant events placed at the key points of
+ * the record and playback paths. When started, the events are kept in a lock
+ * free in-memory ring, exported as Chrome/Perfetto JSON, and/or written to the
+ * ftrace marker in the systrace format, so they show on the kernel timeline.
+ *
+ * A stopped trace point costs one load and branch, build with
+ * DVR_TRACE_DISABLE to remove them.
+ */
+
+#ifndef _DVR_TRACE_H_
+#define _DVR_TRACE_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**Trace ring entries, power of 2*/
+#define DVR_TRACE_RING_SIZE 8192
+
+/**\brief Trace outputs*/
+typedef enum {
+  DVR_TRACE_OUTPUT_RING   = 0x01,   /**< In-memory ring, see dvr_trace_dump_json()*/
+  DVR_TRACE_OUTPUT_FTRACE = 0x02    /**< ftrace trace_marker, systrace format*/
+} DVR_TraceOutput_t;
+
+/**\brief Trace event types*/
+typedef enum {
+  DVR_TRACE_EVENT_BEGIN,            /**< Span begins on the calling thread*/
+  DVR_TRACE_EVENT_END,              /**< Span ends on the calling thread*/
+  DVR_TRACE_EVENT_COUNTER,          /**< Counter value*/
+  DVR_TRACE_EVENT_INSTANT           /**< Instant event*/
+} DVR_TraceEventType_t;
+
+/**Outputs of the running trace, 0 if stopped*/
+extern volatile int dvr_trace_outputs;
+
+#ifndef DVR_TRACE_DISABLE
+/**Trace point, the name shall be a string literal*/
+#define DVR_TRACE(_type, _name, _value) \
+  do {\
+    if (dvr_trace_outputs)\
+      dvr_trace_event(_type, _name, _value);\
+  } while (0)
+#else
+#define DVR_TRACE(_type, _name, _value) do {} while (0)
+#endif
+
+/**Begin a span on the calling thread*/
+#define DVR_TRACE_BEGIN(_name)            DVR_TRACE(DVR_TRACE_EVENT_BEGIN, _name, 0)
+/**End the last span begun on the calling thread*/
+#define DVR_TRACE_END(_name)              DVR_TRACE(DVR_TRACE_EVENT_END, _name, 0)
+/**Set a counter*/
+#define DVR_TRACE_COUNTER(_name, _value)  DVR_TRACE(DVR_TRACE_EVENT_COUNTER, _name, _value)
+/**Mark an instant event*/
+#define DVR_TRACE_INSTANT(_name)          DVR_TRACE(DVR_TRACE_EVENT_INSTANT, _name, 0)
+
+/**\brief Record a trace event, use the macros instead
+ * \param[in] type the event type, DVR_TraceEventType_t
+ * \param[in] name the event name, a string literal
+ * \param[in] value the counter value
+ */
+void dvr_trace_event(int type, const char *name, int64_t value);
+
+/**\brief Start tracing, the ring is cleared
+ * \param[in] outputs DVR_TraceOutput_t flags
+ * \retval 0 On success
+ * \return Error code, DVR_FAILURE if the ftrace marker can not be opened
+ */
+int dvr_trace_start(int outputs);
+
+/**\brief Stop tracing, the ring is kept for dumping
+ * \retval 0 On success
+ * \return Error code
+ */
+int dvr_trace_stop(void);
+
+/**\brief Dump the trace ring in the Chrome/Perfetto JSON trace format
+ * \param[in] fd the file to write to
+ * \return The events dumped, or error code
+ */
+int dvr_trace_dump_json(int fd);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*END _DVR_TRACE_H_*/
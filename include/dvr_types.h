@@ -23,6 +23,7 @@
 #include <pthread.h>
 
 #include <android/log.h>
+#include "dvr_log.h"
 
 #ifndef __ANDROID_API__
 #include <limits.h>
@@ -43,27 +44,22 @@ extern "C"
 /**Maximum path size.*/
 #define DVR_MAX_LOCATION_SIZE     512
 
-/**Logcat TAG of libdvr*/
-#define DVR_LOG_TAG "libdvr"
-/**Default debug level*/
-#define DVR_DEBUG_LEVEL 1
-
-/**Log output*/
+/**Log output, not filtered*/
 #define dvr_log_print(...) __android_log_print(ANDROID_LOG_INFO, DVR_LOG_TAG, __VA_ARGS__)
 #define dvr_log_print_fl(tag, fmt, ...)\
   __android_log_print(ANDROID_LOG_INFO, DVR_LOG_TAG, tag " %s %d: " fmt, __FUNCTION__, __LINE__, ##__VA_ARGS__)
 
-/**Output debug message.*/
+/**Output debug message, the arguments are not evaluated if the level is filtered.*/
 #define DVR_DEBUG(_level,_fmt...) \
   do {\
-    if (_level <= DVR_DEBUG_LEVEL)\
-      dvr_log_print(_fmt);\
+    if (dvr_log_enabled(DVR_LOG_MODULE, _level))\
+      dvr_log_output(DVR_LOG_MODULE, _level, _fmt);\
   } while (0)
 
 #define DVR_DEBUG_FL(_level, _tag, _fmt...) \
   do {\
-    if (_level <= DVR_DEBUG_LEVEL)\
-      dvr_log_print_fl(_tag, _fmt);\
+    if (dvr_log_enabled(DVR_LOG_MODULE, _level))\
+      dvr_log_output_fl(DVR_LOG_MODULE, _level, _tag, _fmt);\
   } while (0)
 
 /**Abort the program if assertion is false.*/
@@ -199,6 +195,22 @@ typedef enum
 } DVR_Error_Reason_t;
 
 
+/**\brief Segment stream summary flags*/
+typedef enum {
+  DVR_SEGMENT_SUMMARY_VALID        = (1 << 0),  /**< The summary is set*/
+  DVR_SEGMENT_SUMMARY_VIDEO        = (1 << 1),  /**< Has video*/
+  DVR_SEGMENT_SUMMARY_AUDIO        = (1 << 2),  /**< Has audio*/
+  DVR_SEGMENT_SUMMARY_AD           = (1 << 3),  /**< Has AD*/
+  DVR_SEGMENT_SUMMARY_PIDS_CHANGED = (1 << 4)   /**< The A/V pids or their types differ from the previous segment*/
+} DVR_SegmentSummaryFlag_t;
+
+/**\brief Segment stream summary, so a segment is checked without scanning its pids*/
+typedef struct {
+  uint32_t            flags;                                      /**< DVR_SegmentSummaryFlag_t, 0 if unknown*/
+  int                 video_format;                               /**< Format of the 1st video, -1 if none*/
+  int                 audio_format;                               /**< Format of the 1st audio, -1 if none*/
+} DVR_SegmentSummary_t;
+
 /**\brief Segment store information*/
 typedef struct {
   uint64_t            id;                                         /**< DVR segment id*/
@@ -207,6 +219,7 @@ typedef struct {
   time_t              duration;                                   /**< DVR segment time duration, unit on ms*/
   size_t              size;                                       /**< DVR segment size*/
   uint32_t            nb_packets;                                 /**< DVR segment number of ts packets*/
+  DVR_SegmentSummary_t summary;                                   /**< DVR segment stream summary*/
 } Segment_StoreInfo_t;
 
 /**\brief DVR record segment information*/
@@ -65,6 +65,8 @@ typedef struct {
   DVR_WrapperInfo_t info;             /**< DVR record information*/
   DVR_WrapperPidsInfo_t pids;         /**< DVR record pids info*/
   DVR_WrapperInfo_t info_obsolete;    /**< DVR record obsolete information, take into account for timeshift*/
+  uint32_t bitrate;                   /**< Measured input bitrate in bit/s, 0 until measured*/
+  uint32_t block_size;                /**< Current read/write block size in bytes*/
 } DVR_WrapperRecordStatus_t;
 
 /**Record wrapper open parameters.*/
@@ -84,6 +86,20 @@ typedef struct {
   void                        *event_userdata;           /**< DVR event userdata*/
   int                   flush_size;                      /**< DVR flush size*/
   int                   ringbuf_size;                      /**< DVR ringbuf size*/
+  int                   dev_backend;                     /**< Record device backend, 0 is the demux device*/
+  const char           *dev_src_file;                    /**< TS source file of the file backend*/
+  uint32_t              dev_src_bitrate;                 /**< Software backend bitrate in bit/s*/
+  int                   crypto_workers;                  /**< Encrypt worker threads, 0 means encrypt in the record thread*/
+  uint32_t              crypto_flags;                    /**< Encrypt function capability, see DVR_CryptoFlag_t*/
+  DVR_Bool_t            ring_storage;                    /**< Store the timeshift segments in one preallocated ring file, reserves (max_size / segment_size rounded up + 2) slots of segment_size + 4MB*/
+  loff_t                prealloc_size;                   /**< Reserve the segment disk space in extents of this size, 0 disables*/
+  loff_t                writeback_size;                  /**< Write back and drop the recorded data from the page cache every writeback_size bytes, 0 syncs each write*/
+  DVR_Bool_t            direct_io;                       /**< Write the segments with O_DIRECT*/
+  size_t                live_cache_size;                 /**< Timeshift, bytes of the latest data kept in memory for the player, 0 disables*/
+  uint32_t              block_latency_ms;                /**< Size the read/write blocks to hold this many ms at the measured bitrate, 0 keeps the flush size*/
+  uint32_t              block_min_size;                  /**< Smallest adaptive block in bytes, 0 means 32 packets*/
+  uint32_t              block_max_size;                  /**< Largest adaptive block in bytes, 0 means the flush size*/
+  uint32_t              crypto_block_size;               /**< Input alignment of the crypto function in bytes, 0 means 188 only*/
 } DVR_WrapperRecordOpenParams_t;
 
 typedef struct {
@@ -109,6 +125,10 @@ typedef struct {
   void                        *event_userdata;             /**< event userdata*/
   DVR_Bool_t              is_notify_time;                  /**< 0:not notify time, 1 : notify*/
   DVR_PlaybackVendor_t    vendor;                          /**< vendor type*/
+  const DVR_PlaybackSinkOps_t *sink_ops;                   /**< decoder sink operations, NULL means AmTsPlayer*/
+  int                     crypto_workers;                  /**< Decrypt worker threads, 0 means decrypt in the playback thread*/
+  uint32_t                crypto_flags;                    /**< Decrypt function capability, see DVR_CryptoFlag_t*/
+  int                     readahead_size;                  /**< Read-ahead window in bytes, 0 means default, negative disables the read hints*/
 } DVR_WrapperPlaybackOpenParams_t;
 
 /**
@@ -179,6 +199,19 @@ int dvr_wrapper_update_record_pids (DVR_WrapperRecord_t rec, DVR_WrapperUpdatePi
  */
 int dvr_wrapper_get_record_status (DVR_WrapperRecord_t rec, DVR_WrapperRecordStatus_t *status);
 
+/**
+ * Get the last recording status notified, without locking the recording session.
+ * The status is refreshed on each status event, so it can be behind the one
+ * returned by dvr_wrapper_get_record_status(). It is read lock free, pollers
+ * can compare the version to skip unchanged status.
+ * \param rec The record handle.
+ * \param status The recording status returned.
+ * \param p_version The snapshot version returned, changed on each update, can be NULL.
+ * \retval DVR_SUCCESS On success.
+ * \return Error code, DVR_FAILURE if no status generated yet.
+ */
+int dvr_wrapper_get_record_status_snapshot (DVR_WrapperRecord_t rec, DVR_WrapperRecordStatus_t *status, uint32_t *p_version);
+
 /**
  * check record mode is secure or free.
  * \param rec The record handle.
@@ -294,6 +327,19 @@ int dvr_wrapper_seek_playback (DVR_WrapperPlayback_t playback, uint32_t time_off
  */
 int dvr_wrapper_get_playback_status (DVR_WrapperPlayback_t playback, DVR_WrapperPlaybackStatus_t *status);
 
+/**
+ * Get the last playback status notified, without locking the playback session.
+ * The status is refreshed on each playback event, so it can be behind the one
+ * returned by dvr_wrapper_get_playback_status(). It is read lock free, pollers
+ * can compare the version to skip unchanged status.
+ * \param playback The playback handle.
+ * \param status The playback status returned.
+ * \param p_version The snapshot version returned, changed on each update, can be NULL.
+ * \retval DVR_SUCCESS On success.
+ * \return Error code, DVR_FAILURE if no status generated yet.
+ */
+int dvr_wrapper_get_playback_status_snapshot (DVR_WrapperPlayback_t playback, DVR_WrapperPlaybackStatus_t *status, uint32_t *p_version);
+
 /**
  * Update playback.
  * \param playback The playback handle.
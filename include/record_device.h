@@ -8,12 +8,23 @@ extern "C" {
 /**\brief DVR record handle*/
 typedef void* Record_DeviceHandle_t;
 
+/**\brief DVR record device backend*/
+typedef enum {
+  RECORD_DEVICE_BACKEND_DVB,        /**< Demux/dvr device nodes (default)*/
+  RECORD_DEVICE_BACKEND_FILE,       /**< Replay a TS file, no hardware needed*/
+  RECORD_DEVICE_BACKEND_SYNTHETIC,  /**< Generate TS packets, no hardware needed*/
+  RECORD_DEVICE_BACKEND_FRONTEND,   /**< Receive the TS file of the virtual frontend feeding the demux while it is locked*/
+} Record_DeviceBackend_t;
+
 /**\brief DVR record open parameters*/
 typedef struct Record_DeviceOpenParams_t_s {
   int         fend_dev_id;  /**< frontend device id*/
   int         dmx_dev_id;   /**< demux device id*/
   uint32_t    buf_size;     /**< dvr record buffer size*/
   uint32_t    ringbuf_size;     /**< dvr record ring buffer size*/
+  Record_DeviceBackend_t backend;   /**< device backend*/
+  const char  *src_file;    /**< TS source file, RECORD_DEVICE_BACKEND_FILE only*/
+  uint32_t    src_bitrate;  /**< software backend bitrate in bit/s, 0 means as fast as possible*/
 } Record_DeviceOpenParams_t;
 
 /**\brief Open a DVR record device
@@ -69,7 +80,20 @@ int record_device_stop(Record_DeviceHandle_t handle);
  * \return The actual length on Success
  * \return Error code On failure
  */
-int record_device_read(Record_DeviceHandle_t handle, void *buf, size_t len, int timeout);
+ssize_t record_device_read(Record_DeviceHandle_t handle, void *buf, size_t len, int timeout);
+
+/**\brief Read the next secure demux output update, new demux driver only
+ *
+ * The secure demux service of the sid processes the data once per write
+ * pointer advance and queues the updates of each output buffer.
+ * \param[in] handle, DVR device handle
+ * \param[out] buf, the data start in the secure buffer
+ * \param[out] len, the data length
+ * \param[in] timeout, unit on ms
+ * \return The actual length on Success
+ * \return Error code On failure
+ */
+ssize_t record_device_read_ext(Record_DeviceHandle_t handle, size_t *buf, size_t *len, int timeout);
 
 /**\brief Configure secure buffer for the given record device
  * \param[in] handle, DVR device handle
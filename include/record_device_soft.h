@@ -0,0 +1,80 @@
+/**
+ * \file
+ * \brief Software record device backend
+ *
+ * Feeds the record device interface from a TS file, a synthetic packet
+ * generator or the TS file of a virtual frontend instead of the demux
+ * hardware, so the record pipeline can be exercised on machines without a
+ * DVB device.
+ */
+
+#ifndef _RECORD_DEVICE_SOFT_H_
+#define _RECORD_DEVICE_SOFT_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**\brief Software record device handle*/
+typedef void* Record_SoftDeviceHandle_t;
+
+/**\brief Open a software record device
+ * \param[out] p_handle, software device handle
+ * \param[in] params, record device open parameters, backend must not be RECORD_DEVICE_BACKEND_DVB
+ * \return DVR_SUCCESS On success
+ * \return Error code On failure
+ */
+int record_soft_open(Record_SoftDeviceHandle_t *p_handle, Record_DeviceOpenParams_t *params);
+
+/**\brief Close a software record device
+ * \param[in] handle, software device handle
+ * \return DVR_SUCCESS On success
+ * \return Error code On failure
+ */
+int record_soft_close(Record_SoftDeviceHandle_t handle);
+
+/**\brief Add a pid to the software device filter
+ * \param[in] handle, software device handle
+ * \param[in] pid, pid value
+ * \return DVR_SUCCESS On success
+ * \return Error code On failure
+ */
+int record_soft_add_pid(Record_SoftDeviceHandle_t handle, int pid);
+
+/**\brief Remove a pid from the software device filter
+ * \param[in] handle, software device handle
+ * \param[in] pid, pid value
+ * \return DVR_SUCCESS On success
+ * \return Error code On failure
+ */
+int record_soft_remove_pid(Record_SoftDeviceHandle_t handle, int pid);
+
+/**\brief Start the software device, pacing restarts from now
+ * \param[in] handle, software device handle
+ * \return DVR_SUCCESS On success
+ * \return Error code On failure
+ */
+int record_soft_start(Record_SoftDeviceHandle_t handle);
+
+/**\brief Stop the software device and wake up a blocked reader
+ * \param[in] handle, software device handle
+ * \return DVR_SUCCESS On success
+ * \return Error code On failure
+ */
+int record_soft_stop(Record_SoftDeviceHandle_t handle);
+
+/**\brief Read filtered TS packets from the software device
+ * \param[in] handle, software device handle
+ * \param[out] buf, the data buffer
+ * \param[in] len, the buffer length
+ * \param[in] timeout, unit on ms
+ * \return The actual length on Success
+ * \return Error code On failure
+ */
+ssize_t record_soft_read(Record_SoftDeviceHandle_t handle, void *buf, size_t len, int timeout);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*END _RECORD_DEVICE_SOFT_H_*/
@@ -11,6 +11,7 @@ extern "C" {
 #endif
 
 #include "dvr_types.h"
+#include "dvr_crypto.h"
 
 /**\brief Segment handle*/
 typedef void* Segment_Handle_t;
@@ -19,14 +20,36 @@ typedef void* Segment_Handle_t;
 typedef enum {
   SEGMENT_MODE_READ,            /**< Segment open read mode*/
   SEGMENT_MODE_WRITE,           /**< Segment open write mode*/
+  SEGMENT_MODE_APPEND,          /**< Segment open write mode continuing the existing files, the index state is restored from the index tail*/
   SEGMENT_MODE_MAX              /**< Segment invalid open mode*/
 } Segment_OpenMode_t;
 
+/**\brief Segment read access pattern*/
+typedef enum {
+  SEGMENT_ACCESS_NORMAL,        /**< No access hint*/
+  SEGMENT_ACCESS_SEQUENTIAL,    /**< Sequential read, read ahead of the position and drop the data behind*/
+  SEGMENT_ACCESS_RANDOM,        /**< Random read, no read-ahead, prefetch with segment_prefetch*/
+} Segment_AccessMode_t;
+
+/**\brief Segment page cache statistics*/
+typedef struct Segment_CacheStats_s {
+  uint64_t              read_bytes;                             /**< Bytes read*/
+  uint64_t              willneed_bytes;                         /**< Bytes advised to read ahead or prefetched*/
+  uint64_t              dontneed_bytes;                         /**< Bytes dropped from the page cache after being read*/
+  uint32_t              prefetch_count;                         /**< Prefetch requests*/
+  uint64_t              live_bytes;                             /**< Bytes read from the live cache instead of the file*/
+} Segment_CacheStats_t;
+
 /**\brief Segment open parameters*/
 typedef struct Segment_OpenParams_s {
   char                  location[DVR_MAX_LOCATION_SIZE];        /**< Segment file location*/
   uint64_t              segment_id;                             /**< Segment index*/
   Segment_OpenMode_t    mode;                                   /**< Segment open mode*/
+  loff_t                prealloc_size;                          /**< Write mode, reserve the disk space in extents of this size, 0 disables*/
+  loff_t                writeback_size;                         /**< Write mode, write back and drop the data from the page cache every writeback_size bytes instead of syncing each write, 0 disables*/
+  DVR_Bool_t            direct_io;                              /**< Write mode, write the ts data with O_DIRECT, falls back to buffered io if not supported*/
+  loff_t                resume_size;                            /**< Append mode, keep at most this many bytes of the ts data, -1 keeps all of it*/
+  DVR_Bool_t            no_progress;                            /**< Write/append mode, do not publish the progress to the readers, such as a segment being repaired*/
 } Segment_OpenParams_t;
 
 /**\brief Open a segment for a target giving some open parameters
@@ -97,6 +120,13 @@ loff_t segment_seek(Segment_Handle_t handle, uint64_t time, int block_size);
  */
 loff_t segment_tell_position(Segment_Handle_t handle);
 
+/**\brief Tell how many more bytes the giving segment can take, a ring segment is limited by its slot
+ * \param[in] handle, Segment handle
+ * \return The bytes left, LLONG_MAX if the segment is not limited
+ * \return error code on failure
+ */
+loff_t segment_tell_room(Segment_Handle_t handle);
+
 /**\brief Tell the giving position time for the giving segment, used for playback
  * \param[in] handle, Segment handle
  * \return The segment giving position time on success
@@ -149,6 +179,120 @@ int segment_delete(const char *location, uint64_t segment_id);
  */
 int segment_ongoing(Segment_Handle_t handle);
 
+/**\brief Repair a segment whose recording was interrupted, left with its ongoing file.
+ * The ts data is cut to whole packets and the index after its last complete entry,
+ * the size, packets and duration are recomputed from the file ends and stored with
+ * the pids kept from the information file, then the ongoing file is removed.
+ * Only the file tails are read. A segment open for write in this process is not touched
+ * \param[in] location, The record file's location
+ * \param[in] segment_id, The segment's index
+ * \return DVR_SUCCESS On success, or if the segment needs no repair
+ * \return Error code On failure
+ */
+int segment_recover(const char *location, uint64_t segment_id);
+
+/**\brief Append a crypto period transition to the segment crypto period index
+ * \param[in] handle, The segment handle, write mode
+ * \param[in] p_entry, The crypto period
+ * \return DVR_SUCCESS On success
+ * \return Error code On failure
+ */
+int segment_update_crypto_period(Segment_Handle_t handle, DVR_CryptoPeriodEntry_t *p_entry);
+
+/**\brief Get the crypto periods in force at an offset, followed by the next transitions
+ * \param[in] handle, The segment handle, read mode
+ * \param[in] offset, The segment offset
+ * \param[out] entries, The crypto periods
+ * \param[in] max, Max number of entries
+ * \return The number of entries On success, 0 when the segment has no crypto period index
+ * \return Error code On failure
+ */
+int segment_get_crypto_periods(Segment_Handle_t handle, loff_t offset, DVR_CryptoPeriodEntry_t *entries, int max);
+
+/**\brief Create the timeshift ring of a location, a preallocated data file split in slots.
+ * A segment opened for write takes a slot released by segment_delete, it uses its own files if none is free.
+ * The slot is held until the segment is closed and deleted
+ * \param[in] location, The record location
+ * \param[in] nb_slots, The slot count
+ * \param[in] slot_size, The max size of a segment in bytes
+ * \return DVR_SUCCESS On success
+ * \return Error code On failure
+ */
+int segment_ring_create(const char *location, uint32_t nb_slots, loff_t slot_size);
+
+/**\brief Destroy the timeshift ring of a location and remove its files,
+ * fails while a segment of the ring is open for write
+ * \param[in] location, The record location
+ * \return DVR_SUCCESS On success
+ * \return Error code On failure
+ */
+int segment_ring_destroy(const char *location);
+
+/**\brief Set the read access pattern of a segment
+ * \param[in] handle, The segment handle
+ * \param[in] mode, The access pattern
+ * \param[in] window, The read-ahead and drop-behind window in bytes, unused in normal mode
+ * \return DVR_SUCCESS On success
+ * \return Error code On failure
+ */
+int segment_set_access_mode(Segment_Handle_t handle, Segment_AccessMode_t mode, loff_t window);
+
+/**\brief Ask the kernel to read the data at a time in the background
+ * \param[in] handle, The segment handle
+ * \param[in] time, The segment time in ms
+ * \param[in] len, The bytes to prefetch
+ * \return DVR_SUCCESS On success
+ * \return Error code On failure
+ */
+int segment_prefetch(Segment_Handle_t handle, uint64_t time, size_t len);
+
+/**\brief Get the page cache statistics of a segment
+ * \param[in] handle, The segment handle
+ * \param[out] p_stats, The statistics
+ * \return DVR_SUCCESS On success
+ * \return Error code On failure
+ */
+int segment_get_cache_stats(Segment_Handle_t handle, Segment_CacheStats_t *p_stats);
+
+/**\brief Get the bytes of the segment ts data resident in the page cache
+ * \param[in] handle, The segment handle
+ * \return The cached bytes On success
+ * \return Error code On failure
+ */
+loff_t segment_get_cached_size(Segment_Handle_t handle);
+
+/**\brief Create the live cache of a location, the last size bytes recorded are kept in memory
+ * and segment_read serves them without going to the file
+ * \param[in] location, The record location
+ * \param[in] size, The cache size in bytes
+ * \return DVR_SUCCESS On success
+ * \return Error code On failure
+ */
+int segment_live_cache_create(const char *location, size_t size);
+
+/**\brief Destroy the live cache of a location
+ * \param[in] location, The record location
+ * \return DVR_SUCCESS On success
+ * \return Error code On failure
+ */
+int segment_live_cache_destroy(const char *location);
+
+/**\brief Wait for the recorder of a location to write past an offset of a segment,
+ * to open another segment or to close it
+ * \param[in] location, The record location
+ * \param[in] segment_id, The segment read
+ * \param[in] offset, The read offset
+ * \param[in] timeout, The max wait time in ms
+ * \return DVR_SUCCESS On new data, segment change, cancel or timeout
+ * \return Error code When the location is not recorded in this process, nothing was waited
+ */
+int segment_wait_data(const char *location, uint64_t segment_id, loff_t offset, int timeout);
+
+/**\brief Wake up all segment_wait_data callers
+ * \return DVR_SUCCESS On success
+ */
+int segment_wait_cancel(void);
+
 
 #ifdef __cplusplus
 }
@@ -13,6 +13,8 @@
  * \date 2020-07-16: create the document
  ***************************************************************************/
 
+#define DVR_LOG_MODULE DVR_LOG_MODULE_DVB
+
 #include <sys/types.h>
 #include <sys/ioctl.h>
 #include <sys/prctl.h>
@@ -51,6 +53,8 @@ typedef struct
     int running;
     pthread_t thread;
     pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uint32_t loop_seq;  /* passes of the data thread, callbacks of a pass end before the next one */
 
     dvb_dmx_filter_t filter[DMX_FILTER_COUNT];
 }dvb_dmx_t;
@@ -109,6 +113,9 @@ static void* dmx_data_thread(void *arg)
            }
         }
 
+        /*the filters freed before are closed and no callback is running*/
+        dmx->loop_seq++;
+        pthread_cond_broadcast(&dmx->cond);
     	pthread_mutex_unlock(&dmx->lock);
 
     	if (!cnt)
@@ -199,6 +206,7 @@ DVB_RESULT AML_DMX_Open(int dev_no)
 	dev->dev_no = dev_no;
 
     pthread_mutex_init(&dev->lock, NULL);
+    pthread_cond_init(&dev->cond, NULL);
     dev->running = 1;
     pthread_create(&dev->thread, NULL, dmx_data_thread, dev);
 
@@ -572,8 +580,35 @@ DVB_RESULT AML_DMX_Close(int dev_no)
        dev->running = 0;
        pthread_join(dev->thread, NULL);
        pthread_mutex_destroy(&dev->lock);
+       pthread_cond_destroy(&dev->cond);
+    }
+
+    pthread_mutex_unlock(&dev->lock);
+    return DVB_SUCCESS;
+}
+
+/**\brief wait for the filters freed before to be released
+ * \param dmx device number
+ * \return DVB_SUCCESS On success, DVB_FAILURE on error.
+ */
+DVB_RESULT AML_DMX_Sync(int dev_no)
+{
+    dvb_dmx_t *dev = NULL;
+    uint32_t seq;
+
+    if (dmx_get_dev(dev_no, &dev))
+    {
+        DVB_DEBUG(1, "wrong dmx device no %d", dev_no);
+        return DVB_FAILURE;
     }
+    if (!dev->running)
+        return DVB_SUCCESS;
 
+    /*the next pass starts after the running callbacks and closes the freed filters*/
+    pthread_mutex_lock(&dev->lock);
+    seq = dev->loop_seq;
+    while (dev->running && dev->loop_seq == seq)
+        pthread_cond_wait(&dev->cond, &dev->lock);
     pthread_mutex_unlock(&dev->lock);
     return DVB_SUCCESS;
 }
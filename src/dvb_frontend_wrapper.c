@@ -13,19 +13,496 @@
  * \date 2020-09-11: create the document
  ***************************************************************************/
 
+#define DVR_LOG_MODULE DVR_LOG_MODULE_DVB
+
 #include <sys/ioctl.h>
+#include <sys/eventfd.h>
+#include <sys/epoll.h>
 
 #include <fcntl.h>
 #include <errno.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
+#include <poll.h>
+#include <time.h>
+#include <pthread.h>
 
 #include "frontend.h"
 #include "dvb_frontend_wrapper.h"
+#include "dvr_trace.h"
+
+#define FE_VIRTUAL_MAX 4
+#define FE_VIRTUAL_LOCK_DELAY 300
+#define FE_VIRTUAL_NAME "virtual"
+#define FE_MONITOR_MAX 8
+#define FE_VIRTUAL_TIMELINE 64
+#define FE_SEC_MAX 8
+/*DiSEqC bus, min idle time after a supply, tone or message change before the next message or tone*/
+#define FE_SEC_SETTLE_MS 15
+#define FE_LOCK_STATUS (FE_HAS_SIGNAL | FE_HAS_CARRIER | FE_HAS_VITERBI | FE_HAS_SYNC | FE_HAS_LOCK)
+
+/*virtual frontend, its fd is an eventfd signaled on each status change*/
+typedef struct
+{
+    int fd;
+    dmd_virtual_desc_t desc;
+    char ts_file[256];
+    fe_status_t status;
+    uint_t frequency;
+    uint64_t done_ms; /* monotonic time the pending tune locks or times out, 0 if none */
+    int quit;
+    pthread_t thread;
+    pthread_cond_t cond;
+    dmd_sec_event_t timeline[FE_VIRTUAL_TIMELINE]; /* satellite equipment commands, a ring */
+    int timeline_pos;
+    int timeline_cnt;
+} fe_virtual_t;
+
+/*satellite equipment state of a frontend, -1 if unknown*/
+typedef struct
+{
+    int fd;
+    pthread_mutex_t lock; /* held during a switch sequence */
+    int voltage;
+    int tone;
+    int committed;
+    int uncommitted;
+    int position;
+    uint64_t change_ms; /* monotonic time of the last bus change */
+} fe_sec_t;
+
+/*status event callback of a frontend*/
+typedef struct
+{
+    int fd;
+    dmd_tuner_event_cb_t cb;
+    void *user_data;
+} fe_monitor_t;
+
+static fe_virtual_t fe_virtual[FE_VIRTUAL_MAX] = {[0 ... FE_VIRTUAL_MAX - 1] = {.fd = -1}};
+static volatile int fe_virtual_cnt;
+static pthread_mutex_t fe_virtual_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static fe_monitor_t fe_monitor[FE_MONITOR_MAX] = {[0 ... FE_MONITOR_MAX - 1] = {.fd = -1}};
+static int fe_monitor_epfd = -1;
+/*held while a callback runs, so a removed callback is never called afterwards*/
+static pthread_mutex_t fe_monitor_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static fe_sec_t fe_sec[FE_SEC_MAX] = {[0 ... FE_SEC_MAX - 1] = {.fd = -1, .lock = PTHREAD_MUTEX_INITIALIZER}};
+static pthread_mutex_t fe_sec_lock = PTHREAD_MUTEX_INITIALIZER;
 
 static DVB_RESULT dmd_set_prop(int frontend_fd, const struct dtv_properties *prop);
 
+static uint64_t fe_get_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static uint64_t fe_get_ms(void)
+{
+    return fe_get_us() / 1000;
+}
+
+static dmd_tuner_event_t dmd_status_to_event(fe_status_t status)
+{
+    if ((status & FE_HAS_LOCK) != 0)
+        return TUNER_STATE_LOCKED;
+    if ((status & FE_TIMEDOUT) != 0)
+        return TUNER_STATE_TIMEOUT;
+    return TUNER_STATE_UNKNOW;
+}
+
+/*called with fe_virtual_lock*/
+static fe_virtual_t *fe_virtual_find(int frontend_fd)
+{
+    int i;
+
+    for (i = 0; i < FE_VIRTUAL_MAX; i++)
+    {
+        if (fe_virtual[i].fd != -1 && fe_virtual[i].fd == frontend_fd)
+            return &fe_virtual[i];
+    }
+    return NULL;
+}
+
+static void fe_virtual_notify(fe_virtual_t *fe)
+{
+    uint64_t pad = 1;
+
+    if (write(fe->fd, &pad, sizeof(pad)) != sizeof(pad))
+        DVB_DEBUG(1, "virtual frontend:%d event write failed, errno[%d]:%s", fe->fd, errno, strerror(errno));
+}
+
+/*completes the pending tune after the lock delay*/
+static void *fe_virtual_thread(void *arg)
+{
+    fe_virtual_t *fe = (fe_virtual_t *)arg;
+    struct timespec ts;
+
+    pthread_mutex_lock(&fe_virtual_lock);
+    while (!fe->quit)
+    {
+        if (!fe->done_ms)
+        {
+            pthread_cond_wait(&fe->cond, &fe_virtual_lock);
+            continue;
+        }
+        if (fe_get_ms() < fe->done_ms)
+        {
+            ts.tv_sec = fe->done_ms / 1000;
+            ts.tv_nsec = (fe->done_ms % 1000) * 1000000;
+            pthread_cond_timedwait(&fe->cond, &fe_virtual_lock, &ts);
+            continue;
+        }
+
+        fe->done_ms = 0;
+        if (fe->desc.no_lock)
+        {
+            fe->status = FE_TIMEDOUT;
+            DVR_TRACE_INSTANT("fe_timeout");
+        }
+        else
+        {
+            fe->status = FE_LOCK_STATUS;
+            DVR_TRACE_INSTANT("fe_lock");
+        }
+        DVB_DEBUG(1, "virtual frontend:%d freq:%u status:0x%02x", fe->fd, fe->frequency, fe->status);
+        fe_virtual_notify(fe);
+    }
+    pthread_mutex_unlock(&fe_virtual_lock);
+    return NULL;
+}
+
+static void fe_virtual_record(fe_virtual_t *fe, dmd_sec_event_type_t type, uint_t value, const uint8_t *msg, int msg_len)
+{
+    dmd_sec_event_t *event = &fe->timeline[(fe->timeline_pos + fe->timeline_cnt) % FE_VIRTUAL_TIMELINE];
+
+    if (fe->timeline_cnt == FE_VIRTUAL_TIMELINE)
+        fe->timeline_pos = (fe->timeline_pos + 1) % FE_VIRTUAL_TIMELINE;
+    else
+        fe->timeline_cnt++;
+
+    memset(event, 0, sizeof(*event));
+    event->time_us = fe_get_us();
+    event->type = type;
+    event->value = value;
+    if (msg_len > (int)sizeof(event->msg))
+        msg_len = sizeof(event->msg);
+    if (msg && msg_len > 0)
+        memcpy(event->msg, msg, msg_len);
+    event->msg_len = msg_len;
+}
+
+/*emulates the frontend ioctls, called with fe_virtual_lock*/
+static int fe_virtual_ioctl(fe_virtual_t *fe, unsigned long request, void *arg)
+{
+    const struct dtv_properties *prop;
+    const struct dvb_diseqc_master_cmd *cmd;
+    struct dvb_frontend_event *event;
+    int locked = ((fe->status & FE_HAS_LOCK) != 0);
+    uint64_t cnt;
+    uint_t i;
+
+    switch (request)
+    {
+    case FE_SET_PROPERTY:
+        prop = (const struct dtv_properties *)arg;
+        for (i = 0; i < prop->num; i++)
+        {
+            if (prop->props[i].cmd == DTV_FREQUENCY)
+            {
+                fe->frequency = prop->props[i].u.data;
+            }
+            else if (prop->props[i].cmd == DTV_TUNE)
+            {
+                /*the previous lock is lost, like a demodulator restarting*/
+                fe->status = 0;
+                fe->done_ms = fe_get_ms() + fe->desc.lock_delay + 1;
+                fe_virtual_notify(fe);
+                pthread_cond_signal(&fe->cond);
+            }
+        }
+        return 0;
+    case FE_READ_STATUS:
+        *(fe_status_t *)arg = fe->status;
+        return 0;
+    case FE_GET_EVENT:
+        /*the pending events are merged into the current status*/
+        if (read(fe->fd, &cnt, sizeof(cnt)) != sizeof(cnt))
+        {
+            errno = EWOULDBLOCK;
+            return -1;
+        }
+        event = (struct dvb_frontend_event *)arg;
+        memset(event, 0, sizeof(*event));
+        event->status = fe->status;
+        event->parameters.frequency = fe->frequency;
+        return 0;
+    case FE_READ_SIGNAL_STRENGTH:
+        *(uint16_t *)arg = locked ? fe->desc.signal.strength : 0;
+        return 0;
+    case FE_READ_SNR:
+        *(uint16_t *)arg = locked ? fe->desc.signal.snr : 0;
+        return 0;
+    case FE_READ_BER:
+        *(uint32_t *)arg = locked ? fe->desc.signal.ber : 0;
+        return 0;
+    case FE_SET_VOLTAGE:
+        fe_virtual_record(fe, DMD_SEC_EVENT_VOLTAGE, (uint_t)(long)arg, NULL, 0);
+        return 0;
+    case FE_SET_TONE:
+        fe_virtual_record(fe, DMD_SEC_EVENT_TONE, (uint_t)(long)arg, NULL, 0);
+        return 0;
+    case FE_DISEQC_SEND_MASTER_CMD:
+        cmd = (const struct dvb_diseqc_master_cmd *)arg;
+        fe_virtual_record(fe, DMD_SEC_EVENT_DISEQC, 0, cmd->msg, cmd->msg_len);
+        return 0;
+    default:
+        errno = EOPNOTSUPP;
+        return -1;
+    }
+}
+
+/*frontend ioctl, dispatched to the virtual frontend owning the fd if any*/
+static int dmd_ioctl(int frontend_fd, unsigned long request, void *arg)
+{
+    fe_virtual_t *fe;
+    int ret;
+
+    if (fe_virtual_cnt)
+    {
+        pthread_mutex_lock(&fe_virtual_lock);
+        fe = fe_virtual_find(frontend_fd);
+        if (fe)
+        {
+            ret = fe_virtual_ioctl(fe, request, arg);
+            pthread_mutex_unlock(&fe_virtual_lock);
+            return ret;
+        }
+        pthread_mutex_unlock(&fe_virtual_lock);
+    }
+    return ioctl(frontend_fd, request, arg);
+}
+
+static DVB_RESULT fe_virtual_close(int frontend_fd)
+{
+    fe_virtual_t *fe;
+    pthread_t thread;
+
+    pthread_mutex_lock(&fe_virtual_lock);
+    fe = fe_virtual_find(frontend_fd);
+    if (!fe)
+    {
+        pthread_mutex_unlock(&fe_virtual_lock);
+        return DVB_FAILURE;
+    }
+    fe->quit = 1;
+    pthread_cond_signal(&fe->cond);
+    thread = fe->thread;
+    pthread_mutex_unlock(&fe_virtual_lock);
+
+    pthread_join(thread, NULL);
+
+    pthread_mutex_lock(&fe_virtual_lock);
+    pthread_cond_destroy(&fe->cond);
+    fe->fd = -1;
+    fe_virtual_cnt--;
+    pthread_mutex_unlock(&fe_virtual_lock);
+
+    close(frontend_fd);
+    return DVB_SUCCESS;
+}
+
+/*the satellite equipment state of a frontend, locked, NULL if none and not created*/
+static fe_sec_t *fe_sec_get(int frontend_fd, int create)
+{
+    fe_sec_t *sec = NULL;
+    int i;
+
+    pthread_mutex_lock(&fe_sec_lock);
+    for (i = 0; i < FE_SEC_MAX; i++)
+    {
+        if (fe_sec[i].fd == frontend_fd)
+        {
+            sec = &fe_sec[i];
+            break;
+        }
+        if (!sec && create && fe_sec[i].fd == -1)
+            sec = &fe_sec[i];
+    }
+    if (sec && sec->fd != frontend_fd)
+    {
+        sec->fd = frontend_fd;
+        sec->voltage = -1;
+        sec->tone = -1;
+        sec->committed = -1;
+        sec->uncommitted = -1;
+        sec->position = -1;
+        sec->change_ms = 0;
+    }
+    if (sec)
+        pthread_mutex_lock(&sec->lock);
+    pthread_mutex_unlock(&fe_sec_lock);
+    return sec;
+}
+
+/*keeps the cached state in sync with the commands sent directly*/
+static void fe_sec_note(int frontend_fd, unsigned long request, int value)
+{
+    fe_sec_t *sec = fe_sec_get(frontend_fd, 0);
+
+    if (!sec)
+        return;
+    if (request == FE_SET_VOLTAGE)
+    {
+        sec->voltage = value;
+    }
+    else if (request == FE_SET_TONE)
+    {
+        sec->tone = value;
+    }
+    else
+    {
+        /*an unknown message may have switched anything*/
+        sec->committed = -1;
+        sec->uncommitted = -1;
+        sec->position = -1;
+    }
+    sec->change_ms = fe_get_ms();
+    pthread_mutex_unlock(&sec->lock);
+}
+
+static void fe_sec_forget(int frontend_fd)
+{
+    int i;
+
+    pthread_mutex_lock(&fe_sec_lock);
+    for (i = 0; i < FE_SEC_MAX; i++)
+    {
+        if (fe_sec[i].fd == frontend_fd)
+        {
+            pthread_mutex_lock(&fe_sec[i].lock);
+            fe_sec[i].fd = -1;
+            pthread_mutex_unlock(&fe_sec[i].lock);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&fe_sec_lock);
+}
+
+/*waits the rest of the bus settle time*/
+static void fe_sec_settle(fe_sec_t *sec)
+{
+    uint64_t now = fe_get_ms();
+
+    if (sec->change_ms && now < sec->change_ms + FE_SEC_SETTLE_MS)
+        usleep((sec->change_ms + FE_SEC_SETTLE_MS - now) * 1000);
+}
+
+static DVB_RESULT fe_sec_send(fe_sec_t *sec, const uint8_t *msg, int len)
+{
+    struct dvb_diseqc_master_cmd cmd;
+
+    memset(&cmd, 0, sizeof(cmd));
+    memcpy(cmd.msg, msg, len);
+    cmd.msg_len = len;
+    fe_sec_settle(sec);
+    if (dmd_ioctl(sec->fd, FE_DISEQC_SEND_MASTER_CMD, &cmd) == -1)
+    {
+        DVB_DEBUG(1, "FE_DISEQC_SEND_MASTER_CMD failed, frontend_fd:%d, errno[%d]:%s", sec->fd, errno, strerror(errno));
+        return DVB_FAILURE;
+    }
+    sec->change_ms = fe_get_ms();
+    return DVB_SUCCESS;
+}
+
+static DVB_RESULT fe_sec_set(fe_sec_t *sec, unsigned long request, int *state, int value)
+{
+    if (*state == value)
+        return DVB_SUCCESS;
+    if (dmd_ioctl(sec->fd, request, (void *)(long)value) == -1)
+    {
+        DVB_DEBUG(1, "%s failed, frontend_fd:%d, value:%d errno[%d]:%s",
+                  request == FE_SET_VOLTAGE ? "FE_SET_VOLTAGE" : "FE_SET_TONE", sec->fd, value, errno, strerror(errno));
+        *state = -1;
+        return DVB_FAILURE;
+    }
+    *state = value;
+    sec->change_ms = fe_get_ms();
+    return DVB_SUCCESS;
+}
+
+/*reads one status event, DVB_FAILURE if none is pending*/
+static DVB_RESULT fe_read_event(int frontend_fd, dmd_tuner_event_t *tune_event)
+{
+    struct dvb_frontend_event fe_event;
+
+    if (dmd_ioctl(frontend_fd, FE_GET_EVENT, &fe_event) < 0)
+    {
+        /*EOVERFLOW reports dropped events, the next read gets the latest ones*/
+        if (errno != EWOULDBLOCK && errno != EAGAIN && errno != EOVERFLOW)
+            DVB_DEBUG(1, "frontend_fd:%d FE_GET_EVENT errno[%d]:%s", frontend_fd, errno, strerror(errno));
+        return DVB_FAILURE;
+    }
+    DVB_DEBUG(1, "frontend_fd:%d event status=0x%02x", frontend_fd, fe_event.status);
+    *tune_event = dmd_status_to_event(fe_event.status);
+    return DVB_SUCCESS;
+}
+
+static void *fe_monitor_thread(void *arg)
+{
+    struct epoll_event events[FE_MONITOR_MAX];
+    dmd_tuner_event_t tune_event;
+    int i, j, n;
+
+    (void)arg;
+    for (;;)
+    {
+        n = epoll_wait(fe_monitor_epfd, events, FE_MONITOR_MAX, -1);
+        if (n < 0 && errno != EINTR)
+        {
+            DVB_DEBUG(1, "frontend monitor epoll_wait errno[%d]:%s", errno, strerror(errno));
+            break;
+        }
+        for (i = 0; i < n; i++)
+        {
+            pthread_mutex_lock(&fe_monitor_lock);
+            for (j = 0; j < FE_MONITOR_MAX; j++)
+            {
+                if (fe_monitor[j].fd == events[i].data.fd)
+                    break;
+            }
+            /*removed meanwhile*/
+            if (j < FE_MONITOR_MAX && fe_read_event(fe_monitor[j].fd, &tune_event) == DVB_SUCCESS)
+                fe_monitor[j].cb(fe_monitor[j].fd, tune_event, fe_monitor[j].user_data);
+            pthread_mutex_unlock(&fe_monitor_lock);
+        }
+    }
+    return NULL;
+}
+
+/*removes the callback of a frontend, called with fe_monitor_lock*/
+static DVB_RESULT fe_monitor_del(int frontend_fd)
+{
+    int i;
+
+    for (i = 0; i < FE_MONITOR_MAX; i++)
+    {
+        if (fe_monitor[i].fd == frontend_fd)
+        {
+            epoll_ctl(fe_monitor_epfd, EPOLL_CTL_DEL, frontend_fd, NULL);
+            fe_monitor[i].fd = -1;
+            fe_monitor[i].cb = NULL;
+            return DVB_SUCCESS;
+        }
+    }
+    return DVB_FAILURE;
+}
+
 /**\brief open frontend device
  * \param FE device path
  * \param FE device fd
@@ -34,6 +511,17 @@ static DVB_RESULT dmd_set_prop(int frontend_fd, const struct dtv_properties *pro
 DVB_RESULT AML_FE_Open(const char *name, int *frontend_fd)
 {
     DVB_RESULT retval = DVB_SUCCESS;
+    dmd_virtual_desc_t desc;
+
+    if (strncmp(name, FE_VIRTUAL_NAME, strlen(FE_VIRTUAL_NAME)) == 0)
+    {
+        memset(&desc, 0, sizeof(desc));
+        desc.lock_delay = FE_VIRTUAL_LOCK_DELAY;
+        desc.signal.strength = 0xc000;
+        desc.signal.snr = 0xc000;
+        desc.dmx_dev_id = -1;
+        return AML_FE_OpenVirtual(&desc, frontend_fd);
+    }
 
     if ((*frontend_fd = open(name, O_RDWR | O_NONBLOCK)) < 0)
     {
@@ -44,6 +532,71 @@ DVB_RESULT AML_FE_Open(const char *name, int *frontend_fd)
     return retval;
 }
 
+/**\brief open a virtual frontend, it simulates the tune and lock without hardware
+ * \param virtual frontend parameters
+ * \param FE device fd, it can be polled for the status events like a frontend device
+ * \return DVB_SUCCESS On success, DVB_FAILURE on error.
+ */
+DVB_RESULT AML_FE_OpenVirtual(const dmd_virtual_desc_t *desc, int *frontend_fd)
+{
+    pthread_condattr_t cattr;
+    fe_virtual_t *fe = NULL;
+    int fd, i;
+
+    if (!desc || !frontend_fd)
+        return DVB_FAILURE;
+
+    if ((fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0)
+    {
+        DVB_DEBUG(1, "Failed to open virtual frontend, errno[%d]:%s", errno, strerror(errno));
+        return DVB_FAILURE;
+    }
+
+    pthread_mutex_lock(&fe_virtual_lock);
+    for (i = 0; i < FE_VIRTUAL_MAX; i++)
+    {
+        if (fe_virtual[i].fd == -1)
+        {
+            fe = &fe_virtual[i];
+            break;
+        }
+    }
+    if (!fe)
+    {
+        pthread_mutex_unlock(&fe_virtual_lock);
+        close(fd);
+        DVB_DEBUG(1, "Failed to open virtual frontend, max %d", FE_VIRTUAL_MAX);
+        return DVB_FAILURE;
+    }
+
+    memset(fe, 0, sizeof(*fe));
+    fe->desc = *desc;
+    if (desc->ts_file)
+        snprintf(fe->ts_file, sizeof(fe->ts_file), "%s", desc->ts_file);
+    fe->desc.ts_file = desc->ts_file ? fe->ts_file : NULL;
+    pthread_condattr_init(&cattr);
+    pthread_condattr_setclock(&cattr, CLOCK_MONOTONIC);
+    pthread_cond_init(&fe->cond, &cattr);
+    pthread_condattr_destroy(&cattr);
+    if (pthread_create(&fe->thread, NULL, fe_virtual_thread, fe) != 0)
+    {
+        pthread_cond_destroy(&fe->cond);
+        fe->fd = -1;
+        pthread_mutex_unlock(&fe_virtual_lock);
+        close(fd);
+        DVB_DEBUG(1, "Failed to create virtual frontend thread");
+        return DVB_FAILURE;
+    }
+    fe->fd = fd;
+    fe_virtual_cnt++;
+    pthread_mutex_unlock(&fe_virtual_lock);
+
+    DVB_DEBUG(1, "virtual frontend:%d lock_delay:%u no_lock:%d dmx:%d ts:%s", fd,
+              desc->lock_delay, desc->no_lock, desc->dmx_dev_id, desc->ts_file ? desc->ts_file : "none");
+    *frontend_fd = fd;
+    return DVB_SUCCESS;
+}
+
 /**\brief close frontend device
  * \param FE device fd
  * \return DVB_SUCCESS On success, DVB_FAILURE on error.
@@ -52,6 +605,14 @@ DVB_RESULT AML_FE_Colse(int frontend_fd)
 {
     DVB_RESULT retval = DVB_SUCCESS;
 
+    pthread_mutex_lock(&fe_monitor_lock);
+    fe_monitor_del(frontend_fd);
+    pthread_mutex_unlock(&fe_monitor_lock);
+    fe_sec_forget(frontend_fd);
+
+    if (fe_virtual_cnt && fe_virtual_close(frontend_fd) == DVB_SUCCESS)
+        return DVB_SUCCESS;
+
     if (close(frontend_fd) < 0)
     {
         retval = DVB_FAILURE;
@@ -70,17 +631,16 @@ dmd_tuner_event_t AML_FE_GetTuneStatus(int frontend_fd)
     struct dvb_frontend_event fe_event;
     dmd_tuner_event_t tune_event = TUNER_STATE_UNKNOW;
 
-    if (ioctl(frontend_fd, FE_READ_STATUS, &fe_event.status) >= 0)
+    if (dmd_ioctl(frontend_fd, FE_READ_STATUS, &fe_event.status) >= 0)
     {
         DVB_DEBUG(1, "current tuner status=0x%02x \n", fe_event.status);
-        if ((fe_event.status & FE_HAS_LOCK) != 0)
+        tune_event = dmd_status_to_event(fe_event.status);
+        if (tune_event == TUNER_STATE_LOCKED)
         {
-            tune_event = TUNER_STATE_LOCKED;
             DVB_DEBUG(1, "[ LOCKED ]\n");
         }
-        else if ((fe_event.status & FE_TIMEDOUT) != 0)
+        else if (tune_event == TUNER_STATE_TIMEOUT)
         {
-            tune_event = TUNER_STATE_TIMEOUT;
             DVB_DEBUG(1, "[ UNLOCKED ]\n");
         }
     }
@@ -92,6 +652,189 @@ dmd_tuner_event_t AML_FE_GetTuneStatus(int frontend_fd)
     return tune_event;
 }
 
+/**\brief wait for the pending tune to lock or time out, the status events are read instead of polling the status
+ * \param FE device fd
+ * \param timeout in ms, -1 to wait forever
+ * \param the tune status, TUNER_STATE_UNKNOW if the wait timed out
+ * \return DVB_SUCCESS On success, DVB_FAILURE on error or timeout.
+ */
+DVB_RESULT AML_FE_WaitTuneStatus(int frontend_fd, int timeout, dmd_tuner_event_t *tune_event)
+{
+    struct pollfd pfd;
+    uint64_t end_ms = fe_get_ms() + (timeout > 0 ? timeout : 0);
+    int wait_ms = timeout;
+    int ret;
+
+    if (!tune_event)
+        return DVB_FAILURE;
+    *tune_event = TUNER_STATE_UNKNOW;
+
+    for (;;)
+    {
+        /*drain the queued events, the intermediate ones are not final*/
+        while (fe_read_event(frontend_fd, tune_event) == DVB_SUCCESS)
+        {
+            if (*tune_event != TUNER_STATE_UNKNOW)
+                return DVB_SUCCESS;
+        }
+
+        if (timeout >= 0)
+        {
+            uint64_t now = fe_get_ms();
+
+            if (now >= end_ms)
+                break;
+            wait_ms = (int)(end_ms - now);
+        }
+        pfd.fd = frontend_fd;
+        pfd.events = POLLIN | POLLPRI;
+        pfd.revents = 0;
+        ret = poll(&pfd, 1, wait_ms);
+        if (ret < 0 && errno != EINTR)
+        {
+            DVB_DEBUG(1, "frontend_fd:%d poll errno[%d]:%s", frontend_fd, errno, strerror(errno));
+            return DVB_FAILURE;
+        }
+        if (ret == 0)
+            break;
+    }
+
+    *tune_event = TUNER_STATE_UNKNOW;
+    return DVB_FAILURE;
+}
+
+/**\brief set the status event callback, the events of all frontends are monitored by one thread
+ * \param FE device fd
+ * \param callback, NULL to remove it, it shall not set callbacks or close frontends
+ * \param callback user data
+ * \return DVB_SUCCESS On success, DVB_FAILURE on error.
+ */
+DVB_RESULT AML_FE_SetEventCallback(int frontend_fd, dmd_tuner_event_cb_t cb, void *user_data)
+{
+    struct epoll_event ev;
+    pthread_t thread;
+    int i;
+
+    pthread_mutex_lock(&fe_monitor_lock);
+    fe_monitor_del(frontend_fd);
+    if (!cb)
+    {
+        pthread_mutex_unlock(&fe_monitor_lock);
+        return DVB_SUCCESS;
+    }
+
+    if (fe_monitor_epfd == -1)
+    {
+        fe_monitor_epfd = epoll_create1(EPOLL_CLOEXEC);
+        if (fe_monitor_epfd == -1)
+        {
+            pthread_mutex_unlock(&fe_monitor_lock);
+            DVB_DEBUG(1, "frontend monitor epoll_create errno[%d]:%s", errno, strerror(errno));
+            return DVB_FAILURE;
+        }
+        /*the monitor lives as long as the process, it sleeps when no callback is set*/
+        if (pthread_create(&thread, NULL, fe_monitor_thread, NULL) != 0)
+        {
+            close(fe_monitor_epfd);
+            fe_monitor_epfd = -1;
+            pthread_mutex_unlock(&fe_monitor_lock);
+            DVB_DEBUG(1, "Failed to create frontend monitor thread");
+            return DVB_FAILURE;
+        }
+        pthread_detach(thread);
+    }
+
+    for (i = 0; i < FE_MONITOR_MAX; i++)
+    {
+        if (fe_monitor[i].fd == -1)
+            break;
+    }
+    if (i == FE_MONITOR_MAX)
+    {
+        pthread_mutex_unlock(&fe_monitor_lock);
+        DVB_DEBUG(1, "frontend_fd:%d no free monitor, max %d", frontend_fd, FE_MONITOR_MAX);
+        return DVB_FAILURE;
+    }
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN | EPOLLPRI;
+    ev.data.fd = frontend_fd;
+    if (epoll_ctl(fe_monitor_epfd, EPOLL_CTL_ADD, frontend_fd, &ev) == -1)
+    {
+        pthread_mutex_unlock(&fe_monitor_lock);
+        DVB_DEBUG(1, "frontend_fd:%d epoll_ctl errno[%d]:%s", frontend_fd, errno, strerror(errno));
+        return DVB_FAILURE;
+    }
+    fe_monitor[i].fd = frontend_fd;
+    fe_monitor[i].cb = cb;
+    fe_monitor[i].user_data = user_data;
+    pthread_mutex_unlock(&fe_monitor_lock);
+    return DVB_SUCCESS;
+}
+
+/**\brief get the signal parameters
+ * \param FE device fd
+ * \param the signal parameters
+ * \return DVB_SUCCESS On success, DVB_FAILURE on error.
+ */
+DVB_RESULT AML_FE_GetSignal(int frontend_fd, dmd_signal_t *signal)
+{
+    uint16_t strength = 0, snr = 0;
+    uint32_t ber = 0;
+
+    if (!signal)
+        return DVB_FAILURE;
+
+    if (dmd_ioctl(frontend_fd, FE_READ_SIGNAL_STRENGTH, &strength) == -1 ||
+        dmd_ioctl(frontend_fd, FE_READ_SNR, &snr) == -1)
+    {
+        DVB_DEBUG(1, "frontend_fd:%d read signal errno[%d]:%s", frontend_fd, errno, strerror(errno));
+        return DVB_FAILURE;
+    }
+    /*not all the demodulators report the ber*/
+    dmd_ioctl(frontend_fd, FE_READ_BER, &ber);
+
+    signal->strength = strength;
+    signal->snr = snr;
+    signal->ber = ber;
+    return DVB_SUCCESS;
+}
+
+/**\brief get the TS source of the virtual frontend feeding a demux
+ * \param demux device id
+ * \param buffer of the TS file path, NULL if not needed
+ * \param size of the path buffer
+ * \param bitrate of the TS file, NULL if not needed
+ * \return the tune status of the virtual frontend, TUNER_STATE_UNKNOW if none feeds the demux
+ */
+dmd_tuner_event_t AML_FE_GetVirtualSource(int dmx_dev_id, char *ts_file, size_t size, uint_t *ts_bitrate)
+{
+    dmd_tuner_event_t tune_event = TUNER_STATE_UNKNOW;
+    int i;
+
+    if (ts_file && size)
+        ts_file[0] = 0;
+    if (!fe_virtual_cnt)
+        return tune_event;
+
+    pthread_mutex_lock(&fe_virtual_lock);
+    for (i = 0; i < FE_VIRTUAL_MAX; i++)
+    {
+        fe_virtual_t *fe = &fe_virtual[i];
+
+        if (fe->fd == -1 || !fe->desc.ts_file || fe->desc.dmx_dev_id != dmx_dev_id)
+            continue;
+        if (ts_file && size)
+            snprintf(ts_file, size, "%s", fe->ts_file);
+        if (ts_bitrate)
+            *ts_bitrate = fe->desc.ts_bitrate;
+        tune_event = dmd_status_to_event(fe->status);
+        break;
+    }
+    pthread_mutex_unlock(&fe_virtual_lock);
+    return tune_event;
+}
+
 /**\brief tune DVB-C
  * \param FE device fd
  * \param  dvb cable parameter
@@ -382,11 +1125,12 @@ DVB_RESULT AML_FE_LnbVoltage(int frontend_fd, dmd_lnb_voltage_t voltage)
         break;
     }
 
-    if (ioctl(frontend_fd, FE_SET_VOLTAGE, volt) == -1)
+    if (dmd_ioctl(frontend_fd, FE_SET_VOLTAGE, (void *)(long)volt) == -1)
     {
         ret = DVB_FAILURE;
         DVB_DEBUG(1, "FE_SET_VOLTAGE failed, frontend_fd:%d, voltage:%d errno[%d]:%s", frontend_fd, voltage, errno, strerror(errno));
     }
+    fe_sec_note(frontend_fd, FE_SET_VOLTAGE, ret == DVB_SUCCESS ? (int)volt : -1);
     return ret;
 }
 
@@ -414,10 +1158,11 @@ DVB_RESULT AML_FE_LnbTone(int frontend_fd, dmd_lnb_tone_state_t tone_state)
         break;
     }
 
-    if (ioctl(frontend_fd, FE_SET_TONE, tone) >= 0)
+    if (dmd_ioctl(frontend_fd, FE_SET_TONE, (void *)(long)tone) >= 0)
         ret = DVB_SUCCESS;
     else
         ret = DVB_FAILURE;
+    fe_sec_note(frontend_fd, FE_SET_TONE, ret == DVB_SUCCESS ? (int)tone : -1);
     return ret;
 }
 
@@ -440,17 +1185,150 @@ DVB_RESULT AML_FE_SendDISEQCMessage(int frontend_fd, uint8_t *data, uint8_t size
     }
     cmd.msg_len = size;
 
-    if (ioctl(frontend_fd, FE_DISEQC_SEND_MASTER_CMD, &cmd) == -1)
+    if (dmd_ioctl(frontend_fd, FE_DISEQC_SEND_MASTER_CMD, &cmd) == -1)
     {
         ret = DVB_FAILURE;
         DVB_DEBUG(1, "FE_DISEQC_SEND_MASTER_CMD failed, frontend_fd:%d, errno[%d]:%s", frontend_fd, errno, strerror(errno));
     }
+    fe_sec_note(frontend_fd, FE_DISEQC_SEND_MASTER_CMD, -1);
+    return ret;
+}
+
+/**\brief switch the satellite equipment to a target, only the commands changing the cached state
+ * are sent and the waits are the DiSEqC bus minimum settle times
+ * \param FE device fd
+ * \param the target
+ * \return DVB_SUCCESS On success, DVB_FAILURE on error.
+ */
+DVB_RESULT AML_FE_SetSec(int frontend_fd, const dmd_sec_target_t *target)
+{
+    DVB_RESULT ret = DVB_SUCCESS;
+    fe_sec_t *sec;
+    int voltage, tone, committed = -1, uncommitted = -1, position = -1;
+    int diseqc;
+    uint8_t msg[4];
+
+    if (!target)
+        return DVB_FAILURE;
+
+    if (target->polarization == DMD_PLR_NONE)
+        voltage = SEC_VOLTAGE_OFF;
+    else if (target->polarization == DMD_PLR_HORIZONTAL || target->polarization == DMD_PLR_CIRCULAR_LEFT)
+        voltage = SEC_VOLTAGE_18;
+    else
+        voltage = SEC_VOLTAGE_13;
+    tone = target->high_band ? SEC_TONE_ON : SEC_TONE_OFF;
+    /*the switches are powered by the supply, nothing hears a message without it*/
+    if (voltage != SEC_VOLTAGE_OFF)
+    {
+        if (target->port >= DMD_DISEQC_PORTA && target->port <= DMD_DISEQC_PORTD)
+            committed = 0xf0 | ((target->port - DMD_DISEQC_PORTA) << 2)
+                        | (voltage == SEC_VOLTAGE_18 ? 0x02 : 0) | (target->high_band ? 0x01 : 0);
+        if (target->uncommitted > 0 && target->uncommitted <= 16)
+            uncommitted = 0xf0 | (target->uncommitted - 1);
+        if (target->position > 0 && target->position <= 0xff)
+            position = target->position;
+    }
+
+    sec = fe_sec_get(frontend_fd, 1);
+    if (!sec)
+    {
+        DVB_DEBUG(1, "frontend_fd:%d no free satellite equipment state, max %d", frontend_fd, FE_SEC_MAX);
+        return DVB_FAILURE;
+    }
+
+    DVR_TRACE_BEGIN("fe_set_sec");
+    diseqc = (committed != -1 && committed != sec->committed)
+             || (uncommitted != -1 && uncommitted != sec->uncommitted)
+             || (position != -1 && position != sec->position);
+
+    /*the messages need the supply and no continuous tone*/
+    if (fe_sec_set(sec, FE_SET_VOLTAGE, &sec->voltage, voltage) != DVB_SUCCESS)
+        ret = DVB_FAILURE;
+    if (ret == DVB_SUCCESS && diseqc && fe_sec_set(sec, FE_SET_TONE, &sec->tone, SEC_TONE_OFF) != DVB_SUCCESS)
+        ret = DVB_FAILURE;
+
+    if (ret == DVB_SUCCESS && committed != -1 && committed != sec->committed)
+    {
+        msg[0] = 0xe0;
+        msg[1] = 0x10;
+        msg[2] = 0x38;
+        msg[3] = committed;
+        ret = fe_sec_send(sec, msg, 4);
+        sec->committed = (ret == DVB_SUCCESS) ? committed : -1;
+    }
+    if (ret == DVB_SUCCESS && uncommitted != -1 && uncommitted != sec->uncommitted)
+    {
+        msg[0] = 0xe0;
+        msg[1] = 0x10;
+        msg[2] = 0x39;
+        msg[3] = uncommitted;
+        ret = fe_sec_send(sec, msg, 4);
+        sec->uncommitted = (ret == DVB_SUCCESS) ? uncommitted : -1;
+    }
+    if (ret == DVB_SUCCESS && position != -1 && position != sec->position)
+    {
+        msg[0] = 0xe0;
+        msg[1] = 0x31;
+        msg[2] = 0x6b;
+        msg[3] = position;
+        ret = fe_sec_send(sec, msg, 4);
+        sec->position = (ret == DVB_SUCCESS) ? position : -1;
+        /*the positioner does not report when it arrives*/
+        if (ret == DVB_SUCCESS && target->motor_delay)
+            usleep(target->motor_delay * 1000);
+    }
+
+    if (ret == DVB_SUCCESS && sec->tone != tone)
+    {
+        if (diseqc)
+            fe_sec_settle(sec);
+        ret = fe_sec_set(sec, FE_SET_TONE, &sec->tone, tone);
+    }
+    DVR_TRACE_END("fe_set_sec");
+    pthread_mutex_unlock(&sec->lock);
+
+    if (ret != DVB_SUCCESS)
+        DVB_DEBUG(1, "frontend_fd:%d satellite switch failed", frontend_fd);
     return ret;
 }
 
+/**\brief get and clear the satellite equipment commands recorded by a virtual frontend
+ * \param FE device fd
+ * \param the commands, oldest first
+ * \param max commands to get, the commands got on return
+ * \return DVB_SUCCESS On success, DVB_FAILURE on error.
+ */
+DVB_RESULT AML_FE_GetVirtualTimeline(int frontend_fd, dmd_sec_event_t *events, int *count)
+{
+    fe_virtual_t *fe;
+    int i, n;
+
+    if (!events || !count || *count < 0)
+        return DVB_FAILURE;
+
+    pthread_mutex_lock(&fe_virtual_lock);
+    fe = fe_virtual_find(frontend_fd);
+    if (!fe)
+    {
+        pthread_mutex_unlock(&fe_virtual_lock);
+        return DVB_FAILURE;
+    }
+    n = (*count < fe->timeline_cnt) ? *count : fe->timeline_cnt;
+    for (i = 0; i < n; i++)
+        events[i] = fe->timeline[(fe->timeline_pos + i) % FE_VIRTUAL_TIMELINE];
+    fe->timeline_pos = 0;
+    fe->timeline_cnt = 0;
+    pthread_mutex_unlock(&fe_virtual_lock);
+
+    *count = n;
+    return DVB_SUCCESS;
+}
+
 static DVB_RESULT dmd_set_prop(int frontend_fd, const struct dtv_properties *prop)
 {
-    if (ioctl(frontend_fd, FE_SET_PROPERTY, prop) == -1)
+    DVR_TRACE_INSTANT("fe_set_prop");
+    if (dmd_ioctl(frontend_fd, FE_SET_PROPERTY, (void *)prop) == -1)
     {
         DVB_DEBUG(1, "FE_SET_PROPERT failed, frontend_fd:%d, errno[%d]:%s", frontend_fd, errno, strerror(errno));
         return DVB_FAILURE;
@@ -0,0 +1,867 @@
+/***************************************************************************
+ * Copyright (c) 2014 Amlogic, Inc. All rights reserved.
+ *
+ * This source code is subject to the terms and conditions defined in the
+ * file 'LICENSE' which is part of this source code package.
+ *
+ * Description:
+ *
+ * @brief   channel scan on several tuners
+ * @file    dvb_scan.c
+ ***************************************************************************/
+
+#define DVR_LOG_MODULE DVR_LOG_MODULE_DVB
+
+#include <sys/prctl.h>
+
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "dmx.h"
+#include "dvb_dmx_wrapper.h"
+#include "dvb_frontend_wrapper.h"
+#include "dvb_scan.h"
+#include "dvr_trace.h"
+
+#define SCAN_TS_PKT_SIZE (188)
+#define SCAN_SEC_SIZE (4096)
+#define SCAN_READ_SIZE (SCAN_TS_PKT_SIZE * 64)
+/*PMT filters opened at once on a demux*/
+#define SCAN_PMT_FILTERS (8)
+/*max wait of a tuner between two checks of the stop request*/
+#define SCAN_WAIT_SLICE (100)
+#define SCAN_DEFAULT_LOCK_TIMEOUT (2000)
+#define SCAN_DEFAULT_TABLE_TIMEOUT (5000)
+
+#define SCAN_PAT_PID (0x0000)
+#define SCAN_SDT_PID (0x0011)
+#define SCAN_PAT_TID (0x00)
+#define SCAN_PMT_TID (0x02)
+#define SCAN_SDT_TID (0x42)
+#define SCAN_SERVICE_DESC (0x48)
+
+/*sections received of a table version*/
+typedef struct
+{
+    int version;
+    uint8_t last;
+    uint8_t mask[32];
+    int done;
+} scan_table_t;
+
+/*section assembly of a pid, virtual frontend only*/
+typedef struct
+{
+    uint16_t pid;
+    int started;
+    int len;
+    uint8_t buf[SCAN_SEC_SIZE];
+} scan_sec_asm_t;
+
+typedef struct dvb_scan_s dvb_scan_t;
+
+typedef struct
+{
+    dvb_scan_t *scan;
+    int tuner;
+    pthread_t thread;
+    /*tables and result, the demux callback runs on the demux thread*/
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int collecting;
+    dvb_scan_result_t result;
+    scan_table_t pat;
+    scan_table_t sdt;
+    scan_table_t pmt[DVB_SCAN_MAX_SERVICES];
+    int in_pat[DVB_SCAN_MAX_SERVICES];
+    int pat_fh;
+    int sdt_fh;
+    int pmt_fh[DVB_SCAN_MAX_SERVICES];
+    scan_sec_asm_t *sec_asm[DVB_SCAN_MAX_SERVICES + 2];
+} scan_tuner_t;
+
+struct dvb_scan_s
+{
+    dvb_scan_params_t params;
+    dvb_scan_freq_t *freqs;
+    volatile int next;
+    volatile int quit;
+    int running;
+    /*Wait, and serializes the result callbacks*/
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    scan_tuner_t tuners[DVB_SCAN_MAX_TUNERS];
+};
+
+static uint64_t scan_get_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void scan_cond_init(pthread_cond_t *cond)
+{
+    pthread_condattr_t cattr;
+
+    pthread_condattr_init(&cattr);
+    pthread_condattr_setclock(&cattr, CLOCK_MONOTONIC);
+    pthread_cond_init(cond, &cattr);
+    pthread_condattr_destroy(&cattr);
+}
+
+static void scan_cond_wait_until(pthread_cond_t *cond, pthread_mutex_t *lock, uint64_t end_ms)
+{
+    struct timespec ts;
+
+    ts.tv_sec = end_ms / 1000;
+    ts.tv_nsec = (end_ms % 1000) * 1000000;
+    pthread_cond_timedwait(cond, lock, &ts);
+}
+
+static uint32_t scan_crc32(const uint8_t *data, int len)
+{
+    uint32_t crc = 0xffffffff;
+    int i;
+
+    while (len--)
+    {
+        crc ^= (uint32_t)*data++ << 24;
+        for (i = 0; i < 8; i++)
+            crc = (crc & 0x80000000) ? (crc << 1) ^ 0x04c11db7 : (crc << 1);
+    }
+    return crc;
+}
+
+/*returns 1 if the section is new, a new version restarts the table*/
+static int scan_table_add(scan_table_t *table, int version, int sec, int last)
+{
+    int i;
+
+    if (table->version != version)
+    {
+        memset(table, 0, sizeof(*table));
+        table->version = version;
+        table->last = last;
+    }
+    if (table->mask[sec >> 3] & (1 << (sec & 7)))
+        return 0;
+    table->mask[sec >> 3] |= (1 << (sec & 7));
+
+    for (i = 0; i <= table->last; i++)
+    {
+        if (!(table->mask[i >> 3] & (1 << (i & 7))))
+            return 1;
+    }
+    table->done = 1;
+    return 1;
+}
+
+static void scan_table_reset(scan_table_t *table)
+{
+    memset(table, 0, sizeof(*table));
+    table->version = -1;
+}
+
+static int scan_get_service(scan_tuner_t *t, uint16_t service_id)
+{
+    dvb_scan_result_t *r = &t->result;
+    int i;
+
+    for (i = 0; i < r->service_count; i++)
+    {
+        if (r->services[i].service_id == service_id)
+            return i;
+    }
+    if (r->service_count >= DVB_SCAN_MAX_SERVICES)
+        return -1;
+
+    memset(&r->services[i], 0, sizeof(r->services[i]));
+    r->services[i].service_id = service_id;
+    r->service_count++;
+    return i;
+}
+
+static void scan_parse_pat(scan_tuner_t *t, const uint8_t *p, int len)
+{
+    int i, idx;
+    uint16_t program, pid;
+
+    for (i = 0; i + 4 <= len; i += 4)
+    {
+        program = (p[i] << 8) | p[i + 1];
+        pid = ((p[i + 2] & 0x1f) << 8) | p[i + 3];
+        /*program 0 is the NIT*/
+        if (!program || (idx = scan_get_service(t, program)) < 0)
+            continue;
+        t->result.services[idx].pmt_pid = pid;
+        t->in_pat[idx] = 1;
+    }
+}
+
+static void scan_parse_pmt(scan_tuner_t *t, int idx, const uint8_t *p, int len)
+{
+    dvb_scan_service_t *srv = &t->result.services[idx];
+    int info_len, es_len;
+
+    if (len < 4)
+        return;
+    srv->pcr_pid = ((p[0] & 0x1f) << 8) | p[1];
+    info_len = ((p[2] & 0x0f) << 8) | p[3];
+    p += 4 + info_len;
+    len -= 4 + info_len;
+
+    while (len >= 5)
+    {
+        es_len = ((p[3] & 0x0f) << 8) | p[4];
+        if (srv->es_count < DVB_SCAN_MAX_ES)
+        {
+            srv->es[srv->es_count].type = p[0];
+            srv->es[srv->es_count].pid = ((p[1] & 0x1f) << 8) | p[2];
+            srv->es_count++;
+        }
+        p += 5 + es_len;
+        len -= 5 + es_len;
+    }
+}
+
+static void scan_parse_sdt(scan_tuner_t *t, const uint8_t *p, int len)
+{
+    dvb_scan_service_t *srv;
+    int idx, loop_len, dlen, plen, nlen;
+    const uint8_t *d;
+
+    if (len < 3)
+        return;
+    t->result.onid = (p[0] << 8) | p[1];
+    p += 3;
+    len -= 3;
+
+    while (len >= 5)
+    {
+        loop_len = ((p[3] & 0x0f) << 8) | p[4];
+        idx = scan_get_service(t, (p[0] << 8) | p[1]);
+        d = p + 5;
+        p += 5 + loop_len;
+        len -= 5 + loop_len;
+        if (idx < 0 || len < 0)
+            continue;
+
+        srv = &t->result.services[idx];
+        for (; d + 2 <= p; d += 2 + dlen)
+        {
+            dlen = d[1];
+            if (d[0] != SCAN_SERVICE_DESC || d + 2 + dlen > p || dlen < 3)
+                continue;
+            srv->service_type = d[2];
+            plen = d[3];
+            if (4 + plen >= 2 + dlen)
+                continue;
+            nlen = d[4 + plen];
+            if (5 + plen + nlen > 2 + dlen)
+                continue;
+            if (nlen > (int)sizeof(srv->name) - 1)
+                nlen = sizeof(srv->name) - 1;
+            memcpy(srv->name, d + 5 + plen, nlen);
+            srv->name[nlen] = 0;
+        }
+    }
+}
+
+/*called with t->lock, the crc is checked by the demux or the assembler*/
+static void scan_section(scan_tuner_t *t, const uint8_t *sec, int len)
+{
+    int sec_len, version, idx;
+    uint16_t ext;
+
+    if (len < 12 || !(sec[1] & 0x80))
+        return;
+    sec_len = 3 + (((sec[1] & 0x0f) << 8) | sec[2]);
+    if (sec_len > len || sec_len < 12 || !(sec[5] & 0x01))
+        return;
+    ext = (sec[3] << 8) | sec[4];
+    version = (sec[5] >> 1) & 0x1f;
+
+    /*the payload is between the header and the crc*/
+    switch (sec[0])
+    {
+    case SCAN_PAT_TID:
+        if (scan_table_add(&t->pat, version, sec[6], sec[7]))
+        {
+            t->result.ts_id = ext;
+            scan_parse_pat(t, sec + 8, sec_len - 12);
+        }
+        break;
+    case SCAN_PMT_TID:
+        for (idx = 0; idx < t->result.service_count; idx++)
+        {
+            if (t->in_pat[idx] && t->result.services[idx].service_id == ext)
+                break;
+        }
+        if (idx < t->result.service_count && scan_table_add(&t->pmt[idx], version, sec[6], sec[7]))
+        {
+            /*a new version replaces the streams*/
+            if (sec[6] == 0)
+                t->result.services[idx].es_count = 0;
+            scan_parse_pmt(t, idx, sec + 8, sec_len - 12);
+        }
+        break;
+    case SCAN_SDT_TID:
+        if (scan_table_add(&t->sdt, version, sec[6], sec[7]))
+            scan_parse_sdt(t, sec + 8, sec_len - 12);
+        break;
+    default:
+        return;
+    }
+    pthread_cond_signal(&t->cond);
+}
+
+/*called with t->lock*/
+static int scan_complete(scan_tuner_t *t)
+{
+    int i;
+
+    if (!t->pat.done || !t->sdt.done)
+        return 0;
+    for (i = 0; i < t->result.service_count; i++)
+    {
+        if (t->in_pat[i] && !t->pmt[i].done)
+            return 0;
+    }
+    return 1;
+}
+
+static void scan_dmx_cb(int dev_no, int fd, const uint8_t *data, int len, void *user_data)
+{
+    scan_tuner_t *t = (scan_tuner_t *)user_data;
+
+    (void)dev_no;
+    (void)fd;
+    pthread_mutex_lock(&t->lock);
+    if (t->collecting)
+        scan_section(t, data, len);
+    pthread_mutex_unlock(&t->lock);
+}
+
+static int scan_open_filter(scan_tuner_t *t, uint16_t pid, uint8_t table_id, int ext)
+{
+    int dmx = t->scan->params.dmx_dev_id[t->tuner];
+    struct dmx_sct_filter_params params;
+    int fh;
+
+    memset(&params, 0, sizeof(params));
+    params.pid = pid;
+    params.filter.filter[0] = table_id;
+    params.filter.mask[0] = 0xff;
+    /*the filter skips the section length bytes*/
+    if (ext >= 0)
+    {
+        params.filter.filter[1] = (ext >> 8) & 0xff;
+        params.filter.mask[1] = 0xff;
+        params.filter.filter[2] = ext & 0xff;
+        params.filter.mask[2] = 0xff;
+    }
+    params.flags = DMX_CHECK_CRC;
+
+    if (AML_DMX_AllocateFilter(dmx, &fh) != DVB_SUCCESS)
+        return -1;
+    if (AML_DMX_SetSecFilter(dmx, fh, &params) != DVB_SUCCESS ||
+        AML_DMX_SetCallback(dmx, fh, scan_dmx_cb, t) != DVB_SUCCESS ||
+        AML_DMX_StartFilter(dmx, fh) != DVB_SUCCESS)
+    {
+        AML_DMX_FreeFilter(dmx, fh);
+        return -1;
+    }
+    return fh;
+}
+
+static void scan_close_filter(scan_tuner_t *t, int *fh)
+{
+    int dmx = t->scan->params.dmx_dev_id[t->tuner];
+
+    if (*fh == -1)
+        return;
+    AML_DMX_StopFilter(dmx, *fh);
+    AML_DMX_FreeFilter(dmx, *fh);
+    *fh = -1;
+}
+
+/*PMT filters of the services left, at most SCAN_PMT_FILTERS at once, called with t->lock*/
+static void scan_update_pmt_filters(scan_tuner_t *t)
+{
+    int i, opened = 0;
+
+    for (i = 0; i < t->result.service_count; i++)
+    {
+        if (t->pmt_fh[i] != -1 && t->pmt[i].done)
+            scan_close_filter(t, &t->pmt_fh[i]);
+        if (t->pmt_fh[i] != -1)
+            opened++;
+    }
+    for (i = 0; i < t->result.service_count && opened < SCAN_PMT_FILTERS; i++)
+    {
+        if (!t->in_pat[i] || t->pmt[i].done || t->pmt_fh[i] != -1)
+            continue;
+        t->pmt_fh[i] = scan_open_filter(t, t->result.services[i].pmt_pid, SCAN_PMT_TID,
+                                        t->result.services[i].service_id);
+        if (t->pmt_fh[i] != -1)
+            opened++;
+    }
+}
+
+static void scan_collect_dmx(scan_tuner_t *t, uint64_t end_ms)
+{
+    dvb_scan_t *s = t->scan;
+    uint64_t wait_ms;
+    int i;
+
+    pthread_mutex_lock(&t->lock);
+    t->collecting = 1;
+    t->pat_fh = scan_open_filter(t, SCAN_PAT_PID, SCAN_PAT_TID, -1);
+    t->sdt_fh = scan_open_filter(t, SCAN_SDT_PID, SCAN_SDT_TID, -1);
+    while (!s->quit && !scan_complete(t))
+    {
+        if (t->pat.done)
+            scan_update_pmt_filters(t);
+        if (scan_get_ms() >= end_ms)
+            break;
+        wait_ms = scan_get_ms() + SCAN_WAIT_SLICE;
+        scan_cond_wait_until(&t->cond, &t->lock, wait_ms < end_ms ? wait_ms : end_ms);
+    }
+    t->collecting = 0;
+
+    scan_close_filter(t, &t->pat_fh);
+    scan_close_filter(t, &t->sdt_fh);
+    for (i = 0; i < DVB_SCAN_MAX_SERVICES; i++)
+        scan_close_filter(t, &t->pmt_fh[i]);
+    pthread_mutex_unlock(&t->lock);
+}
+
+/*the assembler of a wanted pid, NULL for the others, called with t->lock*/
+static scan_sec_asm_t *scan_get_asm(scan_tuner_t *t, uint16_t pid)
+{
+    int i, n = 0;
+    uint16_t pids[DVB_SCAN_MAX_SERVICES + 2];
+
+    pids[n++] = SCAN_PAT_PID;
+    pids[n++] = SCAN_SDT_PID;
+    for (i = 0; i < t->result.service_count; i++)
+    {
+        if (t->in_pat[i] && !t->pmt[i].done)
+            pids[n++] = t->result.services[i].pmt_pid;
+    }
+    for (i = 0; i < n && pids[i] != pid; i++)
+        ;
+    if (i == n)
+        return NULL;
+
+    for (i = 0; i < DVB_SCAN_MAX_SERVICES + 2; i++)
+    {
+        if (t->sec_asm[i] && t->sec_asm[i]->pid == pid)
+            return t->sec_asm[i];
+    }
+    /*a free or an idle one*/
+    for (i = 0; i < DVB_SCAN_MAX_SERVICES + 2; i++)
+    {
+        if (!t->sec_asm[i])
+        {
+            if (!(t->sec_asm[i] = (scan_sec_asm_t *)calloc(1, sizeof(scan_sec_asm_t))))
+                return NULL;
+            break;
+        }
+        if (!t->sec_asm[i]->started)
+            break;
+    }
+    if (i == DVB_SCAN_MAX_SERVICES + 2)
+        return NULL;
+    t->sec_asm[i]->pid = pid;
+    t->sec_asm[i]->started = 0;
+    t->sec_asm[i]->len = 0;
+    return t->sec_asm[i];
+}
+
+static void scan_asm_append(scan_tuner_t *t, scan_sec_asm_t *a, const uint8_t *data, int len)
+{
+    int total, want;
+
+    while (len > 0)
+    {
+        /*stuffing after the last section of the packet*/
+        if (a->len == 0 && data[0] == 0xff)
+        {
+            a->started = 0;
+            return;
+        }
+        total = (a->len < 3) ? 3 : 3 + (((a->buf[1] & 0x0f) << 8) | a->buf[2]);
+        if (total > SCAN_SEC_SIZE)
+        {
+            a->started = 0;
+            a->len = 0;
+            return;
+        }
+        want = total - a->len;
+        /*a header too short for a table section or a zero length one, drop it*/
+        if (a->len >= 3 && (total - 3 < 5 || want == 0))
+        {
+            a->started = 0;
+            a->len = 0;
+            return;
+        }
+        if (want > len)
+            want = len;
+        memcpy(a->buf + a->len, data, want);
+        a->len += want;
+        data += want;
+        len -= want;
+
+        if (a->len > 3 && a->len == 3 + (((a->buf[1] & 0x0f) << 8) | a->buf[2]))
+        {
+            if (scan_crc32(a->buf, a->len) == 0)
+                scan_section(t, a->buf, a->len);
+            a->len = 0;
+        }
+    }
+}
+
+static void scan_soft_packet(scan_tuner_t *t, const uint8_t *pkt)
+{
+    scan_sec_asm_t *a;
+    int off = 4, ptr;
+    uint16_t pid = ((pkt[1] & 0x1f) << 8) | pkt[2];
+
+    if (pkt[0] != 0x47 || !(a = scan_get_asm(t, pid)))
+        return;
+    if (pkt[3] & 0x20)
+        off += 1 + pkt[4];
+    if (!(pkt[3] & 0x10) || off >= SCAN_TS_PKT_SIZE)
+        return;
+
+    if (pkt[1] & 0x40)
+    {
+        ptr = pkt[off++];
+        if (off + ptr > SCAN_TS_PKT_SIZE)
+        {
+            a->started = 0;
+            a->len = 0;
+            return;
+        }
+        /*the pointer field bytes end the previous section*/
+        if (a->started && a->len)
+            scan_asm_append(t, a, pkt + off, ptr);
+        a->started = 1;
+        a->len = 0;
+        off += ptr;
+    }
+    else if (!a->started)
+    {
+        return;
+    }
+    scan_asm_append(t, a, pkt + off, SCAN_TS_PKT_SIZE - off);
+}
+
+/*the tables of a virtual frontend from its TS file, the PMTs before the PAT need a second pass*/
+static void scan_collect_file(scan_tuner_t *t, const char *path, uint64_t end_ms)
+{
+    dvb_scan_t *s = t->scan;
+    uint8_t *buf;
+    int fd, len, i, done = 0, passes = 1;
+
+    if ((fd = open(path, O_RDONLY)) == -1)
+    {
+        DVB_DEBUG(1, "scan tuner:%d cannot open \"%s\" (%s)", t->tuner, path, strerror(errno));
+        return;
+    }
+    if (!(buf = (uint8_t *)malloc(SCAN_READ_SIZE)))
+    {
+        close(fd);
+        return;
+    }
+
+    pthread_mutex_lock(&t->lock);
+    t->collecting = 1;
+    while (!done && !s->quit && scan_get_ms() < end_ms)
+    {
+        pthread_mutex_unlock(&t->lock);
+        len = read(fd, buf, SCAN_READ_SIZE);
+        pthread_mutex_lock(&t->lock);
+        if (len < SCAN_TS_PKT_SIZE)
+        {
+            if (passes++ == 2 || lseek(fd, 0, SEEK_SET) == -1)
+                break;
+            continue;
+        }
+        for (i = 0; i + SCAN_TS_PKT_SIZE <= len && !done; i += SCAN_TS_PKT_SIZE)
+        {
+            scan_soft_packet(t, buf + i);
+            done = scan_complete(t);
+        }
+    }
+    t->collecting = 0;
+    for (i = 0; i < DVB_SCAN_MAX_SERVICES + 2; i++)
+    {
+        free(t->sec_asm[i]);
+        t->sec_asm[i] = NULL;
+    }
+    pthread_mutex_unlock(&t->lock);
+
+    free(buf);
+    close(fd);
+}
+
+static DVB_RESULT scan_tune(scan_tuner_t *t, const dvb_scan_freq_t *freq)
+{
+    int fd = t->scan->params.frontend_fd[t->tuner];
+    dmd_sec_target_t sec;
+
+    switch (freq->delivery)
+    {
+    case DVB_SCAN_DVB_C:
+        return AML_FE_TuneDVB_C(fd, &freq->desc.cable);
+    case DVB_SCAN_DVB_T:
+        return AML_FE_TuneDVB_T(fd, &freq->desc.terr);
+    case DVB_SCAN_DVB_S:
+        /*the tuned polarization selects the supply, nothing is sent if the previous frequency used the same target*/
+        sec = freq->sec;
+        sec.polarization = freq->desc.sate.polarization;
+        if (AML_FE_SetSec(fd, &sec) != DVB_SUCCESS)
+            return DVB_FAILURE;
+        return AML_FE_TuneDVB_S(fd, &freq->desc.sate);
+    default:
+        return DVB_FAILURE;
+    }
+}
+
+static dmd_tuner_event_t scan_wait_lock(scan_tuner_t *t)
+{
+    dvb_scan_t *s = t->scan;
+    uint64_t now, end_ms = scan_get_ms() + s->params.lock_timeout;
+    dmd_tuner_event_t tune_event;
+
+    while (!s->quit && (now = scan_get_ms()) < end_ms)
+    {
+        if (AML_FE_WaitTuneStatus(s->params.frontend_fd[t->tuner],
+                                  (end_ms - now < SCAN_WAIT_SLICE) ? (int)(end_ms - now) : SCAN_WAIT_SLICE,
+                                  &tune_event) == DVB_SUCCESS)
+            return tune_event;
+    }
+    return TUNER_STATE_TIMEOUT;
+}
+
+static void scan_transponder(scan_tuner_t *t, int index)
+{
+    dvb_scan_t *s = t->scan;
+    dvb_scan_result_t *r = &t->result;
+    char path[256];
+    uint64_t start_ms;
+    int i;
+
+    pthread_mutex_lock(&t->lock);
+    memset(r, 0, sizeof(*r));
+    r->index = index;
+    r->tuner = t->tuner;
+    r->status = TUNER_STATE_TIMEOUT;
+    scan_table_reset(&t->pat);
+    scan_table_reset(&t->sdt);
+    for (i = 0; i < DVB_SCAN_MAX_SERVICES; i++)
+    {
+        scan_table_reset(&t->pmt[i]);
+        t->in_pat[i] = 0;
+    }
+    pthread_mutex_unlock(&t->lock);
+
+    start_ms = scan_get_ms();
+    DVR_TRACE_BEGIN("scan_lock");
+    if (scan_tune(t, &s->freqs[index]) == DVB_SUCCESS)
+        r->status = scan_wait_lock(t);
+    DVR_TRACE_END("scan_lock");
+    r->lock_ms = scan_get_ms() - start_ms;
+    if (r->status != TUNER_STATE_LOCKED)
+        return;
+
+    AML_FE_GetSignal(s->params.frontend_fd[t->tuner], &r->signal);
+
+    start_ms = scan_get_ms();
+    DVR_TRACE_BEGIN("scan_tables");
+    if (AML_FE_GetVirtualSource(s->params.dmx_dev_id[t->tuner], path, sizeof(path), NULL) == TUNER_STATE_LOCKED
+        && path[0])
+        scan_collect_file(t, path, start_ms + s->params.table_timeout);
+    else
+        scan_collect_dmx(t, start_ms + s->params.table_timeout);
+    DVR_TRACE_END("scan_tables");
+    r->tables_ms = scan_get_ms() - start_ms;
+
+    pthread_mutex_lock(&t->lock);
+    r->complete = scan_complete(t);
+    pthread_mutex_unlock(&t->lock);
+}
+
+static void *scan_thread(void *arg)
+{
+    scan_tuner_t *t = (scan_tuner_t *)arg;
+    dvb_scan_t *s = t->scan;
+    int index;
+
+    prctl(PR_SET_NAME, "dvb_scan_thread");
+    while (!s->quit)
+    {
+        index = __sync_fetch_and_add(&s->next, 1);
+        if (index >= s->params.freq_count)
+            break;
+
+        scan_transponder(t, index);
+        DVB_DEBUG(1, "scan tuner:%d freq[%d] status:%d lock:%ums tables:%ums services:%d complete:%d",
+                  t->tuner, index, t->result.status, t->result.lock_ms, t->result.tables_ms,
+                  t->result.service_count, t->result.complete);
+
+        pthread_mutex_lock(&s->lock);
+        if (!s->quit && s->params.cb)
+            s->params.cb(&t->result, s->params.user_data);
+        pthread_mutex_unlock(&s->lock);
+    }
+
+    pthread_mutex_lock(&s->lock);
+    s->running--;
+    pthread_cond_broadcast(&s->cond);
+    pthread_mutex_unlock(&s->lock);
+    return NULL;
+}
+
+/**\brief start a scan
+ * \param scan parameters, the frequency list is copied
+ * \param scan handle
+ * \return DVB_SUCCESS On success, DVB_FAILURE on error.
+ */
+DVB_RESULT AML_SCAN_Start(const dvb_scan_params_t *params, dvb_scan_handle_t *handle)
+{
+    dvb_scan_t *s;
+    int i, j;
+
+    if (!params || !handle || params->tuner_count <= 0 || params->tuner_count > DVB_SCAN_MAX_TUNERS
+        || !params->freqs || params->freq_count <= 0)
+        return DVB_FAILURE;
+
+    s = (dvb_scan_t *)calloc(1, sizeof(dvb_scan_t));
+    if (!s)
+        return DVB_FAILURE;
+    s->freqs = (dvb_scan_freq_t *)malloc(params->freq_count * sizeof(dvb_scan_freq_t));
+    if (!s->freqs)
+    {
+        free(s);
+        return DVB_FAILURE;
+    }
+    memcpy(s->freqs, params->freqs, params->freq_count * sizeof(dvb_scan_freq_t));
+    s->params = *params;
+    s->params.freqs = s->freqs;
+    if (s->params.lock_timeout <= 0)
+        s->params.lock_timeout = SCAN_DEFAULT_LOCK_TIMEOUT;
+    if (s->params.table_timeout <= 0)
+        s->params.table_timeout = SCAN_DEFAULT_TABLE_TIMEOUT;
+    pthread_mutex_init(&s->lock, NULL);
+    scan_cond_init(&s->cond);
+
+    for (i = 0; i < params->tuner_count; i++)
+    {
+        scan_tuner_t *t = &s->tuners[i];
+
+        t->scan = s;
+        t->tuner = i;
+        t->pat_fh = -1;
+        t->sdt_fh = -1;
+        for (j = 0; j < DVB_SCAN_MAX_SERVICES; j++)
+            t->pmt_fh[j] = -1;
+        pthread_mutex_init(&t->lock, NULL);
+        scan_cond_init(&t->cond);
+    }
+
+    pthread_mutex_lock(&s->lock);
+    for (i = 0; i < params->tuner_count; i++)
+    {
+        if (pthread_create(&s->tuners[i].thread, NULL, scan_thread, &s->tuners[i]) != 0)
+            break;
+        s->running++;
+    }
+    pthread_mutex_unlock(&s->lock);
+    if (i < params->tuner_count)
+    {
+        DVB_DEBUG(1, "scan create thread failed, %d of %d tuners", i, params->tuner_count);
+        s->params.tuner_count = i;
+        AML_SCAN_Stop(s);
+        return DVB_FAILURE;
+    }
+
+    DVB_DEBUG(1, "scan start, tuners:%d freqs:%d", params->tuner_count, params->freq_count);
+    *handle = s;
+    return DVB_SUCCESS;
+}
+
+/**\brief wait for all the frequencies to be scanned
+ * \param scan handle
+ * \param timeout in ms, -1 to wait forever
+ * \return DVB_SUCCESS when done, DVB_FAILURE on error or timeout.
+ */
+DVB_RESULT AML_SCAN_Wait(dvb_scan_handle_t handle, int timeout)
+{
+    dvb_scan_t *s = (dvb_scan_t *)handle;
+    uint64_t end_ms = scan_get_ms() + (timeout > 0 ? timeout : 0);
+    DVB_RESULT ret;
+
+    if (!s)
+        return DVB_FAILURE;
+
+    pthread_mutex_lock(&s->lock);
+    while (s->running && (timeout < 0 || scan_get_ms() < end_ms))
+    {
+        if (timeout < 0)
+            pthread_cond_wait(&s->cond, &s->lock);
+        else
+            scan_cond_wait_until(&s->cond, &s->lock, end_ms);
+    }
+    ret = s->running ? DVB_FAILURE : DVB_SUCCESS;
+    pthread_mutex_unlock(&s->lock);
+    return ret;
+}
+
+/**\brief stop a scan and free it, the transponders being scanned are aborted
+ * \param scan handle
+ * \return DVB_SUCCESS On success, DVB_FAILURE on error.
+ */
+DVB_RESULT AML_SCAN_Stop(dvb_scan_handle_t handle)
+{
+    dvb_scan_t *s = (dvb_scan_t *)handle;
+    int i;
+
+    if (!s)
+        return DVB_FAILURE;
+
+    s->quit = 1;
+    for (i = 0; i < s->params.tuner_count; i++)
+    {
+        pthread_mutex_lock(&s->tuners[i].lock);
+        pthread_cond_signal(&s->tuners[i].cond);
+        pthread_mutex_unlock(&s->tuners[i].lock);
+    }
+    for (i = 0; i < s->params.tuner_count; i++)
+        pthread_join(s->tuners[i].thread, NULL);
+    /*a section callback may still be running on a freed filter*/
+    for (i = 0; i < s->params.tuner_count; i++)
+        AML_DMX_Sync(s->params.dmx_dev_id[i]);
+
+    for (i = 0; i < DVB_SCAN_MAX_TUNERS; i++)
+    {
+        if (!s->tuners[i].scan)
+            continue;
+        pthread_mutex_destroy(&s->tuners[i].lock);
+        pthread_cond_destroy(&s->tuners[i].cond);
+    }
+    pthread_mutex_destroy(&s->lock);
+    pthread_cond_destroy(&s->cond);
+    free(s->freqs);
+    free(s);
+    return DVB_SUCCESS;
+}
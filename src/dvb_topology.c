@@ -0,0 +1,195 @@
+#define DVR_LOG_MODULE DVR_LOG_MODULE_DVB
+
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "dvr_types.h"
+#include "dvr_utils.h"
+#include "dvb_topology.h"
+
+/**Cached sysfs values, 5 nodes per asyncfifo and the demux sources.*/
+#define TOPOLOGY_NODE_MAX (DVB_TOPOLOGY_MAX_ASYNCFIFO * 5 + DVB_TOPOLOGY_MAX_DEMUX)
+
+/**\brief Last value written to a sysfs node*/
+typedef struct
+{
+    char node[48];   /**< Node path, empty if unused*/
+    char val[24];    /**< Value written*/
+} DVB_TopologyNode_t;
+
+static pthread_once_t topo_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t topo_lock = PTHREAD_MUTEX_INITIALIZER;
+static DVB_Topology_t topo;
+static DVB_TopologyNode_t topo_nodes[TOPOLOGY_NODE_MAX];
+static int topo_source[DVB_TOPOLOGY_MAX_DEMUX];  /* DVB_DemuxSource_t, -1 if unknown */
+
+static void topology_probe(void)
+{
+    char node[48];
+    struct stat st;
+    int i;
+
+    for (i = 0; i < DVB_TOPOLOGY_MAX_DEMUX; i++)
+        topo_source[i] = -1;
+
+    snprintf(node, sizeof(node), "/sys/class/stb/demux%d_source", 0);
+    topo.new_dmx = (stat(node, &st) == -1) ? 1 : 0;
+
+    for (i = 0; i < DVB_TOPOLOGY_MAX_DEMUX; i++)
+    {
+        snprintf(node, sizeof(node), "/dev/dvb0.demux%d", i);
+        if (stat(node, &st) == -1)
+            break;
+    }
+    topo.demux_count = i;
+
+    for (i = 0; !topo.new_dmx && i < DVB_TOPOLOGY_MAX_ASYNCFIFO; i++)
+    {
+        snprintf(node, sizeof(node), "/sys/class/stb/asyncfifo%d_source", i);
+        if (stat(node, &st) == -1)
+            break;
+    }
+    topo.asyncfifo_count = i;
+
+    DVR_DEBUG(1, "dvb topology new_dmx:%d demux:%d asyncfifo:%d",
+              topo.new_dmx, topo.demux_count, topo.asyncfifo_count);
+}
+
+const DVB_Topology_t *dvb_topology_get(void)
+{
+    pthread_once(&topo_once, topology_probe);
+    return &topo;
+}
+
+int dvb_topology_write(const char *node, const char *val)
+{
+    DVB_TopologyNode_t *n = NULL;
+    int i, r;
+
+    if (!node || !val)
+        return -1;
+    pthread_once(&topo_once, topology_probe);
+
+    pthread_mutex_lock(&topo_lock);
+    for (i = 0; i < TOPOLOGY_NODE_MAX; i++)
+    {
+        if (!strcmp(topo_nodes[i].node, node))
+        {
+            n = &topo_nodes[i];
+            break;
+        }
+        if (!n && !topo_nodes[i].node[0])
+            n = &topo_nodes[i];
+    }
+    if (n && n->node[0] && !strcmp(n->val, val))
+    {
+        pthread_mutex_unlock(&topo_lock);
+        return 0;
+    }
+
+    r = dvr_file_echo(node, val);
+    /*a value not fitting is written each time, a failed one is retried*/
+    if (n && r == DVR_SUCCESS && strlen(node) < sizeof(n->node) && strlen(val) < sizeof(n->val))
+    {
+        strcpy(n->node, node);
+        strcpy(n->val, val);
+    }
+    else if (n)
+    {
+        n->node[0] = 0;
+    }
+    pthread_mutex_unlock(&topo_lock);
+    return (r == DVR_SUCCESS) ? 0 : -1;
+}
+
+int dvb_topology_get_source(int dmx_idx, DVB_DemuxSource_t *src)
+{
+    int s;
+
+    if (dmx_idx < 0 || dmx_idx >= DVB_TOPOLOGY_MAX_DEMUX || !src)
+        return -1;
+    pthread_once(&topo_once, topology_probe);
+
+    pthread_mutex_lock(&topo_lock);
+    s = topo_source[dmx_idx];
+    pthread_mutex_unlock(&topo_lock);
+    if (s < 0)
+        return -1;
+    *src = (DVB_DemuxSource_t)s;
+    return 0;
+}
+
+void dvb_topology_set_source(int dmx_idx, DVB_DemuxSource_t src)
+{
+    if (dmx_idx < 0 || dmx_idx >= DVB_TOPOLOGY_MAX_DEMUX)
+        return;
+    pthread_once(&topo_once, topology_probe);
+
+    pthread_mutex_lock(&topo_lock);
+    topo_source[dmx_idx] = src;
+    pthread_mutex_unlock(&topo_lock);
+}
+
+int dvb_topology_set_asyncfifo(int fifo_idx, int dmx_idx, int flush_size)
+{
+    char node[48];
+    char val[24];
+    int r = 0;
+
+    if (dvb_topology_get()->new_dmx)
+        return 0;
+
+    snprintf(node, sizeof(node), "/sys/class/stb/asyncfifo%d_flush_size", fifo_idx);
+    snprintf(val, sizeof(val), "%d", flush_size);
+    if (dvb_topology_write(node, val) != 0)
+        r = -1;
+
+    snprintf(node, sizeof(node), "/sys/class/stb/asyncfifo%d_source", fifo_idx);
+    snprintf(val, sizeof(val), "dmx%d", dmx_idx);
+    if (dvb_topology_write(node, val) != 0)
+        r = -1;
+
+    return r;
+}
+
+int dvb_topology_set_asyncfifo_secure(int fifo_idx, int enable, uint64_t addr, int size)
+{
+    char node[48];
+    char val[24];
+    int r = 0;
+
+    if (dvb_topology_get()->new_dmx)
+        return 0;
+
+    snprintf(node, sizeof(node), "/sys/class/stb/asyncfifo%d_secure_enable", fifo_idx);
+    if (dvb_topology_write(node, enable ? "1" : "0") != 0)
+        r = -1;
+
+    snprintf(node, sizeof(node), "/sys/class/stb/asyncfifo%d_secure_addr", fifo_idx);
+    snprintf(val, sizeof(val), "%llu", (unsigned long long)addr);
+    if (dvb_topology_write(node, val) != 0)
+        r = -1;
+
+    snprintf(node, sizeof(node), "/sys/class/stb/asyncfifo%d_secure_addr_size", fifo_idx);
+    snprintf(val, sizeof(val), "%d", size);
+    if (dvb_topology_write(node, val) != 0)
+        r = -1;
+
+    return r;
+}
+
+void dvb_topology_invalidate(void)
+{
+    int i;
+
+    pthread_once(&topo_once, topology_probe);
+
+    pthread_mutex_lock(&topo_lock);
+    memset(topo_nodes, 0, sizeof(topo_nodes));
+    for (i = 0; i < DVB_TOPOLOGY_MAX_DEMUX; i++)
+        topo_source[i] = -1;
+    pthread_mutex_unlock(&topo_lock);
+}
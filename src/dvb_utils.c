@@ -1,3 +1,5 @@
+#define DVR_LOG_MODULE DVR_LOG_MODULE_DVB
+
 #include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
@@ -11,6 +13,7 @@
 #include "dvr_types.h"
 #include "dvb_utils.h"
 #include "dvr_utils.h"
+#include "dvb_topology.h"
 
 #include <dmx.h>
 
@@ -24,13 +27,16 @@
 int dvb_set_demux_source(int dmx_idx, DVB_DemuxSource_t src)
 {
     char node[32];
-    struct stat st;
-    int r;
+    DVB_DemuxSource_t cur;
+    int r = -1;
+
+    /*channel change usually keeps the routing*/
+    if (dvb_topology_get_source(dmx_idx, &cur) == 0 && cur == src)
+        return 0;
 
     snprintf(node, sizeof(node), "/sys/class/stb/demux%d_source", dmx_idx);
 
-    r = stat(node, &st);
-    if (r == -1)
+    if (dvb_topology_get()->new_dmx)
     {
         int fd, source, input;
         memset(node, 0, sizeof(node));
@@ -139,6 +145,7 @@ int dvb_set_demux_source(int dmx_idx, DVB_DemuxSource_t src)
             default:
                 assert(0);
             }
+            r = 0;
             if (ioctl(fd, DMX_SET_INPUT, input) == -1)
             {
                 DVR_DEBUG(1, "dvb_set_demux_source ioctl DMX_SET_INPUT:%d error:%d", input, errno);
@@ -147,7 +154,6 @@ int dvb_set_demux_source(int dmx_idx, DVB_DemuxSource_t src)
             else
             {
                 DVR_DEBUG(1, "dvb_set_demux_source ioctl sucesss src:%d DMX_SET_INPUT:%d dmx_idx:%d", src, input, dmx_idx);
-                r = 0;
             }
             if (ioctl(fd, DMX_SET_HW_SOURCE, source) == -1)
             {
@@ -157,7 +163,6 @@ int dvb_set_demux_source(int dmx_idx, DVB_DemuxSource_t src)
             else
             {
                 DVR_DEBUG(1, "dvb_set_demux_source ioctl sucesss src:%d DMX_SET_HW_SOURCE:%d dmx_idx:%d", src, source, dmx_idx);
-                r = 0;
             }
             close(fd);
         }
@@ -195,9 +200,11 @@ int dvb_set_demux_source(int dmx_idx, DVB_DemuxSource_t src)
             assert(0);
         }
 
-        r = dvr_file_echo(node, val);
+        r = dvb_topology_write(node, val);
     }
 
+    if (r == 0)
+        dvb_topology_set_source(dmx_idx, src);
     return r;
 }
 
@@ -212,12 +219,13 @@ int dvb_get_demux_source(int dmx_idx, DVB_DemuxSource_t *src)
 {
     char node[32] = {0};
     char buf[32] = {0};
-    struct stat st;
-    int r, source_no;
+    int r = -1, source_no;
+
+    if (dvb_topology_get_source(dmx_idx, src) == 0)
+        return 0;
 
     snprintf(node, sizeof(node), "/sys/class/stb/demux%d_source", dmx_idx);
-    r = stat(node, &st);
-    if (r == -1)
+    if (dvb_topology_get()->new_dmx)
     {
         int fd, source;
         memset(node, 0, sizeof(node));
@@ -280,6 +288,7 @@ int dvb_get_demux_source(int dmx_idx, DVB_DemuxSource_t *src)
                 default:
                     assert(0);
                 }
+                r = 0;
             }
             else
             {
@@ -329,21 +338,12 @@ int dvb_get_demux_source(int dmx_idx, DVB_DemuxSource_t *src)
         }
     }
 
+    if (r == 0)
+        dvb_topology_set_source(dmx_idx, *src);
     return r;
 }
 //check is device platform is used new dmx
 int dvr_check_dmx_isNew(void)
 {
-    char node[32];
-    struct stat st;
-    int r;
-
-    snprintf(node, sizeof(node), "/sys/class/stb/demux%d_source", 0);
-
-    r = stat(node, &st);
-    if (r == -1)
-    {
-        return 1;
-    }
-    return 0;
-}
\ No newline at end of file
+    return dvb_topology_get()->new_dmx;
+}
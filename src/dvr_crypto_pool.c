@@ -0,0 +1,223 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "dvr_types.h"
+#include "dvr_crypto.h"
+#include "dvr_crypto_pool.h"
+#include "dvr_trace.h"
+
+/**\brief Crypto job state*/
+typedef enum {
+  CRYPTO_JOB_QUEUED,                                                    /**< Submitted, waiting for a worker*/
+  CRYPTO_JOB_BUSY,                                                      /**< Running on a worker*/
+  CRYPTO_JOB_DONE                                                       /**< Finished, waiting to be collected*/
+} DVR_CryptoJobState_t;
+
+/**\brief Crypto job*/
+typedef struct {
+  DVR_CryptoParams_t              params;                               /**< Crypto parameters*/
+  DVR_Result_t                    result;                               /**< Crypto function result*/
+  DVR_CryptoJobState_t            state;                                /**< Job state*/
+} DVR_CryptoJob_t;
+
+/**\brief Crypto worker pool context*/
+typedef struct {
+  pthread_mutex_t                 lock;                                 /**< Pool lock*/
+  pthread_cond_t                  cond;                                 /**< Signaled on job submit, finish and quit*/
+  pthread_t                       threads[DVR_CRYPTO_POOL_MAX_WORKERS]; /**< Worker threads*/
+  int                             workers;                              /**< Worker thread count*/
+  DVR_CryptoFunction_t            func;                                 /**< Crypto function*/
+  void                            *userdata;                            /**< Crypto function userdata*/
+  DVR_CryptoJob_t                 *jobs;                                /**< Job ring*/
+  uint32_t                        depth;                                /**< Job ring size*/
+  uint32_t                        head;                                 /**< Sequence of the oldest pending job*/
+  uint32_t                        run;                                  /**< Sequence of the next job to run*/
+  uint32_t                        tail;                                 /**< Sequence of the next job to submit*/
+  DVR_Bool_t                      quit;                                 /**< Workers shall exit*/
+} DVR_CryptoPool_t;
+
+static void *crypto_pool_worker(void *arg)
+{
+  DVR_CryptoPool_t *pool = (DVR_CryptoPool_t *)arg;
+  DVR_CryptoJob_t *job;
+
+  pthread_mutex_lock(&pool->lock);
+  for (;;) {
+    while (!pool->quit && pool->run == pool->tail)
+      pthread_cond_wait(&pool->cond, &pool->lock);
+    if (pool->quit)
+      break;
+
+    job = &pool->jobs[pool->run % pool->depth];
+    pool->run++;
+    job->state = CRYPTO_JOB_BUSY;
+    pthread_mutex_unlock(&pool->lock);
+
+    DVR_TRACE_BEGIN("crypto_func");
+    job->result = pool->func(&job->params, pool->userdata);
+    DVR_TRACE_END("crypto_func");
+
+    pthread_mutex_lock(&pool->lock);
+    job->state = CRYPTO_JOB_DONE;
+    pthread_cond_broadcast(&pool->cond);
+  }
+  pthread_mutex_unlock(&pool->lock);
+  return NULL;
+}
+
+int dvr_crypto_pool_open(DVR_CryptoPoolHandle_t *p_handle, int workers, int depth,
+    DVR_CryptoFunction_t func, void *userdata)
+{
+  DVR_CryptoPool_t *pool;
+  pthread_condattr_t cattr;
+  int i;
+
+  DVR_RETURN_IF_FALSE(p_handle);
+  DVR_RETURN_IF_FALSE(func);
+  DVR_RETURN_IF_FALSE(workers > 0 && workers <= DVR_CRYPTO_POOL_MAX_WORKERS);
+  DVR_RETURN_IF_FALSE(depth > 0);
+
+  pool = (DVR_CryptoPool_t *)calloc(1, sizeof(DVR_CryptoPool_t));
+  DVR_RETURN_IF_FALSE(pool);
+  pool->jobs = (DVR_CryptoJob_t *)calloc(depth, sizeof(DVR_CryptoJob_t));
+  if (!pool->jobs) {
+    free(pool);
+    return DVR_FAILURE;
+  }
+  pool->depth = depth;
+  pool->func = func;
+  pool->userdata = userdata;
+
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_condattr_init(&cattr);
+  pthread_condattr_setclock(&cattr, CLOCK_MONOTONIC);
+  pthread_cond_init(&pool->cond, &cattr);
+  pthread_condattr_destroy(&cattr);
+
+  for (i = 0; i < workers; i++) {
+    if (pthread_create(&pool->threads[i], NULL, crypto_pool_worker, pool) != 0)
+      break;
+  }
+  pool->workers = i;
+  if (pool->workers == 0) {
+    DVR_DEBUG(1, "%s, create crypto worker failed", __func__);
+    dvr_crypto_pool_close(pool);
+    return DVR_FAILURE;
+  }
+
+  DVR_DEBUG(1, "%s, workers:%d depth:%d", __func__, pool->workers, depth);
+  *p_handle = pool;
+  return DVR_SUCCESS;
+}
+
+int dvr_crypto_pool_close(DVR_CryptoPoolHandle_t handle)
+{
+  DVR_CryptoPool_t *pool = (DVR_CryptoPool_t *)handle;
+  int i;
+
+  DVR_RETURN_IF_FALSE(pool);
+
+  pthread_mutex_lock(&pool->lock);
+  /*drop the queued jobs, the running ones finish before the workers exit*/
+  while (pool->run != pool->tail) {
+    pool->jobs[pool->run % pool->depth].state = CRYPTO_JOB_DONE;
+    pool->run++;
+  }
+  pool->quit = DVR_TRUE;
+  pthread_cond_broadcast(&pool->cond);
+  pthread_mutex_unlock(&pool->lock);
+
+  for (i = 0; i < pool->workers; i++)
+    pthread_join(pool->threads[i], NULL);
+
+  pthread_mutex_destroy(&pool->lock);
+  pthread_cond_destroy(&pool->cond);
+  free(pool->jobs);
+  free(pool);
+  return DVR_SUCCESS;
+}
+
+int dvr_crypto_pool_submit(DVR_CryptoPoolHandle_t handle, DVR_CryptoParams_t *params)
+{
+  DVR_CryptoPool_t *pool = (DVR_CryptoPool_t *)handle;
+  DVR_CryptoJob_t *job;
+
+  DVR_RETURN_IF_FALSE(pool);
+  DVR_RETURN_IF_FALSE(params);
+
+  pthread_mutex_lock(&pool->lock);
+  DVR_RETURN_IF_FALSE_WITH_UNLOCK(pool->tail - pool->head < pool->depth, &pool->lock);
+  job = &pool->jobs[pool->tail % pool->depth];
+  memcpy(&job->params, params, sizeof(DVR_CryptoParams_t));
+  job->params.output_size = 0;
+  job->result = DVR_SUCCESS;
+  job->state = CRYPTO_JOB_QUEUED;
+  pool->tail++;
+  pthread_cond_broadcast(&pool->cond);
+  pthread_mutex_unlock(&pool->lock);
+  return DVR_SUCCESS;
+}
+
+int dvr_crypto_pool_collect(DVR_CryptoPoolHandle_t handle, DVR_CryptoParams_t *params,
+    DVR_Result_t *p_result, int timeout)
+{
+  DVR_CryptoPool_t *pool = (DVR_CryptoPool_t *)handle;
+  DVR_CryptoJob_t *job;
+  struct timespec ts;
+
+  DVR_RETURN_IF_FALSE(pool);
+  DVR_RETURN_IF_FALSE(params);
+
+  if (timeout > 0) {
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    ts.tv_sec += timeout / 1000;
+    ts.tv_nsec += (timeout % 1000) * 1000000;
+    if (ts.tv_nsec >= 1000000000) {
+      ts.tv_sec++;
+      ts.tv_nsec -= 1000000000;
+    }
+  }
+
+  /*not ready is a normal poll result, do not log it*/
+  pthread_mutex_lock(&pool->lock);
+  if (pool->head == pool->tail) {
+    pthread_mutex_unlock(&pool->lock);
+    return DVR_FAILURE;
+  }
+  job = &pool->jobs[pool->head % pool->depth];
+  while (job->state != CRYPTO_JOB_DONE) {
+    if (timeout == 0)
+      break;
+    if (timeout < 0)
+      pthread_cond_wait(&pool->cond, &pool->lock);
+    else if (pthread_cond_timedwait(&pool->cond, &pool->lock, &ts) != 0)
+      break;
+  }
+  if (job->state != CRYPTO_JOB_DONE) {
+    pthread_mutex_unlock(&pool->lock);
+    return DVR_FAILURE;
+  }
+
+  memcpy(params, &job->params, sizeof(DVR_CryptoParams_t));
+  if (p_result)
+    *p_result = job->result;
+  pool->head++;
+  pthread_mutex_unlock(&pool->lock);
+  return DVR_SUCCESS;
+}
+
+int dvr_crypto_pool_get_pending(DVR_CryptoPoolHandle_t handle)
+{
+  DVR_CryptoPool_t *pool = (DVR_CryptoPool_t *)handle;
+  int pending;
+
+  DVR_RETURN_IF_FALSE(pool);
+
+  pthread_mutex_lock(&pool->lock);
+  pending = pool->tail - pool->head;
+  pthread_mutex_unlock(&pool->lock);
+  return pending;
+}
@@ -0,0 +1,193 @@
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include "dvr_types.h"
+#include "dvr_log.h"
+
+/*size of a log line, longer ones are truncated*/
+#define DVR_LOG_LINE_SIZE 256
+/*size of a line kept in the ring*/
+#define DVR_LOG_RING_LINE 160
+
+/**\brief Log ring entry*/
+typedef struct {
+  volatile uint32_t  seq;                       /**< Write sequence + 1 when complete, 0 while written*/
+  uint8_t            module;                    /**< Module*/
+  uint8_t            level;                     /**< Level*/
+  uint16_t           reserved;
+  int                tid;                       /**< Writer thread*/
+  uint64_t           time;                      /**< Monotonic time in us*/
+  char               line[DVR_LOG_RING_LINE];   /**< The line*/
+} DVR_LogRingEntry_t;
+
+volatile int dvr_log_levels[DVR_LOG_MODULE_COUNT] =
+{
+  [0 ... (DVR_LOG_MODULE_COUNT - 1)] = DVR_DEBUG_LEVEL
+};
+
+volatile int dvr_log_ring_on;
+
+static DVR_LogRingEntry_t log_ring[DVR_LOG_RING_SIZE];
+static volatile uint32_t log_ring_pos;
+
+static const char *log_module_names[DVR_LOG_MODULE_COUNT] =
+{
+  [DVR_LOG_MODULE_COMMON]   = "common",
+  [DVR_LOG_MODULE_RECORD]   = "record",
+  [DVR_LOG_MODULE_PLAYBACK] = "playback",
+  [DVR_LOG_MODULE_WRAPPER]  = "wrapper",
+  [DVR_LOG_MODULE_SEGMENT]  = "segment",
+  [DVR_LOG_MODULE_DVB]      = "dvb",
+};
+
+static const char *log_module_tag(int module)
+{
+  return (module == DVR_LOG_MODULE_DVB) ? "dvb_debug" : DVR_LOG_TAG;
+}
+
+static uint64_t log_time_us(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/*lock free, a slot being rewritten is skipped by the dump*/
+static void log_ring_put(int module, int level, const char *line)
+{
+  uint32_t pos = __sync_fetch_and_add(&log_ring_pos, 1);
+  DVR_LogRingEntry_t *e = &log_ring[pos & (DVR_LOG_RING_SIZE - 1)];
+  size_t len;
+
+  e->seq = 0;
+  __sync_synchronize();
+  e->module = module;
+  e->level = level;
+  e->tid = (int)syscall(SYS_gettid);
+  e->time = log_time_us();
+  len = strcspn(line, "\n");
+  if (len > sizeof(e->line) - 1)
+    len = sizeof(e->line) - 1;
+  memcpy(e->line, line, len);
+  e->line[len] = 0;
+  __sync_synchronize();
+  e->seq = pos + 1;
+}
+
+void dvr_log_write(int module, int level, const char *tag, const char *func, int line,
+    const char *fmt, ...)
+{
+  char buf[DVR_LOG_LINE_SIZE];
+  va_list ap;
+  int n = 0;
+
+  if (module < 0 || module >= DVR_LOG_MODULE_COUNT)
+    module = DVR_LOG_MODULE_COMMON;
+
+  if (func)
+    n = (tag && tag[0]) ?
+      snprintf(buf, sizeof(buf), "%s %s %d: ", tag, func, line) :
+      snprintf(buf, sizeof(buf), "%s %d: ", func, line);
+  if (n < 0 || n >= (int)sizeof(buf))
+    n = 0;
+
+  va_start(ap, fmt);
+  vsnprintf(buf + n, sizeof(buf) - n, fmt, ap);
+  va_end(ap);
+
+  if (level <= dvr_log_levels[module])
+    __android_log_write(ANDROID_LOG_INFO, log_module_tag(module), buf);
+  if (dvr_log_ring_on)
+    log_ring_put(module, level, buf);
+}
+
+int dvr_log_ratelimit(DVR_LogRateLimit_t *rl, uint32_t interval, int module, int level)
+{
+  uint32_t now = (uint32_t)(log_time_us() / 1000);
+  uint32_t last = rl->last;
+  uint32_t missed;
+
+  /*0 is the never printed state*/
+  if (!now)
+    now = 1;
+
+  if ((last && now - last < interval)
+      || !__sync_bool_compare_and_swap(&rl->last, last, now)) {
+    __sync_fetch_and_add(&rl->missed, 1);
+    return 0;
+  }
+
+  missed = __sync_lock_test_and_set(&rl->missed, 0);
+  if (missed)
+    dvr_log_write(module, level, NULL, NULL, 0, "%u similar lines suppressed", missed);
+  return 1;
+}
+
+int dvr_log_set_level(int module, int level)
+{
+  int i;
+
+  if (module == DVR_LOG_MODULE_COUNT) {
+    for (i = 0; i < DVR_LOG_MODULE_COUNT; i++)
+      dvr_log_levels[i] = level;
+    return DVR_SUCCESS;
+  }
+
+  DVR_RETURN_IF_FALSE(module >= 0 && module < DVR_LOG_MODULE_COUNT);
+  dvr_log_levels[module] = level;
+  return DVR_SUCCESS;
+}
+
+int dvr_log_get_level(int module)
+{
+  if (module < 0 || module >= DVR_LOG_MODULE_COUNT)
+    return 0;
+  return dvr_log_levels[module];
+}
+
+void dvr_log_ring_enable(int on)
+{
+  dvr_log_ring_on = on ? 1 : 0;
+}
+
+int dvr_log_ring_dump(int fd)
+{
+  DVR_LogRingEntry_t e;
+  uint32_t end = log_ring_pos;
+  uint32_t pos = (end > DVR_LOG_RING_SIZE) ? end - DVR_LOG_RING_SIZE : 0;
+  char buf[DVR_LOG_RING_LINE + 64];
+  int lines = 0;
+  int n;
+
+  for (; pos != end; pos++) {
+    DVR_LogRingEntry_t *pe = &log_ring[pos & (DVR_LOG_RING_SIZE - 1)];
+
+    if (pe->seq != pos + 1)
+      continue;
+    __sync_synchronize();
+    memcpy(&e, pe, sizeof(e));
+    __sync_synchronize();
+    /*rewritten meanwhile*/
+    if (pe->seq != pos + 1)
+      continue;
+
+    e.line[sizeof(e.line) - 1] = 0;
+    n = snprintf(buf, sizeof(buf), "%llu.%06llu %5d %-8s %d %s\n",
+        (unsigned long long)(e.time / 1000000), (unsigned long long)(e.time % 1000000),
+        e.tid,
+        (e.module < DVR_LOG_MODULE_COUNT) ? log_module_names[e.module] : "?",
+        e.level, e.line);
+    if (n > (int)sizeof(buf) - 1)
+      n = sizeof(buf) - 1;
+    if (write(fd, buf, n) != n)
+      break;
+    lines++;
+  }
+
+  return lines;
+}
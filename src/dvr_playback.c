@@ -1,3 +1,5 @@
+#define DVR_LOG_MODULE DVR_LOG_MODULE_PLAYBACK
+
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -15,9 +17,13 @@
 #include "dvr_utils.h"
 #include "dvr_types.h"
 #include "dvr_playback.h"
+#include "dvr_crypto_pool.h"
+#include "dvr_trace.h"
 
 #define DVR_PB_DG(_level, _fmt...) \
   DVR_DEBUG_FL(_level, "playback", _fmt)
+#define DVR_PB_DG_RL(_level, _interval, _fmt...) \
+  DVR_DEBUG_RL_FL(_level, _interval, "playback", _fmt)
 
 #define VALID_PID(_pid_) ((_pid_)>0 && (_pid_)<0x1fff)
 
@@ -34,6 +40,7 @@
 
 #define FFFB_SLEEP_TIME    (1000)//500ms
 #define FB_DEFAULT_LEFT_TIME    (3000)
+#define DEFAULT_READAHEAD_SIZE  (2*1024*1024)
 //if tsplayer delay time < 200 and no data can read, we will pause
 #define MIN_TSPLAYER_DELAY_TIME (200)
 
@@ -146,34 +153,8 @@ static DVR_Bool_t _dvr_support_speed(int speed) {
   }
   return ret;
 }
-void _dvr_tsplayer_callback_test(void *user_data, am_tsplayer_event *event)
-{
-  DVR_PB_DG(1, "in callback test ");
-  DVR_Playback_t *player = NULL;
-  if (user_data != NULL) {
-    player = (DVR_Playback_t *) user_data;
-    DVR_PB_DG(1, "play speed [%f] in callback test ", player->speed);
-  }
-  switch (event->type) {
-      case AM_TSPLAYER_EVENT_TYPE_VIDEO_CHANGED:
-      {
-          DVR_PB_DG(1,"[evt] test AM_TSPLAYER_EVENT_TYPE_VIDEO_CHANGED: %d x %d @%d\n",
-              event->event.video_format.frame_width,
-              event->event.video_format.frame_height,
-              event->event.video_format.frame_rate);
-          break;
-      }
-      case AM_TSPLAYER_EVENT_TYPE_FIRST_FRAME:
-      {
-          DVR_PB_DG(1, "[evt] test  AM_TSPLAYER_EVENT_TYPE_FIRST_FRAME\n");
-          player->first_frame = 1;
-          break;
-      }
-      default:
-          break;
-    }
-}
-void _dvr_tsplayer_callback(void *user_data, am_tsplayer_event *event)
+//the sink chains the callback the decoder had before, it is not called here
+void _dvr_sink_callback(void *user_data, DVR_PlaybackSinkEvent_t *event)
 {
   DVR_Playback_t *player = NULL;
   if (user_data != NULL) {
@@ -181,17 +162,17 @@ void _dvr_tsplayer_callback(void *user_data, am_tsplayer_event *event)
     DVR_PB_DG(1, "play speed [%f] in-- callback", player->speed);
   }
   switch (event->type) {
-    case AM_TSPLAYER_EVENT_TYPE_VIDEO_CHANGED:
+    case DVR_PLAYBACK_SINK_EVENT_VIDEO_CHANGED:
     {
-        DVR_PB_DG(1,"[evt] AM_TSPLAYER_EVENT_TYPE_VIDEO_CHANGED: %d x %d @%d\n",
-            event->event.video_format.frame_width,
-            event->event.video_format.frame_height,
-            event->event.video_format.frame_rate);
+        DVR_PB_DG(1,"[evt] DVR_PLAYBACK_SINK_EVENT_VIDEO_CHANGED: %d x %d @%d\n",
+            event->frame_width,
+            event->frame_height,
+            event->frame_rate);
         break;
     }
-    case AM_TSPLAYER_EVENT_TYPE_FIRST_FRAME:
+    case DVR_PLAYBACK_SINK_EVENT_FIRST_FRAME:
     {
-        DVR_PB_DG(1, "[evt] AM_TSPLAYER_EVENT_TYPE_FIRST_FRAME\n");
+        DVR_PB_DG(1, "[evt] DVR_PLAYBACK_SINK_EVENT_FIRST_FRAME\n");
         if (player->first_trans_ok == DVR_FALSE) {
           player->first_trans_ok = DVR_TRUE;
           _dvr_playback_sent_transition_ok((DVR_PlaybackHandle_t)player, DVR_FALSE);
@@ -202,91 +183,28 @@ void _dvr_tsplayer_callback(void *user_data, am_tsplayer_event *event)
         }
         break;
     }
-    case AM_TSPLAYER_EVENT_TYPE_DECODE_FIRST_FRAME_AUDIO:
+    case DVR_PLAYBACK_SINK_EVENT_AUDIO_FIRST_FRAME:
         if (player->first_trans_ok == DVR_FALSE && player->has_video == DVR_FALSE) {
           player->first_trans_ok = DVR_TRUE;
           _dvr_playback_sent_transition_ok((DVR_PlaybackHandle_t)player, DVR_FALSE);
         }
         if (player != NULL && player->has_video == DVR_FALSE) {
-          DVR_PB_DG(1, "[evt]AM_TSPLAYER_EVENT_TYPE_DECODE_FIRST_FRAME_AUDIO [%d]\n", event->type);
+          DVR_PB_DG(1, "[evt]DVR_PLAYBACK_SINK_EVENT_AUDIO_FIRST_FRAME [%d]\n", event->native_type);
           player->first_frame = 1;
           player->seek_pause = DVR_FALSE;
         }
       break;
     default:
-      DVR_PB_DG(1, "[evt]unkown event [%d]\n", event->type);
+      DVR_PB_DG(1, "[evt]unkown event [%d]\n", event->native_type);
       break;
   }
-  if (player&&player->player_callback_func) {
-    DVR_PB_DG(1, "player is nonull, --call callback\n");
-    player->player_callback_func(player->player_callback_userdata, event);
-  } else if (player == NULL){
-    DVR_PB_DG(1, "player is null, get userdata error\n");
-  } else {
-    DVR_PB_DG(1, "player callback is null, get callback error\n");
-  }
 }
 
-//convert video and audio fmt
-static int _dvr_convert_stream_fmt(int fmt, DVR_Bool_t is_audio) {
-  int format = 0;
-  if (is_audio == DVR_FALSE) {
-    //for video fmt
-    switch (fmt)
-    {
-        case DVR_VIDEO_FORMAT_MPEG1:
-          format = AV_VIDEO_CODEC_MPEG1;
-          break;
-        case DVR_VIDEO_FORMAT_MPEG2:
-          format = AV_VIDEO_CODEC_MPEG2;
-          break;
-        case DVR_VIDEO_FORMAT_HEVC:
-          format = AV_VIDEO_CODEC_H265;
-          break;
-        case DVR_VIDEO_FORMAT_H264:
-          format = AV_VIDEO_CODEC_H264;
-          break;
-        case DVR_VIDEO_FORMAT_VP9:
-          format = AV_VIDEO_CODEC_VP9;
-          break;
-    }
-  } else {
-    //for audio fmt
-    switch (fmt)
-    {
-        case DVR_AUDIO_FORMAT_MPEG:
-          format = AV_AUDIO_CODEC_MP2;
-          break;
-        case DVR_AUDIO_FORMAT_AC3:
-          format = AV_AUDIO_CODEC_AC3;
-          break;
-        case DVR_AUDIO_FORMAT_EAC3:
-          format = AV_AUDIO_CODEC_EAC3;
-          break;
-        case DVR_AUDIO_FORMAT_DTS:
-          format = AV_AUDIO_CODEC_DTS;
-          break;
-        case DVR_AUDIO_FORMAT_AAC:
-          format = AV_AUDIO_CODEC_AAC;
-          break;
-        case DVR_AUDIO_FORMAT_LATM:
-          format = AV_AUDIO_CODEC_LATM;
-          break;
-        case DVR_AUDIO_FORMAT_PCM:
-          format = AV_AUDIO_CODEC_PCM;
-          break;
-        case DVR_AUDIO_FORMAT_AC4:
-          format = AV_AUDIO_CODEC_AC4;
-          break;
-    }
-  }
-  return format;
-}
 static int _dvr_playback_get_trick_stat(DVR_PlaybackHandle_t handle)
 {
   DVR_Playback_t *player = (DVR_Playback_t *) handle;
 
-  if (player == NULL || player->handle == (am_tsplayer_handle)NULL)
+  if (player == NULL || player->handle == NULL)
     return -1;
 
   return player->first_frame;
@@ -335,12 +253,12 @@ static int _dvr_playback_timeoutwait(DVR_PlaybackHandle_t handle , int ms)
 static int _dvr_playback_get_delaytime(DVR_PlaybackHandle_t handle ) {
   DVR_Playback_t *player = (DVR_Playback_t *) handle;
   int64_t cache = 0;
-  if (player == NULL || player->handle == (am_tsplayer_handle)NULL) {
+  if (player == NULL || player->handle == NULL) {
     DVR_PB_DG(1, "tsplayer delay time error, handle is NULL");
     return 0;
   }
-  AmTsPlayer_getDelayTime(player->handle, &cache);
-  DVR_PB_DG(1, "tsplayer cache time [%lld]ms", cache);
+  player->sink->get_delay_time(player->handle, &cache);
+  DVR_PB_DG(2, "tsplayer cache time [%lld]ms", cache);
   return cache;
 }
 //send signal
@@ -356,9 +274,37 @@ static int _dvr_playback_sendSignal(DVR_PlaybackHandle_t handle)
   pthread_mutex_lock(&player->lock);
   pthread_cond_signal(&player->cond);
   pthread_mutex_unlock(&player->lock);
+  //the thread may wait for record data
+  segment_wait_cancel();
   return 0;
 }
 
+//wait for the recorder to write more of the current segment, return the time waited in ms
+static int _dvr_playback_wait_data(DVR_Playback_t *player, int ms)
+{
+  char location[DVR_MAX_LOCATION_SIZE];
+  uint64_t segment_id = 0;
+  loff_t pos = -1;
+  uint64_t start = _dvr_time_getClock();
+
+  pthread_mutex_lock(&player->segment_lock);
+  if (player->r_handle) {
+    pos = segment_tell_position(player->r_handle);
+    segment_id = player->cur_segment.segment_id;
+    memcpy(location, player->cur_segment.location, sizeof(location));
+  }
+  pthread_mutex_unlock(&player->segment_lock);
+
+  //recorder not in this process, poll
+  if (pos < 0 || !player->openParams.is_timeshift
+      || segment_wait_data(location, segment_id, pos, ms) != DVR_SUCCESS) {
+    pthread_mutex_lock(&player->lock);
+    _dvr_playback_timeoutwait((DVR_PlaybackHandle_t)player, ms);
+    pthread_mutex_unlock(&player->lock);
+  }
+  return _dvr_time_getClock() - start;
+}
+
 //send playback event, need check is need lock first
 static int _dvr_playback_sent_event(DVR_PlaybackHandle_t handle, DVR_PlaybackEvent_t evt, DVR_Play_Notify_t *notify, DVR_Bool_t is_lock) {
 
@@ -469,7 +415,7 @@ static int _dvr_check_segment_ongoing(DVR_PlaybackHandle_t handle) {
 static int _dvr_init_fffb_t(DVR_PlaybackHandle_t handle) {
   DVR_Playback_t *player = (DVR_Playback_t *) handle;
   player->fffb_start = _dvr_time_getClock();
-  DVR_PB_DG(1, " player->fffb_start:%lld", player->fffb_start);
+  DVR_PB_DG(2, " player->fffb_start:%lld", player->fffb_start);
   player->fffb_current = player->fffb_start;
   //get segment current time pos
   player->fffb_start_pcr = _dvr_get_cur_time(handle);
@@ -481,7 +427,7 @@ static int _dvr_init_fffb_t(DVR_PlaybackHandle_t handle) {
 static int _dvr_init_fffb_time(DVR_PlaybackHandle_t handle) {
   DVR_Playback_t *player = (DVR_Playback_t *) handle;
   player->fffb_start = _dvr_time_getClock();
-  DVR_PB_DG(1, " player->fffb_start:%lld", player->fffb_start);
+  DVR_PB_DG(2, " player->fffb_start:%lld", player->fffb_start);
   player->fffb_current = player->fffb_start;
   //get segment current time pos
   player->fffb_start_pcr = _dvr_get_cur_time(handle);
@@ -604,6 +550,7 @@ static int _dvr_get_next_segmentId(DVR_PlaybackHandle_t handle) {
       player->last_segment_tatol = segment_tell_total_time(player->r_handle);
       player->last_segment.segment_id = player->cur_segment.segment_id;
       player->last_segment.flags = player->cur_segment.flags;
+      player->last_segment.summary = player->cur_segment.summary;
       memcpy(player->last_segment.location, player->cur_segment.location, DVR_MAX_LOCATION_SIZE);
       //pids
       memcpy(&player->last_segment.pids, &player->cur_segment.pids, sizeof(DVR_PlaybackPids_t));
@@ -613,6 +560,7 @@ static int _dvr_get_next_segmentId(DVR_PlaybackHandle_t handle) {
       player->cur_segment_id = segment->segment_id;
       player->cur_segment.segment_id = segment->segment_id;
       player->cur_segment.flags = segment->flags;
+      player->cur_segment.summary = segment->summary;
       DVR_PB_DG(1, "set cur id cur flag[0x%x]segment->flags flag[0x%x] id [%lld]", player->cur_segment.flags, segment->flags, segment->segment_id);
       memcpy(player->cur_segment.location, segment->location, DVR_MAX_LOCATION_SIZE);
       //pids
@@ -641,8 +589,45 @@ static int _dvr_get_next_segmentId(DVR_PlaybackHandle_t handle) {
   }
   return DVR_SUCCESS;
 }
+static loff_t _dvr_playback_readahead_size(DVR_Playback_t *player)
+{
+  return player->openParams.readahead_size > 0 ? player->openParams.readahead_size : DEFAULT_READAHEAD_SIZE;
+}
+
+//set the read hints of the current segment for the play speed, need segment lock
+static void _dvr_playback_update_access(DVR_Playback_t *player)
+{
+  Segment_AccessMode_t mode;
+
+  if (player->r_handle == NULL || player->openParams.readahead_size < 0)
+    return;
+  //trick modes jump, normal play reads sequentially
+  mode = (IS_FFFB(player->speed) || IS_FB(player->speed)) ? SEGMENT_ACCESS_RANDOM : SEGMENT_ACCESS_SEQUENTIAL;
+  if (mode == player->access_mode)
+    return;
+  if (segment_set_access_mode(player->r_handle, mode, _dvr_playback_readahead_size(player)) == DVR_SUCCESS)
+    player->access_mode = mode;
+}
+
+//close the current segment and keep its cache stats, need segment lock
+static void _dvr_playback_close_segment(DVR_Playback_t *player)
+{
+  Segment_CacheStats_t stats;
+
+  if (segment_get_cache_stats(player->r_handle, &stats) == DVR_SUCCESS) {
+    player->cache_stats.read_bytes += stats.read_bytes;
+    player->cache_stats.willneed_bytes += stats.willneed_bytes;
+    player->cache_stats.dontneed_bytes += stats.dontneed_bytes;
+    player->cache_stats.prefetch_count += stats.prefetch_count;
+    player->cache_stats.live_bytes += stats.live_bytes;
+  }
+  segment_close(player->r_handle);
+  player->r_handle = NULL;
+  player->access_mode = SEGMENT_ACCESS_NORMAL;
+}
+
 //open next segment to play,if reach list end return errro.
-static int _change_to_next_segment(DVR_PlaybackHandle_t handle)
+static int _do_change_to_next_segment(DVR_PlaybackHandle_t handle)
 {
   DVR_Playback_t *player = (DVR_Playback_t *) handle;
   Segment_OpenParams_t  params;
@@ -663,8 +648,7 @@ static int _change_to_next_segment(DVR_PlaybackHandle_t handle)
 
   if (player->r_handle != NULL) {
     DVR_PB_DG(1, "close segment");
-    segment_close(player->r_handle);
-    player->r_handle = NULL;
+    _dvr_playback_close_segment(player);
   }
 
   memset(params.location, 0, DVR_MAX_LOCATION_SIZE);
@@ -693,6 +677,16 @@ static int _change_to_next_segment(DVR_PlaybackHandle_t handle)
   return ret;
 }
 
+static int _change_to_next_segment(DVR_PlaybackHandle_t handle)
+{
+  int ret;
+
+  DVR_TRACE_BEGIN("_change_to_next_segment");
+  ret = _do_change_to_next_segment(handle);
+  DVR_TRACE_END("_change_to_next_segment");
+  return ret;
+}
+
 //open next segment to play,if reach list end return errro.
 static int _dvr_open_segment(DVR_PlaybackHandle_t handle, uint64_t segment_id)
 {
@@ -750,8 +744,7 @@ static int _dvr_open_segment(DVR_PlaybackHandle_t handle, uint64_t segment_id)
   params.mode = SEGMENT_MODE_READ;
   DVR_PB_DG(1, "open segment location[%s][%lld]cur flag[0x%x]", params.location, params.segment_id, player->cur_segment.flags);
   if (player->r_handle != NULL) {
-    segment_close(player->r_handle);
-    player->r_handle = NULL;
+    _dvr_playback_close_segment(player);
   }
   ret = segment_open(&params, &(player->r_handle));
   if (ret == DVR_FAILURE) {
@@ -768,8 +761,8 @@ static int _dvr_open_segment(DVR_PlaybackHandle_t handle, uint64_t segment_id)
 //get play info by segment id
 static int _dvr_playback_get_playinfo(DVR_PlaybackHandle_t handle,
   uint64_t segment_id,
-  am_tsplayer_video_params *vparam,
-  am_tsplayer_audio_params *aparam, am_tsplayer_audio_params *adparam) {
+  DVR_PlaybackSinkVideoParams_t *vparam,
+  DVR_PlaybackSinkAudioParams_t *aparam, DVR_PlaybackSinkAudioParams_t *adparam) {
 
   DVR_Playback_t *player = (DVR_Playback_t *) handle;
   DVR_PlaybackSegmentInfo_t *segment;
@@ -808,13 +801,13 @@ static int _dvr_playback_get_playinfo(DVR_PlaybackHandle_t handle,
       player->cur_segment.pids.ad.type = segment->pids.ad.type;
       player->cur_segment.pids.pcr.pid = segment->pids.pcr.pid;
       //
-      vparam->codectype = _dvr_convert_stream_fmt(segment->pids.video.format, DVR_FALSE);
+      vparam->format = segment->pids.video.format;
       vparam->pid = segment->pids.video.pid;
-      aparam->codectype = _dvr_convert_stream_fmt(segment->pids.audio.format, DVR_TRUE);
+      aparam->format = segment->pids.audio.format;
       aparam->pid = segment->pids.audio.pid;
-      adparam->codectype =_dvr_convert_stream_fmt(segment->pids.ad.format, DVR_TRUE);
+      adparam->format = segment->pids.ad.format;
       adparam->pid =segment->pids.ad.pid;
-      DVR_PB_DG(1, "get play info sucess[0x%x]apid[0x%x]vfmt[%d]afmt[%d]", vparam->pid, aparam->pid, vparam->codectype, aparam->codectype);
+      DVR_PB_DG(1, "get play info sucess[0x%x]apid[0x%x]vfmt[%d]afmt[%d]", vparam->pid, aparam->pid, vparam->format, aparam->format);
       found = 2;
       break;
     }
@@ -827,13 +820,30 @@ static int _dvr_playback_get_playinfo(DVR_PlaybackHandle_t handle,
 
   return DVR_SUCCESS;
 }
+//the summary of the later of two adjacent segments tells if its pids changed
+static DVR_Bool_t _dvr_segment_pids_continuous(DVR_Playback_t *player) {
+  DVR_PlaybackSegmentInfo_t *later;
+
+  if (strncmp(player->cur_segment.location, player->last_segment.location, DVR_MAX_LOCATION_SIZE))
+    return DVR_FALSE;
+  if (player->cur_segment.segment_id == player->last_segment.segment_id + 1)
+    later = &player->cur_segment;
+  else if (player->last_segment.segment_id == player->cur_segment.segment_id + 1)
+    later = &player->last_segment;
+  else
+    return DVR_FALSE;
+  if (!(later->summary.flags & DVR_SEGMENT_SUMMARY_VALID)
+    || (later->summary.flags & DVR_SEGMENT_SUMMARY_PIDS_CHANGED))
+    return DVR_FALSE;
+  return DVR_TRUE;
+}
+
 static int _dvr_replay_changed_pid(DVR_PlaybackHandle_t handle) {
   DVR_Playback_t *player = (DVR_Playback_t *) handle;
   if (player == NULL) {
     DVR_PB_DG(1, "player is NULL");
     return DVR_FAILURE;
   }
-
   //compare cur segment
   //if (player->cmd.state == DVR_PLAYBACK_STATE_START)
   {
@@ -859,13 +869,13 @@ static int _dvr_check_speed_con(DVR_PlaybackHandle_t handle)
   }
   char buf[10];
   dvr_prop_read("vendor.tv.libdvr.con", buf, sizeof(buf));
-  DVR_PB_DG(1, "player get prop[%d][%s]", atoi(buf), buf);
+  DVR_PB_DG(2, "player get prop[%d][%s]", atoi(buf), buf);
 
   if (atoi(buf) != 1) {
     //return DVR_TRUE;
   }
 
-  DVR_PB_DG(1, ":play speed: %f  ply dur: %lld sys_dur: %lld",
+  DVR_PB_DG(2, ":play speed: %f  ply dur: %lld sys_dur: %lld",
                 player->speed,
                 player->con_spe.ply_dur,
                 player->con_spe.sys_dur);
@@ -900,14 +910,14 @@ static int _dvr_check_cur_segment_flag(DVR_PlaybackHandle_t handle)
     (player->last_segment.flags & DVR_PLAYBACK_SEGMENT_DISPLAYABLE) == 0) {
     //enable display
     DVR_PB_DG(1, "unmute");
-    AmTsPlayer_showVideo(player->handle);
-    AmTsPlayer_setAudioMute(player->handle, 0, 0);
+    player->sink->show_video(player->handle);
+    player->sink->set_audio_mute(player->handle, 0, 0);
   } else if ((player->cur_segment.flags & DVR_PLAYBACK_SEGMENT_DISPLAYABLE) == 0 &&
     (player->last_segment.flags & DVR_PLAYBACK_SEGMENT_DISPLAYABLE) == DVR_PLAYBACK_SEGMENT_DISPLAYABLE) {
     //disable display
     DVR_PB_DG(1, "mute");
-    AmTsPlayer_hideVideo(player->handle);
-    AmTsPlayer_setAudioMute(player->handle, 1, 1);
+    player->sink->hide_video(player->handle);
+    player->sink->set_audio_mute(player->handle, 1, 1);
   }
   return DVR_SUCCESS;
 }
@@ -928,12 +938,62 @@ static DVR_Bool_t _dvr_pauselive_decode_sucess(DVR_PlaybackHandle_t handle) {
     return DVR_FALSE;
   }
 }
+//decrypt a block on the crypto workers, split on ts packet boundaries
+//and packed back in order, the crypto function is keyed by offset
+static int _dvr_playback_decrypt_parallel(DVR_CryptoPoolHandle_t pool, int workers, DVR_CryptoParams_t *params)
+{
+  DVR_CryptoParams_t chunk;
+  uint8_t *in = (uint8_t *)params->input_buffer.addr;
+  uint8_t *out = (uint8_t *)params->output_buffer.addr;
+  size_t in_len = params->input_buffer.size;
+  size_t chunk_len;
+  size_t pos = 0;
+  size_t out_len = 0;
+  DVR_Result_t result;
+  int ret = DVR_SUCCESS;
+  int n = 0;
+
+  chunk_len = (in_len / workers + 187) / 188 * 188;
+  if (chunk_len == 0)
+    chunk_len = in_len;
+
+  while (pos < in_len && n < workers) {
+    memcpy(&chunk, params, sizeof(chunk));
+    chunk.offset = params->offset + pos;
+    chunk.input_buffer.addr = (size_t)(in + pos);
+    chunk.input_buffer.size = (in_len - pos > chunk_len && n < workers - 1) ? chunk_len : in_len - pos;
+    chunk.output_buffer.addr = (size_t)(out + pos);
+    chunk.output_buffer.size = (pos + chunk.input_buffer.size < in_len) ?
+      chunk.input_buffer.size : params->output_buffer.size - pos;
+    if (dvr_crypto_pool_submit(pool, &chunk) != DVR_SUCCESS)
+      break;
+    pos += chunk.input_buffer.size;
+    n++;
+  }
+
+  //output may be shorter than input, pack the chunks
+  while (n-- > 0) {
+    dvr_crypto_pool_collect(pool, &chunk, &result, -1);
+    if (result != DVR_SUCCESS)
+      ret = result;
+    if (chunk.output_buffer.addr != (size_t)(out + out_len))
+      memmove(out + out_len, (uint8_t *)chunk.output_buffer.addr, chunk.output_size);
+    out_len += chunk.output_size;
+  }
+  if (pos < in_len) {
+    DVR_PB_DG(1, "decrypt submit failed");
+    ret = DVR_FAILURE;
+  }
+  params->output_size = out_len;
+  return ret;
+}
+
 static void* _dvr_playback_thread(void *arg)
 {
   DVR_Playback_t *player = (DVR_Playback_t *) arg;
   //int need_open_segment = 1;
-  am_tsplayer_input_buffer     wbufs;
-  am_tsplayer_input_buffer     dec_bufs;
+  DVR_PlaybackSinkBuffer_t     wbufs;
+  DVR_PlaybackSinkBuffer_t     dec_bufs;
   int ret = DVR_SUCCESS;
 
   #define MAX_REACHEND_TIMEOUT (3000)
@@ -948,6 +1008,10 @@ static void* _dvr_playback_thread(void *arg)
   int dec_buf_size = buf_len + 188;
   int real_read = 0;
   DVR_Bool_t goto_rewrite = DVR_FALSE;
+  DVR_CryptoPoolHandle_t crypto_pool = NULL;
+  DVR_CryptoFunction_t pool_func = NULL;
+  void *pool_userdata = NULL;
+  int crypto_workers = player->openParams.crypto_workers;
 
   if (player->is_secure_mode) {
     if (dec_buf_size > player->secure_buffer_size) {
@@ -960,17 +1024,13 @@ static void* _dvr_playback_thread(void *arg)
     DVR_PB_DG(1, "Malloc buffer failed");
     return NULL;
   }
-  wbufs.buf_type = TS_INPUT_BUFFER_TYPE_NORMAL;
-  wbufs.buf_size = 0;
+  wbufs.type = DVR_PLAYBACK_SINK_BUFFER_NORMAL;
+  wbufs.size = 0;
 
-  dec_bufs.buf_data = malloc(dec_buf_size);
-  if (!dec_bufs.buf_data) {
-    DVR_PB_DG(1, "Malloc dec buffer failed");
-    free(buf);
-    return NULL;
-  }
-  dec_bufs.buf_type = TS_INPUT_BUFFER_TYPE_NORMAL;
-  dec_bufs.buf_size = dec_buf_size;
+  //dec buffer is allocated on the first decrypt which can not work in place
+  dec_bufs.data = NULL;
+  dec_bufs.type = DVR_PLAYBACK_SINK_BUFFER_NORMAL;
+  dec_bufs.size = dec_buf_size;
 
   if (player->segment_is_open == DVR_FALSE) {
     ret = _change_to_next_segment((DVR_PlaybackHandle_t)player);
@@ -981,7 +1041,6 @@ static void* _dvr_playback_thread(void *arg)
       free(buf);
       buf = NULL;
     }
-    free(dec_bufs.buf_data);
     DVR_PB_DG(1, "get segment error");
     return NULL;
   }
@@ -995,7 +1054,7 @@ static void* _dvr_playback_thread(void *arg)
   }
   _dvr_check_cur_segment_flag((DVR_PlaybackHandle_t)player);
   //set video show
-  AmTsPlayer_showVideo(player->handle);
+  player->sink->show_video(player->handle);
 
   int trick_stat = 0;
   while (player->is_running/* || player->cmd.last_cmd != player->cmd.cur_cmd*/) {
@@ -1012,7 +1071,7 @@ static void* _dvr_playback_thread(void *arg)
     {
       trick_stat = _dvr_playback_get_trick_stat((DVR_PlaybackHandle_t)player);
       if (trick_stat > 0) {
-        DVR_PB_DG(1, "trick stat[%d] is > 0 cur cmd[%d]last cmd[%d]flag[0x%x]",
+        DVR_PB_DG(2, "trick stat[%d] is > 0 cur cmd[%d]last cmd[%d]flag[0x%x]",
                       trick_stat, player->cmd.cur_cmd, player->cmd.last_cmd, player->play_flag);
         if (player->cmd.cur_cmd == DVR_PLAYBACK_CMD_SEEK || (player->play_flag&DVR_PLAYBACK_STARTED_PAUSEDLIVE) == DVR_PLAYBACK_STARTED_PAUSEDLIVE) {
           //check last cmd
@@ -1022,7 +1081,7 @@ static void* _dvr_playback_thread(void *arg)
                 ||player->cmd.last_cmd == DVR_PLAYBACK_CMD_VSTART
                     || player->cmd.last_cmd == DVR_PLAYBACK_CMD_ASTART
                     || player->cmd.last_cmd == DVR_PLAYBACK_CMD_START))) {
-            DVR_PB_DG(1, "pause play-------cur cmd[%d]last cmd[%d]flag[0x%x]",
+            DVR_PB_DG(2, "pause play-------cur cmd[%d]last cmd[%d]flag[0x%x]",
                           player->cmd.cur_cmd, player->cmd.last_cmd, player->play_flag);
             //need change to pause state
             player->cmd.cur_cmd = DVR_PLAYBACK_CMD_PAUSE;
@@ -1031,9 +1090,9 @@ static void* _dvr_playback_thread(void *arg)
             //clear flag
             player->play_flag = player->play_flag & (~DVR_PLAYBACK_STARTED_PAUSEDLIVE);
             player->first_frame = 0;
-            AmTsPlayer_setTrickMode(player->handle, AV_VIDEO_TRICK_MODE_NONE);
-            AmTsPlayer_pauseVideoDecoding(player->handle);
-            AmTsPlayer_pauseAudioDecoding(player->handle);
+            player->sink->set_trick_mode(player->handle, DVR_PLAYBACK_SINK_TRICK_NONE);
+            player->sink->pause_video_decoding(player->handle);
+            player->sink->pause_audio_decoding(player->handle);
           } else {
             DVR_PB_DG(1, "clear first frame value-------");
             player->first_frame = 0;
@@ -1043,7 +1102,7 @@ static void* _dvr_playback_thread(void *arg)
                 ||player->speed > FF_SPEED ||player->speed < FB_SPEED) {
             //restart play stream if speed > 2
             if (player->state == DVR_PLAYBACK_STATE_PAUSE) {
-              DVR_PB_DG(1, "fffb pause state----speed[%f] fffb cur[%lld] cur sys[%lld] [%s] [%lld]",
+              DVR_PB_DG(2, "fffb pause state----speed[%f] fffb cur[%lld] cur sys[%lld] [%s] [%lld]",
                             player->speed,
                             player->fffb_current,
                             _dvr_time_getClock(),
@@ -1056,7 +1115,7 @@ static void* _dvr_playback_thread(void *arg)
               pthread_mutex_unlock(&player->lock);
               continue;
             } else if (_dvr_time_getClock() < player->next_fffb_time) {
-              DVR_PB_DG(1, "fffb timeout-to pause video---speed[%f] fffb cur[%lld] cur sys[%lld] [%s] [%lld]",
+              DVR_PB_DG(2, "fffb timeout-to pause video---speed[%f] fffb cur[%lld] cur sys[%lld] [%s] [%lld]",
                             player->speed,
                             player->fffb_current,
                             _dvr_time_getClock(),
@@ -1065,13 +1124,13 @@ static void* _dvr_playback_thread(void *arg)
               //used timeout wait need lock first,so we unlock and lock
               //pthread_mutex_unlock(&player->lock);
               //pthread_mutex_lock(&player->lock);
-              AmTsPlayer_pauseVideoDecoding(player->handle);
+              player->sink->pause_video_decoding(player->handle);
               _dvr_playback_timeoutwait((DVR_PlaybackHandle_t)player, timeout);
               pthread_mutex_unlock(&player->lock);
               continue;
 
             }
-            DVR_PB_DG(1, "fffb play-------speed[%f][%d][%d][%s][%d]",
+            DVR_PB_DG(2, "fffb play-------speed[%f][%d][%d][%s][%d]",
                         player->speed,
                         goto_rewrite,
                         real_read,
@@ -1091,15 +1150,15 @@ static void* _dvr_playback_thread(void *arg)
             //user to resume
             DVR_PB_DG(1, "pause, when got first frame event when user seek end");
             player->first_frame = 0;
-            AmTsPlayer_setTrickMode(player->handle, AV_VIDEO_TRICK_MODE_NONE);
-            AmTsPlayer_pauseVideoDecoding(player->handle);
-            AmTsPlayer_pauseAudioDecoding(player->handle);
+            player->sink->set_trick_mode(player->handle, DVR_PLAYBACK_SINK_TRICK_NONE);
+            player->sink->pause_video_decoding(player->handle);
+            player->sink->pause_audio_decoding(player->handle);
         }
       } else if (player->fffb_play == DVR_TRUE){
         //for first into fffb when reset speed
         if (player->state == DVR_PLAYBACK_STATE_PAUSE ||
           _dvr_time_getClock() < player->next_fffb_time) {
-          DVR_PB_DG(1, "fffb timeout-fffb play---speed[%f] fffb cur[%lld] cur sys[%lld] [%s] [%lld]",
+          DVR_PB_DG(2, "fffb timeout-fffb play---speed[%f] fffb cur[%lld] cur sys[%lld] [%s] [%lld]",
                         player->speed,
                         player->fffb_current,
                         _dvr_time_getClock(),
@@ -1112,7 +1171,7 @@ static void* _dvr_playback_thread(void *arg)
           pthread_mutex_unlock(&player->lock);
           continue;
         }
-        DVR_PB_DG(1, "fffb replay-------speed[%f][%d][%d][%s][%d]player->fffb_play[%d]",
+        DVR_PB_DG(2, "fffb replay-------speed[%f][%d][%d][%s][%d]player->fffb_play[%d]",
                       player->speed,
                       goto_rewrite,
                       real_read,
@@ -1134,7 +1193,7 @@ static void* _dvr_playback_thread(void *arg)
     if (player->state == DVR_PLAYBACK_STATE_PAUSE
         && player->seek_pause == DVR_FALSE) {
       //check is need send time send end
-      DVR_PB_DG(1, "pause, continue");
+      DVR_PB_DG(2, "pause, continue");
       _dvr_playback_sent_playtime((DVR_PlaybackHandle_t)player, DVR_FALSE);
       _dvr_playback_timeoutwait((DVR_PlaybackHandle_t)player, timeout);
       pthread_mutex_unlock(&player->lock);
@@ -1155,6 +1214,7 @@ static void* _dvr_playback_thread(void *arg)
     //.check is need send time send end
     _dvr_playback_sent_playtime((DVR_PlaybackHandle_t)player, DVR_FALSE);
     pthread_mutex_lock(&player->segment_lock);
+    _dvr_playback_update_access(player);
     //DVR_PB_DG(1, "start read");
     int read = segment_read(player->r_handle, buf + real_read, buf_len - real_read);
     //DVR_PB_DG(1, "start read end [%d]", read);
@@ -1174,7 +1234,7 @@ static void* _dvr_playback_thread(void *arg)
     }
     //if on fb mode and read file end , we need calculate pos to retry read.
     if (read == 0 && IS_FB(player->speed) && real_read == 0) {
-      DVR_PB_DG(1, "recalculate read [%d] readed [%d]buf_len[%d]speed[%f]id=[%llu]",
+      DVR_PB_DG(2, "recalculate read [%d] readed [%d]buf_len[%d]speed[%f]id=[%llu]",
                     read,
                     real_read,
                     buf_len,
@@ -1196,13 +1256,13 @@ static void* _dvr_playback_thread(void *arg)
         pthread_mutex_lock(&player->lock);
         /*if cache time > 20s , we think get time is error,*/
         if (_cache_time - MIN_CACHE_TIME > 20 * 1000) {
-            DVR_PB_DG(1, "read end but cache time is %d > 20s, this is an error at media_hal", _cache_time);
-            DVR_PB_DG(1, "read end but cache time is %d > 20s, this is an error at media_hal", _cache_time);
-            DVR_PB_DG(1, "read end but cache time is %d > 20s, this is an error at media_hal", _cache_time);
+            DVR_PB_DG_RL(1, 1000, "read end but cache time is %d > 20s, this is an error at media_hal", _cache_time);
+            DVR_PB_DG_RL(1, 1000, "read end but cache time is %d > 20s, this is an error at media_hal", _cache_time);
+            DVR_PB_DG_RL(1, 1000, "read end but cache time is %d > 20s, this is an error at media_hal", _cache_time);
         }
         _dvr_playback_timeoutwait((DVR_PlaybackHandle_t)player, ((_cache_time - MIN_CACHE_TIME) > MIN_CACHE_TIME ? MIN_CACHE_TIME : (_cache_time - MIN_CACHE_TIME)));
         pthread_mutex_unlock(&player->lock);
-        DVR_PB_DG(1, "read end but cache time is %d > %d, to sleep end and continue", _cache_time, MIN_CACHE_TIME);
+        DVR_PB_DG(2, "read end but cache time is %d > %d, to sleep end and continue", _cache_time, MIN_CACHE_TIME);
         //continue;
       }
 
@@ -1213,7 +1273,7 @@ static void* _dvr_playback_thread(void *arg)
       int delay = _dvr_playback_get_delaytime((DVR_PlaybackHandle_t)player);
       if (ret != DVR_SUCCESS) {
         player->noData++;
-        DVR_PB_DG(1, "playback is sleep:[%d]ms nodata[%d]", timeout, player->noData);
+        DVR_PB_DG(2, "playback is sleep:[%d]ms nodata[%d]", timeout, player->noData);
         if (player->noData == 4) {
             DVR_PB_DG(1, "playback send nodata event nodata[%d]", player->noData);
                   //send event here and pause
@@ -1240,23 +1300,22 @@ static void* _dvr_playback_thread(void *arg)
          dvr_playback_pause((DVR_PlaybackHandle_t)player, DVR_FALSE);
          _dvr_playback_sent_event((DVR_PlaybackHandle_t)player, DVR_PLAYBACK_EVENT_REACHED_END, &notify, DVR_TRUE);
          //continue,timeshift mode, when read end,need wait cur recording segment
-         DVR_PB_DG(1, "playback is  send end delay:[%d]reach_end_timeout[%d]ms", delay, reach_end_timeout);
+         DVR_PB_DG(2, "playback is  send end delay:[%d]reach_end_timeout[%d]ms", delay, reach_end_timeout);
          pthread_mutex_lock(&player->lock);
          _dvr_playback_timeoutwait((DVR_PlaybackHandle_t)player, timeout);
          pthread_mutex_unlock(&player->lock);
          continue;
        } else if (ret != DVR_SUCCESS) {
-         //not send event and pause,sleep and go to next time to recheck
+         //not send event and pause,wait for record data and go to next time to recheck
+         int waited;
+         DVR_PB_DG(2, "delay:%d pauselive:%d", delay, _dvr_pauselive_decode_sucess((DVR_PlaybackHandle_t)player));
+         waited = _dvr_playback_wait_data(player, timeout);
          if (delay < cache_time) {
             //delay time is changed and then has data to play, so not start timeout
          } else {
-           reach_end_timeout = reach_end_timeout + timeout;
+           reach_end_timeout = reach_end_timeout + waited;
          }
          cache_time = delay;
-         DVR_PB_DG(1, "delay:%d pauselive:%d", delay, _dvr_pauselive_decode_sucess((DVR_PlaybackHandle_t)player));
-         pthread_mutex_lock(&player->lock);
-         _dvr_playback_timeoutwait((DVR_PlaybackHandle_t)player, timeout);
-         pthread_mutex_unlock(&player->lock);
          continue;
        }
       reach_end_timeout = 0;
@@ -1264,8 +1323,11 @@ static void* _dvr_playback_thread(void *arg)
       pthread_mutex_lock(&player->lock);
       //change next segment success case
       _dvr_playback_sent_transition_ok((DVR_PlaybackHandle_t)player, DVR_FALSE);
-      DVR_PB_DG(1, "_dvr_replay_changed_pid:start");
-      _dvr_replay_changed_pid((DVR_PlaybackHandle_t)player);
+      //nothing to stop or restart if the pids are the same as the last segment's
+      if (_dvr_segment_pids_continuous(player))
+        DVR_PB_DG(2, "segment[%lld] pids unchanged", player->cur_segment.segment_id);
+      else
+        _dvr_replay_changed_pid((DVR_PlaybackHandle_t)player);
       _dvr_check_cur_segment_flag((DVR_PlaybackHandle_t)player);
       read = segment_read(player->r_handle, buf + real_read, buf_len - real_read);
       pthread_mutex_unlock(&player->lock);
@@ -1283,12 +1345,12 @@ static void* _dvr_playback_thread(void *arg)
     }
     reach_end_timeout = 0;
     real_read = real_read + read;
-    wbufs.buf_size = real_read;
-    wbufs.buf_data = buf;
+    wbufs.size = real_read;
+    wbufs.data = buf;
 
     //check read data len,iflen < 0, we need continue
-    if (wbufs.buf_size <= 0 || wbufs.buf_data == NULL) {
-      DVR_PB_DG(1, "error occur read_read [%d],buf=[%p]",wbufs.buf_size, wbufs.buf_data);
+    if (wbufs.size <= 0 || wbufs.data == NULL) {
+      DVR_PB_DG(1, "error occur read_read [%d],buf=[%p]",wbufs.size, wbufs.data);
       real_read = 0;
       player->ts_cache_len = 0;
       continue;
@@ -1298,14 +1360,14 @@ static void* _dvr_playback_thread(void *arg)
       //buf_len is block size value.
       if (real_read < buf_len) {
         //coontinue to read data from file
-        DVR_PB_DG(1, "read buf len[%d] is < block size [%d]", real_read, buf_len);
+        DVR_PB_DG(2, "read buf len[%d] is < block size [%d]", real_read, buf_len);
         pthread_mutex_lock(&player->lock);
          _dvr_playback_timeoutwait((DVR_PlaybackHandle_t)player, timeout);
          pthread_mutex_unlock(&player->lock);
-         DVR_PB_DG(1, "read buf len[%d] is < block size [%d] continue", real_read, buf_len);
+         DVR_PB_DG(2, "read buf len[%d] is < block size [%d] continue", real_read, buf_len);
         continue;
       } else if (real_read > buf_len) {
-        DVR_PB_DG(1, "read buf len[%d] is > block size [%d],this error occur", real_read, buf_len);
+        DVR_PB_DG_RL(1, 1000, "read buf len[%d] is > block size [%d],this error occur", real_read, buf_len);
       }
     }
 
@@ -1316,32 +1378,69 @@ static void* _dvr_playback_thread(void *arg)
       crypto_params.type = DVR_CRYPTO_TYPE_DECRYPT;
       memcpy(crypto_params.location, player->cur_segment.location, strlen(player->cur_segment.location));
       crypto_params.segment_id = player->cur_segment.segment_id;
-      crypto_params.offset = segment_tell_position(player->r_handle) - wbufs.buf_size;
+      crypto_params.offset = segment_tell_position(player->r_handle) - wbufs.size;
       if ((crypto_params.offset % (player->openParams.block_size)) != 0)
-        DVR_PB_DG(1, "offset is not block_size %d", player->openParams.block_size);
+        DVR_PB_DG_RL(1, 1000, "offset is not block_size %d", player->openParams.block_size);
       crypto_params.input_buffer.type = DVR_BUFFER_TYPE_NORMAL;
       crypto_params.input_buffer.addr = (size_t)buf;
       crypto_params.input_buffer.size = real_read;
+      //hand the current and upcoming crypto periods over, so keys can be prefetched
+      crypto_params.nb_periods = segment_get_crypto_periods(player->r_handle, crypto_params.offset,
+          crypto_params.periods, DVR_CRYPTO_MAX_PERIODS);
+      if (crypto_params.nb_periods < 0)
+        crypto_params.nb_periods = 0;
 
       if (player->is_secure_mode) {
         crypto_params.output_buffer.type = DVR_BUFFER_TYPE_SECURE;
         crypto_params.output_buffer.addr = (size_t)player->secure_buffer;
         crypto_params.output_buffer.size = dec_buf_size;
         ret = player->dec_func(&crypto_params, player->dec_userdata);
-        wbufs.buf_data = player->secure_buffer;
-        wbufs.buf_type = TS_INPUT_BUFFER_TYPE_SECURE;
+        wbufs.data = player->secure_buffer;
+        wbufs.type = DVR_PLAYBACK_SINK_BUFFER_SECURE;
       } else {
-        crypto_params.output_buffer.type = DVR_BUFFER_TYPE_NORMAL;
-        crypto_params.output_buffer.addr = (size_t)dec_bufs.buf_data;
-        crypto_params.output_buffer.size = dec_buf_size;
-        ret = player->dec_func(&crypto_params, player->dec_userdata);
-        wbufs.buf_data = dec_bufs.buf_data;
-        wbufs.buf_type = TS_INPUT_BUFFER_TYPE_NORMAL;
+        if (player->openParams.crypto_flags & DVR_CRYPTO_FLAG_IN_PLACE) {
+          crypto_params.flags = DVR_CRYPTO_FLAG_IN_PLACE;
+          crypto_params.output_buffer = crypto_params.input_buffer;
+        } else {
+          if (!dec_bufs.data) {
+            dec_bufs.data = malloc(dec_buf_size);
+            if (!dec_bufs.data) {
+              DVR_PB_DG(1, "Malloc dec buffer failed");
+              goto end;
+            }
+          }
+          crypto_params.output_buffer.type = DVR_BUFFER_TYPE_NORMAL;
+          crypto_params.output_buffer.addr = (size_t)dec_bufs.data;
+          crypto_params.output_buffer.size = dec_buf_size;
+        }
+        /*the workers call the callback the pool was opened with, reopen it on a new one*/
+        if (crypto_pool && (pool_func != player->dec_func || pool_userdata != player->dec_userdata)) {
+          DVR_PB_DG(1, "decrypt callback changed, reopen crypto pool");
+          dvr_crypto_pool_close(crypto_pool);
+          crypto_pool = NULL;
+        }
+        if (crypto_workers > 0 && crypto_pool == NULL) {
+          if (crypto_workers > DVR_CRYPTO_POOL_MAX_WORKERS)
+            crypto_workers = DVR_CRYPTO_POOL_MAX_WORKERS;
+          pool_func = player->dec_func;
+          pool_userdata = player->dec_userdata;
+          if (dvr_crypto_pool_open(&crypto_pool, crypto_workers, crypto_workers,
+                pool_func, pool_userdata) != DVR_SUCCESS) {
+            DVR_PB_DG(1, "open crypto pool failed, decrypt in playback thread");
+            crypto_workers = 0;
+          }
+        }
+        if (crypto_pool)
+          ret = _dvr_playback_decrypt_parallel(crypto_pool, crypto_workers, &crypto_params);
+        else
+          ret = player->dec_func(&crypto_params, player->dec_userdata);
+        wbufs.data = (uint8_t *)crypto_params.output_buffer.addr;
+        wbufs.type = DVR_PLAYBACK_SINK_BUFFER_NORMAL;
       }
       if (ret != DVR_SUCCESS) {
-        DVR_PB_DG(1, "decrypt failed");
+        DVR_PB_DG_RL(1, 1000, "decrypt failed");
       }
-      wbufs.buf_size = crypto_params.output_size;
+      wbufs.size = crypto_params.output_size;
     }
 rewrite:
     if (player->drop_ts == DVR_TRUE) {
@@ -1353,8 +1452,11 @@ rewrite:
       continue;
     }
     player->ts_cache_len = real_read;
-    ret = AmTsPlayer_writeData(player->handle, &wbufs, write_timeout_ms);
-    if (ret == AM_TSPLAYER_OK) {
+    DVR_TRACE_BEGIN("sink_write_data");
+    ret = player->sink->write_data(player->handle, &wbufs, write_timeout_ms);
+    DVR_TRACE_END("sink_write_data");
+    DVR_TRACE_COUNTER("playback_write_len", (ret == DVR_PLAYBACK_SINK_OK) ? wbufs.size : 0);
+    if (ret == DVR_PLAYBACK_SINK_OK) {
       player->ts_cache_len = 0;
       real_read = 0;
       write_success++;
@@ -1368,12 +1470,12 @@ check0:
               goto check0;
             }
       }
-      //DVR_PB_DG(1, "write  write_success:%d wbufs.buf_size:%d", write_success, wbufs.buf_size);
+      //DVR_PB_DG(1, "write  write_success:%d wbufs.size:%d", write_success, wbufs.size);
       continue;
     } else {
-      DVR_PB_DG(1, "write time out write_success:%d wbufs.buf_size:%d systime:%lld",
+      DVR_PB_DG_RL(1, 1000, "write time out write_success:%d wbufs.size:%d systime:%lld",
                     write_success,
-                    wbufs.buf_size,
+                    wbufs.size,
                     _dvr_time_getClock());
 
       write_success = 0;
@@ -1400,8 +1502,11 @@ check1:
   }
 end:
   DVR_PB_DG(1, "playback thread is end");
+  if (crypto_pool)
+    dvr_crypto_pool_close(crypto_pool);
   free(buf);
-  free(dec_bufs.buf_data);
+  if (dec_bufs.data)
+    free(dec_bufs.data);
   return NULL;
 }
 
@@ -1443,8 +1548,7 @@ static int _stop_playback_thread(DVR_PlaybackHandle_t handle)
     pthread_join(player->playback_thread, NULL);
   }
   if (player->r_handle) {
-    segment_close(player->r_handle);
-    player->r_handle = NULL;
+    _dvr_playback_close_segment(player);
   }
   DVR_PB_DG(1, ":end");
   return 0;
@@ -1461,6 +1565,12 @@ int dvr_playback_open(DVR_PlaybackHandle_t *p_handle, DVR_PlaybackOpenParams_t *
   DVR_Playback_t *player;
   pthread_condattr_t  cattr;
 
+  //a library built without AmTsPlayer has no default sink
+  if (!params->sink_ops && !dvr_playback_sink_tsplayer_ops()) {
+    DVR_PB_DG(1, "no decoder sink");
+    return DVR_FAILURE;
+  }
+
   player = (DVR_Playback_t*)calloc(1, sizeof(DVR_Playback_t));
 
   pthread_mutex_init(&player->lock, NULL);
@@ -1488,24 +1598,20 @@ int dvr_playback_open(DVR_PlaybackHandle_t *p_handle, DVR_PlaybackOpenParams_t *
   player->openParams.event_fn = params->event_fn;
   player->openParams.event_userdata = params->event_userdata;
   player->openParams.is_notify_time = params->is_notify_time;
+  player->openParams.crypto_workers = params->crypto_workers;
+  player->openParams.crypto_flags = params->crypto_flags;
+  player->openParams.readahead_size = params->readahead_size;
+  player->access_mode = SEGMENT_ACCESS_NORMAL;
+  memset(&player->cache_stats, 0, sizeof(player->cache_stats));
   player->vendor = params->vendor;
 
   player->has_pids = params->has_pids;
 
   player->handle = params->player_handle ;
+  player->sink = params->sink_ops ? params->sink_ops : dvr_playback_sink_tsplayer_ops();
+  DVR_PB_DG(1, "playback open sink[%s]", player->sink->name);
 
-  AmTsPlayer_getCb(player->handle, &player->player_callback_func, &player->player_callback_userdata);
-  //for test get callback
-  if (0 && player->player_callback_func == NULL) {
-    AmTsPlayer_registerCb(player->handle, _dvr_tsplayer_callback_test, player);
-    AmTsPlayer_getCb(player->handle, &player->player_callback_func, &player->player_callback_userdata);
-    DVR_PB_DG(1, "playback open get callback[%p][%p][%p][%p]",
-                  player->player_callback_func,
-                  player->player_callback_userdata,
-                  _dvr_tsplayer_callback_test,
-                  player);
-  }
-  AmTsPlayer_registerCb(player->handle, _dvr_tsplayer_callback, player);
+  player->sink->register_cb(player->handle, _dvr_sink_callback, player);
 
   //init has audio and video
   player->has_video = DVR_FALSE;
@@ -1574,6 +1680,8 @@ int dvr_playback_close(DVR_PlaybackHandle_t handle) {
   } else {
     DVR_PB_DG(1, ":is stoped state");
   }
+  //the decoder outlives the player, give it back its own callback
+  player->sink->register_cb(player->handle, NULL, NULL);
   DVR_PB_DG(1, ":into");
   pthread_mutex_destroy(&player->lock);
   pthread_cond_destroy(&player->cond);
@@ -1594,9 +1702,9 @@ int dvr_playback_close(DVR_PlaybackHandle_t handle) {
  */
 int dvr_playback_start(DVR_PlaybackHandle_t handle, DVR_PlaybackFlag_t flag) {
   DVR_Playback_t *player = (DVR_Playback_t *) handle;
-  am_tsplayer_video_params    vparams;
-  am_tsplayer_audio_params    aparams;
-  am_tsplayer_audio_params    adparams;
+  DVR_PlaybackSinkVideoParams_t    vparams;
+  DVR_PlaybackSinkAudioParams_t    aparams;
+  DVR_PlaybackSinkAudioParams_t    adparams;
 
   memset(&vparams, 0, sizeof(vparams));
   memset(&aparams, 0, sizeof(aparams));
@@ -1619,7 +1727,7 @@ int dvr_playback_start(DVR_PlaybackHandle_t handle, DVR_PlaybackFlag_t flag) {
     if ((player->play_flag&DVR_PLAYBACK_STARTED_PAUSEDLIVE) == DVR_PLAYBACK_STARTED_PAUSEDLIVE) {
       DVR_PB_DG(1, "[%p]clear pause live flag and clear trick mode", handle);
       player->play_flag = player->play_flag & (~DVR_PLAYBACK_STARTED_PAUSEDLIVE);
-      AmTsPlayer_setTrickMode(player->handle, AV_VIDEO_TRICK_MODE_NONE);
+      player->sink->set_trick_mode(player->handle, DVR_PLAYBACK_SINK_TRICK_NONE);
     }
     DVR_PB_DG(1, "stat is start, not need into start play");
     return DVR_SUCCESS;
@@ -1651,18 +1759,18 @@ int dvr_playback_start(DVR_PlaybackHandle_t handle, DVR_PlaybackFlag_t flag) {
       //if set flag is pause live, we need set trick mode
       if ((player->play_flag&DVR_PLAYBACK_STARTED_PAUSEDLIVE) == DVR_PLAYBACK_STARTED_PAUSEDLIVE) {
         DVR_PB_DG(1, "set trick mode -pauselive flag--");
-        AmTsPlayer_setTrickMode(player->handle, AV_VIDEO_TRICK_MODE_PAUSE_NEXT);
+        player->sink->set_trick_mode(player->handle, DVR_PLAYBACK_SINK_TRICK_PAUSE_NEXT);
       } else if (player->cmd.cur_cmd == DVR_PLAYBACK_CMD_FB
         || player->cmd.cur_cmd == DVR_PLAYBACK_CMD_FF) {
         DVR_PB_DG(1, "set trick mode -fffb--at pause live");
-        AmTsPlayer_setTrickMode(player->handle, AV_VIDEO_TRICK_MODE_PAUSE_NEXT);
+        player->sink->set_trick_mode(player->handle, DVR_PLAYBACK_SINK_TRICK_PAUSE_NEXT);
       } else {
         DVR_PB_DG(1, "set trick mode ---none");
-        AmTsPlayer_setTrickMode(player->handle, AV_VIDEO_TRICK_MODE_NONE);
+        player->sink->set_trick_mode(player->handle, DVR_PLAYBACK_SINK_TRICK_NONE);
       }
-      AmTsPlayer_showVideo(player->handle);
-      AmTsPlayer_setVideoParams(player->handle,  &vparams);
-      AmTsPlayer_startVideoDecoding(player->handle);
+      player->sink->show_video(player->handle);
+      player->sink->set_video_params(player->handle,  &vparams);
+      player->sink->start_video_decoding(player->handle);
     }
 
     DVR_PB_DG(1, "player->cmd.cur_cmd:%d vpid[0x%x]apis[0x%x]", player->cmd.cur_cmd, vparams.pid, aparams.pid);
@@ -1677,26 +1785,26 @@ int dvr_playback_start(DVR_PlaybackHandle_t handle, DVR_PlaybackFlag_t flag) {
       if (IS_FAST_SPEED(player->cmd.speed.speed.speed)) {
         //set fast play
         DVR_PB_DG(1, "start fast");
-        AmTsPlayer_startFast(player->handle, (float)player->cmd.speed.speed.speed/100.0f);
+        player->sink->start_fast(player->handle, (float)player->cmd.speed.speed.speed/100.0f);
       } else {
         if (VALID_PID(adparams.pid)) {
           player->has_ad_audio = DVR_TRUE;
           DVR_PB_DG(1, "start ad audio");
-          AmTsPlayer_setADParams(player->handle,  &adparams);
-          AmTsPlayer_enableADMix(player->handle);
+          player->sink->set_ad_params(player->handle,  &adparams);
+          player->sink->enable_ad_mix(player->handle);
         }
         if (VALID_PID(aparams.pid)) {
           DVR_PB_DG(1, "start audio");
           player->has_audio = DVR_TRUE;
-          AmTsPlayer_setAudioParams(player->handle,  &aparams);
-          AmTsPlayer_startAudioDecoding(player->handle);
+          player->sink->set_audio_params(player->handle,  &aparams);
+          player->sink->start_audio_decoding(player->handle);
         }
       }
       player->cmd.state = DVR_PLAYBACK_STATE_START;
       player->state = DVR_PLAYBACK_STATE_START;
     }
   }
-  DVR_PB_DG(1, "unlock");
+  DVR_PB_DG(2, "unlock");
   pthread_mutex_unlock(&player->lock);
   _start_playback_thread(handle);
   return DVR_SUCCESS;
@@ -1728,6 +1836,7 @@ int dvr_playback_add_segment(DVR_PlaybackHandle_t handle, DVR_PlaybackSegmentInf
 
   DVR_PB_DG(1, "add location [%s]id[%lld]flag[%x]", segment->location, segment->segment_id, info->flags);
   segment->flags = info->flags;
+  segment->summary = info->summary;
 
   //pids
   segment->pids.video.pid = info->pids.video.pid;
@@ -1748,7 +1857,7 @@ int dvr_playback_add_segment(DVR_PlaybackHandle_t handle, DVR_PlaybackSegmentInf
   pthread_mutex_lock(&player->lock);
   list_add_tail(&segment->head, &player->segment_list);
   pthread_mutex_unlock(&player->lock);
-  DVR_PB_DG(1, "unlock");
+  DVR_PB_DG(2, "unlock");
 
   return DVR_SUCCESS;
 }
@@ -1782,7 +1891,7 @@ int dvr_playback_remove_segment(DVR_PlaybackHandle_t handle, uint64_t segment_id
       break;
     }
   }
-  DVR_PB_DG(1, "unlock");
+  DVR_PB_DG(2, "unlock");
   pthread_mutex_unlock(&player->lock);
 
   return DVR_SUCCESS;
@@ -1822,14 +1931,14 @@ int dvr_playback_update_segment_flags(DVR_PlaybackHandle_t handle,
         && (flags & DVR_PLAYBACK_SEGMENT_DISPLAYABLE) == 0) {
         //disable display, mute
         DVR_PB_DG(1, "mute av");
-        AmTsPlayer_hideVideo(player->handle);
-        AmTsPlayer_setAudioMute(player->handle, 1, 1);
+        player->sink->hide_video(player->handle);
+        player->sink->set_audio_mute(player->handle, 1, 1);
       } else if ((segment->flags & DVR_PLAYBACK_SEGMENT_DISPLAYABLE) == 0 &&
           (flags & DVR_PLAYBACK_SEGMENT_DISPLAYABLE) == DVR_PLAYBACK_SEGMENT_DISPLAYABLE) {
         //enable display, unmute
         DVR_PB_DG(1, "unmute av");
-        AmTsPlayer_showVideo(player->handle);
-        AmTsPlayer_setAudioMute(player->handle, 0, 0);
+        player->sink->show_video(player->handle);
+        player->sink->set_audio_mute(player->handle, 0, 0);
       } else {
         //do nothing
       }
@@ -1839,7 +1948,7 @@ int dvr_playback_update_segment_flags(DVR_PlaybackHandle_t handle,
     //continue , only set flag
     segment->flags = flags;
   }
-  DVR_PB_DG(1, "unlock");
+  DVR_PB_DG(2, "unlock");
   pthread_mutex_unlock(&player->lock);
   return DVR_SUCCESS;
 }
@@ -1874,20 +1983,20 @@ static int _do_check_pid_info(DVR_PlaybackHandle_t handle, DVR_StreamInfo_t  now
         //stop vieo
         if (player->has_video == DVR_TRUE) {
           DVR_PB_DG(1, "stop video");
-          AmTsPlayer_stopVideoDecoding(player->handle);
+          player->sink->stop_video_decoding(player->handle);
           player->has_video = DVR_FALSE;
         }
       } else if (type == 1) {
         //stop audio
         if (player->has_audio == DVR_TRUE) {
           DVR_PB_DG(1, "stop audio");
-          AmTsPlayer_stopAudioDecoding(player->handle);
+          player->sink->stop_audio_decoding(player->handle);
           player->has_audio = DVR_FALSE;
         }
       } else if (type == 2) {
         //stop sub audio
         DVR_PB_DG(1, "stop ad");
-        AmTsPlayer_disableADMix(player->handle);
+        player->sink->disable_ad_mix(player->handle);
       } else if (type == 3) {
         //pcr
       }
@@ -1896,55 +2005,55 @@ static int _do_check_pid_info(DVR_PlaybackHandle_t handle, DVR_StreamInfo_t  now
       //start
       if (type == 0) {
         //start vieo
-        am_tsplayer_video_params vparams;
+        DVR_PlaybackSinkVideoParams_t vparams;
         vparams.pid = set_pid.pid;
-        vparams.codectype = _dvr_convert_stream_fmt(set_pid.format, DVR_FALSE);
+        vparams.format = set_pid.format;
         player->has_video = DVR_TRUE;
-        DVR_PB_DG(1, "start video pid[%d]fmt[%d]",vparams.pid, vparams.codectype);
-        AmTsPlayer_setVideoParams(player->handle,  &vparams);
-        AmTsPlayer_startVideoDecoding(player->handle);
+        DVR_PB_DG(1, "start video pid[%d]fmt[%d]",vparams.pid, vparams.format);
+        player->sink->set_video_params(player->handle,  &vparams);
+        player->sink->start_video_decoding(player->handle);
         //playback_device_video_start(player->handle,&vparams);
       } else if (type == 1) {
         //start audio
         if (player->cmd.speed.speed.speed == PLAYBACK_SPEED_X1) {
           if (VALID_PID(set_pids.ad.pid)) {
-            am_tsplayer_audio_params adparams;
+            DVR_PlaybackSinkAudioParams_t adparams;
             adparams.pid = set_pids.ad.pid;
-            adparams.codectype= _dvr_convert_stream_fmt(set_pids.ad.format, DVR_TRUE);
-            DVR_PB_DG(1, "start ad audio pid[%d]fmt[%d]",adparams.pid, adparams.codectype);
-            AmTsPlayer_setADParams(player->handle,  &adparams);
-            AmTsPlayer_enableADMix(player->handle);
+            adparams.format = set_pids.ad.format;
+            DVR_PB_DG(1, "start ad audio pid[%d]fmt[%d]",adparams.pid, adparams.format);
+            player->sink->set_ad_params(player->handle,  &adparams);
+            player->sink->enable_ad_mix(player->handle);
           }
 
-          am_tsplayer_audio_params aparams;
+          DVR_PlaybackSinkAudioParams_t aparams;
 
           memset(&aparams, 0, sizeof(aparams));
 
           aparams.pid = set_pid.pid;
-          aparams.codectype= _dvr_convert_stream_fmt(set_pid.format, DVR_TRUE);
+          aparams.format = set_pid.format;
           player->has_audio = DVR_TRUE;
-          DVR_PB_DG(1, "start audio pid[%d]fmt[%d]",aparams.pid, aparams.codectype);
-          AmTsPlayer_setAudioParams(player->handle,  &aparams);
-          AmTsPlayer_startAudioDecoding(player->handle);
+          DVR_PB_DG(1, "start audio pid[%d]fmt[%d]",aparams.pid, aparams.format);
+          player->sink->set_audio_params(player->handle,  &aparams);
+          player->sink->start_audio_decoding(player->handle);
           //playback_device_audio_start(player->handle,&aparams);
         }
       } else if (type == 2) {
         if (player->cmd.speed.speed.speed == PLAYBACK_SPEED_X1) {
-          am_tsplayer_audio_params aparams;
+          DVR_PlaybackSinkAudioParams_t aparams;
 
           memset(&aparams, 0, sizeof(aparams));
           aparams.pid = set_pid.pid;
-          aparams.codectype= _dvr_convert_stream_fmt(set_pid.format, DVR_TRUE);
+          aparams.format = set_pid.format;
           player->has_audio = DVR_TRUE;
-          DVR_PB_DG(1, "start ad audio pid[%d]fmt[%d]",aparams.pid, aparams.codectype);
-          AmTsPlayer_setADParams(player->handle,  &aparams);
-          AmTsPlayer_enableADMix(player->handle);
+          DVR_PB_DG(1, "start ad audio pid[%d]fmt[%d]",aparams.pid, aparams.format);
+          player->sink->set_ad_params(player->handle,  &aparams);
+          player->sink->enable_ad_mix(player->handle);
           //playback_device_audio_start(player->handle,&aparams);
         }
       } else if (type == 3) {
         //pcr
         DVR_PB_DG(1, "start set pcr [%d]", set_pid.pid);
-        AmTsPlayer_setPcrPid(player->handle, set_pid.pid);
+        player->sink->set_pcr_pid(player->handle, set_pid.pid);
       }
       //audio and video all close
       if (!player->has_audio && !player->has_video) {
@@ -2094,12 +2203,20 @@ int dvr_playback_update_segment_pids(DVR_PlaybackHandle_t handle, uint64_t segme
       }
       //save pids info
       DVR_PB_DG(1, ":apid :%d %d", segment->pids.audio.pid, p_pids->audio.pid);
+      if (memcmp(&segment->pids, p_pids, sizeof(DVR_PlaybackPids_t))) {
+        //the summary no longer tells the pids played around this segment
+        segment->summary.flags = 0;
+        if (!list_is_last(&segment->head, &player->segment_list))
+          list_next_entry(segment, head)->summary.flags = 0;
+        if (player->cur_segment_id == segment_id)
+          player->cur_segment.summary.flags = 0;
+      }
       memcpy(&segment->pids, p_pids, sizeof(DVR_PlaybackPids_t));
       DVR_PB_DG(1, ":cp apid :%d %d", segment->pids.audio.pid, p_pids->audio.pid);
       break;
     }
   }
-  DVR_PB_DG(1, "unlock");
+  DVR_PB_DG(2, "unlock");
   pthread_mutex_unlock(&player->lock);
   return DVR_SUCCESS;
 }
@@ -2128,25 +2245,25 @@ int dvr_playback_stop(DVR_PlaybackHandle_t handle, DVR_Bool_t clear) {
   DVR_PB_DG(1, "lock");
   pthread_mutex_lock(&player->lock);
   DVR_PB_DG(1, ":get lock into stop fast");
-  AmTsPlayer_stopFast(player->handle);
+  player->sink->stop_fast(player->handle);
   if (player->has_video) {
-    AmTsPlayer_resumeVideoDecoding(player->handle);
+    player->sink->resume_video_decoding(player->handle);
   }
   if (player->has_audio) {
-    AmTsPlayer_resumeAudioDecoding(player->handle);
+    player->sink->resume_audio_decoding(player->handle);
   }
   if (player->has_video) {
     player->has_video = DVR_FALSE;
-    AmTsPlayer_hideVideo(player->handle);
-    AmTsPlayer_stopVideoDecoding(player->handle);
+    player->sink->hide_video(player->handle);
+    player->sink->stop_video_decoding(player->handle);
   }
   if (player->has_audio) {
     player->has_audio = DVR_FALSE;
-    AmTsPlayer_stopAudioDecoding(player->handle);
+    player->sink->stop_audio_decoding(player->handle);
   }
   if (player->has_ad_audio) {
     player->has_ad_audio =DVR_FALSE;
-    AmTsPlayer_disableADMix(player->handle);
+    player->sink->disable_ad_mix(player->handle);
   }
 
   player->cmd.last_cmd = player->cmd.cur_cmd;
@@ -2155,7 +2272,7 @@ int dvr_playback_stop(DVR_PlaybackHandle_t handle, DVR_Bool_t clear) {
   player->state = DVR_PLAYBACK_STATE_STOP;
   player->cur_segment_id = UINT64_MAX;
   player->segment_is_open = DVR_FALSE;
-  DVR_PB_DG(1, "unlock");
+  DVR_PB_DG(2, "unlock");
   DVR_PB_DG(1, "player->state %s", _dvr_playback_state_toString(player->state));
   pthread_mutex_unlock(&player->lock);
   return DVR_SUCCESS;
@@ -2167,7 +2284,7 @@ int dvr_playback_stop(DVR_PlaybackHandle_t handle, DVR_Bool_t clear) {
  * \return Error code
  */
 
-int dvr_playback_audio_start(DVR_PlaybackHandle_t handle, am_tsplayer_audio_params *param, am_tsplayer_audio_params *adparam) {
+int dvr_playback_audio_start(DVR_PlaybackHandle_t handle, DVR_PlaybackSinkAudioParams_t *param, DVR_PlaybackSinkAudioParams_t *adparam) {
   DVR_Playback_t *player = (DVR_Playback_t *) handle;
 
   if (player == NULL) {
@@ -2182,21 +2299,21 @@ int dvr_playback_audio_start(DVR_PlaybackHandle_t handle, am_tsplayer_audio_para
   if (VALID_PID(adparam->pid)) {
     player->has_ad_audio = DVR_TRUE;
     DVR_PB_DG(1, "start ad audio");
-    AmTsPlayer_setADParams(player->handle, adparam);
-    AmTsPlayer_enableADMix(player->handle);
+    player->sink->set_ad_params(player->handle, adparam);
+    player->sink->enable_ad_mix(player->handle);
   }
   if (VALID_PID(param->pid)) {
     DVR_PB_DG(1, "start audio");
     player->has_audio = DVR_TRUE;
-    AmTsPlayer_setAudioParams(player->handle, param);
-    AmTsPlayer_startAudioDecoding(player->handle);
+    player->sink->set_audio_params(player->handle, param);
+    player->sink->start_audio_decoding(player->handle);
   }
 
   player->cmd.last_cmd = player->cmd.cur_cmd;
   player->cmd.cur_cmd = DVR_PLAYBACK_CMD_ASTART;
   player->cmd.state = DVR_PLAYBACK_STATE_START;
   player->state = DVR_PLAYBACK_STATE_START;
-  DVR_PB_DG(1, "unlock");
+  DVR_PB_DG(2, "unlock");
   pthread_mutex_unlock(&player->lock);
   return DVR_SUCCESS;
 }
@@ -2227,18 +2344,18 @@ int dvr_playback_audio_stop(DVR_PlaybackHandle_t handle) {
 
   if (player->has_audio) {
     player->has_audio = DVR_FALSE;
-    AmTsPlayer_stopAudioDecoding(player->handle);
+    player->sink->stop_audio_decoding(player->handle);
   }
 
   if (player->has_ad_audio) {
     player->has_ad_audio =DVR_FALSE;
-    AmTsPlayer_disableADMix(player->handle);
+    player->sink->disable_ad_mix(player->handle);
   }
 
   player->cmd.last_cmd = player->cmd.cur_cmd;
   player->cmd.cur_cmd = DVR_PLAYBACK_CMD_ASTOP;
 
-  DVR_PB_DG(1, "unlock");
+  DVR_PB_DG(2, "unlock");
   pthread_mutex_unlock(&player->lock);
   return DVR_SUCCESS;
 }
@@ -2248,7 +2365,7 @@ int dvr_playback_audio_stop(DVR_PlaybackHandle_t handle) {
  * \retval DVR_SUCCESS On success
  * \return Error code
  */
-int dvr_playback_video_start(DVR_PlaybackHandle_t handle, am_tsplayer_video_params *param) {
+int dvr_playback_video_start(DVR_PlaybackHandle_t handle, DVR_PlaybackSinkVideoParams_t *param) {
   DVR_Playback_t *player = (DVR_Playback_t *) handle;
 
   if (player == NULL) {
@@ -2261,21 +2378,21 @@ int dvr_playback_video_start(DVR_PlaybackHandle_t handle, am_tsplayer_video_para
   DVR_PB_DG(1, "lock");
   pthread_mutex_lock(&player->lock);
   player->has_video = DVR_TRUE;
-  AmTsPlayer_setVideoParams(player->handle, param);
-  AmTsPlayer_startVideoDecoding(player->handle);
+  player->sink->set_video_params(player->handle, param);
+  player->sink->start_video_decoding(player->handle);
 
   //playback_device_video_start(player->handle , param);
   //if set flag is pause live, we need set trick mode
   if ((player->play_flag&DVR_PLAYBACK_STARTED_PAUSEDLIVE) == DVR_PLAYBACK_STARTED_PAUSEDLIVE) {
     DVR_PB_DG(1, "settrick mode at video start");
-    AmTsPlayer_setTrickMode(player->handle, AV_VIDEO_TRICK_MODE_PAUSE_NEXT);
+    player->sink->set_trick_mode(player->handle, DVR_PLAYBACK_SINK_TRICK_PAUSE_NEXT);
     //playback_device_trick_mode(player->handle, 1);
   }
   player->cmd.last_cmd = player->cmd.cur_cmd;
   player->cmd.cur_cmd = DVR_PLAYBACK_CMD_VSTART;
   player->cmd.state = DVR_PLAYBACK_STATE_START;
   player->state = DVR_PLAYBACK_STATE_START;
-  DVR_PB_DG(1, "unlock");
+  DVR_PB_DG(2, "unlock");
   pthread_mutex_unlock(&player->lock);
   return DVR_SUCCESS;
 }
@@ -2306,13 +2423,13 @@ int dvr_playback_video_stop(DVR_PlaybackHandle_t handle) {
 
   player->has_video = DVR_FALSE;
 
-  AmTsPlayer_stopVideoDecoding(player->handle);
+  player->sink->stop_video_decoding(player->handle);
   //playback_device_video_stop(player->handle);
 
   player->cmd.last_cmd = player->cmd.cur_cmd;
   player->cmd.cur_cmd = DVR_PLAYBACK_CMD_VSTOP;
 
-  DVR_PB_DG(1, "unlock");
+  DVR_PB_DG(2, "unlock");
   pthread_mutex_unlock(&player->lock);
   return DVR_SUCCESS;
 }
@@ -2337,9 +2454,9 @@ int dvr_playback_pause(DVR_PlaybackHandle_t handle, DVR_Bool_t flush) {
   pthread_mutex_lock(&player->lock);
   DVR_PB_DG(1, "get lock");
   if (player->has_video)
-    AmTsPlayer_pauseVideoDecoding(player->handle);
+    player->sink->pause_video_decoding(player->handle);
   if (player->has_audio)
-    AmTsPlayer_pauseAudioDecoding(player->handle);
+    player->sink->pause_audio_decoding(player->handle);
 
   //playback_device_pause(player->handle);
   if (player->cmd.cur_cmd == DVR_PLAYBACK_CMD_FF ||
@@ -2353,7 +2470,7 @@ int dvr_playback_pause(DVR_PlaybackHandle_t handle, DVR_Bool_t flush) {
     player->state = DVR_PLAYBACK_STATE_PAUSE;
   }
   pthread_mutex_unlock(&player->lock);
-  DVR_PB_DG(1, "unlock");
+  DVR_PB_DG(2, "unlock");
 
   return DVR_SUCCESS;
 }
@@ -2371,9 +2488,9 @@ static int _dvr_cmd(DVR_PlaybackHandle_t handle, int cmd)
   //get video params and audio params
   DVR_PB_DG(1, "lock");
   pthread_mutex_lock(&player->lock);
-  am_tsplayer_video_params vparams;
-  am_tsplayer_audio_params aparams;
-  am_tsplayer_audio_params adparams;
+  DVR_PlaybackSinkVideoParams_t vparams;
+  DVR_PlaybackSinkAudioParams_t aparams;
+  DVR_PlaybackSinkAudioParams_t adparams;
   uint64_t segmentid = player->cur_segment_id;
 
   memset(&vparams, 0, sizeof(vparams));
@@ -2479,25 +2596,25 @@ int dvr_playback_resume(DVR_PlaybackHandle_t handle) {
     pthread_mutex_lock(&player->lock);
     player->first_frame = 0;
     if (player->has_video)
-          AmTsPlayer_pauseVideoDecoding(player->handle);
+          player->sink->pause_video_decoding(player->handle);
     if (player->has_audio)
-          AmTsPlayer_pauseAudioDecoding(player->handle);
+          player->sink->pause_audio_decoding(player->handle);
 
     if (player->has_video) {
       DVR_PB_DG(1, "dvr_playback_resume set trick mode none");
-      AmTsPlayer_setTrickMode(player->handle, AV_VIDEO_TRICK_MODE_NONE);
-      AmTsPlayer_resumeVideoDecoding(player->handle);
+      player->sink->set_trick_mode(player->handle, DVR_PLAYBACK_SINK_TRICK_NONE);
+      player->sink->resume_video_decoding(player->handle);
     }
     if (player->has_audio) {
-      AmTsPlayer_resumeAudioDecoding(player->handle);
+      player->sink->resume_audio_decoding(player->handle);
     }
     //check is has audio param,if has audio .we need start audio,
     //we will stop audio when ff fb, if reach end, we will pause.so we need
     //start audio when resume play
 
-    am_tsplayer_video_params vparams;
-    am_tsplayer_audio_params aparams;
-    am_tsplayer_audio_params adparams;
+    DVR_PlaybackSinkVideoParams_t vparams;
+    DVR_PlaybackSinkAudioParams_t aparams;
+    DVR_PlaybackSinkAudioParams_t adparams;
     uint64_t segmentid = player->cur_segment_id;
 
     memset(&vparams, 0, sizeof(vparams));
@@ -2507,14 +2624,14 @@ int dvr_playback_resume(DVR_PlaybackHandle_t handle) {
     if (player->has_ad_audio == DVR_FALSE && VALID_PID(adparams.pid) && (player->cmd.speed.speed.speed == PLAYBACK_SPEED_X1)) {
       player->has_ad_audio = DVR_TRUE;
       DVR_PB_DG(1, "start ad audio");
-      AmTsPlayer_setADParams(player->handle,  &adparams);
-      AmTsPlayer_enableADMix(player->handle);
+      player->sink->set_ad_params(player->handle,  &adparams);
+      player->sink->enable_ad_mix(player->handle);
     }
 
     if (player->has_audio == DVR_FALSE && VALID_PID(aparams.pid) && (player->cmd.speed.speed.speed == PLAYBACK_SPEED_X1)) {
       player->has_audio = DVR_TRUE;
-      AmTsPlayer_setAudioParams(player->handle, &aparams);
-      AmTsPlayer_startAudioDecoding(player->handle);
+      player->sink->set_audio_params(player->handle, &aparams);
+      player->sink->start_audio_decoding(player->handle);
     } else {
       DVR_PB_DG(1, "aparams.pid:%d player->has_audio:%d speed:%d", aparams.pid, player->has_audio, player->cmd.speed.speed.speed);
     }
@@ -2529,22 +2646,22 @@ int dvr_playback_resume(DVR_PlaybackHandle_t handle) {
       player->cmd.state = DVR_PLAYBACK_STATE_START;
       player->state = DVR_PLAYBACK_STATE_START;
     }
-    DVR_PB_DG(1, "unlock");
+    DVR_PB_DG(2, "unlock");
     pthread_mutex_unlock(&player->lock);
   } else if (player->state == DVR_PLAYBACK_STATE_PAUSE){
     player->first_frame = 0;
     if (player->has_video)
-          AmTsPlayer_pauseVideoDecoding(player->handle);
+          player->sink->pause_video_decoding(player->handle);
     if (player->has_audio)
-          AmTsPlayer_pauseAudioDecoding(player->handle);
+          player->sink->pause_audio_decoding(player->handle);
 
     if (player->has_video) {
       DVR_PB_DG(1, "dvr_playback_resume set trick mode none 1");
-      AmTsPlayer_setTrickMode(player->handle, AV_VIDEO_TRICK_MODE_NONE);
-      AmTsPlayer_resumeVideoDecoding(player->handle);
+      player->sink->set_trick_mode(player->handle, DVR_PLAYBACK_SINK_TRICK_NONE);
+      player->sink->resume_video_decoding(player->handle);
     }
     if (player->has_audio)
-      AmTsPlayer_resumeAudioDecoding(player->handle);
+      player->sink->resume_audio_decoding(player->handle);
     DVR_PB_DG(1, "set start state cur cmd[%d]", player->cmd.cur_cmd);
     player->cmd.state = DVR_PLAYBACK_STATE_START;
     player->state = DVR_PLAYBACK_STATE_START;
@@ -2556,18 +2673,18 @@ int dvr_playback_resume(DVR_PlaybackHandle_t handle) {
       pthread_mutex_lock(&player->lock);
       player->first_frame = 0;
       if (player->has_video)
-          AmTsPlayer_pauseVideoDecoding(player->handle);
+          player->sink->pause_video_decoding(player->handle);
       if (player->has_audio)
-          AmTsPlayer_pauseAudioDecoding(player->handle);
+          player->sink->pause_audio_decoding(player->handle);
       //clear flag
       DVR_PB_DG(1, "clear pause live flag cur cmd[%d]", player->cmd.cur_cmd);
       player->play_flag = player->play_flag & (~DVR_PLAYBACK_STARTED_PAUSEDLIVE);
-      AmTsPlayer_setTrickMode(player->handle, AV_VIDEO_TRICK_MODE_NONE);
+      player->sink->set_trick_mode(player->handle, DVR_PLAYBACK_SINK_TRICK_NONE);
       if (player->has_video) {
-        AmTsPlayer_resumeVideoDecoding(player->handle);
+        player->sink->resume_video_decoding(player->handle);
       }
       if (player->has_audio)
-        AmTsPlayer_resumeAudioDecoding(player->handle);
+        player->sink->resume_audio_decoding(player->handle);
 
       pthread_mutex_unlock(&player->lock);
     }
@@ -2632,13 +2749,7 @@ int dvr_playback_setlimit(DVR_PlaybackHandle_t handle, uint64_t time, int32_t li
   return DVR_SUCCESS;
 }
 
-/**\brief seek
- * \param[in] handle playback handle
- * \param[in] time_offset time offset base cur segment
- * \retval DVR_SUCCESS On success
- * \return Error code
- */
-int dvr_playback_seek(DVR_PlaybackHandle_t handle, uint64_t segment_id, uint32_t time_offset) {
+static int _do_playback_seek(DVR_PlaybackHandle_t handle, uint64_t segment_id, uint32_t time_offset) {
   DVR_Playback_t *player = (DVR_Playback_t *) handle;
   int ret = DVR_SUCCESS;
   if (player == NULL) {
@@ -2647,6 +2758,8 @@ int dvr_playback_seek(DVR_PlaybackHandle_t handle, uint64_t segment_id, uint32_t
   }
 
   DVR_PB_DG(1, "lock segment_id %llu cur id %llu time_offset %u cur end: %d player->state:%d", segment_id,player->cur_segment_id, (uint32_t)time_offset, _dvr_get_end_time(handle), player->state);
+  if (player->sink->notify_seek)
+    player->sink->notify_seek(player->handle);
   pthread_mutex_lock(&player->lock);
 
   int offset = -1;
@@ -2708,7 +2821,7 @@ int dvr_playback_seek(DVR_PlaybackHandle_t handle, uint64_t segment_id, uint32_t
   //pause state if need to replayer false
   if (player->state == DVR_PLAYBACK_STATE_STOP) {
     //only seek file,not start
-    DVR_PB_DG(1, "unlock");
+    DVR_PB_DG(2, "unlock");
     pthread_mutex_unlock(&player->lock);
     return DVR_SUCCESS;
   }
@@ -2718,22 +2831,22 @@ int dvr_playback_seek(DVR_PlaybackHandle_t handle, uint64_t segment_id, uint32_t
 
   if (player->has_video) {
     player->has_video = DVR_FALSE;
-    AmTsPlayer_stopVideoDecoding(player->handle);
+    player->sink->stop_video_decoding(player->handle);
   }
 
   if (player->has_audio) {
     player->has_audio =DVR_FALSE;
-    AmTsPlayer_stopAudioDecoding(player->handle);
+    player->sink->stop_audio_decoding(player->handle);
   }
   if (player->has_ad_audio) {
       player->has_ad_audio =DVR_FALSE;
-      AmTsPlayer_disableADMix(player->handle);
+      player->sink->disable_ad_mix(player->handle);
   }
 
   //start play
-  am_tsplayer_video_params    vparams;
-  am_tsplayer_audio_params    aparams;
-  am_tsplayer_audio_params    adparams;
+  DVR_PlaybackSinkVideoParams_t    vparams;
+  DVR_PlaybackSinkAudioParams_t    aparams;
+  DVR_PlaybackSinkAudioParams_t    adparams;
 
   memset(&vparams, 0, sizeof(vparams));
   memset(&aparams, 0, sizeof(aparams));
@@ -2760,28 +2873,28 @@ int dvr_playback_seek(DVR_PlaybackHandle_t handle, uint64_t segment_id, uint32_t
         player->speed <= -1.0f) {
         //if is pause state. we need set trick mode.
         DVR_PB_DG(1, "seek set trick mode player->speed [%f]", player->speed);
-        AmTsPlayer_setTrickMode(player->handle, AV_VIDEO_TRICK_MODE_PAUSE_NEXT);
+        player->sink->set_trick_mode(player->handle, DVR_PLAYBACK_SINK_TRICK_PAUSE_NEXT);
       }
-      AmTsPlayer_setVideoParams(player->handle, &vparams);
-      AmTsPlayer_startVideoDecoding(player->handle);
+      player->sink->set_video_params(player->handle, &vparams);
+      player->sink->start_video_decoding(player->handle);
       if (IS_KERNEL_SPEED(player->cmd.speed.speed.speed) &&
         player->cmd.speed.speed.speed != PLAYBACK_SPEED_X1) {
-         AmTsPlayer_startFast(player->handle, (float)player->cmd.speed.speed.speed/(float)100);
+         player->sink->start_fast(player->handle, (float)player->cmd.speed.speed.speed/(float)100);
       } else if (player->cmd.speed.speed.speed == PLAYBACK_SPEED_X1) {
-        AmTsPlayer_stopFast(player->handle);
+        player->sink->stop_fast(player->handle);
       }
       player->has_video = DVR_TRUE;
     }
     if (VALID_PID(adparams.pid) && player->speed == 1.0) {
       player->has_ad_audio = DVR_TRUE;
       DVR_PB_DG(1, "start ad audio");
-      AmTsPlayer_setADParams(player->handle,  &adparams);
-      AmTsPlayer_enableADMix(player->handle);
+      player->sink->set_ad_params(player->handle,  &adparams);
+      player->sink->enable_ad_mix(player->handle);
     }
     if (VALID_PID(aparams.pid) && player->speed == 1.0) {
       DVR_PB_DG(1, "start audio seek");
-      AmTsPlayer_setAudioParams(player->handle, &aparams);
-      AmTsPlayer_startAudioDecoding(player->handle);
+      player->sink->set_audio_params(player->handle, &aparams);
+      player->sink->start_audio_decoding(player->handle);
       player->has_audio = DVR_TRUE;
     }
   }
@@ -2804,28 +2917,43 @@ int dvr_playback_seek(DVR_PlaybackHandle_t handle, uint64_t segment_id, uint32_t
     player->state = DVR_PLAYBACK_STATE_START;
   }
   player->last_send_time_id = UINT64_MAX;
-  DVR_PB_DG(1, "unlock");
+  DVR_PB_DG(2, "unlock");
   pthread_mutex_unlock(&player->lock);
 
   return DVR_SUCCESS;
 }
 
+/**\brief seek
+ * \param[in] handle playback handle
+ * \param[in] time_offset time offset base cur segment
+ * \retval DVR_SUCCESS On success
+ * \return Error code
+ */
+int dvr_playback_seek(DVR_PlaybackHandle_t handle, uint64_t segment_id, uint32_t time_offset) {
+  int ret;
+
+  DVR_TRACE_BEGIN("seek");
+  ret = _do_playback_seek(handle, segment_id, time_offset);
+  DVR_TRACE_END("seek");
+  return ret;
+}
+
 static int _dvr_get_cur_time(DVR_PlaybackHandle_t handle) {
   //get cur time of segment
   DVR_Playback_t *player = (DVR_Playback_t *) handle;
 
-  if (player == NULL || player->handle == (am_tsplayer_handle)NULL) {
+  if (player == NULL || player->handle == NULL) {
     DVR_PB_DG(1, "player is NULL");
     return DVR_FAILURE;
   }
 
   int64_t cache = 0;//defalut es buf cache 500ms
-  AmTsPlayer_getDelayTime(player->handle, &cache);
+  player->sink->get_delay_time(player->handle, &cache);
   pthread_mutex_lock(&player->segment_lock);
   loff_t pos = segment_tell_position(player->r_handle) -player->ts_cache_len;
   uint64_t cur = segment_tell_position_time(player->r_handle, pos);
   pthread_mutex_unlock(&player->segment_lock);
-  DVR_PB_DG(1, "get cur time [%lld] cache:%lld cur id [%lld]last id [%lld] pb cache len [%d] [%lld]", cur, cache, player->cur_segment_id,player->last_send_time_id,  player->ts_cache_len, pos);
+  DVR_PB_DG(2, "get cur time [%lld] cache:%lld cur id [%lld]last id [%lld] pb cache len [%d] [%lld]", cur, cache, player->cur_segment_id,player->last_send_time_id,  player->ts_cache_len, pos);
   if (player->state == DVR_PLAYBACK_STATE_STOP) {
     cache = 0;
   }
@@ -2844,12 +2972,12 @@ static int _dvr_get_play_cur_time(DVR_PlaybackHandle_t handle, uint64_t *id) {
 
   int64_t cache = 0;//defalut es buf cache 500ms
   int cur_time = 0;
-  AmTsPlayer_getDelayTime(player->handle, &cache);
+  player->sink->get_delay_time(player->handle, &cache);
   pthread_mutex_lock(&player->segment_lock);
   loff_t pos = segment_tell_position(player->r_handle) -player->ts_cache_len;
   uint64_t cur = segment_tell_position_time(player->r_handle, pos);
   pthread_mutex_unlock(&player->segment_lock);
-  DVR_PB_DG(1, "get play cur time [%lld] cache:%lld cur id [%lld]last id [%lld] pb cache len [%d] [%lld]", cur, cache, player->cur_segment_id,player->last_send_time_id,  player->ts_cache_len, pos);
+  DVR_PB_DG(2, "get play cur time [%lld] cache:%lld cur id [%lld]last id [%lld] pb cache len [%d] [%lld]", cur, cache, player->cur_segment_id,player->last_send_time_id,  player->ts_cache_len, pos);
   if (player->state == DVR_PLAYBACK_STATE_STOP) {
     cache = 0;
   }
@@ -2859,7 +2987,7 @@ static int _dvr_get_play_cur_time(DVR_PlaybackHandle_t handle, uint64_t *id) {
   } else if (player->last_segment_tatol > 0) {
       cur_time = (int)(player->last_segment_tatol - (cache - cur));
       *id = player->last_segment_id;
-      DVR_PB_DG(1, "get play cur time[%lld][%lld][%d]", player->last_segment_id, player->cur_segment_id, player->last_segment_tatol);
+      DVR_PB_DG(2, "get play cur time[%lld][%lld][%d]", player->last_segment_id, player->cur_segment_id, player->last_segment_tatol);
   } else {
       cur_time = 0;
       *id =  player->cur_segment_id;
@@ -3044,7 +3172,7 @@ static int _dvr_playback_calculate_seekpos(DVR_PlaybackHandle_t handle) {
     player->fffb_current = player->fffb_start;
     //get segment current time pos
     player->fffb_start_pcr = _dvr_get_cur_time(handle);
-    DVR_PB_DG(1, "calculate seek pos player->fffb_start_pcr[%d]ms, speed[%f]",
+    DVR_PB_DG(2, "calculate seek pos player->fffb_start_pcr[%d]ms, speed[%f]",
                   player->fffb_start_pcr, player->speed);
     t_diff = 0;
     //default first time 2s seek
@@ -3093,13 +3221,18 @@ static int _dvr_playback_calculate_seekpos(DVR_PlaybackHandle_t handle) {
       }
       if (segment_seek(player->r_handle, seek_time, player->openParams.block_size) == DVR_FAILURE) {
         seek_time = 0;
+      } else if (player->openParams.readahead_size >= 0) {
+        //prefetch the target of the next trick step
+        int next_time = seek_time + FFFB_SLEEP_TIME * player->speed;
+        if (next_time > 0)
+          segment_prefetch(player->r_handle, next_time, _dvr_playback_readahead_size(player) / 4);
       }
       pthread_mutex_unlock(&player->segment_lock);
     } else {
       //
       DVR_PB_DG(1, "segment not open,can not seek");
     }
-    DVR_PB_DG(1, "calculate seek pos seek_time[%d]ms, speed[%f]id[%lld]cur [%d]",
+    DVR_PB_DG(2, "calculate seek pos seek_time[%d]ms, speed[%f]id[%lld]cur [%d]",
                   seek_time,
                   player->speed,
                   player->cur_segment_id,
@@ -3121,25 +3254,25 @@ static int _dvr_playback_fffb_replay(DVR_PlaybackHandle_t handle) {
 
   //stop
   if (player->has_video) {
-    DVR_PB_DG(1, "fffb stop video");
-    AmTsPlayer_stopVideoDecoding(player->handle);
+    DVR_PB_DG(2, "fffb stop video");
+    player->sink->stop_video_decoding(player->handle);
   }
   if (player->has_audio) {
-    DVR_PB_DG(1, "fffb stop audio");
+    DVR_PB_DG(2, "fffb stop audio");
     player->has_audio =DVR_FALSE;
-    AmTsPlayer_stopAudioDecoding(player->handle);
+    player->sink->stop_audio_decoding(player->handle);
   }
   if (player->has_ad_audio) {
-    DVR_PB_DG(1, "fffb stop audio");
+    DVR_PB_DG(2, "fffb stop audio");
     player->has_ad_audio =DVR_FALSE;
-    AmTsPlayer_disableADMix(player->handle);
+    player->sink->disable_ad_mix(player->handle);
   }
 
   //start video and audio
 
-  am_tsplayer_video_params    vparams;
-  am_tsplayer_audio_params    aparams;
-  am_tsplayer_audio_params    adparams;
+  DVR_PlaybackSinkVideoParams_t    vparams;
+  DVR_PlaybackSinkAudioParams_t    aparams;
+  DVR_PlaybackSinkAudioParams_t    adparams;
 
   memset(&vparams, 0, sizeof(vparams));
   memset(&aparams, 0, sizeof(aparams));
@@ -3159,25 +3292,25 @@ static int _dvr_playback_fffb_replay(DVR_PlaybackHandle_t handle) {
 
   if (VALID_PID(vparams.pid)) {
     player->has_video = DVR_TRUE;
-    DVR_PB_DG(1, "fffb start video");
+    DVR_PB_DG(2, "fffb start video");
     //DVR_PB_DG(1, "fffb start video and save last frame");
     //AmTsPlayer_setVideoBlackOut(player->handle, 0);
-    AmTsPlayer_setTrickMode(player->handle, AV_VIDEO_TRICK_MODE_NONE);
-    AmTsPlayer_setTrickMode(player->handle, AV_VIDEO_TRICK_MODE_PAUSE_NEXT);
-    AmTsPlayer_setVideoParams(player->handle, &vparams);
-    AmTsPlayer_startVideoDecoding(player->handle);
+    player->sink->set_trick_mode(player->handle, DVR_PLAYBACK_SINK_TRICK_NONE);
+    player->sink->set_trick_mode(player->handle, DVR_PLAYBACK_SINK_TRICK_PAUSE_NEXT);
+    player->sink->set_video_params(player->handle, &vparams);
+    player->sink->start_video_decoding(player->handle);
     //playback_device_video_start(player->handle , &vparams);
     //if set flag is pause live, we need set trick mode
     //playback_device_trick_mode(player->handle, 1);
   }
   //fffb mode need stop fast;
-  DVR_PB_DG(1, "stop fast");
-  AmTsPlayer_stopFast(player->handle);
+  DVR_PB_DG(2, "stop fast");
+  player->sink->stop_fast(player->handle);
   //pthread_mutex_unlock(&player->lock);
   return 0;
 }
 
-static int _dvr_playback_fffb(DVR_PlaybackHandle_t handle) {
+static int _do_playback_fffb(DVR_PlaybackHandle_t handle) {
   DVR_Playback_t *player = (DVR_Playback_t *) handle;
   if (player == NULL) {
     DVR_PB_DG(1, "player is NULL");
@@ -3185,11 +3318,11 @@ static int _dvr_playback_fffb(DVR_PlaybackHandle_t handle) {
   }
 
   player->first_frame = 0;
-  DVR_PB_DG(1, "lock  speed [%f]", player->speed);
+  DVR_PB_DG(2, "lock  speed [%f]", player->speed);
   pthread_mutex_lock(&player->lock);
 
   int seek_time = _dvr_playback_calculate_seekpos(handle);
-  DVR_PB_DG(1, "get lock  speed [%f]id [%lld]seek_time[%d]", player->speed, player->cur_segment_id, seek_time);
+  DVR_PB_DG(2, "get lock  speed [%f]id [%lld]seek_time[%d]", player->speed, player->cur_segment_id, seek_time);
 
   if (_dvr_has_next_segmentId(handle, player->cur_segment_id) == DVR_FAILURE && seek_time < FB_MIX_SEEK_TIME && IS_FB(player->speed)) {
       //seek time set 0
@@ -3219,11 +3352,20 @@ static int _dvr_playback_fffb(DVR_PlaybackHandle_t handle) {
   _dvr_playback_fffb_replay(handle);
 
   pthread_mutex_unlock(&player->lock);
-  DVR_PB_DG(1, "unlock");
+  DVR_PB_DG(2, "unlock");
 
   return DVR_SUCCESS;
 }
 
+static int _dvr_playback_fffb(DVR_PlaybackHandle_t handle) {
+  int ret;
+
+  DVR_TRACE_BEGIN("fffb_step");
+  ret = _do_playback_fffb(handle);
+  DVR_TRACE_END("fffb_step");
+  return ret;
+}
+
 //start replay, need get lock at extern
 static int _dvr_playback_replay(DVR_PlaybackHandle_t handle, DVR_Bool_t trick) {
   //
@@ -3237,18 +3379,18 @@ static int _dvr_playback_replay(DVR_PlaybackHandle_t handle, DVR_Bool_t trick) {
   //stop
   if (player->has_video) {
     player->has_video = DVR_FALSE;
-    AmTsPlayer_stopVideoDecoding(player->handle);
+    player->sink->stop_video_decoding(player->handle);
   }
 
   if (player->has_audio) {
     player->has_audio = DVR_FALSE;
-    AmTsPlayer_stopAudioDecoding(player->handle);
+    player->sink->stop_audio_decoding(player->handle);
   }
   //start video and audio
 
-  am_tsplayer_video_params    vparams;
-  am_tsplayer_audio_params    aparams;
-  am_tsplayer_audio_params    adparams;
+  DVR_PlaybackSinkVideoParams_t    vparams;
+  DVR_PlaybackSinkAudioParams_t    aparams;
+  DVR_PlaybackSinkAudioParams_t    adparams;
   uint64_t segment_id = player->cur_segment_id;
 
   memset(&vparams, 0, sizeof(vparams));
@@ -3268,35 +3410,35 @@ static int _dvr_playback_replay(DVR_PlaybackHandle_t handle, DVR_Bool_t trick) {
     player->has_video = DVR_TRUE;
     if (trick == DVR_TRUE) {
       DVR_PB_DG(1, "settrick mode at replay");
-      AmTsPlayer_setTrickMode(player->handle, AV_VIDEO_TRICK_MODE_PAUSE_NEXT);
+      player->sink->set_trick_mode(player->handle, DVR_PLAYBACK_SINK_TRICK_PAUSE_NEXT);
     }
     else {
-      AmTsPlayer_setTrickMode(player->handle, AV_VIDEO_TRICK_MODE_NONE);
+      player->sink->set_trick_mode(player->handle, DVR_PLAYBACK_SINK_TRICK_NONE);
     }
-    AmTsPlayer_setVideoParams(player->handle, &vparams);
-    AmTsPlayer_startVideoDecoding(player->handle);
+    player->sink->set_video_params(player->handle, &vparams);
+    player->sink->start_video_decoding(player->handle);
   }
 
   if (IS_FAST_SPEED(player->cmd.speed.speed.speed)) {
     DVR_PB_DG(1, "start fast");
-    AmTsPlayer_startFast(player->handle, (float)player->cmd.speed.speed.speed/(float)100);
+    player->sink->start_fast(player->handle, (float)player->cmd.speed.speed.speed/(float)100);
     player->speed = (float)player->cmd.speed.speed.speed/100.0f;
   } else {
     if (VALID_PID(adparams.pid)) {
       player->has_ad_audio = DVR_TRUE;
       DVR_PB_DG(1, "start ad audio");
-      AmTsPlayer_setADParams(player->handle,  &adparams);
-      AmTsPlayer_enableADMix(player->handle);
+      player->sink->set_ad_params(player->handle,  &adparams);
+      player->sink->enable_ad_mix(player->handle);
     }
     if (VALID_PID(aparams.pid)) {
       player->has_audio = DVR_TRUE;
       DVR_PB_DG(1, "start audio");
-      AmTsPlayer_setAudioParams(player->handle, &aparams);
-      AmTsPlayer_startAudioDecoding(player->handle);
+      player->sink->set_audio_params(player->handle, &aparams);
+      player->sink->start_audio_decoding(player->handle);
     }
 
-    DVR_PB_DG(1, "stop fast");
-    AmTsPlayer_stopFast(player->handle);
+    DVR_PB_DG(2, "stop fast");
+    player->sink->stop_fast(player->handle);
     player->cmd.speed.speed.speed = PLAYBACK_SPEED_X1;
     player->speed = (float)PLAYBACK_SPEED_X1/100.0f;
   }
@@ -3356,8 +3498,8 @@ int dvr_playback_set_speed(DVR_PlaybackHandle_t handle, DVR_PlaybackSpeed_t spee
       //if last speed is x2 or s2, we need stop fast
       if (speed.speed.speed == PLAYBACK_SPEED_X1) {
         // resume audio and stop fast play
-        DVR_PB_DG(1, "stop fast");
-        AmTsPlayer_stopFast(player->handle);
+        DVR_PB_DG(2, "stop fast");
+        player->sink->stop_fast(player->handle);
         pthread_mutex_unlock(&player->lock);
         _dvr_cmd(handle, DVR_PLAYBACK_CMD_ASTART);
         pthread_mutex_lock(&player->lock);
@@ -3365,11 +3507,11 @@ int dvr_playback_set_speed(DVR_PlaybackHandle_t handle, DVR_PlaybackSpeed_t spee
         //set play speed and if audio is start, stop audio.
         if (player->has_audio) {
           DVR_PB_DG(1, "fast play stop audio");
-          AmTsPlayer_stopAudioDecoding(player->handle);
+          player->sink->stop_audio_decoding(player->handle);
           player->has_audio = DVR_FALSE;
         }
         DVR_PB_DG(1, "start fast");
-        AmTsPlayer_startFast(player->handle, (float)speed.speed.speed/(float)100);
+        player->sink->start_fast(player->handle, (float)speed.speed.speed/(float)100);
       }
       player->fffb_play = DVR_FALSE;
       player->cmd.speed.mode = DVR_PLAYBACK_KERNEL_SUPPORT;
@@ -3399,18 +3541,18 @@ int dvr_playback_set_speed(DVR_PlaybackHandle_t handle, DVR_PlaybackSpeed_t spee
      //if last speed is x2 or s2, we need stop fast
      if (speed.speed.speed == PLAYBACK_SPEED_X1) {
         // resume audio and stop fast play
-        DVR_PB_DG(1, "stop fast");
-        AmTsPlayer_stopFast(player->handle);
+        DVR_PB_DG(2, "stop fast");
+        player->sink->stop_fast(player->handle);
         player->cmd.cur_cmd = DVR_PLAYBACK_CMD_ASTART;
       } else {
         //set play speed and if audio is start, stop audio.
         if (player->has_audio) {
           DVR_PB_DG(1, "fast play stop audio at pause");
-          AmTsPlayer_stopAudioDecoding(player->handle);
+          player->sink->stop_audio_decoding(player->handle);
           player->has_audio = DVR_FALSE;
        }
        DVR_PB_DG(1, "start fast");
-       AmTsPlayer_startFast(player->handle, (float)speed.speed.speed/(float)100);
+       player->sink->start_fast(player->handle, (float)speed.speed.speed/(float)100);
      }
      player->cmd.speed.mode = DVR_PLAYBACK_KERNEL_SUPPORT;
      player->cmd.speed.speed = speed.speed;
@@ -3502,14 +3644,14 @@ static int _dvr_playback_get_status(DVR_PlaybackHandle_t handle,
 
   if (CONTROL_SPEED_ENABLE == 1) {
     if (player->con_spe.ply_sta < 0) {
-          DVR_PB_DG(1, "player dur[%lld] sta[%lld] cur[%d] -----reinit",
+          DVR_PB_DG(2, "player dur[%lld] sta[%lld] cur[%d] -----reinit",
                         player->con_spe.ply_dur,
                         player->con_spe.ply_sta,
                         p_status->time_cur);
           player->con_spe.ply_sta = p_status->time_cur;
       } else if (player->speed == 1.0f && player->con_spe.ply_sta < p_status->time_cur) {
         player->con_spe.ply_dur += (p_status->time_cur - player->con_spe.ply_sta);
-        DVR_PB_DG(1, "player dur[%lld] sta[%lld] cur[%d]",
+        DVR_PB_DG(2, "player dur[%lld] sta[%lld] cur[%d]",
                       player->con_spe.ply_dur,
                       player->con_spe.ply_sta,
                       p_status->time_cur);
@@ -3532,7 +3674,7 @@ static int _dvr_playback_get_status(DVR_PlaybackHandle_t handle,
     if (player->speed > 0.0f ) {
       //ff
       if (p_status->time_cur < player->last_cur_time ) {
-        DVR_PB_DG(1, "get ff time error last[%d]cur[%d]diff[%d]",
+        DVR_PB_DG(2, "get ff time error last[%d]cur[%d]diff[%d]",
                       player->last_cur_time,
                       p_status->time_cur,
                       player->last_cur_time - p_status->time_cur);
@@ -3543,7 +3685,7 @@ static int _dvr_playback_get_status(DVR_PlaybackHandle_t handle,
     } else if (player->speed <= -1.0f){
       //fb
       if (p_status->time_cur > player->last_cur_time ) {
-        DVR_PB_DG(1, "get fb time error last[%d]cur[%d]diff[%d]",
+        DVR_PB_DG(2, "get fb time error last[%d]cur[%d]diff[%d]",
                       player->last_cur_time,
                       p_status->time_cur,
                       p_status->time_cur - player->last_cur_time );
@@ -3561,7 +3703,7 @@ static int _dvr_playback_get_status(DVR_PlaybackHandle_t handle,
   memcpy(&p_status->pids, &player->cur_segment.pids, sizeof(DVR_PlaybackPids_t));
   p_status->speed = player->cmd.speed.speed.speed;
   p_status->flags = player->cur_segment.flags;
-  DVR_PB_DG(1, "player real state[%s]state[%s]cur[%d]end[%d] id[%lld]playflag[%d]speed[%f]is_lock[%d]",
+  DVR_PB_DG(2, "player real state[%s]state[%s]cur[%d]end[%d] id[%lld]playflag[%d]speed[%f]is_lock[%d]",
                 _dvr_playback_state_toString(player->state),
                 _dvr_playback_state_toString(p_status->state),
                 p_status->time_cur, p_status->time_end,
@@ -3599,6 +3741,36 @@ int dvr_playback_get_status(DVR_PlaybackHandle_t handle,
   return DVR_SUCCESS;
 }
 
+int dvr_playback_get_cache_stats(DVR_PlaybackHandle_t handle, DVR_PlaybackCacheStats_t *p_stats)
+{
+  DVR_Playback_t *player = (DVR_Playback_t *) handle;
+  Segment_CacheStats_t stats;
+  loff_t cached;
+
+  DVR_RETURN_IF_FALSE(player);
+  DVR_RETURN_IF_FALSE(p_stats);
+
+  pthread_mutex_lock(&player->segment_lock);
+  memset(p_stats, 0, sizeof(*p_stats));
+  p_stats->read_bytes = player->cache_stats.read_bytes;
+  p_stats->readahead_bytes = player->cache_stats.willneed_bytes;
+  p_stats->dropped_bytes = player->cache_stats.dontneed_bytes;
+  p_stats->prefetch_count = player->cache_stats.prefetch_count;
+  p_stats->live_bytes = player->cache_stats.live_bytes;
+  if (player->r_handle && segment_get_cache_stats(player->r_handle, &stats) == DVR_SUCCESS) {
+    p_stats->read_bytes += stats.read_bytes;
+    p_stats->readahead_bytes += stats.willneed_bytes;
+    p_stats->dropped_bytes += stats.dontneed_bytes;
+    p_stats->prefetch_count += stats.prefetch_count;
+    p_stats->live_bytes += stats.live_bytes;
+    cached = segment_get_cached_size(player->r_handle);
+    if (cached > 0)
+      p_stats->cached_bytes = cached;
+  }
+  pthread_mutex_unlock(&player->segment_lock);
+  return DVR_SUCCESS;
+}
+
 void _dvr_dump_segment(DVR_PlaybackSegmentInfo_t *segment) {
   if (segment != NULL) {
     DVR_PB_DG(1, "segment id: %lld", segment->segment_id);
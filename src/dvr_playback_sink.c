@@ -0,0 +1,414 @@
+#define DVR_LOG_MODULE DVR_LOG_MODULE_PLAYBACK
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "dvr_types.h"
+#include "dvr_playback_sink.h"
+
+#define MEASURE_SINK_DEFAULT_BUF_SIZE   (2 * 1024 * 1024)
+
+#ifdef DVR_PLAYBACK_NO_TSPLAYER
+/*built without the media hal, dvr_playback_sink_tsplayer.c is left out and a sink must be given*/
+const DVR_PlaybackSinkOps_t *dvr_playback_sink_tsplayer_ops(void)
+{
+  return NULL;
+}
+#endif
+
+/**\brief Measuring sink context*/
+typedef struct
+{
+  pthread_mutex_t            lock;                 /**< sink lock*/
+  uint32_t                   buf_size;             /**< simulated buffer size*/
+  uint32_t                   drain_bitrate;        /**< consume bitrate, 0 is a null sink*/
+  uint64_t                   level;                /**< buffer level in bytes*/
+  uint64_t                   level_us;             /**< time the level was last updated*/
+  DVR_Bool_t                 video_start;          /**< video decoding*/
+  DVR_Bool_t                 audio_start;          /**< audio decoding*/
+  DVR_Bool_t                 video_pause;          /**< video paused*/
+  DVR_Bool_t                 audio_pause;          /**< audio paused*/
+  DVR_Bool_t                 first_frame;          /**< first frame event pending*/
+  float                      scale;                /**< fast play scale*/
+  DVR_PlaybackSinkEventFunction_t cb;                /**< event callback*/
+  void                       *cb_data;             /**< event callback data*/
+  uint64_t                   first_write_us;       /**< time of the first write*/
+  uint64_t                   last_write_us;        /**< time of the last write*/
+  DVR_Bool_t                 seek_pending;         /**< waiting for the first write after a seek*/
+  uint64_t                   seek_us;              /**< time of the last seek*/
+  uint64_t                   seek_latency_total;   /**< sum of seek latency in ms*/
+  uint32_t                   seek_done;            /**< seeks followed by data*/
+  DVR_PlaybackSinkStats_t    stats;                /**< statistics*/
+} DVR_PlaybackMeasureSink_t;
+
+static uint64_t measure_get_us(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static DVR_Bool_t measure_is_draining(DVR_PlaybackMeasureSink_t *sink)
+{
+  return ((sink->video_start && !sink->video_pause) ||
+      (sink->audio_start && !sink->audio_pause)) ? DVR_TRUE : DVR_FALSE;
+}
+
+/*Consume the buffer up to now at the drain bitrate*/
+static void measure_drain(DVR_PlaybackMeasureSink_t *sink, uint64_t now)
+{
+  uint64_t drained;
+
+  if (sink->drain_bitrate && measure_is_draining(sink) && now > sink->level_us) {
+    drained = (uint64_t)((now - sink->level_us) * (sink->drain_bitrate / 8) * sink->scale / 1000000);
+    if (drained >= sink->level) {
+      if (sink->level)
+        sink->stats.underflows++;
+      sink->level = 0;
+    } else {
+      sink->level -= drained;
+    }
+  }
+  sink->level_us = now;
+}
+
+static int measure_write_data(DVR_PlaybackSinkHandle_t handle, DVR_PlaybackSinkBuffer_t *buf, uint64_t timeout_ms)
+{
+  DVR_PlaybackMeasureSink_t *sink = (DVR_PlaybackMeasureSink_t *)handle;
+  DVR_PlaybackSinkEventFunction_t cb = NULL;
+  void *cb_data = NULL;
+  uint64_t now, wait_us;
+
+  if (!sink || !buf || buf->size <= 0)
+    return DVR_PLAYBACK_SINK_ERROR;
+
+  pthread_mutex_lock(&sink->lock);
+  now = measure_get_us();
+  measure_drain(sink, now);
+  if (sink->drain_bitrate && sink->level + buf->size > sink->buf_size) {
+    /*block like the decoder does until there is room or the timeout*/
+    if (measure_is_draining(sink)) {
+      wait_us = (sink->level + buf->size - sink->buf_size) * 8 * 1000000 / sink->drain_bitrate;
+      wait_us = (uint64_t)(wait_us / sink->scale) + 1;
+    } else {
+      wait_us = UINT64_MAX;
+    }
+    if (wait_us > timeout_ms * 1000) {
+      sink->stats.write_retries++;
+      pthread_mutex_unlock(&sink->lock);
+      usleep(timeout_ms * 1000);
+      return DVR_PLAYBACK_SINK_RETRY;
+    }
+    pthread_mutex_unlock(&sink->lock);
+    usleep(wait_us);
+    pthread_mutex_lock(&sink->lock);
+    now = measure_get_us();
+    measure_drain(sink, now);
+  }
+
+  sink->level += buf->size;
+  if (sink->drain_bitrate == 0)
+    sink->level = 0;
+  if (sink->level > sink->stats.buf_level_max)
+    sink->stats.buf_level_max = sink->level;
+  if (!sink->first_write_us)
+    sink->first_write_us = now;
+  sink->last_write_us = now;
+  sink->stats.write_bytes += buf->size;
+  sink->stats.write_count++;
+  if (sink->seek_pending) {
+    uint32_t latency = (now - sink->seek_us) / 1000;
+
+    sink->seek_pending = DVR_FALSE;
+    sink->stats.seek_latency_last = latency;
+    if (latency > sink->stats.seek_latency_max)
+      sink->stats.seek_latency_max = latency;
+    sink->seek_latency_total += latency;
+    sink->seek_done++;
+  }
+  if (sink->first_frame && sink->video_start) {
+    sink->first_frame = DVR_FALSE;
+    cb = sink->cb;
+    cb_data = sink->cb_data;
+  }
+  pthread_mutex_unlock(&sink->lock);
+
+  if (cb) {
+    DVR_PlaybackSinkEvent_t event;
+
+    memset(&event, 0, sizeof(event));
+    event.type = DVR_PLAYBACK_SINK_EVENT_FIRST_FRAME;
+    cb(cb_data, &event);
+  }
+  return DVR_PLAYBACK_SINK_OK;
+}
+
+static int measure_get_delay_time(DVR_PlaybackSinkHandle_t handle, int64_t *p_time)
+{
+  DVR_PlaybackMeasureSink_t *sink = (DVR_PlaybackMeasureSink_t *)handle;
+
+  if (!sink || !p_time)
+    return DVR_PLAYBACK_SINK_ERROR;
+  pthread_mutex_lock(&sink->lock);
+  measure_drain(sink, measure_get_us());
+  *p_time = sink->drain_bitrate ? (int64_t)(sink->level * 8 * 1000 / sink->drain_bitrate) : 0;
+  pthread_mutex_unlock(&sink->lock);
+  return DVR_PLAYBACK_SINK_OK;
+}
+
+static int measure_register_cb(DVR_PlaybackSinkHandle_t handle, DVR_PlaybackSinkEventFunction_t func, void *userdata)
+{
+  DVR_PlaybackMeasureSink_t *sink = (DVR_PlaybackMeasureSink_t *)handle;
+
+  if (!sink)
+    return DVR_PLAYBACK_SINK_ERROR;
+  pthread_mutex_lock(&sink->lock);
+  sink->cb = func;
+  sink->cb_data = userdata;
+  pthread_mutex_unlock(&sink->lock);
+  return DVR_PLAYBACK_SINK_OK;
+}
+
+/*Update the decoder state, stopping all the decoders flushes the buffer*/
+static int measure_set_state(DVR_PlaybackSinkHandle_t handle, DVR_Bool_t is_video, DVR_Bool_t start, DVR_Bool_t pause)
+{
+  DVR_PlaybackMeasureSink_t *sink = (DVR_PlaybackMeasureSink_t *)handle;
+
+  if (!sink)
+    return DVR_PLAYBACK_SINK_ERROR;
+  pthread_mutex_lock(&sink->lock);
+  measure_drain(sink, measure_get_us());
+  if (is_video) {
+    if (start && !sink->video_start)
+      sink->first_frame = DVR_TRUE;
+    sink->video_start = start;
+    sink->video_pause = pause;
+  } else {
+    sink->audio_start = start;
+    sink->audio_pause = pause;
+  }
+  if (!sink->video_start && !sink->audio_start)
+    sink->level = 0;
+  pthread_mutex_unlock(&sink->lock);
+  return DVR_PLAYBACK_SINK_OK;
+}
+
+static int measure_start_video_decoding(DVR_PlaybackSinkHandle_t handle)
+{
+  return measure_set_state(handle, DVR_TRUE, DVR_TRUE, DVR_FALSE);
+}
+
+static int measure_stop_video_decoding(DVR_PlaybackSinkHandle_t handle)
+{
+  return measure_set_state(handle, DVR_TRUE, DVR_FALSE, DVR_FALSE);
+}
+
+static int measure_pause_video_decoding(DVR_PlaybackSinkHandle_t handle)
+{
+  return measure_set_state(handle, DVR_TRUE, DVR_TRUE, DVR_TRUE);
+}
+
+static int measure_resume_video_decoding(DVR_PlaybackSinkHandle_t handle)
+{
+  return measure_set_state(handle, DVR_TRUE, DVR_TRUE, DVR_FALSE);
+}
+
+static int measure_start_audio_decoding(DVR_PlaybackSinkHandle_t handle)
+{
+  return measure_set_state(handle, DVR_FALSE, DVR_TRUE, DVR_FALSE);
+}
+
+static int measure_stop_audio_decoding(DVR_PlaybackSinkHandle_t handle)
+{
+  return measure_set_state(handle, DVR_FALSE, DVR_FALSE, DVR_FALSE);
+}
+
+static int measure_pause_audio_decoding(DVR_PlaybackSinkHandle_t handle)
+{
+  return measure_set_state(handle, DVR_FALSE, DVR_TRUE, DVR_TRUE);
+}
+
+static int measure_resume_audio_decoding(DVR_PlaybackSinkHandle_t handle)
+{
+  return measure_set_state(handle, DVR_FALSE, DVR_TRUE, DVR_FALSE);
+}
+
+static int measure_set_scale(DVR_PlaybackSinkHandle_t handle, float scale)
+{
+  DVR_PlaybackMeasureSink_t *sink = (DVR_PlaybackMeasureSink_t *)handle;
+
+  if (!sink)
+    return DVR_PLAYBACK_SINK_ERROR;
+  pthread_mutex_lock(&sink->lock);
+  measure_drain(sink, measure_get_us());
+  sink->scale = (scale > 0.0f) ? scale : 1.0f;
+  pthread_mutex_unlock(&sink->lock);
+  return DVR_PLAYBACK_SINK_OK;
+}
+
+static int measure_start_fast(DVR_PlaybackSinkHandle_t handle, float scale)
+{
+  return measure_set_scale(handle, scale);
+}
+
+static int measure_stop_fast(DVR_PlaybackSinkHandle_t handle)
+{
+  return measure_set_scale(handle, 1.0f);
+}
+
+static int measure_set_params(DVR_PlaybackSinkHandle_t handle, void *params)
+{
+  return (handle && params) ? DVR_PLAYBACK_SINK_OK : DVR_PLAYBACK_SINK_ERROR;
+}
+
+static int measure_set_video_params(DVR_PlaybackSinkHandle_t handle, DVR_PlaybackSinkVideoParams_t *params)
+{
+  return measure_set_params(handle, params);
+}
+
+static int measure_set_audio_params(DVR_PlaybackSinkHandle_t handle, DVR_PlaybackSinkAudioParams_t *params)
+{
+  return measure_set_params(handle, params);
+}
+
+static int measure_nop(DVR_PlaybackSinkHandle_t handle)
+{
+  return handle ? DVR_PLAYBACK_SINK_OK : DVR_PLAYBACK_SINK_ERROR;
+}
+
+static int measure_set_trick_mode(DVR_PlaybackSinkHandle_t handle, DVR_PlaybackSinkTrickMode_t trickmode)
+{
+  (void)trickmode;
+  return measure_nop(handle);
+}
+
+static int measure_set_audio_mute(DVR_PlaybackSinkHandle_t handle, int32_t analog_mute, int32_t digital_mute)
+{
+  (void)analog_mute;
+  (void)digital_mute;
+  return measure_nop(handle);
+}
+
+static int measure_set_pcr_pid(DVR_PlaybackSinkHandle_t handle, int32_t pid)
+{
+  (void)pid;
+  return measure_nop(handle);
+}
+
+static void measure_notify_seek(DVR_PlaybackSinkHandle_t handle)
+{
+  DVR_PlaybackMeasureSink_t *sink = (DVR_PlaybackMeasureSink_t *)handle;
+
+  if (!sink)
+    return;
+  pthread_mutex_lock(&sink->lock);
+  sink->seek_pending = DVR_TRUE;
+  sink->seek_us = measure_get_us();
+  sink->stats.seek_count++;
+  pthread_mutex_unlock(&sink->lock);
+}
+
+static const DVR_PlaybackSinkOps_t measure_sink_ops = {
+  .name = "measure",
+  .write_data = measure_write_data,
+  .get_delay_time = measure_get_delay_time,
+  .register_cb = measure_register_cb,
+  .set_video_params = measure_set_video_params,
+  .start_video_decoding = measure_start_video_decoding,
+  .stop_video_decoding = measure_stop_video_decoding,
+  .pause_video_decoding = measure_pause_video_decoding,
+  .resume_video_decoding = measure_resume_video_decoding,
+  .set_audio_params = measure_set_audio_params,
+  .start_audio_decoding = measure_start_audio_decoding,
+  .stop_audio_decoding = measure_stop_audio_decoding,
+  .pause_audio_decoding = measure_pause_audio_decoding,
+  .resume_audio_decoding = measure_resume_audio_decoding,
+  .set_ad_params = measure_set_audio_params,
+  .enable_ad_mix = measure_nop,
+  .disable_ad_mix = measure_nop,
+  .set_trick_mode = measure_set_trick_mode,
+  .start_fast = measure_start_fast,
+  .stop_fast = measure_stop_fast,
+  .show_video = measure_nop,
+  .hide_video = measure_nop,
+  .set_audio_mute = measure_set_audio_mute,
+  .set_pcr_pid = measure_set_pcr_pid,
+  .notify_seek = measure_notify_seek,
+};
+
+const DVR_PlaybackSinkOps_t *dvr_playback_sink_measure_ops(void)
+{
+  return &measure_sink_ops;
+}
+
+int dvr_playback_sink_measure_create(DVR_PlaybackSinkHandle_t *p_handle, DVR_PlaybackSinkMeasureParams_t *params)
+{
+  DVR_PlaybackMeasureSink_t *sink;
+
+  DVR_RETURN_IF_FALSE(p_handle);
+
+  sink = (DVR_PlaybackMeasureSink_t *)calloc(1, sizeof(DVR_PlaybackMeasureSink_t));
+  DVR_RETURN_IF_FALSE(sink);
+
+  pthread_mutex_init(&sink->lock, NULL);
+  sink->buf_size = (params && params->buf_size) ? params->buf_size : MEASURE_SINK_DEFAULT_BUF_SIZE;
+  sink->drain_bitrate = params ? params->drain_bitrate : 0;
+  sink->scale = 1.0f;
+  sink->level_us = measure_get_us();
+  DVR_DEBUG(1, "%s buf_size:%u drain_bitrate:%u", __func__, sink->buf_size, sink->drain_bitrate);
+
+  *p_handle = (DVR_PlaybackSinkHandle_t)sink;
+  return DVR_SUCCESS;
+}
+
+int dvr_playback_sink_measure_destroy(DVR_PlaybackSinkHandle_t handle)
+{
+  DVR_PlaybackMeasureSink_t *sink = (DVR_PlaybackMeasureSink_t *)handle;
+
+  DVR_RETURN_IF_FALSE(sink);
+  pthread_mutex_destroy(&sink->lock);
+  free(sink);
+  return DVR_SUCCESS;
+}
+
+int dvr_playback_sink_measure_get_stats(DVR_PlaybackSinkHandle_t handle, DVR_PlaybackSinkStats_t *p_stats)
+{
+  DVR_PlaybackMeasureSink_t *sink = (DVR_PlaybackMeasureSink_t *)handle;
+  uint64_t span;
+
+  DVR_RETURN_IF_FALSE(sink);
+  DVR_RETURN_IF_FALSE(p_stats);
+
+  pthread_mutex_lock(&sink->lock);
+  measure_drain(sink, measure_get_us());
+  *p_stats = sink->stats;
+  p_stats->buf_level = sink->level;
+  span = sink->last_write_us - sink->first_write_us;
+  p_stats->inject_rate = span ? p_stats->write_bytes * 1000000 / span : 0;
+  p_stats->seek_latency_avg = sink->seek_done ?
+    sink->seek_latency_total / sink->seek_done : 0;
+  pthread_mutex_unlock(&sink->lock);
+  return DVR_SUCCESS;
+}
+
+int dvr_playback_sink_measure_reset_stats(DVR_PlaybackSinkHandle_t handle)
+{
+  DVR_PlaybackMeasureSink_t *sink = (DVR_PlaybackMeasureSink_t *)handle;
+
+  DVR_RETURN_IF_FALSE(sink);
+
+  pthread_mutex_lock(&sink->lock);
+  memset(&sink->stats, 0, sizeof(sink->stats));
+  sink->first_write_us = 0;
+  sink->last_write_us = 0;
+  sink->seek_pending = DVR_FALSE;
+  sink->seek_latency_total = 0;
+  sink->seek_done = 0;
+  pthread_mutex_unlock(&sink->lock);
+  return DVR_SUCCESS;
+}
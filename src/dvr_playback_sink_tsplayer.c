@@ -0,0 +1,347 @@
+#define DVR_LOG_MODULE DVR_LOG_MODULE_PLAYBACK
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "dvr_types.h"
+#include "dvr_playback_sink.h"
+#include "AmTsPlayer.h"
+
+#define TSPLAYER_HANDLE(_h) ((am_tsplayer_handle)(_h))
+
+/**\brief Event callback registered on a tsplayer, it chains to the callback the tsplayer had before*/
+typedef struct
+{
+  DVR_PlaybackSinkEventFunction_t func;       /**< playback callback*/
+  void                       *userdata;       /**< playback callback data*/
+  event_callback             prev_func;       /**< callback registered before the playback*/
+  void                       *prev_userdata;  /**< callback data registered before the playback*/
+} DVR_PlaybackTsPlayerCb_t;
+
+static pthread_mutex_t tsplayer_cb_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int tsplayer_result(am_tsplayer_result ret)
+{
+  if (ret == AM_TSPLAYER_OK)
+    return DVR_PLAYBACK_SINK_OK;
+  if (ret == AM_TSPLAYER_ERROR_RETRY)
+    return DVR_PLAYBACK_SINK_RETRY;
+  return DVR_PLAYBACK_SINK_ERROR;
+}
+
+//convert video and audio fmt
+static int tsplayer_codec(int fmt, DVR_Bool_t is_audio) {
+  int format = 0;
+  if (is_audio == DVR_FALSE) {
+    //for video fmt
+    switch (fmt)
+    {
+        case DVR_VIDEO_FORMAT_MPEG1:
+          format = AV_VIDEO_CODEC_MPEG1;
+          break;
+        case DVR_VIDEO_FORMAT_MPEG2:
+          format = AV_VIDEO_CODEC_MPEG2;
+          break;
+        case DVR_VIDEO_FORMAT_HEVC:
+          format = AV_VIDEO_CODEC_H265;
+          break;
+        case DVR_VIDEO_FORMAT_H264:
+          format = AV_VIDEO_CODEC_H264;
+          break;
+        case DVR_VIDEO_FORMAT_VP9:
+          format = AV_VIDEO_CODEC_VP9;
+          break;
+    }
+  } else {
+    //for audio fmt
+    switch (fmt)
+    {
+        case DVR_AUDIO_FORMAT_MPEG:
+          format = AV_AUDIO_CODEC_MP2;
+          break;
+        case DVR_AUDIO_FORMAT_AC3:
+          format = AV_AUDIO_CODEC_AC3;
+          break;
+        case DVR_AUDIO_FORMAT_EAC3:
+          format = AV_AUDIO_CODEC_EAC3;
+          break;
+        case DVR_AUDIO_FORMAT_DTS:
+          format = AV_AUDIO_CODEC_DTS;
+          break;
+        case DVR_AUDIO_FORMAT_AAC:
+          format = AV_AUDIO_CODEC_AAC;
+          break;
+        case DVR_AUDIO_FORMAT_LATM:
+          format = AV_AUDIO_CODEC_LATM;
+          break;
+        case DVR_AUDIO_FORMAT_PCM:
+          format = AV_AUDIO_CODEC_PCM;
+          break;
+        case DVR_AUDIO_FORMAT_AC4:
+          format = AV_AUDIO_CODEC_AC4;
+          break;
+    }
+  }
+  return format;
+}
+
+static void tsplayer_event_cb(void *user_data, am_tsplayer_event *event)
+{
+  DVR_PlaybackTsPlayerCb_t *cb = (DVR_PlaybackTsPlayerCb_t *)user_data;
+  DVR_PlaybackSinkEvent_t sink_event;
+
+  memset(&sink_event, 0, sizeof(sink_event));
+  sink_event.native_type = event->type;
+  switch (event->type) {
+    case AM_TSPLAYER_EVENT_TYPE_VIDEO_CHANGED:
+      sink_event.type = DVR_PLAYBACK_SINK_EVENT_VIDEO_CHANGED;
+      sink_event.frame_width = event->event.video_format.frame_width;
+      sink_event.frame_height = event->event.video_format.frame_height;
+      sink_event.frame_rate = event->event.video_format.frame_rate;
+      break;
+    case AM_TSPLAYER_EVENT_TYPE_FIRST_FRAME:
+      sink_event.type = DVR_PLAYBACK_SINK_EVENT_FIRST_FRAME;
+      break;
+    case AM_TSPLAYER_EVENT_TYPE_DECODE_FIRST_FRAME_AUDIO:
+      sink_event.type = DVR_PLAYBACK_SINK_EVENT_AUDIO_FIRST_FRAME;
+      break;
+    default:
+      sink_event.type = DVR_PLAYBACK_SINK_EVENT_OTHER;
+      break;
+  }
+  if (cb->func)
+    cb->func(cb->userdata, &sink_event);
+  if (cb->prev_func)
+    cb->prev_func(cb->prev_userdata, event);
+}
+
+static int tsplayer_write_data(DVR_PlaybackSinkHandle_t handle, DVR_PlaybackSinkBuffer_t *buf, uint64_t timeout_ms)
+{
+  am_tsplayer_input_buffer ibuf;
+
+  memset(&ibuf, 0, sizeof(ibuf));
+  ibuf.buf_type = (buf->type == DVR_PLAYBACK_SINK_BUFFER_SECURE) ?
+    TS_INPUT_BUFFER_TYPE_SECURE : TS_INPUT_BUFFER_TYPE_NORMAL;
+  ibuf.buf_data = buf->data;
+  ibuf.buf_size = buf->size;
+  return tsplayer_result(AmTsPlayer_writeData(TSPLAYER_HANDLE(handle), &ibuf, timeout_ms));
+}
+
+static int tsplayer_get_delay_time(DVR_PlaybackSinkHandle_t handle, int64_t *p_time)
+{
+  return tsplayer_result(AmTsPlayer_getDelayTime(TSPLAYER_HANDLE(handle), p_time));
+}
+
+/*Install tsplayer_event_cb once per tsplayer, the callback found there is chained and restored on unregister*/
+static int tsplayer_register_cb(DVR_PlaybackSinkHandle_t handle, DVR_PlaybackSinkEventFunction_t func, void *userdata)
+{
+  DVR_PlaybackTsPlayerCb_t *cb = NULL;
+  event_callback cur_func = NULL;
+  void *cur_userdata = NULL;
+  am_tsplayer_result ret;
+
+  pthread_mutex_lock(&tsplayer_cb_lock);
+  AmTsPlayer_getCb(TSPLAYER_HANDLE(handle), &cur_func, &cur_userdata);
+  if (cur_func == tsplayer_event_cb)
+    cb = (DVR_PlaybackTsPlayerCb_t *)cur_userdata;
+
+  if (!func) {
+    ret = AM_TSPLAYER_OK;
+    if (cb) {
+      ret = AmTsPlayer_registerCb(TSPLAYER_HANDLE(handle), cb->prev_func, cb->prev_userdata);
+      free(cb);
+    }
+    pthread_mutex_unlock(&tsplayer_cb_lock);
+    return tsplayer_result(ret);
+  }
+
+  if (cb) {
+    cb->func = func;
+    cb->userdata = userdata;
+    pthread_mutex_unlock(&tsplayer_cb_lock);
+    return DVR_PLAYBACK_SINK_OK;
+  }
+  cb = (DVR_PlaybackTsPlayerCb_t *)calloc(1, sizeof(DVR_PlaybackTsPlayerCb_t));
+  if (!cb) {
+    pthread_mutex_unlock(&tsplayer_cb_lock);
+    return DVR_PLAYBACK_SINK_ERROR;
+  }
+  cb->func = func;
+  cb->userdata = userdata;
+  cb->prev_func = cur_func;
+  cb->prev_userdata = cur_userdata;
+  ret = AmTsPlayer_registerCb(TSPLAYER_HANDLE(handle), tsplayer_event_cb, cb);
+  if (ret != AM_TSPLAYER_OK)
+    free(cb);
+  pthread_mutex_unlock(&tsplayer_cb_lock);
+  return tsplayer_result(ret);
+}
+
+static int tsplayer_set_video_params(DVR_PlaybackSinkHandle_t handle, DVR_PlaybackSinkVideoParams_t *params)
+{
+  am_tsplayer_video_params vparams;
+
+  memset(&vparams, 0, sizeof(vparams));
+  vparams.codectype = tsplayer_codec(params->format, DVR_FALSE);
+  vparams.pid = params->pid;
+  return tsplayer_result(AmTsPlayer_setVideoParams(TSPLAYER_HANDLE(handle), &vparams));
+}
+
+static int tsplayer_start_video_decoding(DVR_PlaybackSinkHandle_t handle)
+{
+  return tsplayer_result(AmTsPlayer_startVideoDecoding(TSPLAYER_HANDLE(handle)));
+}
+
+static int tsplayer_stop_video_decoding(DVR_PlaybackSinkHandle_t handle)
+{
+  return tsplayer_result(AmTsPlayer_stopVideoDecoding(TSPLAYER_HANDLE(handle)));
+}
+
+static int tsplayer_pause_video_decoding(DVR_PlaybackSinkHandle_t handle)
+{
+  return tsplayer_result(AmTsPlayer_pauseVideoDecoding(TSPLAYER_HANDLE(handle)));
+}
+
+static int tsplayer_resume_video_decoding(DVR_PlaybackSinkHandle_t handle)
+{
+  return tsplayer_result(AmTsPlayer_resumeVideoDecoding(TSPLAYER_HANDLE(handle)));
+}
+
+static void tsplayer_audio_params(am_tsplayer_audio_params *aparams, DVR_PlaybackSinkAudioParams_t *params)
+{
+  memset(aparams, 0, sizeof(*aparams));
+  aparams->codectype = tsplayer_codec(params->format, DVR_TRUE);
+  aparams->pid = params->pid;
+}
+
+static int tsplayer_set_audio_params(DVR_PlaybackSinkHandle_t handle, DVR_PlaybackSinkAudioParams_t *params)
+{
+  am_tsplayer_audio_params aparams;
+
+  tsplayer_audio_params(&aparams, params);
+  return tsplayer_result(AmTsPlayer_setAudioParams(TSPLAYER_HANDLE(handle), &aparams));
+}
+
+static int tsplayer_start_audio_decoding(DVR_PlaybackSinkHandle_t handle)
+{
+  return tsplayer_result(AmTsPlayer_startAudioDecoding(TSPLAYER_HANDLE(handle)));
+}
+
+static int tsplayer_stop_audio_decoding(DVR_PlaybackSinkHandle_t handle)
+{
+  return tsplayer_result(AmTsPlayer_stopAudioDecoding(TSPLAYER_HANDLE(handle)));
+}
+
+static int tsplayer_pause_audio_decoding(DVR_PlaybackSinkHandle_t handle)
+{
+  return tsplayer_result(AmTsPlayer_pauseAudioDecoding(TSPLAYER_HANDLE(handle)));
+}
+
+static int tsplayer_resume_audio_decoding(DVR_PlaybackSinkHandle_t handle)
+{
+  return tsplayer_result(AmTsPlayer_resumeAudioDecoding(TSPLAYER_HANDLE(handle)));
+}
+
+static int tsplayer_set_ad_params(DVR_PlaybackSinkHandle_t handle, DVR_PlaybackSinkAudioParams_t *params)
+{
+  am_tsplayer_audio_params aparams;
+
+  tsplayer_audio_params(&aparams, params);
+  return tsplayer_result(AmTsPlayer_setADParams(TSPLAYER_HANDLE(handle), &aparams));
+}
+
+static int tsplayer_enable_ad_mix(DVR_PlaybackSinkHandle_t handle)
+{
+  return tsplayer_result(AmTsPlayer_enableADMix(TSPLAYER_HANDLE(handle)));
+}
+
+static int tsplayer_disable_ad_mix(DVR_PlaybackSinkHandle_t handle)
+{
+  return tsplayer_result(AmTsPlayer_disableADMix(TSPLAYER_HANDLE(handle)));
+}
+
+static int tsplayer_set_trick_mode(DVR_PlaybackSinkHandle_t handle, DVR_PlaybackSinkTrickMode_t trickmode)
+{
+  am_tsplayer_video_trick_mode mode;
+
+  switch (trickmode) {
+    case DVR_PLAYBACK_SINK_TRICK_PAUSE:
+      mode = AV_VIDEO_TRICK_MODE_PAUSE;
+      break;
+    case DVR_PLAYBACK_SINK_TRICK_PAUSE_NEXT:
+      mode = AV_VIDEO_TRICK_MODE_PAUSE_NEXT;
+      break;
+    case DVR_PLAYBACK_SINK_TRICK_IONLY:
+      mode = AV_VIDEO_TRICK_MODE_IONLY;
+      break;
+    default:
+      mode = AV_VIDEO_TRICK_MODE_NONE;
+      break;
+  }
+  return tsplayer_result(AmTsPlayer_setTrickMode(TSPLAYER_HANDLE(handle), mode));
+}
+
+static int tsplayer_start_fast(DVR_PlaybackSinkHandle_t handle, float scale)
+{
+  return tsplayer_result(AmTsPlayer_startFast(TSPLAYER_HANDLE(handle), scale));
+}
+
+static int tsplayer_stop_fast(DVR_PlaybackSinkHandle_t handle)
+{
+  return tsplayer_result(AmTsPlayer_stopFast(TSPLAYER_HANDLE(handle)));
+}
+
+static int tsplayer_show_video(DVR_PlaybackSinkHandle_t handle)
+{
+  return tsplayer_result(AmTsPlayer_showVideo(TSPLAYER_HANDLE(handle)));
+}
+
+static int tsplayer_hide_video(DVR_PlaybackSinkHandle_t handle)
+{
+  return tsplayer_result(AmTsPlayer_hideVideo(TSPLAYER_HANDLE(handle)));
+}
+
+static int tsplayer_set_audio_mute(DVR_PlaybackSinkHandle_t handle, int32_t analog_mute, int32_t digital_mute)
+{
+  return tsplayer_result(AmTsPlayer_setAudioMute(TSPLAYER_HANDLE(handle), analog_mute, digital_mute));
+}
+
+static int tsplayer_set_pcr_pid(DVR_PlaybackSinkHandle_t handle, int32_t pid)
+{
+  return tsplayer_result(AmTsPlayer_setPcrPid(TSPLAYER_HANDLE(handle), pid));
+}
+
+static const DVR_PlaybackSinkOps_t tsplayer_sink_ops = {
+  .name = "tsplayer",
+  .write_data = tsplayer_write_data,
+  .get_delay_time = tsplayer_get_delay_time,
+  .register_cb = tsplayer_register_cb,
+  .set_video_params = tsplayer_set_video_params,
+  .start_video_decoding = tsplayer_start_video_decoding,
+  .stop_video_decoding = tsplayer_stop_video_decoding,
+  .pause_video_decoding = tsplayer_pause_video_decoding,
+  .resume_video_decoding = tsplayer_resume_video_decoding,
+  .set_audio_params = tsplayer_set_audio_params,
+  .start_audio_decoding = tsplayer_start_audio_decoding,
+  .stop_audio_decoding = tsplayer_stop_audio_decoding,
+  .pause_audio_decoding = tsplayer_pause_audio_decoding,
+  .resume_audio_decoding = tsplayer_resume_audio_decoding,
+  .set_ad_params = tsplayer_set_ad_params,
+  .enable_ad_mix = tsplayer_enable_ad_mix,
+  .disable_ad_mix = tsplayer_disable_ad_mix,
+  .set_trick_mode = tsplayer_set_trick_mode,
+  .start_fast = tsplayer_start_fast,
+  .stop_fast = tsplayer_stop_fast,
+  .show_video = tsplayer_show_video,
+  .hide_video = tsplayer_hide_video,
+  .set_audio_mute = tsplayer_set_audio_mute,
+  .set_pcr_pid = tsplayer_set_pcr_pid,
+  .notify_seek = NULL,
+};
+
+const DVR_PlaybackSinkOps_t *dvr_playback_sink_tsplayer_ops(void)
+{
+  return &tsplayer_sink_ops;
+}
@@ -1,3 +1,5 @@
+#define DVR_LOG_MODULE DVR_LOG_MODULE_RECORD
+
 #include <stdio.h>
 #include <unistd.h>
 #include <stdlib.h>
@@ -6,9 +8,12 @@
 #include "dvr_types.h"
 #include "dvr_record.h"
 #include "dvr_crypto.h"
+#include "dvr_crypto_pool.h"
 #include "dvb_utils.h"
 #include "record_device.h"
 #include "segment.h"
+#include "dvr_segment.h"
+#include "dvr_trace.h"
 #include <sys/time.h>
 
 #define CONTROL_SPEED_ENABLE 0
@@ -17,6 +22,10 @@
 #define MAX_DVR_RECORD_SESSION_COUNT 2
 #define RECORD_BLOCK_SIZE (256 * 1024)
 #define NEW_DEVICE_RECORD_BLOCK_SIZE (1024 * 188)
+/*Default smallest adaptive block*/
+#define RECORD_BLOCK_MIN_SIZE (32 * 188)
+/*Input bitrate measurement window in ms*/
+#define RECORD_BITRATE_WINDOW 500
 
 /**\brief DVR index file type*/
 typedef enum {
@@ -68,10 +77,28 @@ typedef struct {
   uint32_t                        block_size;                           /**< DVR record block size */
   DVR_Bool_t                      is_new_dmx;                           /**< DVR is used new dmx driver */
   int                             index_type;                           /**< DVR is used pcr or local time */
+  int                             crypto_workers;                       /**< Encrypt worker threads, 0 encrypts in the record thread */
+  uint32_t                        crypto_flags;                         /**< Encrypt function capability */
+  DVR_CryptoPeriod_t              crypto_period;                        /**< Crypto period notification settings */
+  int8_t                          pid_parity[DVR_MAX_RECORD_PIDS_COUNT]; /**< Parity of each pid in the segment, -1 is unknown */
+  int8_t                          crypto_parity[2];                     /**< Parity of audio and video last notified, -1 is unknown */
+  size_t                          crypto_notify_size;                   /**< Segment size of the last crypto status notification */
+  loff_t                          prealloc_size;                        /**< Segment preallocation extent size */
+  loff_t                          writeback_size;                       /**< Segment write-behind range size */
+  DVR_Bool_t                      direct_io;                            /**< Segment O_DIRECT writes */
+  uint32_t                        block_latency_ms;                     /**< Adaptive block latency target, 0 keeps block_size */
+  uint32_t                        block_min_size;                       /**< Adaptive block lower bound */
+  uint32_t                        block_max_size;                       /**< Adaptive block upper bound, the allocated block */
+  uint32_t                        block_align;                          /**< Adaptive block alignment, 188 and the crypto block */
+  volatile uint32_t               cur_block_size;                       /**< Block size in use */
+  volatile uint32_t               bitrate;                              /**< Measured input bitrate in bit/s */
+  uint64_t                        rate_bytes;                           /**< Bytes read in the bitrate window */
+  struct timespec                 rate_ts;                              /**< Bitrate window start, 0 restarts the window */
+  uint8_t                         *held_buf;                            /**< Data the full ring slot could not take, written to the next segment */
+  size_t                          held_len;                             /**< Bytes held, the device is not read meanwhile */
+  size_t                          held_size;                            /**< Allocated size of held_buf */
 } DVR_RecordContext_t;
 
-extern ssize_t record_device_read_ext(Record_DeviceHandle_t handle, size_t *buf, size_t *len);
-
 static DVR_RecordContext_t record_ctx[MAX_DVR_RECORD_SESSION_COUNT] = {
   {
     .state = DVR_RECORD_STATE_CLOSED
@@ -139,11 +166,85 @@ static int record_save_pcr(DVR_RecordContext_t *p_ctx, uint8_t *buf, loff_t pos)
   }
 
   if (has_pcr && p_ctx->index_type == DVR_INDEX_TYPE_PCR) {
+    DVR_TRACE_BEGIN("segment_update_pts");
     segment_update_pts(p_ctx->segment_handle, pcr/90, pos);
+    DVR_TRACE_END("segment_update_pts");
   }
   return has_pcr;
 }
 
+static void record_notify_crypto(DVR_RecordContext_t *p_ctx, DVR_CryptoFilterType_t type,
+    DVR_CryptoParity_t parity, loff_t offset, DVR_Bool_t transition)
+{
+  DVR_CryptoPeriodInfo_t info;
+
+  if (!p_ctx->event_notify_fn || !p_ctx->crypto_period.interval_bytes)
+    return;
+  if (parity == DVR_CRYPTO_PARITY_CLEAR && p_ctx->crypto_period.notify_clear_periods)
+    return;
+
+  memset(&info, 0, sizeof(info));
+  info.transition = transition;
+  info.parity = parity;
+  info.ts_offset = offset;
+  info.filter_type = type;
+  p_ctx->event_notify_fn(DVR_RECORD_EVENT_CRYPTO_STATUS, &info, p_ctx->event_userdata);
+}
+
+/*Track transport_scrambling_control of the audio and video pids*/
+static void record_save_parity(DVR_RecordContext_t *p_ctx, uint8_t *p, loff_t offset)
+{
+  DVR_CryptoPeriodEntry_t entry;
+  DVR_CryptoFilterType_t type;
+  DVR_CryptoParity_t parity;
+  int pid, stream_type;
+  int i;
+
+  pid = ((p[1] & 0x1f) << 8) | p[2];
+  for (i = 0; i < p_ctx->segment_info.nb_pids; i++) {
+    if (pid == p_ctx->segment_info.pids[i].pid)
+      break;
+  }
+  if (i == p_ctx->segment_info.nb_pids)
+    return;
+
+  stream_type = (p_ctx->segment_info.pids[i].type >> 24) & 0x0f;
+  if (stream_type == DVR_STREAM_TYPE_VIDEO)
+    type = DVR_CRYPTO_FILTER_TYPE_VIDEO;
+  else if (stream_type == DVR_STREAM_TYPE_AUDIO)
+    type = DVR_CRYPTO_FILTER_TYPE_AUDIO;
+  else
+    return;
+
+  switch (p[3] >> 6) {
+    case 2:
+      parity = DVR_CRYPTO_PARITY_EVEN;
+      break;
+    case 3:
+      parity = DVR_CRYPTO_PARITY_ODD;
+      break;
+    default:
+      parity = DVR_CRYPTO_PARITY_CLEAR;
+      break;
+  }
+  if (parity == p_ctx->pid_parity[i])
+    return;
+
+  /*a clear record has no crypto period index*/
+  if (p_ctx->pid_parity[i] >= 0 || parity != DVR_CRYPTO_PARITY_CLEAR) {
+    entry.offset = offset;
+    entry.filter_type = type;
+    entry.parity = parity;
+    segment_update_crypto_period(p_ctx->segment_handle, &entry);
+  }
+  p_ctx->pid_parity[i] = parity;
+
+  if (p_ctx->crypto_parity[type] != parity) {
+    p_ctx->crypto_parity[type] = parity;
+    record_notify_crypto(p_ctx, type, parity, offset, DVR_TRUE);
+  }
+}
+
 static int record_do_pcr_index(DVR_RecordContext_t *p_ctx, uint8_t *buf, int len)
 {
   uint8_t *p = buf;
@@ -155,6 +256,8 @@ static int record_do_pcr_index(DVR_RecordContext_t *p_ctx, uint8_t *buf, int len
   while (left >= 188) {
     if (*p == 0x47) {
       has_pcr |= record_save_pcr(p_ctx, p, pos);
+      /*segment size is not updated yet, it is the offset of buf*/
+      record_save_parity(p_ctx, p, p_ctx->segment_info.size + (p - buf));
       p += 188;
       left -= 188;
       pos += 188;
@@ -172,39 +275,263 @@ static int get_diff_time(struct timeval start_tv, struct timeval end_tv)
   return end_tv.tv_sec * 1000 + end_tv.tv_usec / 1000 - start_tv.tv_sec * 1000 - start_tv.tv_usec / 1000;
 }
 
+/*Keep a block the ring slot has no room for and ask for the next segment at once,
+ the record status reports a size past the segment size so the wrapper rolls*/
+static int record_hold_block(DVR_RecordContext_t *p_ctx, uint8_t *data, ssize_t len)
+{
+  DVR_RecordStatus_t record_status;
+  uint8_t *p;
+
+  if (p_ctx->held_len + len > p_ctx->held_size) {
+    p = (uint8_t *)realloc(p_ctx->held_buf, p_ctx->held_len + len);
+    DVR_RETURN_IF_FALSE(p);
+    p_ctx->held_buf = p;
+    p_ctx->held_size = p_ctx->held_len + len;
+  }
+  memcpy(p_ctx->held_buf + p_ctx->held_len, data, len);
+  p_ctx->held_len += len;
+  if (p_ctx->held_len != (size_t)len || !p_ctx->event_notify_fn)
+    return DVR_SUCCESS;
+
+  DVR_DEBUG(1, "%s, segment %llu slot full at %zu, wait for the next segment", __func__,
+      (unsigned long long)p_ctx->segment_info.id, p_ctx->segment_info.size);
+  memset(&record_status, 0, sizeof(record_status));
+  p_ctx->last_send_size = p_ctx->segment_info.size;
+  record_status.state = p_ctx->state;
+  record_status.info.id = p_ctx->segment_info.id;
+  record_status.info.duration = p_ctx->segment_info.duration;
+  record_status.info.size = p_ctx->segment_info.size;
+  record_status.info.nb_packets = p_ctx->segment_info.size/188;
+  record_status.bitrate = p_ctx->bitrate;
+  record_status.block_size = p_ctx->cur_block_size;
+  p_ctx->event_notify_fn(DVR_RECORD_EVENT_STATUS, &record_status, p_ctx->event_userdata);
+  return DVR_SUCCESS;
+}
+
+/*Write a block to the segment, do the time index and notify the record status*/
+static int record_write_block(DVR_RecordContext_t *p_ctx, uint8_t *data, ssize_t len,
+    struct timespec *start_ts, time_t *pre_time)
+{
+  DVR_RecordStatus_t record_status;
+  struct timespec end_ts;
+  loff_t pos;
+  int has_pcr;
+  int ret = 0;
+
+  #define DVR_STORE_INFO_TIME (400)
+
+  /*a ring segment does not grow past its slot, the rest goes to the next segment*/
+  if (len > 0 && (p_ctx->held_len || segment_tell_room(p_ctx->segment_handle) < len))
+    return record_hold_block(p_ctx, data, len);
+  if (len > 0) {
+    DVR_TRACE_BEGIN("segment_write");
+    ret = segment_write(p_ctx->segment_handle, data, len);
+    DVR_TRACE_END("segment_write");
+  }
+  //add DVR_RECORD_EVENT_WRITE_ERROR event if write error
+  if (ret == -1 && len > 0 && p_ctx->event_notify_fn) {
+    //send write event
+     if (p_ctx->event_notify_fn) {
+       memset(&record_status, 0, sizeof(record_status));
+       DVR_DEBUG_RL(1, 1000, "%s：%d,send event write error", __func__,__LINE__);
+       record_status.info.id = p_ctx->segment_info.id;
+       p_ctx->event_notify_fn(DVR_RECORD_EVENT_WRITE_ERROR, &record_status, p_ctx->event_userdata);
+      }
+      DVR_DEBUG_RL(1, 1000, "%s,write error %d", __func__,__LINE__);
+    return DVR_FAILURE;
+  }
+  /* Do time index */
+  pos = segment_tell_position(p_ctx->segment_handle);
+  has_pcr = record_do_pcr_index(p_ctx, data, len);
+  if (has_pcr == 0 && p_ctx->index_type == DVR_INDEX_TYPE_INVALID) {
+    clock_gettime(CLOCK_MONOTONIC, &end_ts);
+    if ((end_ts.tv_sec*1000 + end_ts.tv_nsec/1000000) -
+        (start_ts->tv_sec*1000 + start_ts->tv_nsec/1000000) > 40) {
+      /* PCR interval threshlod > 40 ms*/
+      DVR_DEBUG(1, "%s use local clock time index", __func__);
+      p_ctx->index_type = DVR_INDEX_TYPE_LOCAL_CLOCK;
+    }
+  } else if (has_pcr && p_ctx->index_type == DVR_INDEX_TYPE_INVALID){
+    DVR_DEBUG(1, "%s use pcr time index", __func__);
+    p_ctx->index_type = DVR_INDEX_TYPE_PCR;
+  }
+
+  /* Update segment info */
+  p_ctx->segment_info.size += len;
+  /*Duration need use pcr to calculate, todo...*/
+  if (p_ctx->index_type == DVR_INDEX_TYPE_PCR) {
+    p_ctx->segment_info.duration = segment_tell_total_time(p_ctx->segment_handle);
+    if (*pre_time == 0)
+     *pre_time = p_ctx->segment_info.duration;
+  } else if (p_ctx->index_type == DVR_INDEX_TYPE_LOCAL_CLOCK) {
+    clock_gettime(CLOCK_MONOTONIC, &end_ts);
+    p_ctx->segment_info.duration = (end_ts.tv_sec*1000 + end_ts.tv_nsec/1000000) -
+      (start_ts->tv_sec*1000 + start_ts->tv_nsec/1000000);
+          if (*pre_time == 0)
+     *pre_time = p_ctx->segment_info.duration;
+    DVR_TRACE_BEGIN("segment_update_pts");
+    segment_update_pts(p_ctx->segment_handle, p_ctx->segment_info.duration, pos);
+    DVR_TRACE_END("segment_update_pts");
+  } else {
+    DVR_DEBUG(1, "%s can NOT do time index", __func__);
+  }
+  p_ctx->segment_info.nb_packets = p_ctx->segment_info.size/188;
+
+  /* Regular crypto status notification */
+  if (p_ctx->crypto_period.interval_bytes &&
+      p_ctx->segment_info.size - p_ctx->crypto_notify_size >= p_ctx->crypto_period.interval_bytes) {
+    p_ctx->crypto_notify_size = p_ctx->segment_info.size;
+    if (p_ctx->crypto_parity[DVR_CRYPTO_FILTER_TYPE_AUDIO] >= 0)
+      record_notify_crypto(p_ctx, DVR_CRYPTO_FILTER_TYPE_AUDIO,
+          p_ctx->crypto_parity[DVR_CRYPTO_FILTER_TYPE_AUDIO], p_ctx->segment_info.size, DVR_FALSE);
+    if (p_ctx->crypto_parity[DVR_CRYPTO_FILTER_TYPE_VIDEO] >= 0)
+      record_notify_crypto(p_ctx, DVR_CRYPTO_FILTER_TYPE_VIDEO,
+          p_ctx->crypto_parity[DVR_CRYPTO_FILTER_TYPE_VIDEO], p_ctx->segment_info.size, DVR_FALSE);
+  }
+
+  if (p_ctx->segment_info.duration - *pre_time > DVR_STORE_INFO_TIME) {
+    *pre_time = p_ctx->segment_info.duration + DVR_STORE_INFO_TIME;
+    segment_store_info(p_ctx->segment_handle, &(p_ctx->segment_info));
+  }
+   /*Event notification*/
+  if (p_ctx->notification_size &&
+      p_ctx->event_notify_fn &&
+      /*!(p_ctx->segment_info.size % p_ctx->notification_size)*/
+  (p_ctx->segment_info.size -p_ctx->last_send_size) >= p_ctx->notification_size&&
+      p_ctx->segment_info.duration > 0) {
+    memset(&record_status, 0, sizeof(record_status));
+    //clock_gettime(CLOCK_MONOTONIC, &end_ts);
+    p_ctx->last_send_size = p_ctx->segment_info.size;
+    record_status.state = p_ctx->state;
+    record_status.info.id = p_ctx->segment_info.id;
+    record_status.info.duration = p_ctx->segment_info.duration;
+    record_status.info.size = p_ctx->segment_info.size;
+    record_status.info.nb_packets = p_ctx->segment_info.size/188;
+    record_status.bitrate = p_ctx->bitrate;
+    record_status.block_size = p_ctx->cur_block_size;
+    p_ctx->event_notify_fn(DVR_RECORD_EVENT_STATUS, &record_status, p_ctx->event_userdata);
+    DVR_DEBUG(2, "%s notify record status, state:%d, id:%lld, duration:%ld ms, size:%zu loc[%s]",
+        __func__, record_status.state,
+        record_status.info.id, record_status.info.duration,
+        record_status.info.size, p_ctx->location);
+  }
+  return DVR_SUCCESS;
+}
+
+/*Write back up to count encrypted blocks in submission order*/
+static int record_write_back(DVR_RecordContext_t *p_ctx, DVR_CryptoPoolHandle_t pool,
+    int count, int timeout, struct timespec *start_ts, time_t *pre_time)
+{
+  DVR_CryptoParams_t crypto_params;
+  int ret;
+
+  while (count-- > 0 &&
+      dvr_crypto_pool_collect(pool, &crypto_params, NULL, timeout) == DVR_SUCCESS) {
+    /* Out buffer length may not equal in buffer length */
+    ret = record_write_block(p_ctx, (uint8_t *)crypto_params.output_buffer.addr,
+        crypto_params.output_size, start_ts, pre_time);
+    if (ret != DVR_SUCCESS)
+      return ret;
+  }
+  return DVR_SUCCESS;
+}
+
+/*Measure the input bitrate, and size the next blocks to hold block_latency_ms of data*/
+static void record_adapt_block(DVR_RecordContext_t *p_ctx, ssize_t len)
+{
+  struct timespec now;
+  uint64_t ms, sample, size;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  if (!p_ctx->rate_ts.tv_sec && !p_ctx->rate_ts.tv_nsec) {
+    p_ctx->rate_ts = now;
+    p_ctx->rate_bytes = 0;
+    return;
+  }
+  p_ctx->rate_bytes += len;
+  ms = (now.tv_sec - p_ctx->rate_ts.tv_sec) * 1000 +
+    (now.tv_nsec - p_ctx->rate_ts.tv_nsec) / 1000000;
+  if (ms < RECORD_BITRATE_WINDOW)
+    return;
+
+  sample = p_ctx->rate_bytes * 8 * 1000 / ms;
+  p_ctx->bitrate = p_ctx->bitrate ? (uint32_t)((p_ctx->bitrate * 3ULL + sample) / 4) : (uint32_t)sample;
+  p_ctx->rate_ts = now;
+  p_ctx->rate_bytes = 0;
+  DVR_TRACE_COUNTER("record_bitrate", p_ctx->bitrate);
+
+  /*the secure path reads descriptors, its block size does not matter*/
+  if (!p_ctx->block_latency_ms || p_ctx->is_secure_mode)
+    return;
+  size = (uint64_t)p_ctx->bitrate / 8 * p_ctx->block_latency_ms / 1000;
+  size -= size % p_ctx->block_align;
+  if (size < p_ctx->block_min_size)
+    size = p_ctx->block_min_size;
+  if (size > p_ctx->block_max_size)
+    size = p_ctx->block_max_size;
+  if (size != p_ctx->cur_block_size) {
+    DVR_DEBUG(1, "%s, bitrate:%u block_size:%u -> %u", __func__,
+        p_ctx->bitrate, p_ctx->cur_block_size, (uint32_t)size);
+    p_ctx->cur_block_size = (uint32_t)size;
+    DVR_TRACE_COUNTER("record_block_size", size);
+  }
+}
+
 void *record_thread(void *arg)
 {
   DVR_RecordContext_t *p_ctx = (DVR_RecordContext_t *)arg;
   ssize_t len;
-  uint8_t *buf, *buf_out;
-  uint32_t block_size = p_ctx->block_size;
-  loff_t pos = 0;
+  uint8_t *buf, *buf_out = NULL;
+  /* Blocks are allocated at the largest size, the adaptive size only changes the reads */
+  uint32_t stride = p_ctx->block_latency_ms ? p_ctx->block_max_size : p_ctx->block_size;
+  uint32_t block_size;
   int ret;
-  struct timespec start_ts, end_ts;
+  struct timespec start_ts;
   DVR_RecordStatus_t record_status;
-  int has_pcr;
+  DVR_CryptoPoolHandle_t pool = NULL;
+  int nb_bufs = 1;
+  int slot = 0;
+  loff_t enc_offset;
+  DVR_Bool_t in_place;
 
   time_t pre_time = 0;
-  #define DVR_STORE_INFO_TIME (400)
   DVR_SecureBuffer_t secure_buf;
-  DVR_NewDmxSecureBuffer_t new_dmx_secure_buf;
 
   if (CONTROL_SPEED_ENABLE == 0)
     p_ctx->index_type = DVR_INDEX_TYPE_INVALID;
   else
     p_ctx->index_type = DVR_INDEX_TYPE_LOCAL_CLOCK;
 
-  buf = (uint8_t *)malloc(block_size);
+  /* Software encryption on the crypto workers, each worker owns two blocks in flight */
+  if (p_ctx->enc_func && !p_ctx->is_secure_mode && p_ctx->crypto_workers > 0) {
+    ret = dvr_crypto_pool_open(&pool, p_ctx->crypto_workers, p_ctx->crypto_workers * 2,
+        p_ctx->enc_func, p_ctx->enc_userdata);
+    if (ret == DVR_SUCCESS)
+      nb_bufs = p_ctx->crypto_workers * 2;
+    else
+      DVR_DEBUG(1, "%s, open crypto pool failed, encrypt in record thread", __func__);
+  }
+  enc_offset = p_ctx->segment_info.size;
+
+  buf = (uint8_t *)malloc(stride * nb_bufs);
   if (!buf) {
     DVR_DEBUG(1, "%s, malloc failed", __func__);
+    if (pool)
+      dvr_crypto_pool_close(pool);
     return NULL;
   }
 
-  buf_out = (uint8_t *)malloc(block_size + 188);
-  if (!buf_out) {
-    DVR_DEBUG(1, "%s, malloc failed", __func__);
-    free(buf);
-    return NULL;
+  /* The output buffer is only needed when the data cannot be encrypted in place */
+  in_place = (p_ctx->crypto_flags & DVR_CRYPTO_FLAG_IN_PLACE) && !p_ctx->is_secure_mode;
+  if (p_ctx->enc_func && !in_place) {
+    buf_out = (uint8_t *)malloc((stride + 188) * nb_bufs);
+    if (!buf_out) {
+      DVR_DEBUG(1, "%s, malloc failed", __func__);
+      free(buf);
+      if (pool)
+        dvr_crypto_pool_close(pool);
+      return NULL;
+    }
   }
 
   memset(&record_status, 0, sizeof(record_status));
@@ -215,41 +542,76 @@ void *record_thread(void *arg)
     DVR_DEBUG(1, "%s line %d notify record status, state:%d id=%lld",
           __func__,__LINE__, record_status.state, p_ctx->segment_info.id);
   }
-  DVR_DEBUG(1, "%s, secure_mode:%d, block_size:%d", __func__, p_ctx->is_secure_mode, block_size);
+  p_ctx->cur_block_size = stride;
+  p_ctx->bitrate = 0;
+  p_ctx->rate_bytes = 0;
+  clock_gettime(CLOCK_MONOTONIC, &p_ctx->rate_ts);
+  DVR_DEBUG(1, "%s, secure_mode:%d, block_size:%d latency:%d crypto_workers:%d in_place:%d", __func__,
+      p_ctx->is_secure_mode, stride, p_ctx->block_latency_ms, pool ? p_ctx->crypto_workers : 0, in_place);
   clock_gettime(CLOCK_MONOTONIC, &start_ts);
+  /*a resumed segment, the local clock time index continues from its duration*/
+  start_ts.tv_sec -= p_ctx->segment_info.duration / 1000;
+  start_ts.tv_nsec -= (p_ctx->segment_info.duration % 1000) * 1000000;
+  if (start_ts.tv_nsec < 0) {
+    start_ts.tv_sec--;
+    start_ts.tv_nsec += 1000000000;
+  }
+
+  /*what the previous segment's slot could not take starts this segment*/
+  if (p_ctx->held_len) {
+    uint8_t *held = p_ctx->held_buf;
 
-  struct timeval t1, t2, t3, t4, t5, t6, t7;
+    len = p_ctx->held_len;
+    p_ctx->held_buf = NULL;
+    p_ctx->held_len = 0;
+    p_ctx->held_size = 0;
+    ret = record_write_block(p_ctx, held, len, &start_ts, &pre_time);
+    free(held);
+    if (ret != DVR_SUCCESS)
+      goto end;
+  }
+
+  struct timeval t1, t2, t3, t4;
   while (p_ctx->state == DVR_RECORD_STATE_STARTED ||
     p_ctx->state == DVR_RECORD_STATE_PAUSE) {
 
+    if (pool) {
+      /* Write back the finished blocks, wait for one when all blocks are in flight */
+      ret = record_write_back(p_ctx, pool, nb_bufs, 0, &start_ts, &pre_time);
+      if (ret == DVR_SUCCESS && (p_ctx->state == DVR_RECORD_STATE_PAUSE ||
+          dvr_crypto_pool_get_pending(pool) == nb_bufs))
+        ret = record_write_back(p_ctx, pool,
+            p_ctx->state == DVR_RECORD_STATE_PAUSE ? nb_bufs : 1, -1, &start_ts, &pre_time);
+      if (ret != DVR_SUCCESS)
+        goto end;
+    }
+
+    if (p_ctx->held_len) {
+      /*the slot is full, the device buffer keeps the input until the next segment*/
+      usleep(20*1000);
+      continue;
+    }
+
     if (p_ctx->state == DVR_RECORD_STATE_PAUSE) {
-      //wait resume record
+      //wait resume record, the pause is not measured
+      memset(&p_ctx->rate_ts, 0, sizeof(p_ctx->rate_ts));
       usleep(20*1000);
       continue;
     }
     gettimeofday(&t1, NULL);
 
+    DVR_TRACE_BEGIN("record_device_read");
     /* data from dmx, normal dvr case */
     if (p_ctx->is_secure_mode) {
       if (p_ctx->is_new_dmx) {
-
-          /* We resolve the below invoke for dvbcore to be under safety status */
-          memset(&new_dmx_secure_buf, 0, sizeof(new_dmx_secure_buf));
-          len = record_device_read(p_ctx->dev_handle, &new_dmx_secure_buf, sizeof(new_dmx_secure_buf), 10);
-	  if (len == DVR_FAILURE) {
-	    DVR_DEBUG(1, "handle[%p] ret:%d\n", p_ctx->dev_handle, ret);
-	    /*For the second recording, poll always failed which we should check
-	     * dvbcore further. For now, Just ignore the fack poll fail, I think
-	     * it won't influce anything. But we need adjust the poll timeout
-	     * from 1000ms to 10ms.
-	     */
-	    //continue;
-	  }
-
-	  /* Read data from secure demux TA */
-	  len = record_device_read_ext(p_ctx->dev_handle, &secure_buf.addr,
-				       &secure_buf.len);
-
+          size_t sec_addr, sec_len;
+
+          /* Output updates of the secure demux, the service of the sid processes the data */
+          len = record_device_read_ext(p_ctx->dev_handle, &sec_addr, &sec_len, 1000);
+          if (len != DVR_FAILURE) {
+            secure_buf.addr = sec_addr;
+            secure_buf.len = sec_len;
+          }
       } else {
           memset(&secure_buf, 0, sizeof(secure_buf));
           len = record_device_read(p_ctx->dev_handle, &secure_buf, sizeof(secure_buf), 1000);
@@ -258,14 +620,18 @@ void *record_thread(void *arg)
         //DVR_DEBUG(1, "%s, secure_buf:%#x, size:%#x", __func__, secure_buf.addr, secure_buf.len);
       }
     } else {
-      len = record_device_read(p_ctx->dev_handle, buf, block_size, 1000);
+      block_size = p_ctx->cur_block_size;
+      len = record_device_read(p_ctx->dev_handle, buf + slot * stride, block_size, 1000);
     }
+    DVR_TRACE_END("record_device_read");
     if (len == DVR_FAILURE) {
       //usleep(10*1000);
       DVR_DEBUG(1, "%s, start_read error", __func__);
       continue;
     }
     gettimeofday(&t2, NULL);
+    DVR_TRACE_COUNTER("record_read_len", len);
+    record_adapt_block(p_ctx, len);
 
     /* Got data from device, record it */
     if (p_ctx->enc_func) {
@@ -276,132 +642,98 @@ void *record_thread(void *arg)
       crypto_params.type = DVR_CRYPTO_TYPE_ENCRYPT;
       memcpy(crypto_params.location, p_ctx->location, sizeof(p_ctx->location));
       crypto_params.segment_id = p_ctx->segment_info.id;
-      crypto_params.offset = p_ctx->segment_info.size;
+      crypto_params.offset = pool ? enc_offset : p_ctx->segment_info.size;
 
       if (p_ctx->is_secure_mode) {
         crypto_params.input_buffer.type = DVR_BUFFER_TYPE_SECURE;
-#if 0
-        if (p_ctx->is_new_dmx) {
-          crypto_params.input_buffer.addr = new_dmx_secure_buf.data_start;
-          crypto_params.input_buffer.size = new_dmx_secure_buf.data_end - new_dmx_secure_buf.data_start;
-        } else
-#endif
-	{
-          crypto_params.input_buffer.addr = secure_buf.addr;
-          crypto_params.input_buffer.size = secure_buf.len;
-        }
+        crypto_params.input_buffer.addr = secure_buf.addr;
+        crypto_params.input_buffer.size = secure_buf.len;
       } else {
         crypto_params.input_buffer.type = DVR_BUFFER_TYPE_NORMAL;
-        crypto_params.input_buffer.addr = (size_t)buf;
+        crypto_params.input_buffer.addr = (size_t)(buf + slot * stride);
         crypto_params.input_buffer.size = len;
       }
 
-      crypto_params.output_buffer.type = DVR_BUFFER_TYPE_NORMAL;
-      crypto_params.output_buffer.addr = (size_t)buf_out;
-      crypto_params.output_buffer.size = block_size + 188;
+      if (in_place) {
+        crypto_params.flags = DVR_CRYPTO_FLAG_IN_PLACE;
+        crypto_params.output_buffer = crypto_params.input_buffer;
+      } else {
+        crypto_params.output_buffer.type = DVR_BUFFER_TYPE_NORMAL;
+        crypto_params.output_buffer.addr = (size_t)(buf_out + slot * (stride + 188));
+        crypto_params.output_buffer.size = stride + 188;
+      }
 
-      p_ctx->enc_func(&crypto_params, p_ctx->enc_userdata);
-      gettimeofday(&t3, NULL);
-      /* Out buffer length may not equal in buffer length */
-      if (crypto_params.output_size > 0) {
-        ret = segment_write(p_ctx->segment_handle, buf_out, crypto_params.output_size);
-        len = crypto_params.output_size;
+      if (pool) {
+        /* Offsets of the blocks in flight are not known yet, key them by the input position */
+        enc_offset += len;
+        dvr_crypto_pool_submit(pool, &crypto_params);
+        slot = (slot + 1) % nb_bufs;
+        gettimeofday(&t3, NULL);
+        ret = record_write_back(p_ctx, pool, nb_bufs, 0, &start_ts, &pre_time);
       } else {
-        len = 0;
+        DVR_TRACE_BEGIN("enc_func");
+        p_ctx->enc_func(&crypto_params, p_ctx->enc_userdata);
+        DVR_TRACE_END("enc_func");
+        gettimeofday(&t3, NULL);
+        len = crypto_params.output_size;
+        ret = record_write_block(p_ctx, (uint8_t *)crypto_params.output_buffer.addr, len, &start_ts, &pre_time);
       }
     } else {
       gettimeofday(&t3, NULL);
-      ret = segment_write(p_ctx->segment_handle, buf, len);
+      ret = record_write_block(p_ctx, buf, len, &start_ts, &pre_time);
     }
-    gettimeofday(&t4, NULL);
-    //add DVR_RECORD_EVENT_WRITE_ERROR event if write error
-    if (ret == -1 && len > 0 && p_ctx->event_notify_fn) {
-      //send write event
-       if (p_ctx->event_notify_fn) {
-         memset(&record_status, 0, sizeof(record_status));
-         DVR_DEBUG(1, "%s：%d,send event write error", __func__,__LINE__);
-         record_status.info.id = p_ctx->segment_info.id;
-         p_ctx->event_notify_fn(DVR_RECORD_EVENT_WRITE_ERROR, &record_status, p_ctx->event_userdata);
-        }
-        DVR_DEBUG(1, "%s,write error %d", __func__,__LINE__);
+    if (ret != DVR_SUCCESS)
       goto end;
-    }
-    /* Do time index */
-    uint8_t *index_buf = p_ctx->enc_func ? buf_out : buf;
-    pos = segment_tell_position(p_ctx->segment_handle);
-    has_pcr = record_do_pcr_index(p_ctx, index_buf, len);
-    if (has_pcr == 0 && p_ctx->index_type == DVR_INDEX_TYPE_INVALID) {
-      clock_gettime(CLOCK_MONOTONIC, &end_ts);
-      if ((end_ts.tv_sec*1000 + end_ts.tv_nsec/1000000) -
-          (start_ts.tv_sec*1000 + start_ts.tv_nsec/1000000) > 40) {
-        /* PCR interval threshlod > 40 ms*/
-        DVR_DEBUG(1, "%s use local clock time index", __func__);
-        p_ctx->index_type = DVR_INDEX_TYPE_LOCAL_CLOCK;
-      }
-    } else if (has_pcr && p_ctx->index_type == DVR_INDEX_TYPE_INVALID){
-      DVR_DEBUG(1, "%s use pcr time index", __func__);
-      p_ctx->index_type = DVR_INDEX_TYPE_PCR;
-    }
-    gettimeofday(&t5, NULL);
-
-    /* Update segment info */
-    p_ctx->segment_info.size += len;
-    /*Duration need use pcr to calculate, todo...*/
-    if (p_ctx->index_type == DVR_INDEX_TYPE_PCR) {
-      p_ctx->segment_info.duration = segment_tell_total_time(p_ctx->segment_handle);
-      if (pre_time == 0)
-       pre_time = p_ctx->segment_info.duration;
-    } else if (p_ctx->index_type == DVR_INDEX_TYPE_LOCAL_CLOCK) {
-      clock_gettime(CLOCK_MONOTONIC, &end_ts);
-      p_ctx->segment_info.duration = (end_ts.tv_sec*1000 + end_ts.tv_nsec/1000000) -
-        (start_ts.tv_sec*1000 + start_ts.tv_nsec/1000000);
-            if (pre_time == 0)
-       pre_time = p_ctx->segment_info.duration;
-      segment_update_pts(p_ctx->segment_handle, p_ctx->segment_info.duration, pos);
-    } else {
-      DVR_DEBUG(1, "%s can NOT do time index", __func__);
-    }
-    p_ctx->segment_info.nb_packets = p_ctx->segment_info.size/188;
-
-    if (p_ctx->segment_info.duration - pre_time > DVR_STORE_INFO_TIME) {
-      pre_time = p_ctx->segment_info.duration + DVR_STORE_INFO_TIME;
-      segment_store_info(p_ctx->segment_handle, &(p_ctx->segment_info));
-    }
-    gettimeofday(&t6, NULL);
-     /*Event notification*/
-    if (p_ctx->notification_size &&
-        p_ctx->event_notify_fn &&
-        /*!(p_ctx->segment_info.size % p_ctx->notification_size)*/
-    (p_ctx->segment_info.size -p_ctx->last_send_size) >= p_ctx->notification_size&&
-        p_ctx->segment_info.duration > 0) {
-      memset(&record_status, 0, sizeof(record_status));
-      //clock_gettime(CLOCK_MONOTONIC, &end_ts);
-      p_ctx->last_send_size = p_ctx->segment_info.size;
-      record_status.state = p_ctx->state;
-      record_status.info.id = p_ctx->segment_info.id;
-      record_status.info.duration = p_ctx->segment_info.duration;
-      record_status.info.size = p_ctx->segment_info.size;
-      record_status.info.nb_packets = p_ctx->segment_info.size/188;
-      p_ctx->event_notify_fn(DVR_RECORD_EVENT_STATUS, &record_status, p_ctx->event_userdata);
-      DVR_DEBUG(1, "%s notify record status, state:%d, id:%lld, duration:%ld ms, size:%zu loc[%s]",
-          __func__, record_status.state,
-          record_status.info.id, record_status.info.duration,
-          record_status.info.size, p_ctx->location);
-    }
-    gettimeofday(&t7, NULL);
+    gettimeofday(&t4, NULL);
 #ifdef DEBUG_PERFORMANCE
-    DVR_DEBUG(1, "record count, read:%dms, encrypt:%dms, write:%dms, index:%dms, store:%dms, notify:%dms total:%dms read len:%zd ",
-        get_diff_time(t1, t2), get_diff_time(t2, t3), get_diff_time(t3, t4), get_diff_time(t4, t5),
-        get_diff_time(t5, t6), get_diff_time(t6, t7), get_diff_time(t1, t5), len);
+    DVR_DEBUG(2, "record count, read:%dms, encrypt:%dms, write and index:%dms, total:%dms read len:%zd ",
+        get_diff_time(t1, t2), get_diff_time(t2, t3), get_diff_time(t3, t4),
+        get_diff_time(t1, t4), len);
 #endif
   }
+  if (pool) {
+    /* Drain the blocks in flight before the segment is closed */
+    record_write_back(p_ctx, pool, nb_bufs, -1, &start_ts, &pre_time);
+  }
 end:
+  if (pool)
+    dvr_crypto_pool_close(pool);
   free((void *)buf);
-  free((void *)buf_out);
+  if (buf_out)
+    free((void *)buf_out);
   DVR_DEBUG(1, "exit %s", __func__);
   return NULL;
 }
 
+/*Adaptive block bounds, multiples of 188 and of the crypto block*/
+static void record_set_block_bounds(DVR_RecordContext_t *p_ctx, DVR_RecordOpenParams_t *params)
+{
+  uint32_t a = 188, b = params->crypto_block_size;
+  uint32_t t;
+
+  /*least common multiple*/
+  if (b) {
+    while (b) {
+      t = a % b;
+      a = b;
+      b = t;
+    }
+    a = 188 / a * params->crypto_block_size;
+  }
+  p_ctx->block_align = a;
+  p_ctx->block_latency_ms = params->block_latency_ms;
+  p_ctx->block_max_size = params->block_max_size ? params->block_max_size : p_ctx->block_size;
+  p_ctx->block_max_size -= p_ctx->block_max_size % a;
+  if (p_ctx->block_max_size < a)
+    p_ctx->block_max_size = a;
+  p_ctx->block_min_size = params->block_min_size ? params->block_min_size : RECORD_BLOCK_MIN_SIZE;
+  p_ctx->block_min_size = (p_ctx->block_min_size + a - 1) / a * a;
+  if (p_ctx->block_min_size > p_ctx->block_max_size)
+    p_ctx->block_min_size = p_ctx->block_max_size;
+  p_ctx->cur_block_size = p_ctx->block_latency_ms ? p_ctx->block_max_size : p_ctx->block_size;
+  p_ctx->bitrate = 0;
+}
+
 int dvr_record_open(DVR_RecordHandle_t *p_handle, DVR_RecordOpenParams_t *params)
 {
   DVR_RecordContext_t *p_ctx;
@@ -430,6 +762,8 @@ int dvr_record_open(DVR_RecordHandle_t *p_handle, DVR_RecordOpenParams_t *params
   p_ctx->last_send_size = 0;
   //check is new driver
   p_ctx->is_new_dmx = dvr_check_dmx_isNew();
+  if (params->dev_backend != RECORD_DEVICE_BACKEND_DVB)
+    p_ctx->is_new_dmx = DVR_FALSE;
   /*Process crypto params, todo*/
   memset((void *)&dev_open_params, 0, sizeof(dev_open_params));
   if (params->data_from_memory) {
@@ -441,6 +775,9 @@ int dvr_record_open(DVR_RecordHandle_t *p_handle, DVR_RecordOpenParams_t *params
     dev_open_params.dmx_dev_id = params->dmx_dev_id;
     dev_open_params.buf_size = (params->flush_size > 0 ? params->flush_size : RECORD_BLOCK_SIZE);
     dev_open_params.ringbuf_size = params->ringbuf_size;
+    dev_open_params.backend = params->dev_backend;
+    dev_open_params.src_file = params->dev_src_file;
+    dev_open_params.src_bitrate = params->dev_src_bitrate;
     if (p_ctx->is_new_dmx)
       dev_open_params.buf_size = NEW_DEVICE_RECORD_BLOCK_SIZE * 30;
     ret = record_device_open(&p_ctx->dev_handle, &dev_open_params);
@@ -456,6 +793,16 @@ int dvr_record_open(DVR_RecordHandle_t *p_handle, DVR_RecordOpenParams_t *params
   p_ctx->enc_func = NULL;
   p_ctx->enc_userdata = NULL;
   p_ctx->is_secure_mode = 0;
+  p_ctx->crypto_workers = params->crypto_workers;
+  p_ctx->crypto_flags = params->crypto_flags;
+  p_ctx->crypto_period = params->crypto_period;
+  p_ctx->prealloc_size = params->prealloc_size;
+  p_ctx->writeback_size = params->writeback_size;
+  p_ctx->direct_io = params->direct_io;
+  record_set_block_bounds(p_ctx, params);
+  memset(p_ctx->crypto_parity, -1, sizeof(p_ctx->crypto_parity));
+  if (p_ctx->crypto_workers > DVR_CRYPTO_POOL_MAX_WORKERS)
+    p_ctx->crypto_workers = DVR_CRYPTO_POOL_MAX_WORKERS;
   p_ctx->state = DVR_RECORD_STATE_OPENED;
   DVR_DEBUG(1, "%s, block_size:%d is_new:%d", __func__, p_ctx->block_size, p_ctx->is_new_dmx);
   *p_handle = p_ctx;
@@ -487,6 +834,10 @@ int dvr_record_close(DVR_RecordHandle_t handle)
     }
   }
 
+  free(p_ctx->held_buf);
+  p_ctx->held_buf = NULL;
+  p_ctx->held_len = 0;
+  p_ctx->held_size = 0;
   p_ctx->state = DVR_RECORD_STATE_CLOSED;
   return ret;
 }
@@ -549,7 +900,8 @@ int dvr_record_register_encryption(DVR_RecordHandle_t handle,
 }
 #endif
 
-int dvr_record_start_segment(DVR_RecordHandle_t handle, DVR_RecordStartParams_t *params)
+/*Start recording a segment, a new one or, with p_resume_size, the end of an existing one*/
+static int record_start_segment(DVR_RecordHandle_t handle, DVR_RecordStartParams_t *params, uint64_t *p_resume_size)
 {
   DVR_RecordContext_t *p_ctx;
   Segment_OpenParams_t open_params;
@@ -572,7 +924,11 @@ int dvr_record_start_segment(DVR_RecordHandle_t handle, DVR_RecordStartParams_t
   memset(&open_params, 0, sizeof(open_params));
   memcpy(open_params.location, params->location, sizeof(params->location));
   open_params.segment_id = params->segment.segment_id;
-  open_params.mode = SEGMENT_MODE_WRITE;
+  open_params.mode = p_resume_size ? SEGMENT_MODE_APPEND : SEGMENT_MODE_WRITE;
+  open_params.prealloc_size = p_ctx->prealloc_size;
+  open_params.writeback_size = p_ctx->writeback_size;
+  open_params.direct_io = p_ctx->direct_io;
+  open_params.resume_size = p_resume_size ? (loff_t)*p_resume_size : -1;
 
   ret = segment_open(&open_params, &p_ctx->segment_handle);
   DVR_RETURN_IF_FALSE(ret == DVR_SUCCESS);
@@ -587,6 +943,20 @@ int dvr_record_start_segment(DVR_RecordHandle_t handle, DVR_RecordStartParams_t
     p_ctx->segment_info.id = params->segment.segment_id;
     p_ctx->segment_info.nb_pids = params->segment.nb_pids;
     memcpy(p_ctx->segment_info.pids, params->segment.pids, params->segment.nb_pids*sizeof(DVR_StreamPid_t));
+    dvr_segment_summarize(&p_ctx->segment_info, NULL);
+    memset(p_ctx->pid_parity, -1, sizeof(p_ctx->pid_parity));
+    p_ctx->crypto_notify_size = 0;
+  }
+
+  /*the segment restored its end, continue from it*/
+  if (p_resume_size) {
+    uint64_t duration = segment_tell_total_time(p_ctx->segment_handle);
+
+    p_ctx->segment_info.size = segment_tell_position(p_ctx->segment_handle);
+    p_ctx->segment_info.duration = (duration == (uint64_t)DVR_FAILURE) ? 0 : duration;
+    p_ctx->segment_info.nb_packets = p_ctx->segment_info.size/188;
+    p_ctx->crypto_notify_size = p_ctx->segment_info.size;
+    *p_resume_size = p_ctx->segment_info.size;
   }
 
   if (!p_ctx->is_vod) {
@@ -608,6 +978,11 @@ int dvr_record_start_segment(DVR_RecordHandle_t handle, DVR_RecordStartParams_t
   return DVR_SUCCESS;
 }
 
+int dvr_record_start_segment(DVR_RecordHandle_t handle, DVR_RecordStartParams_t *params)
+{
+  return record_start_segment(handle, params, NULL);
+}
+
 int dvr_record_next_segment(DVR_RecordHandle_t handle, DVR_RecordStartParams_t *params, DVR_RecordSegmentInfo_t *p_info)
 {
   DVR_RecordContext_t *p_ctx;
@@ -658,6 +1033,9 @@ int dvr_record_next_segment(DVR_RecordHandle_t handle, DVR_RecordStartParams_t *
   memcpy(open_params.location, p_ctx->location, sizeof(p_ctx->location));
   open_params.segment_id = params->segment.segment_id;
   open_params.mode = SEGMENT_MODE_WRITE;
+  open_params.prealloc_size = p_ctx->prealloc_size;
+  open_params.writeback_size = p_ctx->writeback_size;
+  open_params.direct_io = p_ctx->direct_io;
   DVR_DEBUG(1, "%s: p_ctx->location:%s  params->location:%s", __func__, p_ctx->location,params->location);
 
   ret = segment_open(&open_params, &p_ctx->segment_handle);
@@ -670,6 +1048,8 @@ int dvr_record_next_segment(DVR_RecordHandle_t handle, DVR_RecordStartParams_t *
     memset(&p_ctx->segment_info, 0, sizeof(p_ctx->segment_info));
     p_ctx->segment_info.id = params->segment.segment_id;
     memcpy(p_ctx->segment_info.pids, params->segment.pids, params->segment.nb_pids*sizeof(DVR_StreamPid_t));
+    memset(p_ctx->pid_parity, -1, sizeof(p_ctx->pid_parity));
+    p_ctx->crypto_notify_size = 0;
   }
 
   p_ctx->segment_info.nb_pids = 0;
@@ -698,6 +1078,8 @@ int dvr_record_next_segment(DVR_RecordHandle_t handle, DVR_RecordStartParams_t *
 
   //ret = record_device_start(p_ctx->dev_handle);
   //DVR_RETURN_IF_FALSE(ret == DVR_SUCCESS);
+  /*p_info keeps the info of the segment just closed*/
+  dvr_segment_summarize(&p_ctx->segment_info, p_info);
   /*Update segment info*/
   ret = segment_store_info(p_ctx->segment_handle, &p_ctx->segment_info);
 
@@ -755,6 +1137,10 @@ int dvr_record_stop_segment(DVR_RecordHandle_t handle, DVR_RecordSegmentInfo_t *
       __func__, p_info->id, p_info->nb_pids, p_info->duration, p_info->size, p_info->nb_packets);
 
 end:
+  if (p_ctx->held_len) {
+    DVR_DEBUG(1, "%s, %zu bytes the full slot could not take are dropped", __func__, p_ctx->held_len);
+    p_ctx->held_len = 0;
+  }
   ret = segment_close(p_ctx->segment_handle);
   DVR_RETURN_IF_FALSE(ret == DVR_SUCCESS);
   return DVR_SUCCESS;
@@ -776,11 +1162,9 @@ int dvr_record_resume_segment(DVR_RecordHandle_t handle, DVR_RecordStartParams_t
   DVR_RETURN_IF_FALSE(p_resume_size);
 
   DVR_DEBUG(1, "%s , current state:%d, resume size:%lld", __func__, p_ctx->state, *p_resume_size);
-  ret = dvr_record_start_segment(handle, params);
+  ret = record_start_segment(handle, params, p_resume_size);
   DVR_RETURN_IF_FALSE(ret == DVR_SUCCESS);
 
-  p_ctx->segment_info.size = *p_resume_size;
-
   return DVR_SUCCESS;
 }
 
@@ -803,6 +1187,8 @@ int dvr_record_get_status(DVR_RecordHandle_t handle, DVR_RecordStatus_t *p_statu
   p_status->info.duration = p_ctx->segment_info.duration;
   p_status->info.size = p_ctx->segment_info.size;
   p_status->info.nb_packets = p_ctx->segment_info.size/188;
+  p_status->bitrate = p_ctx->bitrate;
+  p_status->block_size = p_ctx->cur_block_size;
 
   return DVR_SUCCESS;
 }
@@ -828,11 +1214,13 @@ int dvr_record_write(DVR_RecordHandle_t handle, void *buffer, uint32_t len)
   has_pcr = record_do_pcr_index(p_ctx, buffer, len);
   if (has_pcr == 0) {
     /* Pull VOD record shoud use PCR time index */
-    DVR_DEBUG(1, "%s has no pcr, can NOT do time index", __func__);
+    DVR_DEBUG_RL(1, 1000, "%s has no pcr, can NOT do time index", __func__);
   }
+  DVR_TRACE_BEGIN("segment_write");
   ret = segment_write(p_ctx->segment_handle, buffer, len);
+  DVR_TRACE_END("segment_write");
   if (ret != len) {
-    DVR_DEBUG(1, "%s write error ret:%d len:%d", __func__, ret, len);
+    DVR_DEBUG_RL(1, 1000, "%s write error ret:%d len:%d", __func__, ret, len);
   }
   p_ctx->segment_info.size += len;
   p_ctx->segment_info.nb_packets = p_ctx->segment_info.size/188;
@@ -1,3 +1,5 @@
+#define DVR_LOG_MODULE DVR_LOG_MODULE_SEGMENT
+
 #include <stdio.h>
 #include <unistd.h>
 #include <stdlib.h>
@@ -7,12 +9,26 @@
 #include "dvr_segment.h"
 #include <segment.h>
 
+/*Room left in a ring slot for the data recorded past segment_size before the next segment starts,
+ the record thread holds what does not fit, so this only needs to cover a status interval*/
+#define DVR_SEGMENT_RING_SLOT_MARGIN (4*1024*1024)
+/*Recordings repaired at once by dvr_segment_recover_locations*/
+#define DVR_SEGMENT_RECOVER_MAX_THREADS (4)
+
 /**\brief DVR segment file information*/
 typedef struct {
   char              location[DVR_MAX_LOCATION_SIZE];      /**< DVR record file location*/
   uint64_t          id;                                   /**< DVR Segment id*/
 } DVR_SegmentFile_t;
 
+/**\brief Recovery pass over several recordings, shared by its threads*/
+typedef struct {
+  const char        **locations;                          /**< Record file locations*/
+  int               nb_locations;                         /**< Number of locations*/
+  int               next;                                 /**< Next location to take*/
+  int               failed;                               /**< Number of locations not fully repaired*/
+} DVR_SegmentRecover_t;
+
 void *dvr_segment_thread(void *arg)
 {
   int ret;
@@ -67,6 +83,8 @@ int dvr_segment_del_by_location(const char *location)
   DVR_RETURN_IF_FALSE(location);
 
   DVR_DEBUG(1, "%s location:%s", __func__, location);
+  segment_ring_destroy(location);
+  segment_live_cache_destroy(location);
   {
     /* del file */
     memset(cmd, 0, sizeof(cmd));
@@ -79,6 +97,36 @@ int dvr_segment_del_by_location(const char *location)
   return DVR_SUCCESS;
 }
 
+int dvr_segment_ring_create(const char *location, loff_t max_size, loff_t segment_size)
+{
+  uint32_t nb_slots;
+
+  DVR_RETURN_IF_FALSE(location);
+  DVR_RETURN_IF_FALSE(max_size > 0 && segment_size > 0);
+
+  /*two more slots, the recording one and the one being deleted*/
+  nb_slots = (max_size + segment_size - 1) / segment_size + 2;
+  return segment_ring_create(location, nb_slots, segment_size + DVR_SEGMENT_RING_SLOT_MARGIN);
+}
+
+int dvr_segment_ring_destroy(const char *location)
+{
+  DVR_RETURN_IF_FALSE(location);
+  return segment_ring_destroy(location);
+}
+
+int dvr_segment_live_cache_create(const char *location, size_t size)
+{
+  DVR_RETURN_IF_FALSE(location);
+  return segment_live_cache_create(location, size);
+}
+
+int dvr_segment_live_cache_destroy(const char *location)
+{
+  DVR_RETURN_IF_FALSE(location);
+  return segment_live_cache_destroy(location);
+}
+
 int dvr_segment_get_list(const char *location, uint32_t *p_segment_nb, uint64_t **pp_segment_ids)
 {
   FILE *fp;
@@ -192,6 +240,75 @@ int dvr_segment_get_info(const char *location, uint64_t segment_id, DVR_RecordSe
   return DVR_SUCCESS;
 }
 
+static int segment_count_av(const DVR_RecordSegmentInfo_t *p_info)
+{
+  uint32_t i;
+  int n = 0;
+
+  for (i = 0; i < p_info->nb_pids && i < DVR_MAX_RECORD_PIDS_COUNT; i++) {
+    int type = (p_info->pids[i].type >> 24) & 0x0f;
+    if (type == DVR_STREAM_TYPE_VIDEO || type == DVR_STREAM_TYPE_AUDIO || type == DVR_STREAM_TYPE_AD)
+      n++;
+  }
+  return n;
+}
+
+int dvr_segment_summarize(DVR_RecordSegmentInfo_t *p_info, const DVR_RecordSegmentInfo_t *p_prev)
+{
+  DVR_SegmentSummary_t *s;
+  uint32_t i, j, nb_prev;
+
+  DVR_RETURN_IF_FALSE(p_info);
+  DVR_RETURN_IF_FALSE(p_info->nb_pids <= DVR_MAX_RECORD_PIDS_COUNT);
+
+  s = &p_info->summary;
+  s->flags = DVR_SEGMENT_SUMMARY_VALID;
+  s->video_format = -1;
+  s->audio_format = -1;
+
+  for (i = 0; i < p_info->nb_pids; i++) {
+    int type = (p_info->pids[i].type >> 24) & 0x0f;
+    int format = p_info->pids[i].type & 0xffffff;
+
+    if (type == DVR_STREAM_TYPE_VIDEO) {
+      s->flags |= DVR_SEGMENT_SUMMARY_VIDEO;
+      if (s->video_format < 0)
+        s->video_format = format;
+    } else if (type == DVR_STREAM_TYPE_AUDIO) {
+      s->flags |= DVR_SEGMENT_SUMMARY_AUDIO;
+      if (s->audio_format < 0)
+        s->audio_format = format;
+    } else if (type == DVR_STREAM_TYPE_AD) {
+      s->flags |= DVR_SEGMENT_SUMMARY_AD;
+    }
+  }
+
+  if (!p_prev)
+    return DVR_SUCCESS;
+  nb_prev = (p_prev->nb_pids < DVR_MAX_RECORD_PIDS_COUNT) ? p_prev->nb_pids : DVR_MAX_RECORD_PIDS_COUNT;
+
+  /*changed if an a/v pid, with its type and format, is not in the previous segment*/
+  if (segment_count_av(p_info) != segment_count_av(p_prev)) {
+    s->flags |= DVR_SEGMENT_SUMMARY_PIDS_CHANGED;
+    return DVR_SUCCESS;
+  }
+  for (i = 0; i < p_info->nb_pids; i++) {
+    int type = (p_info->pids[i].type >> 24) & 0x0f;
+
+    if (type != DVR_STREAM_TYPE_VIDEO && type != DVR_STREAM_TYPE_AUDIO && type != DVR_STREAM_TYPE_AD)
+      continue;
+    for (j = 0; j < nb_prev; j++) {
+      if (p_prev->pids[j].pid == p_info->pids[i].pid && p_prev->pids[j].type == p_info->pids[i].type)
+        break;
+    }
+    if (j == nb_prev) {
+      s->flags |= DVR_SEGMENT_SUMMARY_PIDS_CHANGED;
+      break;
+    }
+  }
+  return DVR_SUCCESS;
+}
+
 int dvr_segment_link(const char *location, uint32_t nb_segments, uint64_t *p_segment_ids)
 {
   return dvr_segment_link_op(location, nb_segments, p_segment_ids, LSEG_OP_NEW);
@@ -227,3 +344,64 @@ int dvr_segment_link_op(const char *location, uint32_t nb_segments, uint64_t *p_
   fclose(fp);
   return DVR_SUCCESS;
 }
+
+int dvr_segment_recover(const char *location)
+{
+  uint32_t i, segment_nb = 0;
+  uint64_t *p_segment_ids = NULL;
+  int ret = DVR_SUCCESS;
+
+  DVR_RETURN_IF_FALSE(location);
+  DVR_RETURN_IF_FALSE(strlen(location) < DVR_MAX_LOCATION_SIZE);
+
+  DVR_RETURN_IF_FALSE(dvr_segment_get_list(location, &segment_nb, &p_segment_ids) == DVR_SUCCESS);
+  for (i = 0; i < segment_nb; i++) {
+    if (segment_recover(location, p_segment_ids[i]) != DVR_SUCCESS) {
+      DVR_DEBUG(1, "%s, recover [%s-%lld] failed", __func__, location, p_segment_ids[i]);
+      ret = DVR_FAILURE;
+    }
+  }
+  if (p_segment_ids)
+    free(p_segment_ids);
+  return ret;
+}
+
+static void *dvr_segment_recover_thread(void *arg)
+{
+  DVR_SegmentRecover_t *recover = (DVR_SegmentRecover_t *)arg;
+  int i;
+
+  while ((i = __sync_fetch_and_add(&recover->next, 1)) < recover->nb_locations) {
+    if (dvr_segment_recover(recover->locations[i]) != DVR_SUCCESS)
+      __sync_fetch_and_add(&recover->failed, 1);
+  }
+  return NULL;
+}
+
+int dvr_segment_recover_locations(const char **locations, int nb_locations)
+{
+  DVR_SegmentRecover_t recover;
+  pthread_t threads[DVR_SEGMENT_RECOVER_MAX_THREADS];
+  int i, nb_threads;
+
+  DVR_RETURN_IF_FALSE(locations);
+  DVR_RETURN_IF_FALSE(nb_locations >= 0);
+
+  memset(&recover, 0, sizeof(recover));
+  recover.locations = locations;
+  recover.nb_locations = nb_locations;
+
+  /*the calling thread is one of the workers*/
+  nb_threads = nb_locations < DVR_SEGMENT_RECOVER_MAX_THREADS ? nb_locations : DVR_SEGMENT_RECOVER_MAX_THREADS;
+  for (i = 0; i < nb_threads - 1; i++) {
+    if (pthread_create(&threads[i], NULL, dvr_segment_recover_thread, &recover) != 0)
+      break;
+  }
+  nb_threads = i;
+  dvr_segment_recover_thread(&recover);
+  for (i = 0; i < nb_threads; i++)
+    pthread_join(threads[i], NULL);
+
+  DVR_DEBUG(1, "%s, locations:%d failed:%d", __func__, nb_locations, recover.failed);
+  return recover.failed ? DVR_FAILURE : DVR_SUCCESS;
+}
@@ -0,0 +1,195 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+
+#include "dvr_types.h"
+#include "dvr_trace.h"
+
+/**\brief Trace ring entry*/
+typedef struct {
+  volatile uint32_t  seq;       /**< Write sequence + 1 when complete, 0 while written*/
+  int                type;      /**< Event type*/
+  int                tid;       /**< Thread*/
+  uint64_t           time;      /**< Monotonic time in us*/
+  const char         *name;     /**< Event name*/
+  int64_t            value;     /**< Counter value*/
+} DVR_TraceEntry_t;
+
+volatile int dvr_trace_outputs;
+
+static DVR_TraceEntry_t trace_ring[DVR_TRACE_RING_SIZE];
+static volatile uint32_t trace_ring_pos;
+static int trace_marker_fd = -1;
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static const char *trace_marker_paths[] = {
+  "/sys/kernel/tracing/trace_marker",
+  "/sys/kernel/debug/tracing/trace_marker",
+};
+
+static uint64_t trace_time_us(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void trace_ring_put(int type, int tid, const char *name, int64_t value)
+{
+  uint32_t pos = __sync_fetch_and_add(&trace_ring_pos, 1);
+  DVR_TraceEntry_t *e = &trace_ring[pos & (DVR_TRACE_RING_SIZE - 1)];
+
+  e->seq = 0;
+  __sync_synchronize();
+  e->type = type;
+  e->tid = tid;
+  e->time = trace_time_us();
+  e->name = name;
+  e->value = value;
+  __sync_synchronize();
+  e->seq = pos + 1;
+}
+
+/*systrace format, parsed by perfetto and systrace from the ftrace buffer*/
+static void trace_marker_put(int fd, int type, const char *name, int64_t value)
+{
+  char buf[128];
+  int n;
+
+  switch (type) {
+    case DVR_TRACE_EVENT_BEGIN:
+      n = snprintf(buf, sizeof(buf), "B|%d|%s", getpid(), name);
+      break;
+    case DVR_TRACE_EVENT_END:
+      n = snprintf(buf, sizeof(buf), "E|%d", getpid());
+      break;
+    case DVR_TRACE_EVENT_COUNTER:
+      n = snprintf(buf, sizeof(buf), "C|%d|%s|%lld", getpid(), name, (long long)value);
+      break;
+    default:
+      n = snprintf(buf, sizeof(buf), "I|%d|%s", getpid(), name);
+      break;
+  }
+  if (n > (int)sizeof(buf) - 1)
+    n = sizeof(buf) - 1;
+  if (write(fd, buf, n) != n) {
+    /*marker write is best effort*/
+  }
+}
+
+void dvr_trace_event(int type, const char *name, int64_t value)
+{
+  int outputs = dvr_trace_outputs;
+  int fd = trace_marker_fd;
+
+  if (outputs & DVR_TRACE_OUTPUT_RING)
+    trace_ring_put(type, (int)syscall(SYS_gettid), name, value);
+  if ((outputs & DVR_TRACE_OUTPUT_FTRACE) && fd >= 0)
+    trace_marker_put(fd, type, name, value);
+}
+
+int dvr_trace_start(int outputs)
+{
+  size_t i;
+
+  pthread_mutex_lock(&trace_lock);
+  dvr_trace_outputs = 0;
+
+  if ((outputs & DVR_TRACE_OUTPUT_FTRACE) && trace_marker_fd < 0) {
+    for (i = 0; i < sizeof(trace_marker_paths) / sizeof(trace_marker_paths[0]); i++) {
+      trace_marker_fd = open(trace_marker_paths[i], O_WRONLY | O_CLOEXEC);
+      if (trace_marker_fd >= 0)
+        break;
+    }
+    if (trace_marker_fd < 0) {
+      DVR_DEBUG(1, "%s, no ftrace marker", __func__);
+      pthread_mutex_unlock(&trace_lock);
+      return DVR_FAILURE;
+    }
+  }
+
+  if (outputs & DVR_TRACE_OUTPUT_RING) {
+    memset(trace_ring, 0, sizeof(trace_ring));
+    trace_ring_pos = 0;
+  }
+
+  __sync_synchronize();
+  dvr_trace_outputs = outputs;
+  pthread_mutex_unlock(&trace_lock);
+
+  DVR_DEBUG(1, "%s, outputs:0x%x", __func__, outputs);
+  return DVR_SUCCESS;
+}
+
+int dvr_trace_stop(void)
+{
+  pthread_mutex_lock(&trace_lock);
+  dvr_trace_outputs = 0;
+  /*the marker fd is kept open, a late event may still be writing to it*/
+  pthread_mutex_unlock(&trace_lock);
+  return DVR_SUCCESS;
+}
+
+static int trace_flush(int fd, char *buf, int *p_len)
+{
+  int ret = (write(fd, buf, *p_len) == *p_len) ? DVR_SUCCESS : DVR_FAILURE;
+
+  *p_len = 0;
+  return ret;
+}
+
+int dvr_trace_dump_json(int fd)
+{
+  static const char *phases[] = {
+    [DVR_TRACE_EVENT_BEGIN]   = "B",
+    [DVR_TRACE_EVENT_END]     = "E",
+    [DVR_TRACE_EVENT_COUNTER] = "C",
+    [DVR_TRACE_EVENT_INSTANT] = "i",
+  };
+  DVR_TraceEntry_t e;
+  uint32_t end = trace_ring_pos;
+  uint32_t pos = (end > DVR_TRACE_RING_SIZE) ? end - DVR_TRACE_RING_SIZE : 0;
+  char buf[4096];
+  int len = 0;
+  int events = 0;
+  int pid = getpid();
+
+  len = snprintf(buf, sizeof(buf), "{\"traceEvents\":[");
+
+  for (; pos != end; pos++) {
+    DVR_TraceEntry_t *pe = &trace_ring[pos & (DVR_TRACE_RING_SIZE - 1)];
+
+    if (pe->seq != pos + 1)
+      continue;
+    __sync_synchronize();
+    memcpy(&e, pe, sizeof(e));
+    __sync_synchronize();
+    /*rewritten meanwhile*/
+    if (pe->seq != pos + 1 || e.type < 0 || e.type > DVR_TRACE_EVENT_INSTANT)
+      continue;
+
+    if (len > (int)sizeof(buf) - 256 && trace_flush(fd, buf, &len) != DVR_SUCCESS)
+      return DVR_FAILURE;
+
+    len += snprintf(buf + len, sizeof(buf) - len,
+        "%s\n{\"name\":\"%s\",\"ph\":\"%s\",\"ts\":%llu,\"pid\":%d,\"tid\":%d",
+        events ? "," : "", e.name ? e.name : "", phases[e.type],
+        (unsigned long long)e.time, pid, e.tid);
+    if (e.type == DVR_TRACE_EVENT_COUNTER)
+      len += snprintf(buf + len, sizeof(buf) - len, ",\"args\":{\"value\":%lld}", (long long)e.value);
+    else if (e.type == DVR_TRACE_EVENT_INSTANT)
+      len += snprintf(buf + len, sizeof(buf) - len, ",\"s\":\"t\"");
+    len += snprintf(buf + len, sizeof(buf) - len, "}");
+    events++;
+  }
+
+  len += snprintf(buf + len, sizeof(buf) - len, "\n],\"displayTimeUnit\":\"ms\"}\n");
+  if (trace_flush(fd, buf, &len) != DVR_SUCCESS)
+    return DVR_FAILURE;
+  return events;
+}
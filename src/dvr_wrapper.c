@@ -1,6 +1,9 @@
+#define DVR_LOG_MODULE DVR_LOG_MODULE_WRAPPER
+
 #include <stddef.h>
 #include <stdlib.h>
 #include <pthread.h>
+#include <sched.h>
 #include <string.h>
 #include <time.h>
 #include <errno.h>
@@ -13,11 +16,10 @@
 #include "dvr_playback.h"
 #include "dvr_segment.h"
 
-#include "AmTsPlayer.h"
-
 #include "list.h"
 
 #include "dvr_wrapper.h"
+#include "dvr_trace.h"
 
 #define DVR_WRAPPER_DEBUG(_level, _fmt...) \
   DVR_DEBUG_FL(_level, "wrapper", _fmt)
@@ -26,6 +28,8 @@
 #define TIMESHIFT_DATA_DURATION_TO_RESUME (600)
 /*a tolerant gap*/
 #define DVR_PLAYBACK_END_GAP              (1000)
+/*segments to load per background load event after the playback started*/
+#define PLAYBACK_LOAD_BATCH               (4)
 
 enum {
   W_REC      = 1,
@@ -38,10 +42,25 @@ enum {
   U_ALL      = U_PIDS | U_STAT,
 };
 
+enum {
+  EVT_F_PIDS = 0x01,  /**<pids changed, carried in the event tail*/
+};
+
+/*wrapper internal playback event, loads the pending segments on the wrapper thread*/
+#define W_EVT_LOAD_SEGMENTS ((DVR_PlaybackEvent_t)0x7fff)
+
 typedef struct {
   /*make lock the 1st item in the structure*/
   pthread_mutex_t               lock;
 
+  /*status snapshot, seqlock read without the lock above, written with it held*/
+  volatile uint32_t             snap_seq;                    /**<odd while the snapshot is being written*/
+  unsigned long                 snap_sn;                     /**<sn the snapshot belongs to, 0 if none*/
+  union {
+    DVR_WrapperRecordStatus_t     record;
+    DVR_WrapperPlaybackStatus_t   playback;
+  } snap;
+
   /*rec or play*/
   int                           type;
 
@@ -67,6 +86,9 @@ typedef struct {
       uint64_t                        next_segment_id;
 
       DVR_WrapperInfo_t               obsolete;             /**<data obsolete due to the max limit*/
+      DVR_WrapperInfo_t               seg_total;            /**<running total of the listed segments*/
+      DVR_WrapperPidsInfo_t           evt_pids;             /**<pids of the last event queued, event handler only*/
+      uint64_t                        evt_segment_id;       /**<segment of the last event queued, event handler only*/
     } record;
 
     struct {
@@ -84,6 +106,16 @@ typedef struct {
       DVR_Bool_t                      reach_end;
 
       DVR_WrapperInfo_t               obsolete;
+      DVR_WrapperInfo_t               seg_total;            /**<running total of the listed segments*/
+      DVR_WrapperInfo_t               seg_before;           /**<running total of the segments added before the current one*/
+      uint64_t                        seg_before_id;        /**<current segment id seg_before is valid for*/
+      uint32_t                        seg_before_mark;      /**<add mark of the current segment, UINT32_MAX if not listed*/
+      DVR_Bool_t                      seg_before_valid;     /**<seg_before is valid*/
+      uint32_t                        next_mark;            /**<add mark of the next segment*/
+
+      uint64_t                        *load_ids;            /**<listed segments whose info is not loaded yet, NULL if none*/
+      uint32_t                        load_nb;              /**<number of load_ids*/
+      uint32_t                        load_pos;             /**<next of load_ids to load*/
     } playback;
   };
 } DVR_WrapperCtx_t;
@@ -95,16 +127,30 @@ typedef struct {
   /* rec or playback */
   int type;
 
+  /*only the fields the wrapper uses, pids follow the event if changed*/
   union {
     struct {
-      DVR_RecordEvent_t event;
-      DVR_RecordStatus_t status;
+      DVR_RecordEvent_t       event;
+      DVR_RecordState_t       state;
+      uint64_t                segment_id;
+      time_t                  duration;
+      size_t                  size;
+      uint32_t                nb_packets;
+      uint32_t                bitrate;
+      uint32_t                block_size;
+      uint32_t                changed;      /**<EVT_F_* */
     } record;
     struct {
-      DVR_PlaybackEvent_t event;
-      DVR_Play_Notify_t status;
+      DVR_PlaybackEvent_t     event;
+      DVR_PlaybackPlayState_t state;
+      uint64_t                segment_id;
+      uint32_t                time_cur;
+      uint32_t                time_end;
+      int                     speed;
+      DVR_PlaybackSegmentFlag_t flags;
     } playback;
   };
+  DVR_WrapperPidsInfo_t pids[];
 } DVR_WrapperEventCtx_t;
 
 typedef struct {
@@ -121,6 +167,7 @@ typedef struct {
 
   DVR_RecordSegmentInfo_t seg_info;
   DVR_PlaybackSegmentInfo_t playback_info;
+  uint32_t mark;                            /**<add order in the playback*/
 } DVR_WrapperPlaybackSegmentInfo_t;
 
 typedef struct {
@@ -255,15 +302,11 @@ static inline DVR_WrapperEventCtx_t *ctx_getPlaybackEvent()
   return ctx_getEvent(&playback_evt_list, &playback_evt_list_lock);
 }
 
+/*the event is allocated by the caller and freed by ctx_freeEvent*/
 static int ctx_addEvent(struct list_head *list, pthread_mutex_t *lock, DVR_WrapperEventCtx_t *evt)
 {
-  DVR_WrapperEventCtx_t *padd;
-  padd = (DVR_WrapperEventCtx_t *)calloc(1, sizeof(DVR_WrapperEventCtx_t));
-  DVR_RETURN_IF_FALSE(padd);
-
-  *padd = *evt;
   pthread_mutex_lock(lock);
-  list_add_tail(&padd->head, list);
+  list_add_tail(&evt->head, list);
   pthread_mutex_unlock(lock);
   return DVR_SUCCESS;
 }
@@ -328,8 +371,25 @@ static inline DVR_WrapperCtx_t *ctx_get(unsigned long sn, DVR_WrapperCtx_t *list
   return NULL;
 }
 
+/*seqlock writer side, the writers are serialized by ctx->lock*/
+static inline void ctx_snapBegin(DVR_WrapperCtx_t *ctx)
+{
+  ctx->snap_seq++;
+  __sync_synchronize();
+}
+
+static inline void ctx_snapEnd(DVR_WrapperCtx_t *ctx)
+{
+  __sync_synchronize();
+  ctx->snap_seq++;
+}
+
 static inline void ctx_reset(DVR_WrapperCtx_t *ctx)
 {
+  ctx_snapBegin(ctx);
+  ctx->snap_sn = 0;
+  ctx_snapEnd(ctx);
+
   memset((char *)ctx + offsetof(DVR_WrapperCtx_t, sn),
     0,
     sizeof(DVR_WrapperCtx_t) - offsetof(DVR_WrapperCtx_t, sn));
@@ -519,8 +579,11 @@ static void *wrapper_task(void *arg)
 
         if (ctx_valid(ctx)) {
           /*double check after lock*/
-          if (evt->sn == ctx->sn)
+          if (evt->sn == ctx->sn) {
+            DVR_TRACE_BEGIN("wrapper_event");
             process_handleEvents(evt, ctx);
+            DVR_TRACE_END("wrapper_event");
+          }
         }
         pthread_mutex_unlock(&ctx->lock);
       }
@@ -563,12 +626,86 @@ static inline void ctx_freeSegments(DVR_WrapperCtx_t *ctx)
     list_del(&pseg->head);
     free(pseg);
   }
+
+  if (ctx->type == W_REC) {
+    memset(&ctx->record.seg_total, 0, sizeof(ctx->record.seg_total));
+  } else {
+    memset(&ctx->playback.seg_total, 0, sizeof(ctx->playback.seg_total));
+    ctx->playback.seg_before_valid = DVR_FALSE;
+    free(ctx->playback.load_ids);
+    ctx->playback.load_ids = NULL;
+    ctx->playback.load_nb = 0;
+    ctx->playback.load_pos = 0;
+  }
+}
+
+/*running totals, so that the status is not re-calculated over the segment list*/
+static inline void info_add(DVR_WrapperInfo_t *info, DVR_RecordSegmentInfo_t *seg_info)
+{
+  info->time += seg_info->duration;
+  info->size += seg_info->size;
+  info->pkts += seg_info->nb_packets;
+}
+
+static inline void info_sub(DVR_WrapperInfo_t *info, DVR_RecordSegmentInfo_t *seg_info)
+{
+  info->time -= seg_info->duration;
+  info->size -= seg_info->size;
+  info->pkts -= seg_info->nb_packets;
+}
+
+static inline void ctx_publishRecordStatus(DVR_WrapperCtx_t *ctx, DVR_WrapperRecordStatus_t *status)
+{
+  ctx_snapBegin(ctx);
+  ctx->snap.record = *status;
+  ctx->snap_sn = ctx->sn;
+  ctx_snapEnd(ctx);
+}
+
+static inline void ctx_publishPlaybackStatus(DVR_WrapperCtx_t *ctx, DVR_WrapperPlaybackStatus_t *status)
+{
+  ctx_snapBegin(ctx);
+  ctx->snap.playback = *status;
+  ctx->snap_sn = ctx->sn;
+  ctx_snapEnd(ctx);
+}
+
+/*seqlock reader side, retries while a writer is active or has run meanwhile*/
+static int ctx_readSnapshot(DVR_WrapperCtx_t *ctx, unsigned long sn, void *status, size_t size, uint32_t *p_version)
+{
+  uint32_t seq;
+  unsigned long snap_sn;
+
+  for (;;) {
+    seq = ctx->snap_seq;
+    if (seq & 1) {
+      sched_yield();
+      continue;
+    }
+    __sync_synchronize();
+    snap_sn = ctx->snap_sn;
+    memcpy(status, &ctx->snap, size);
+    __sync_synchronize();
+    if (ctx->snap_seq == seq)
+      break;
+  }
+
+  DVR_RETURN_IF_FALSE(snap_sn == sn);
+  if (p_version)
+    *p_version = seq >> 1;
+  return DVR_SUCCESS;
 }
 
 static inline void _updatePlaybackSegment(DVR_WrapperPlaybackSegmentInfo_t *pseg,
     DVR_RecordSegmentInfo_t *seg_info, int update_flags, DVR_WrapperCtx_t *ctx)
 {
-  (void)ctx;
+  DVR_Bool_t before = ctx->playback.seg_before_valid
+    && pseg->mark < ctx->playback.seg_before_mark;
+
+  info_sub(&ctx->playback.seg_total, &pseg->seg_info);
+  if (before)
+    info_sub(&ctx->playback.seg_before, &pseg->seg_info);
+
   if ((update_flags & U_PIDS) && (update_flags & U_STAT))
     pseg->seg_info = *seg_info;
   else if (update_flags & U_PIDS) {
@@ -579,6 +716,11 @@ static inline void _updatePlaybackSegment(DVR_WrapperPlaybackSegmentInfo_t *pseg
     pseg->seg_info.size = seg_info->size;
     pseg->seg_info.nb_packets = seg_info->nb_packets;
   }
+
+  info_add(&ctx->playback.seg_total, &pseg->seg_info);
+  if (before)
+    info_add(&ctx->playback.seg_before, &pseg->seg_info);
+
   //update current segment duration on timeshift mode
   if (ctx->playback.param_open.is_timeshift)
     dvr_playback_update_duration(ctx->playback.player,pseg->seg_info.id,pseg->seg_info.duration);
@@ -599,7 +741,7 @@ static int wrapper_updatePlaybackSegment(DVR_WrapperCtx_t *ctx, DVR_RecordSegmen
 {
   DVR_WrapperPlaybackSegmentInfo_t *pseg;
 
-  DVR_WRAPPER_DEBUG(1, "timeshift, update playback segments(wrapper), seg:%lld t/s/p(%ld/%zu/%u)\n",
+  DVR_WRAPPER_DEBUG(2, "timeshift, update playback segments(wrapper), seg:%lld t/s/p(%ld/%zu/%u)\n",
     seg_info->id, seg_info->duration, seg_info->size, seg_info->nb_packets);
 
   if (list_empty(&ctx->segments)) {
@@ -654,7 +796,7 @@ static int wrapper_updatePlaybackSegment(DVR_WrapperCtx_t *ctx, DVR_RecordSegmen
 static void _updateRecordSegment(DVR_WrapperRecordSegmentInfo_t *pseg,
   DVR_RecordSegmentInfo_t *seg_info, int update_flags, DVR_WrapperCtx_t *ctx)
 {
-  (void)ctx;
+  info_sub(&ctx->record.seg_total, &pseg->info);
   if ((update_flags & U_PIDS) && (update_flags & U_STAT))
     pseg->info = *seg_info;
   else if (update_flags & U_PIDS) {
@@ -665,27 +807,35 @@ static void _updateRecordSegment(DVR_WrapperRecordSegmentInfo_t *pseg,
     pseg->info.size = seg_info->size;
     pseg->info.nb_packets = seg_info->nb_packets;
   }
+  info_add(&ctx->record.seg_total, &pseg->info);
 }
 
-static int wrapper_updateRecordSegment(DVR_WrapperCtx_t *ctx, DVR_RecordSegmentInfo_t *seg_info, int update_flags)
+static DVR_WrapperRecordSegmentInfo_t *wrapper_findRecordSegment(DVR_WrapperCtx_t *ctx, uint64_t id)
 {
-  DVR_WrapperRecordSegmentInfo_t *pseg = NULL;
+  DVR_WrapperRecordSegmentInfo_t *pseg;
 
-  /*normally, the last segment added will be updated*/
-  if (!list_empty(&ctx->segments)) {
-    pseg =
-      list_first_entry(&ctx->segments, DVR_WrapperRecordSegmentInfo_t, head);
-    if (pseg->info.id == seg_info->id) {
-      _updateRecordSegment(pseg, seg_info, update_flags, ctx);
-    } else {
-      list_for_each_entry_reverse(pseg, &ctx->segments, head) {
-        if (pseg->info.id == seg_info->id) {
-          _updateRecordSegment(pseg, seg_info, update_flags, ctx);
-          break;
-        }
-      }
-    }
+  if (list_empty(&ctx->segments))
+    return NULL;
+
+  /*normally, the last segment added is looked for*/
+  pseg = list_first_entry(&ctx->segments, DVR_WrapperRecordSegmentInfo_t, head);
+  if (pseg->info.id == id)
+    return pseg;
+
+  list_for_each_entry_reverse(pseg, &ctx->segments, head) {
+    if (pseg->info.id == id)
+      return pseg;
   }
+  return NULL;
+}
+
+static int wrapper_updateRecordSegment(DVR_WrapperCtx_t *ctx, DVR_RecordSegmentInfo_t *seg_info, int update_flags)
+{
+  DVR_WrapperRecordSegmentInfo_t *pseg;
+
+  pseg = wrapper_findRecordSegment(ctx, seg_info->id);
+  if (pseg)
+    _updateRecordSegment(pseg, seg_info, update_flags, ctx);
 
   /*timeshift, update the segment for playback*/
   /*
@@ -735,10 +885,24 @@ static int wrapper_addPlaybackSegment(DVR_WrapperCtx_t *ctx,
   pseg->playback_info.segment_id = pseg->seg_info.id;
   strncpy(pseg->playback_info.location, ctx->playback.param_open.location, sizeof(pseg->playback_info.location));
   pseg->playback_info.pids = *p_pids;
+  /*the player skips the pid check at the boundary of a segment with unchanged pids*/
+  pseg->playback_info.summary = pseg->seg_info.summary;
+  if ((pseg->seg_info.summary.flags & DVR_SEGMENT_SUMMARY_VALID)
+      && !(pseg->seg_info.summary.flags & DVR_SEGMENT_SUMMARY_PIDS_CHANGED))
+    flags |= DVR_PLAYBACK_SEGMENT_CONTINUOUS;
   pseg->playback_info.flags = flags;
+  pseg->mark = ctx->playback.next_mark++;
   list_add(&pseg->head, &ctx->segments);
   pseg->playback_info.duration = pseg->seg_info.duration;
 
+  info_add(&ctx->playback.seg_total, &pseg->seg_info);
+  if (ctx->playback.seg_before_valid) {
+    if (pseg->seg_info.id == ctx->playback.seg_before_id)
+      ctx->playback.seg_before_valid = DVR_FALSE;
+    else if (pseg->mark < ctx->playback.seg_before_mark)
+      info_add(&ctx->playback.seg_before, &pseg->seg_info);
+  }
+
   error = dvr_playback_add_segment(ctx->playback.player, &pseg->playback_info);
   if (error) {
     DVR_WRAPPER_DEBUG(1, "fail to add segment %lld (%d)\n", pseg->playback_info.segment_id, error);
@@ -751,6 +915,115 @@ static int wrapper_addPlaybackSegment(DVR_WrapperCtx_t *ctx,
   return error;
 }
 
+/*tell if a segment to add to the playback has audio or video,
+  the segments recorded by older versions have no summary, compare with the one added before*/
+static DVR_Bool_t wrapper_hasPlaybackAV(DVR_WrapperCtx_t *ctx, DVR_RecordSegmentInfo_t *seg_info)
+{
+  if (!(seg_info->summary.flags & DVR_SEGMENT_SUMMARY_VALID)) {
+    DVR_WrapperPlaybackSegmentInfo_t *prev = NULL;
+
+    if (!list_empty(&ctx->segments))
+      prev = list_first_entry(&ctx->segments, DVR_WrapperPlaybackSegmentInfo_t, head);
+    dvr_segment_summarize(seg_info, prev ? &prev->seg_info : NULL);
+  }
+  if (!(seg_info->summary.flags
+      & (DVR_SEGMENT_SUMMARY_VIDEO | DVR_SEGMENT_SUMMARY_AUDIO | DVR_SEGMENT_SUMMARY_AD))) {
+    DVR_WRAPPER_DEBUG(1, "playback(sn:%ld) seg(%llu) has no av, skipped\n", ctx->sn, (unsigned long long)seg_info->id);
+    return DVR_FALSE;
+  }
+  return DVR_TRUE;
+}
+
+/*add a listed segment to the playback, the ones without audio or video are skipped*/
+static int wrapper_loadPlaybackSegment(DVR_WrapperCtx_t *ctx, uint64_t segment_id)
+{
+  DVR_RecordSegmentInfo_t seg_info;
+  DVR_PlaybackSegmentFlag_t flags;
+  int error;
+
+  error = dvr_segment_get_info(ctx->playback.param_open.location, segment_id, &seg_info);
+  if (error) {
+    DVR_WRAPPER_DEBUG(1, "fail to get seg info (location:%s, seg:%llu), (error:%d)\n",
+      ctx->playback.param_open.location, segment_id, error);
+    return DVR_FAILURE;
+  }
+
+  if (!wrapper_hasPlaybackAV(ctx, &seg_info))
+    return DVR_SUCCESS;
+
+  flags = DVR_PLAYBACK_SEGMENT_DISPLAYABLE;
+  return wrapper_addPlaybackSegment(ctx, &seg_info, &ctx->playback.pids_req, flags);
+}
+
+/*
+  load the info of the pending listed segments in order,
+  at most max_nb of them, and stop once the segments listed cover time_offset,
+  a segment that can not be loaded is left out and the ones after it are still loaded
+*/
+static int wrapper_loadPlaybackSegments(DVR_WrapperCtx_t *ctx, uint32_t max_nb, uint32_t time_offset)
+{
+  uint32_t n = 0;
+
+  while (ctx->playback.load_ids
+      && ctx->playback.load_pos < ctx->playback.load_nb
+      && n < max_nb
+      && (uint64_t)(ctx->playback.obsolete.time + ctx->playback.seg_total.time) <= time_offset) {
+    if (wrapper_loadPlaybackSegment(ctx, ctx->playback.load_ids[ctx->playback.load_pos]) != DVR_SUCCESS)
+      DVR_WRAPPER_DEBUG(1, "playback(sn:%ld) seg(%llu) can not be loaded, skipped\n",
+        ctx->sn, (unsigned long long)ctx->playback.load_ids[ctx->playback.load_pos]);
+    ctx->playback.load_pos++;
+    n++;
+  }
+
+  if (ctx->playback.load_ids && ctx->playback.load_pos >= ctx->playback.load_nb) {
+    DVR_WRAPPER_DEBUG(1, "playback(sn:%ld) all %u segments loaded\n", ctx->sn, ctx->playback.load_nb);
+    free(ctx->playback.load_ids);
+    ctx->playback.load_ids = NULL;
+    ctx->playback.load_nb = 0;
+    ctx->playback.load_pos = 0;
+  }
+  return DVR_SUCCESS;
+}
+
+/*add the recording segments to the timeshift playback, the recorder is locked*/
+static int wrapper_snapshotRecordSegments(DVR_WrapperCtx_t *ctx, DVR_WrapperCtx_t *ctx_record)
+{
+  DVR_WrapperRecordSegmentInfo_t *pseg;
+  DVR_PlaybackSegmentFlag_t flags;
+  int error = DVR_SUCCESS;
+
+  flags = DVR_PLAYBACK_SEGMENT_DISPLAYABLE;
+  list_for_each_entry_reverse(pseg, &ctx_record->segments, head) {
+    DVR_RecordSegmentInfo_t seg_info = pseg->info;
+
+    /*the same filter as the listed segments*/
+    if (!wrapper_hasPlaybackAV(ctx, &seg_info))
+      continue;
+    error = wrapper_addPlaybackSegment(ctx, &seg_info, &ctx->playback.pids_req, flags);
+    if (error)
+      break;
+  }
+  ctx->playback.obsolete = ctx_record->record.obsolete;
+  return error;
+}
+
+/*set the info of a segment starting with the params, summarized against the segment recorded before*/
+static void wrapper_initRecordSegment(DVR_WrapperCtx_t *ctx, DVR_RecordSegmentInfo_t *seg_info, DVR_RecordStartParams_t *params)
+{
+  DVR_WrapperRecordSegmentInfo_t *prev = NULL;
+  uint32_t i;
+
+  memset(seg_info, 0, sizeof(*seg_info));
+  seg_info->id = params->segment.segment_id;
+  for (i = 0; i < params->segment.nb_pids && i < DVR_MAX_RECORD_PIDS_COUNT; i++) {
+    if (params->segment.pid_action[i] != DVR_RECORD_PID_CLOSE)
+      seg_info->pids[seg_info->nb_pids++] = params->segment.pids[i];
+  }
+  if (!list_empty(&ctx->segments))
+    prev = list_first_entry(&ctx->segments, DVR_WrapperRecordSegmentInfo_t, head);
+  dvr_segment_summarize(seg_info, prev ? &prev->info : NULL);
+}
+
 static int wrapper_addRecordSegment(DVR_WrapperCtx_t *ctx, DVR_RecordSegmentInfo_t *seg_info)
 {
   DVR_WrapperRecordSegmentInfo_t *pseg;
@@ -761,10 +1034,12 @@ static int wrapper_addRecordSegment(DVR_WrapperCtx_t *ctx, DVR_RecordSegmentInfo
   if (!pseg) {
     error = DVR_FAILURE;
     DVR_WRAPPER_DEBUG(1, "memory fail\n");
+    return error;
   }
   pseg->info = *seg_info;
   list_add(&pseg->head, &ctx->segments);
-  
+  info_add(&ctx->record.seg_total, &pseg->info);
+
   if (ctx->record.param_open.is_timeshift
     || !strcmp(ctx->record.param_open.location, ctx->playback.param_open.location)) {
     DVR_WrapperCtx_t *ctx_playback = ctx_getPlayback(sn_timeshift_playback);
@@ -776,7 +1051,7 @@ static int wrapper_addRecordSegment(DVR_WrapperCtx_t *ctx, DVR_RecordSegmentInfo
 
         /*only if playback has started, the previous segments have been loaded*/
         if (!list_empty(&ctx_playback->segments)) {
-          flags = DVR_PLAYBACK_SEGMENT_DISPLAYABLE | DVR_PLAYBACK_SEGMENT_CONTINUOUS;
+          flags = DVR_PLAYBACK_SEGMENT_DISPLAYABLE;
           if (ctx->record.param_open.flags & DVR_RECORD_FLAG_SCRAMBLED)
             flags |= DVR_PLAYBACK_SEGMENT_ENCRYPTED;
           wrapper_addPlaybackSegment(ctx_playback, seg_info, &ctx_playback->playback.pids_req, flags);
@@ -836,6 +1111,14 @@ static int wrapper_removePlaybackSegment(DVR_WrapperCtx_t *ctx, DVR_RecordSegmen
 
       list_del(&pseg->head);
 
+      info_sub(&ctx->playback.seg_total, &pseg->seg_info);
+      if (ctx->playback.seg_before_valid) {
+        if (pseg->mark == ctx->playback.seg_before_mark)
+          ctx->playback.seg_before_valid = DVR_FALSE;
+        else if (pseg->mark < ctx->playback.seg_before_mark)
+          info_sub(&ctx->playback.seg_before, &pseg->seg_info);
+      }
+
       /*record the obsolete*/
       ctx->playback.obsolete.time += pseg->seg_info.duration;
       ctx->playback.obsolete.size += pseg->seg_info.size;
@@ -877,6 +1160,8 @@ static int wrapper_removeRecordSegment(DVR_WrapperCtx_t *ctx, DVR_WrapperRecordS
     if (pseg->info.id == seg_info->info.id) {
       list_del(&pseg->head);
 
+      info_sub(&ctx->record.seg_total, &pseg->info);
+
       /*record the obsolete*/
       ctx->record.obsolete.time += pseg->info.duration;
       ctx->record.obsolete.size += pseg->info.size;
@@ -932,6 +1217,18 @@ int dvr_wrapper_open_record (DVR_WrapperRecord_t *rec, DVR_WrapperRecordOpenPara
   open_param.notification_size = 500*1024;
   open_param.flush_size = params->flush_size;
   open_param.ringbuf_size = params->ringbuf_size;
+  open_param.dev_backend = params->dev_backend;
+  open_param.dev_src_file = params->dev_src_file;
+  open_param.dev_src_bitrate = params->dev_src_bitrate;
+  open_param.crypto_workers = params->crypto_workers;
+  open_param.crypto_flags = params->crypto_flags;
+  open_param.prealloc_size = params->prealloc_size;
+  open_param.writeback_size = params->writeback_size;
+  open_param.direct_io = params->direct_io;
+  open_param.block_latency_ms = params->block_latency_ms;
+  open_param.block_min_size = params->block_min_size;
+  open_param.block_max_size = params->block_max_size;
+  open_param.crypto_block_size = params->crypto_block_size;
   open_param.event_fn = wrapper_record_event_handler;
   open_param.event_userdata = (void*)ctx->sn;
 
@@ -979,8 +1276,13 @@ int dvr_wrapper_close_record (DVR_WrapperRecord_t rec)
 
   error = dvr_record_close(ctx->record.recorder);
 
-  if (ctx->record.param_open.is_timeshift)
+  if (ctx->record.param_open.is_timeshift) {
     sn_timeshift_record = 0;
+    if (ctx->record.param_open.live_cache_size)
+      dvr_segment_live_cache_destroy(ctx->record.param_open.location);
+    if (ctx->record.param_open.ring_storage)
+      dvr_segment_ring_destroy(ctx->record.param_open.location);
+  }
 
   ctx_freeSegments(ctx);
 
@@ -1020,6 +1322,18 @@ int dvr_wrapper_start_record (DVR_WrapperRecord_t rec, DVR_WrapperRecordStartPar
     start_param->segment.pid_action[i] = DVR_RECORD_PID_CREATE;
   }
   dvr_segment_del_by_location(start_param->location);
+  if (ctx->record.param_open.is_timeshift && ctx->record.param_open.ring_storage
+      && ctx->record.param_open.max_size && ctx->record.param_open.segment_size) {
+    error = dvr_segment_ring_create(start_param->location,
+        ctx->record.param_open.max_size, ctx->record.param_open.segment_size);
+    if (error)
+      DVR_WRAPPER_DEBUG(1, "record(sn:%ld) ring storage fail, use segment files\n", ctx->sn);
+  }
+  if (ctx->record.param_open.is_timeshift && ctx->record.param_open.live_cache_size) {
+    error = dvr_segment_live_cache_create(start_param->location, ctx->record.param_open.live_cache_size);
+    if (error)
+      DVR_WRAPPER_DEBUG(1, "record(sn:%ld) live cache fail\n", ctx->sn);
+  }
   {
     /*sync to update for further use*/
     DVR_RecordStartParams_t *update_param;
@@ -1031,8 +1345,8 @@ int dvr_wrapper_start_record (DVR_WrapperRecord_t rec, DVR_WrapperRecordStartPar
 
   error = dvr_record_start_segment(ctx->record.recorder, start_param);
   {
-    DVR_RecordSegmentInfo_t new_seg_info =
-      { .id = start_param->segment.segment_id, };
+    DVR_RecordSegmentInfo_t new_seg_info;
+    wrapper_initRecordSegment(ctx, &new_seg_info, start_param);
     wrapper_addRecordSegment(ctx, &new_seg_info);
   }
 
@@ -1141,9 +1455,9 @@ int dvr_wrapper_update_record_pids (DVR_WrapperRecord_t rec, DVR_WrapperUpdatePi
   }
   error = dvr_record_next_segment(ctx->record.recorder, start_param, &seg_info);
   {
-    DVR_RecordSegmentInfo_t new_seg_info =
-      { .id = start_param->segment.segment_id, };
+    DVR_RecordSegmentInfo_t new_seg_info;
     wrapper_updateRecordSegment(ctx, &seg_info, U_PIDS);
+    wrapper_initRecordSegment(ctx, &new_seg_info, start_param);
     wrapper_addRecordSegment(ctx, &new_seg_info);
   }
 
@@ -1153,6 +1467,20 @@ int dvr_wrapper_update_record_pids (DVR_WrapperRecord_t rec, DVR_WrapperUpdatePi
   return error;
 }
 
+int dvr_wrapper_get_record_status_snapshot(DVR_WrapperRecord_t rec, DVR_WrapperRecordStatus_t *status, uint32_t *p_version)
+{
+  DVR_WrapperCtx_t *ctx;
+
+  DVR_RETURN_IF_FALSE(rec);
+  DVR_RETURN_IF_FALSE(status);
+
+  ctx = ctx_getRecord((unsigned long)rec);
+  DVR_RETURN_IF_FALSE(ctx);
+
+  /*the session lock is not taken, the snapshot is published by the event thread*/
+  return ctx_readSnapshot(ctx, (unsigned long)rec, status, sizeof(*status), p_version);
+}
+
 int dvr_wrapper_get_record_status(DVR_WrapperRecord_t rec, DVR_WrapperRecordStatus_t *status)
 {
   DVR_WrapperCtx_t *ctx;
@@ -1167,12 +1495,12 @@ int dvr_wrapper_get_record_status(DVR_WrapperRecord_t rec, DVR_WrapperRecordStat
 
   pthread_mutex_lock(&ctx->lock);
 
-  DVR_WRAPPER_DEBUG(1, "get record(sn:%ld) status ...\n", ctx->sn);
+  DVR_WRAPPER_DEBUG(2, "get record(sn:%ld) status ...\n", ctx->sn);
   DVR_RETURN_IF_FALSE_WITH_UNLOCK(ctx_valid(ctx), &ctx->lock);
 
   error = process_generateRecordStatus(ctx, &s);
 
-  DVR_WRAPPER_DEBUG(1, "record(sn:%ld) state/time/size/pkts(%d/%ld/%lld/%u) (%d)\n",
+  DVR_WRAPPER_DEBUG(2, "record(sn:%ld) state/time/size/pkts(%d/%ld/%lld/%u) (%d)\n",
     ctx->sn,
     s.state,
     s.info.time,
@@ -1276,8 +1604,12 @@ int dvr_wrapper_open_playback (DVR_WrapperPlayback_t *playback, DVR_WrapperPlayb
   open_param.event_userdata = (void*)ctx->sn;
   /*open_param.has_pids = 0;*/
   open_param.is_notify_time = params->is_notify_time;
-  open_param.player_handle = (am_tsplayer_handle)params->playback_handle;
+  open_param.player_handle = (DVR_PlaybackSinkHandle_t)params->playback_handle;
   open_param.vendor = params->vendor;
+  open_param.sink_ops = params->sink_ops;
+  open_param.crypto_workers = params->crypto_workers;
+  open_param.crypto_flags = params->crypto_flags;
+  open_param.readahead_size = params->readahead_size;
 
 
   error = dvr_playback_open(&ctx->playback.player, &open_param);
@@ -1351,19 +1683,23 @@ int dvr_wrapper_start_playback (DVR_WrapperPlayback_t playback, DVR_PlaybackFlag
   int error;
   uint64_t *p_segment_ids;
   uint32_t segment_nb;
-  uint32_t i;
-  DVR_RecordSegmentInfo_t seg_info_1st;
-  int got_1st_seg;
+  uint64_t segment_id_1st;
   DVR_WrapperCtx_t *ctx_record;/*for timeshift*/
   DVR_Bool_t is_timeshift = DVR_FALSE;
+  DVR_Bool_t load_pending = DVR_FALSE;
+  unsigned long sn_playback;
 
   DVR_RETURN_IF_FALSE(playback);
   DVR_RETURN_IF_FALSE(p_pids);
 
+  ctx = ctx_getPlayback((unsigned long)playback);
+  DVR_RETURN_IF_FALSE(ctx);
+
   ctx_record = NULL;
 
-  /*lock the recorder to avoid changing the recording segments*/
-  ctx_record = ctx_getRecord(sn_timeshift_record);
+  /*lock the recorder to avoid changing the recording segments, only while they are copied*/
+  if (ctx->playback.param_open.is_timeshift)
+    ctx_record = ctx_getRecord(sn_timeshift_record);
 
   if (ctx_record) {
     pthread_mutex_lock(&ctx_record->lock);
@@ -1377,9 +1713,6 @@ int dvr_wrapper_start_playback (DVR_WrapperPlayback_t playback, DVR_PlaybackFlag
     }
   }
 
-  ctx = ctx_getPlayback((unsigned long)playback);
-  DVR_RETURN_IF_FALSE(ctx);
-
   pthread_mutex_lock(&ctx->lock);
 
   DVR_WRAPPER_DEBUG(1, "start playback(sn:%ld) (%s)\n\t flags(0x%x) v/a/ad/sub/pcr(%d:%d %d:%d %d:%d %d:%d %d)\n",
@@ -1392,120 +1725,86 @@ int dvr_wrapper_start_playback (DVR_WrapperPlayback_t playback, DVR_PlaybackFlag
     p_pids->subtitle.pid, p_pids->subtitle.format,
     p_pids->pcr.pid);
 
-  DVR_RETURN_IF_FALSE_WITH_UNLOCK(ctx_valid(ctx), &ctx->lock);
+  if (!ctx_valid(ctx)) {
+    if (is_timeshift)
+      pthread_mutex_unlock(&ctx_record->lock);
+    pthread_mutex_unlock(&ctx->lock);
+    return DVR_FAILURE;
+  }
+
+  ctx->playback.pids_req = *p_pids;
 
   if (ctx->playback.param_open.is_timeshift) {
-    /*lock the recorder to avoid changing the recording segments*/
     if (is_timeshift == DVR_FALSE) {
       DVR_WRAPPER_DEBUG(1, "timeshift, record is not for timeshifting, FATAL error return\n");
       pthread_mutex_unlock(&ctx->lock);
       return DVR_FAILURE;
-    } else {
-      DVR_WRAPPER_DEBUG(1, "playback(sn:%ld) record(sn:%ld) locked ok due to timeshift\n",
-        ctx->sn, ctx_record->sn);
     }
-  }
 
-  /*obtain all segments in a list*/
-  segment_nb = 0;
-  p_segment_ids = NULL;
-  error = dvr_segment_get_list(ctx->playback.param_open.location, &segment_nb, &p_segment_ids);
-  if (!error) {
-    got_1st_seg = 0;
-    for (i = 0; i < segment_nb; i++) {
-      DVR_RecordSegmentInfo_t seg_info;
-      DVR_PlaybackSegmentFlag_t flags;
-
-      error = dvr_segment_get_info(ctx->playback.param_open.location, p_segment_ids[i], &seg_info);
-      if (error) {
-        error = DVR_FAILURE;
-        DVR_WRAPPER_DEBUG(1, "fail to get seg info (location:%s, seg:%llu), (error:%d)\n",
-          ctx->playback.param_open.location, p_segment_ids[i], error);
-        break;
-      }
-      //add check if has audio  or video pid. if not exist. not add segment to playback
-      int ii = 0;
-      int has_av = 0;
-      for (ii = 0; ii < seg_info.nb_pids; ii++) {
-        int type = (seg_info.pids[ii].type >> 24) & 0x0f;
-        if (type == DVR_STREAM_TYPE_VIDEO ||
-          type == DVR_STREAM_TYPE_AUDIO ||
-          type == DVR_STREAM_TYPE_AD) {
-         DVR_WRAPPER_DEBUG(1, "success to get seg av info \n");
-          DVR_WRAPPER_DEBUG(1, "success to get seg av info type[0x%x][%d] [%d][%d][%d]\n",(seg_info.pids[ii].type >> 24)&0x0f,seg_info.pids[ii].pid,
-          DVR_STREAM_TYPE_VIDEO,
-          DVR_STREAM_TYPE_AUDIO,
-          DVR_STREAM_TYPE_AD);
-          has_av = 1;
-          //break;
-        } else {
-          DVR_WRAPPER_DEBUG(1, "error to get seg av info type[0x%x][%d] [%d][%d][%d]\n",(seg_info.pids[ii].type >> 24)&0x0f,seg_info.pids[ii].pid,
-          DVR_STREAM_TYPE_VIDEO,
-          DVR_STREAM_TYPE_AUDIO,
-          DVR_STREAM_TYPE_AD);
-        }
-      }
-      if (has_av == 0) {
-        DVR_WRAPPER_DEBUG(1, "fail to get seg av info \n");
-        continue;
-      } else {
-        DVR_WRAPPER_DEBUG(1, "success to get seg av info \n");
-      }
-      flags = DVR_PLAYBACK_SEGMENT_DISPLAYABLE | DVR_PLAYBACK_SEGMENT_CONTINUOUS;
-      error = wrapper_addPlaybackSegment(ctx, &seg_info, p_pids, flags);
-      if (error)
-        break;
-
-      /*copy the 1st segment*/
-      if (got_1st_seg == 0) {
-          seg_info_1st = seg_info;
-          got_1st_seg = 1;
-      }
+    /*the recorder keeps the info of its segments, no need to load them*/
+    error = wrapper_snapshotRecordSegments(ctx, ctx_record);
+    pthread_mutex_unlock(&ctx_record->lock);
+    DVR_WRAPPER_DEBUG(1, "playback(sn:%ld) record(sn:%ld) segments copied due to timeshift\n",
+      ctx->sn, ctx_record->sn);
+  } else {
+    /*obtain all segments in a list, only load the info up to the 1st playable one*/
+    segment_nb = 0;
+    p_segment_ids = NULL;
+    error = dvr_segment_get_list(ctx->playback.param_open.location, &segment_nb, &p_segment_ids);
+    if (!error) {
+      ctx->playback.load_ids = p_segment_ids;
+      ctx->playback.load_nb = segment_nb;
+      ctx->playback.load_pos = 0;
+      while (!error && ctx->playback.load_ids && list_empty(&ctx->segments))
+        error = wrapper_loadPlaybackSegments(ctx, 1, UINT32_MAX);
     }
-    free(p_segment_ids);
-
-    /* return if no segment or fail to add */
-    if (!error && got_1st_seg) {
+  }
 
-      /*copy the obsolete infomation, must for timeshifting*/
-      if (ctx->playback.param_open.is_timeshift && ctx_record) {
-        ctx->playback.obsolete = ctx_record->record.obsolete;
-      }
+  /* return if no segment or fail to add */
+  if (!error && !list_empty(&ctx->segments)) {
+    segment_id_1st =
+      list_last_entry(&ctx->segments, DVR_WrapperPlaybackSegmentInfo_t, head)->seg_info.id;
 
-      DVR_WRAPPER_DEBUG(1, "playback(sn:%ld) (%d) segments added\n", ctx->sn, i);
+    DVR_WRAPPER_DEBUG(1, "playback(sn:%ld) segments added, (%u) pending\n", ctx->sn,
+      ctx->playback.load_ids ? ctx->playback.load_nb - ctx->playback.load_pos : 0);
 
-      ctx->playback.reach_end = DVR_FALSE;
-      if ((flags&DVR_PLAYBACK_STARTED_PAUSEDLIVE) == DVR_PLAYBACK_STARTED_PAUSEDLIVE)
-        ctx->playback.speed = 0.0f;
-      else
-        ctx->playback.speed = 100.0f;
+    ctx->playback.reach_end = DVR_FALSE;
+    if ((flags&DVR_PLAYBACK_STARTED_PAUSEDLIVE) == DVR_PLAYBACK_STARTED_PAUSEDLIVE)
+      ctx->playback.speed = 0.0f;
+    else
+      ctx->playback.speed = 100.0f;
 
-      ctx->playback.pids_req = *p_pids;
-      //calualte segment id and pos
-      if (dvr_playback_check_limit(ctx->playback.player)) {
-        pthread_mutex_unlock(&ctx->lock);
-        dvr_wrapper_seek_playback(playback, 0);
-        pthread_mutex_lock(&ctx->lock);
-        error = dvr_playback_start(ctx->playback.player, flags);
-      } else {
-        error = dvr_playback_seek(ctx->playback.player, seg_info_1st.id, 0);
-        error = dvr_playback_start(ctx->playback.player, flags);
-        DVR_WRAPPER_DEBUG(1, "playback(sn:%ld) seek(seg:%llu 0) for start (%d)\n",
-          ctx->sn, seg_info_1st.id, error);
-      }
-      DVR_WRAPPER_DEBUG(1, "playback(sn:%ld) started (%d)\n", ctx->sn, error);
+    //calualte segment id and pos
+    if (dvr_playback_check_limit(ctx->playback.player)) {
+      pthread_mutex_unlock(&ctx->lock);
+      dvr_wrapper_seek_playback(playback, 0);
+      pthread_mutex_lock(&ctx->lock);
+      error = dvr_playback_start(ctx->playback.player, flags);
+    } else {
+      error = dvr_playback_seek(ctx->playback.player, segment_id_1st, 0);
+      error = dvr_playback_start(ctx->playback.player, flags);
+      DVR_WRAPPER_DEBUG(1, "playback(sn:%ld) seek(seg:%llu 0) for start (%d)\n",
+        ctx->sn, segment_id_1st, error);
     }
+    DVR_WRAPPER_DEBUG(1, "playback(sn:%ld) started (%d)\n", ctx->sn, error);
   }
 
-  if (ctx->playback.param_open.is_timeshift) {
-    /*unlock the recorder locked above*/
-    if (ctx_record && ctx_valid(ctx_record)) {
-        pthread_mutex_unlock(&ctx_record->lock);
-        DVR_WRAPPER_DEBUG(1, "playback(sn:%ld), record(sn:%ld) unlocked ok due to timeshift\n",
-          ctx->sn, ctx_record->sn);
+  load_pending = ctx->playback.load_ids ? DVR_TRUE : DVR_FALSE;
+  sn_playback = ctx->sn;
+  pthread_mutex_unlock(&ctx->lock);
+
+  /*the rest of the segments are loaded on the wrapper thread*/
+  if (load_pending) {
+    DVR_WrapperEventCtx_t *evt;
+
+    evt = (DVR_WrapperEventCtx_t *)calloc(1, sizeof(DVR_WrapperEventCtx_t));
+    if (evt) {
+      evt->sn = sn_playback;
+      evt->type = W_PLAYBACK;
+      evt->playback.event = W_EVT_LOAD_SEGMENTS;
+      ctx_addPlaybackEvent(evt);
     }
   }
-  pthread_mutex_unlock(&ctx->lock);
 
   return error;
 }
@@ -1705,6 +2004,9 @@ int dvr_wrapper_seek_playback (DVR_WrapperPlayback_t playback, uint32_t time_off
     }
   }
 
+  /*the target segment may not be loaded yet*/
+  wrapper_loadPlaybackSegments(ctx, UINT32_MAX, time_offset);
+
   list_for_each_entry_reverse(pseg, &ctx->segments, head) {
     segment_id = pseg->seg_info.id;
 
@@ -1787,6 +2089,20 @@ int dvr_wrapper_update_playback (DVR_WrapperPlayback_t playback, DVR_PlaybackPid
   return error;
 }
 
+int dvr_wrapper_get_playback_status_snapshot(DVR_WrapperPlayback_t playback, DVR_WrapperPlaybackStatus_t *status, uint32_t *p_version)
+{
+  DVR_WrapperCtx_t *ctx;
+
+  DVR_RETURN_IF_FALSE(playback);
+  DVR_RETURN_IF_FALSE(status);
+
+  ctx = ctx_getPlayback((unsigned long)playback);
+  DVR_RETURN_IF_FALSE(ctx);
+
+  /*the session lock is not taken, the snapshot is published by the event thread*/
+  return ctx_readSnapshot(ctx, (unsigned long)playback, status, sizeof(*status), p_version);
+}
+
 int dvr_wrapper_get_playback_status(DVR_WrapperPlayback_t playback, DVR_WrapperPlaybackStatus_t *status)
 {
   DVR_WrapperCtx_t *ctx;
@@ -1802,11 +2118,11 @@ int dvr_wrapper_get_playback_status(DVR_WrapperPlayback_t playback, DVR_WrapperP
 
   pthread_mutex_lock(&ctx->lock);
 
-  DVR_WRAPPER_DEBUG(1, "get playback(sn:%ld) status ...\n", ctx->sn);
+  DVR_WRAPPER_DEBUG(2, "get playback(sn:%ld) status ...\n", ctx->sn);
   DVR_RETURN_IF_FALSE_WITH_UNLOCK(ctx_valid(ctx), &ctx->lock);
 
   error = dvr_playback_get_status(ctx->playback.player, &play_status);
-  DVR_WRAPPER_DEBUG(1, "playback(sn:%ld) get status (%d)\n", ctx->sn, error);
+  DVR_WRAPPER_DEBUG(2, "playback(sn:%ld) get status (%d)\n", ctx->sn, error);
 
   ctx->playback.seg_status = play_status;
   error = process_generatePlaybackStatus(ctx, &s);
@@ -1816,7 +2132,7 @@ int dvr_wrapper_get_playback_status(DVR_WrapperPlayback_t playback, DVR_WrapperP
     DVR_WRAPPER_DEBUG(1, "set cur time to full time, reach end occur");
     s.info_cur.time = s.info_full.time;
   }
-  DVR_WRAPPER_DEBUG(1, "playback(sn:%ld) state/cur/full/obsl(%d/%ld/%ld/%ld) (%d)\n",
+  DVR_WRAPPER_DEBUG(2, "playback(sn:%ld) state/cur/full/obsl(%d/%ld/%ld/%ld) (%d)\n",
     ctx->sn,
     s.state,
     s.info_cur.time,
@@ -1867,35 +2183,78 @@ int dvr_wrapper_set_playback_decrypt_callback (DVR_WrapperPlayback_t playback,
 
 static DVR_Result_t wrapper_record_event_handler(DVR_RecordEvent_t event, void *params, void *userdata)
 {
-  DVR_WrapperEventCtx_t evt;
+  DVR_WrapperEventCtx_t *evt;
+  DVR_RecordStatus_t *status = (DVR_RecordStatus_t *)params;
+  DVR_WrapperCtx_t *ctx;
+  uint32_t changed = 0;
 
   DVR_RETURN_IF_FALSE(userdata);
+  DVR_RETURN_IF_FALSE(status);
+
+  /*the pids are carried only when changed, the handler is called in the record thread only*/
+  ctx = ctx_getRecord((unsigned long)userdata);
+  if (!ctx
+      || ctx->record.evt_segment_id != status->info.id
+      || ctx->record.evt_pids.nb_pids != status->info.nb_pids
+      || memcmp(ctx->record.evt_pids.pids, status->info.pids, sizeof(status->info.pids))) {
+    changed |= EVT_F_PIDS;
+    if (ctx) {
+      ctx->record.evt_segment_id = status->info.id;
+      ctx->record.evt_pids.nb_pids = status->info.nb_pids;
+      memcpy(ctx->record.evt_pids.pids, status->info.pids, sizeof(status->info.pids));
+    }
+  }
 
-  evt.sn = (unsigned long)userdata;
-  evt.type = W_REC;
-  evt.record.event = event;
-  evt.record.status = *(DVR_RecordStatus_t *)params;
-  DVR_WRAPPER_DEBUG(1, "evt[sn:%ld, record, evt:0x%x]\n", evt.sn, evt.record.event);
-  return ctx_addRecordEvent(&evt);
+  evt = (DVR_WrapperEventCtx_t *)calloc(1, sizeof(DVR_WrapperEventCtx_t)
+      + ((changed & EVT_F_PIDS) ? sizeof(DVR_WrapperPidsInfo_t) : 0));
+  DVR_RETURN_IF_FALSE(evt);
+
+  evt->sn = (unsigned long)userdata;
+  evt->type = W_REC;
+  evt->record.event = event;
+  evt->record.state = status->state;
+  evt->record.segment_id = status->info.id;
+  evt->record.duration = status->info.duration;
+  evt->record.size = status->info.size;
+  evt->record.nb_packets = status->info.nb_packets;
+  evt->record.bitrate = status->bitrate;
+  evt->record.block_size = status->block_size;
+  evt->record.changed = changed;
+  if (changed & EVT_F_PIDS) {
+    evt->pids[0].nb_pids = status->info.nb_pids;
+    memcpy(evt->pids[0].pids, status->info.pids, sizeof(evt->pids[0].pids));
+  }
+  DVR_WRAPPER_DEBUG(2, "evt[sn:%ld, record, evt:0x%x]\n", evt->sn, evt->record.event);
+  return ctx_addRecordEvent(evt);
 }
 
 static DVR_Result_t wrapper_playback_event_handler(DVR_PlaybackEvent_t event, void *params, void *userdata)
 {
-  DVR_WrapperEventCtx_t evt;
+  DVR_WrapperEventCtx_t *evt;
+  DVR_PlaybackStatus_t *status = &((DVR_Play_Notify_t *)params)->play_status;
 
   DVR_RETURN_IF_FALSE(userdata);
+  DVR_RETURN_IF_FALSE(params);
 
-  evt.sn = (unsigned long)userdata;
-  evt.type = W_PLAYBACK;
-  evt.playback.event = event;
-  evt.playback.status = *(DVR_Play_Notify_t *)params;
-  DVR_WRAPPER_DEBUG(1, "evt[sn:%ld, playbck, evt:0x%x]\n", evt.sn, evt.playback.event);
-  return ctx_addPlaybackEvent(&evt);
+  evt = (DVR_WrapperEventCtx_t *)calloc(1, sizeof(DVR_WrapperEventCtx_t));
+  DVR_RETURN_IF_FALSE(evt);
+
+  evt->sn = (unsigned long)userdata;
+  evt->type = W_PLAYBACK;
+  evt->playback.event = event;
+  evt->playback.state = status->state;
+  evt->playback.segment_id = status->segment_id;
+  evt->playback.time_cur = status->time_cur;
+  evt->playback.time_end = status->time_end;
+  evt->playback.speed = status->speed;
+  evt->playback.flags = status->flags;
+  DVR_WRAPPER_DEBUG(2, "evt[sn:%ld, playbck, evt:0x%x]\n", evt->sn, evt->playback.event);
+  return ctx_addPlaybackEvent(evt);
 }
 
 static inline int process_notifyRecord(DVR_WrapperCtx_t *ctx, DVR_RecordEvent_t evt, DVR_WrapperRecordStatus_t *status)
 {
-  DVR_WRAPPER_DEBUG(1, "notify(sn:%ld) evt(0x%x) statistic:time/size/pkts(%ld/%lld/%u) obsl:(%ld/%llu/%u)\n",
+  DVR_WRAPPER_DEBUG(2, "notify(sn:%ld) evt(0x%x) statistic:time/size/pkts(%ld/%lld/%u) obsl:(%ld/%llu/%u)\n",
     ctx->sn,
     evt,
     status->info.time,
@@ -1929,9 +2288,9 @@ static inline int record_startNextSegment(DVR_WrapperCtx_t *ctx)
   }
   error = dvr_record_next_segment(ctx->record.recorder, &ctx->record.param_update, &seg_info);
   {
-    DVR_RecordSegmentInfo_t new_seg_info =
-      { .id = ctx->record.param_update.segment.segment_id, };
+    DVR_RecordSegmentInfo_t new_seg_info;
     wrapper_updateRecordSegment(ctx, &seg_info, U_ALL);
+    wrapper_initRecordSegment(ctx, &new_seg_info, &ctx->record.param_update);
     wrapper_addRecordSegment(ctx, &new_seg_info);
   }
 
@@ -1950,9 +2309,7 @@ static int process_generateRecordStatus(DVR_WrapperCtx_t *ctx, DVR_WrapperRecord
   /*the current seg is not covered in the statistics*/
   DVR_WrapperRecordSegmentInfo_t *pseg;
 
-  /*re-calculate the all segments*/
-  memset(&ctx->record.status, 0, sizeof(ctx->record.status));
-
+  /*every field is rewritten, no need to clear*/
   ctx->record.status.state = ctx->record.seg_status.state;
   ctx->record.status.pids.nb_pids = ctx->record.seg_status.info.nb_pids;
   memcpy(ctx->record.status.pids.pids,
@@ -1960,15 +2317,14 @@ static int process_generateRecordStatus(DVR_WrapperCtx_t *ctx, DVR_WrapperRecord
     sizeof(ctx->record.status.pids.pids));
   ctx->current_segment_id = ctx->record.seg_status.info.id;
 
-  list_for_each_entry_reverse(pseg, &ctx->segments, head) {
-    if (pseg->info.id != ctx->record.seg_status.info.id) {
-      ctx->record.status.info.time += pseg->info.duration;
-      ctx->record.status.info.size += pseg->info.size;
-      ctx->record.status.info.pkts += pseg->info.nb_packets;
-    }
-  }
+  ctx->record.status.info = ctx->record.seg_total;
+  pseg = wrapper_findRecordSegment(ctx, ctx->record.seg_status.info.id);
+  if (pseg)
+    info_sub(&ctx->record.status.info, &pseg->info);
 
   ctx->record.status.info_obsolete = ctx->record.obsolete;
+  ctx->record.status.bitrate = ctx->record.seg_status.bitrate;
+  ctx->record.status.block_size = ctx->record.seg_status.block_size;
 
   wrapper_updateRecordSegment(ctx, &ctx->record.seg_status.info, U_ALL);
 
@@ -1977,52 +2333,68 @@ static int process_generateRecordStatus(DVR_WrapperCtx_t *ctx, DVR_WrapperRecord
     status->info.time += ctx->record.seg_status.info.duration;
     status->info.size += ctx->record.seg_status.info.size;
     status->info.pkts += ctx->record.seg_status.info.nb_packets;
+    ctx_publishRecordStatus(ctx, status);
   }
 
   return DVR_SUCCESS;
 }
 
 
+static void process_applyRecordEvent(DVR_WrapperEventCtx_t *evt, DVR_WrapperCtx_t *ctx)
+{
+  ctx->record.seg_status.state = evt->record.state;
+  ctx->record.seg_status.info.id = evt->record.segment_id;
+  ctx->record.seg_status.info.duration = evt->record.duration;
+  ctx->record.seg_status.info.size = evt->record.size;
+  ctx->record.seg_status.info.nb_packets = evt->record.nb_packets;
+  ctx->record.seg_status.bitrate = evt->record.bitrate;
+  ctx->record.seg_status.block_size = evt->record.block_size;
+  if (evt->record.changed & EVT_F_PIDS) {
+    ctx->record.seg_status.info.nb_pids = evt->pids[0].nb_pids;
+    memcpy(ctx->record.seg_status.info.pids, evt->pids[0].pids, sizeof(ctx->record.seg_status.info.pids));
+  }
+}
+
 static int process_handleRecordEvent(DVR_WrapperEventCtx_t *evt, DVR_WrapperCtx_t *ctx)
 {
   DVR_WrapperRecordStatus_t status;
 
   memset(&status, 0, sizeof(status));
 
-  DVR_WRAPPER_DEBUG(1, "evt (sn:%ld) 0x%x (state:%d)\n",
-    evt->sn, evt->record.event, evt->record.status.state);
-  if (ctx->record.param_update.segment.segment_id != evt->record.status.info.id) {
-    DVR_WRAPPER_DEBUG(1, "evt (sn:%ld) cur id:0x%x (event id:%d)\n",
-    evt->sn, (int)ctx->record.param_update.segment.segment_id, (int)evt->record.status.info.id);
+  DVR_WRAPPER_DEBUG(2, "evt (sn:%ld) 0x%x (state:%d)\n",
+    evt->sn, evt->record.event, evt->record.state);
+  if (ctx->record.param_update.segment.segment_id != evt->record.segment_id) {
+    DVR_WRAPPER_DEBUG(2, "evt (sn:%ld) cur id:0x%x (event id:%d)\n",
+    evt->sn, (int)ctx->record.param_update.segment.segment_id, (int)evt->record.segment_id);
     return 0;
   }
   switch (evt->record.event)
   {
     case DVR_RECORD_EVENT_STATUS:
     {
-      switch (evt->record.status.state)
+      switch (evt->record.state)
       {
         case DVR_RECORD_STATE_OPENED:
         case DVR_RECORD_STATE_CLOSED:
         {
-          ctx->record.seg_status = evt->record.status;
+          process_applyRecordEvent(evt, ctx);
 
-          status.state = evt->record.status.state;
+          status.state = evt->record.state;
           process_notifyRecord(ctx, evt->record.event, &status);
         } break;
         case DVR_RECORD_STATE_STARTED:
         {
-          ctx->record.seg_status = evt->record.status;
+          process_applyRecordEvent(evt, ctx);
 
           process_generateRecordStatus(ctx, &status);
           process_notifyRecord(ctx, evt->record.event, &status);
 
           /*restart to next segment*/
           if (ctx->record.param_open.segment_size
-              && evt->record.status.info.size >= ctx->record.param_open.segment_size) {
+              && evt->record.size >= ctx->record.param_open.segment_size) {
             DVR_WRAPPER_DEBUG(1, "start new segment for record(%lu), reaches segment size limit, cur(%zu) max(%lld)\n",
               ctx->sn,
-              evt->record.status.info.size,
+              evt->record.size,
               ctx->record.param_open.segment_size);
             if (record_startNextSegment(ctx) != DVR_SUCCESS) {
               /*should notify the recording's stop*/
@@ -2082,7 +2454,7 @@ static int process_handleRecordEvent(DVR_WrapperEventCtx_t *evt, DVR_WrapperCtx_
         } break;
         case DVR_RECORD_STATE_STOPPED:
         {
-          ctx->record.seg_status = evt->record.status;
+          process_applyRecordEvent(evt, ctx);
 
           process_generateRecordStatus(ctx, &status);
           process_notifyRecord(ctx, evt->record.event, &status);
@@ -2092,8 +2464,8 @@ static int process_handleRecordEvent(DVR_WrapperEventCtx_t *evt, DVR_WrapperCtx_
       }
     } break;
     case DVR_RECORD_EVENT_WRITE_ERROR: {
-      ctx->record.seg_status = evt->record.status;
-      status.state = evt->record.status.state;
+      process_applyRecordEvent(evt, ctx);
+      status.state = evt->record.state;
       process_notifyRecord(ctx, evt->record.event, &status);
     }break;
     default:
@@ -2104,7 +2476,7 @@ static int process_handleRecordEvent(DVR_WrapperEventCtx_t *evt, DVR_WrapperCtx_
 
 static inline int process_notifyPlayback(DVR_WrapperCtx_t *ctx, DVR_PlaybackEvent_t evt, DVR_WrapperPlaybackStatus_t *status)
 {
-  DVR_WRAPPER_DEBUG(1, "notify(sn:%ld) evt(0x%x) statistics:state/cur/full/obsl(%d/%ld/%ld/%ld)\n",
+  DVR_WRAPPER_DEBUG(2, "notify(sn:%ld) evt(0x%x) statistics:state/cur/full/obsl(%d/%ld/%ld/%ld)\n",
     ctx->sn,
     evt,
     status->state,
@@ -2123,7 +2495,7 @@ static int process_generatePlaybackStatus(DVR_WrapperCtx_t *ctx, DVR_WrapperPlay
   /*the current seg is not covered in the statistics*/
   DVR_WrapperPlaybackSegmentInfo_t *pseg;
 
-  memset(&ctx->playback.status, 0, sizeof(ctx->playback.status));
+  /*every field is rewritten, no need to clear*/
   ctx->playback.status.pids = ctx->playback.pids_req;
 
   ctx->playback.status.state = ctx->playback.seg_status.state;
@@ -2131,24 +2503,31 @@ static int process_generatePlaybackStatus(DVR_WrapperCtx_t *ctx, DVR_WrapperPlay
   ctx->playback.status.flags = ctx->playback.seg_status.flags;
   ctx->current_segment_id = ctx->playback.seg_status.segment_id;
 
-  list_for_each_entry_reverse(pseg, &ctx->segments, head) {
-    if (pseg->seg_info.id == ctx->playback.seg_status.segment_id)
+  /*the segments before the current one are only summed when the current one changes*/
+  if (!ctx->playback.seg_before_valid
+      || ctx->playback.seg_before_id != ctx->playback.seg_status.segment_id) {
+    memset(&ctx->playback.seg_before, 0, sizeof(ctx->playback.seg_before));
+    ctx->playback.seg_before_mark = UINT32_MAX;
+    list_for_each_entry_reverse(pseg, &ctx->segments, head) {
+      if (pseg->seg_info.id == ctx->playback.seg_status.segment_id) {
+        ctx->playback.seg_before_mark = pseg->mark;
         break;
-    ctx->playback.status.info_cur.time += pseg->seg_info.duration;
-    ctx->playback.status.info_cur.size += pseg->seg_info.size;
-    ctx->playback.status.info_cur.pkts += pseg->seg_info.nb_packets;
-  }
-  list_for_each_entry_reverse(pseg, &ctx->segments, head) {
-    ctx->playback.status.info_full.time += pseg->seg_info.duration;
-    ctx->playback.status.info_full.size += pseg->seg_info.size;
-    ctx->playback.status.info_full.pkts += pseg->seg_info.nb_packets;
+      }
+      info_add(&ctx->playback.seg_before, &pseg->seg_info);
+    }
+    ctx->playback.seg_before_id = ctx->playback.seg_status.segment_id;
+    ctx->playback.seg_before_valid = DVR_TRUE;
   }
+  ctx->playback.status.info_cur = ctx->playback.seg_before;
+  ctx->playback.status.info_full = ctx->playback.seg_total;
+  memset(&ctx->playback.status.info_obsolete, 0, sizeof(ctx->playback.status.info_obsolete));
+  ctx->playback.status.info_obsolete.time = ctx->playback.obsolete.time;
 
   if (status) {
     *status = ctx->playback.status;
     /*deal with current, lack size and pkts with the current*/
     status->info_cur.time += ctx->playback.seg_status.time_cur;
-    status->info_obsolete.time = ctx->playback.obsolete.time;
+    ctx_publishPlaybackStatus(ctx, status);
   }
 
   return DVR_SUCCESS;
@@ -2156,12 +2535,25 @@ static int process_generatePlaybackStatus(DVR_WrapperCtx_t *ctx, DVR_WrapperPlay
 
 static int process_handlePlaybackEvent(DVR_WrapperEventCtx_t *evt, DVR_WrapperCtx_t *ctx)
 {
-  DVR_WRAPPER_DEBUG(1, "evt (sn:%ld) 0x%x (state:%d) cur(%lld:%u/%u)\n",
+  DVR_WRAPPER_DEBUG(2, "evt (sn:%ld) 0x%x (state:%d) cur(%lld:%u/%u)\n",
     evt->sn, evt->playback.event,
-    evt->playback.status.play_status.state,
-    evt->playback.status.play_status.segment_id,
-    evt->playback.status.play_status.time_cur,
-    evt->playback.status.play_status.time_end);
+    evt->playback.state,
+    evt->playback.segment_id,
+    evt->playback.time_cur,
+    evt->playback.time_end);
+
+  if (evt->playback.event == W_EVT_LOAD_SEGMENTS) {
+    wrapper_loadPlaybackSegments(ctx, PLAYBACK_LOAD_BATCH, UINT32_MAX);
+    /*load the next batch after the events queued meanwhile, the thread is running the event list*/
+    if (ctx->playback.load_ids) {
+      DVR_WrapperEventCtx_t *next = (DVR_WrapperEventCtx_t *)calloc(1, sizeof(DVR_WrapperEventCtx_t));
+      if (next) {
+        *next = *evt;
+        ctx_addEvent(&playback_evt_list, &playback_evt_list_lock, next);
+      }
+    }
+    return 0;
+  }
 
   /*evt PLAYTIME will break the last logic, do not save*/
   if (evt->playback.event != DVR_PLAYBACK_EVENT_NOTIFY_PLAYTIME
@@ -2183,8 +2575,13 @@ static int process_handlePlaybackEvent(DVR_WrapperEventCtx_t *evt, DVR_WrapperCt
     {
       DVR_WrapperPlaybackStatus_t status;
 
-      /*copy status of segment*/
-      ctx->playback.seg_status = evt->playback.status.play_status;
+      /*copy status of segment, the pids are kept*/
+      ctx->playback.seg_status.state = evt->playback.state;
+      ctx->playback.seg_status.segment_id = evt->playback.segment_id;
+      ctx->playback.seg_status.time_cur = evt->playback.time_cur;
+      ctx->playback.seg_status.time_end = evt->playback.time_end;
+      ctx->playback.seg_status.speed = evt->playback.speed;
+      ctx->playback.seg_status.flags = evt->playback.flags;
 
       /*generate status of the whole playback*/
       process_generatePlaybackStatus(ctx, &status);
@@ -2192,6 +2589,15 @@ static int process_handlePlaybackEvent(DVR_WrapperEventCtx_t *evt, DVR_WrapperCt
       if (evt->playback.event == DVR_PLAYBACK_EVENT_REACHED_END) {
         if (ctx->playback.param_open.is_timeshift) {
           /*wait for more data in recording*/
+        } else if (ctx->playback.load_ids) {
+          /*reached the end of the segments loaded so far, load the rest and go on*/
+          int error;
+
+          wrapper_loadPlaybackSegments(ctx, UINT32_MAX, UINT32_MAX);
+          ctx->playback.last_event = DVR_PLAYBACK_EVENT_TRANSITION_OK;
+          error = dvr_playback_resume(ctx->playback.player);
+          DVR_WRAPPER_DEBUG(1, "playback(sn:%ld) resume after loading the pending segments (%d)\n",
+            ctx->sn, error);
         } else if ((status.info_cur.time + DVR_PLAYBACK_END_GAP) >= ctx->playback.status.info_full.time) {
           process_notifyPlayback(ctx, evt->playback.event, &status);
         } else {
@@ -1,3 +1,5 @@
+#define DVR_LOG_MODULE DVR_LOG_MODULE_RECORD
+
 #include <stdio.h>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -9,17 +11,25 @@
 #include <errno.h>
 #include <poll.h>
 #include <dlfcn.h>
+#include <pthread.h>
 
 #include <dmx.h>
 /*add for config define for linux dvb *.h*/
 #include "record_device.h"
+#include "record_device_soft.h"
 #include "dvr_types.h"
 #include "dvr_utils.h"
 #include "dvb_utils.h"
+#include "dvb_topology.h"
+#include "dvr_trace.h"
 
 #define MAX_RECORD_DEVICE_COUNT 8
 #define MAX_DEMUX_DEVICE_COUNT 8
 #define MAX_FEND_DEVICE_COUNT 2
+/*Output updates queued per recording, power of 2*/
+#define SECDMX_QUEUE_SIZE 64
+/*Write pointer check period when the dvr device does not signal*/
+#define SECDMX_POLL_MS 10
 
 /**\brief DVR record device state*/
 typedef enum {
@@ -29,6 +39,12 @@ typedef enum {
   RECORD_DEVICE_STATE_CLOSED,                                         /**< Record close state*/
 } Record_DeviceState_t;
 
+/**\brief Secure demux output buffer update*/
+typedef struct {
+  size_t                        addr;                                  /**< Data start*/
+  size_t                        len;                                   /**< Data length*/
+} Record_SecDmxBuf_t;
+
 /**\brief Record stream information*/
 typedef struct {
   int                           fid;                                   /**< DMX Filter ID*/
@@ -48,10 +64,36 @@ typedef struct {
   size_t                        output_handle;                         /**< Secure demux output*/
   pthread_mutex_t               lock;                                  /**< Record device lock*/
   int                           evtfd;                                 /**< eventfd for poll's exit*/
+  Record_DeviceBackend_t        backend;                               /**< Device backend*/
+  Record_SoftDeviceHandle_t     soft;                                  /**< Software backend handle*/
+  Record_SecDmxBuf_t            sec_queue[SECDMX_QUEUE_SIZE];          /**< Secure demux output updates*/
+  volatile uint32_t             sec_head;                              /**< Next update to read, by the record thread*/
+  volatile uint32_t             sec_tail;                              /**< Next update to write, by the service thread*/
+  int                           sec_evtfd;                             /**< eventfd signaled on a new update, -1 if not served*/
+  DVR_Bool_t                    sec_pending;                           /**< Output data left in the secure demux while the queue was full*/
 } Record_DeviceContext_t;
 
-/*  each sid need one mutex */
-static pthread_mutex_t secdmx_lock[MAX_FEND_DEVICE_COUNT] = PTHREAD_MUTEX_INITIALIZER;
+/**\brief Secure demux service of a sid
+ *
+ * The hardware write pointer is shared by the recordings of a sid. One thread
+ * per sid processes the data once per write pointer advance and queues the
+ * output buffer updates to each recording, the record threads only take the
+ * service lock to join and leave.
+ */
+typedef struct {
+  pthread_mutex_t               lock;                                  /**< Service lock*/
+  pthread_cond_t                cond;                                  /**< Signaled on the thread exit*/
+  pthread_t                     thread;                                /**< Service thread*/
+  DVR_Bool_t                    alive;                                 /**< The thread is running*/
+  DVR_Bool_t                    exited;                                /**< The thread exited and shall be joined*/
+  DVR_Bool_t                    quit;                                  /**< The thread shall exit*/
+  int                           evtfd;                                 /**< eventfd waking the thread*/
+  int                           sid;                                   /**< Secure demux id*/
+  Record_DeviceContext_t        *users[MAX_RECORD_DEVICE_COUNT];       /**< Served recordings*/
+  int                           user_cnt;                              /**< Served recording count*/
+} SecDmx_Service_t;
+
+static SecDmx_Service_t secdmx_svc[MAX_FEND_DEVICE_COUNT];
 
 static Record_DeviceContext_t record_ctx[MAX_RECORD_DEVICE_COUNT] = {
   {
@@ -65,25 +107,34 @@ static Record_DeviceContext_t record_ctx[MAX_RECORD_DEVICE_COUNT] = {
     .lock = PTHREAD_MUTEX_INITIALIZER
   }
 };
-/*define sec dmx function api ptr*/
-static int SECDMX_API_INIT = 0;
-int (*SECDMX_Init_Ptr)(void);
-int (*SECDMX_Deinit_Ptr)(void);
-int (*SECDMX_AllocateDVRBuffer_Ptr)(int sid, size_t size, size_t *addr);
-int (*SECDMX_FreeDVRBuffer_Ptr)(int sid);
-int (*SECDMX_AddOutputBuffer_Ptr)(int sid, size_t addr, size_t size, size_t *handle);
-int (*SECDMX_AddDVRPids_Ptr)(size_t handle, uint16_t *pids, int pid_num);
-int (*SECDMX_RemoveOutputBuffer_Ptr)(size_t handle);
-int (*SECDMX_GetOutputBufferStatus_Ptr)(size_t handle, size_t *start_addr, size_t *len);
-int (*SECDMX_ProcessData_Ptr)(int sid, size_t wp);
-
-int load_secdmx_api(void)
+/**\brief Secure demux client api, resolved once*/
+typedef struct {
+  int (*Init)(void);
+  int (*Deinit)(void);
+  int (*AllocateDVRBuffer)(int sid, size_t size, size_t *addr);
+  int (*FreeDVRBuffer)(int sid);
+  int (*AddOutputBuffer)(int sid, size_t addr, size_t size, size_t *handle);
+  int (*AddDVRPids)(size_t handle, uint16_t *pids, int pid_num);
+  int (*RemoveOutputBuffer)(size_t handle);
+  int (*GetOutputBufferStatus)(size_t handle, size_t *start_addr, size_t *len);
+  int (*ProcessData)(int sid, size_t wp);
+} SecDmx_Api_t;
+
+static SecDmx_Api_t secdmx_api;
+static pthread_once_t secdmx_once = PTHREAD_ONCE_INIT;
+
+static void secdmx_init_once(void)
 {
-  if (SECDMX_API_INIT == 1) {
-    return 0;
-  }
-  SECDMX_API_INIT = 1;
   void* handle = NULL;
+  int i;
+
+  for (i = 0; i < MAX_FEND_DEVICE_COUNT; i++) {
+    pthread_mutex_init(&secdmx_svc[i].lock, NULL);
+    pthread_cond_init(&secdmx_svc[i].cond, NULL);
+    secdmx_svc[i].evtfd = -1;
+    secdmx_svc[i].sid = i;
+  }
+
   handle = dlopen("libdmx_client_sys.so", RTLD_NOW);//RTLD_NOW  RTLD_LAZY
 
   if (handle == NULL) {
@@ -93,20 +144,212 @@ int load_secdmx_api(void)
 
   if (handle == NULL) {
     DVR_DEBUG(0, "load_secdmx_api load libdmx_client error[%s] no:%d", strerror(errno), errno);
-    return 0;
+    return;
+  }
+
+  secdmx_api.Init = dlsym(handle, "SECDMX_Init");
+  secdmx_api.Deinit = dlsym(handle, "SECDMX_Deinit");
+  secdmx_api.AllocateDVRBuffer = dlsym(handle, "SECDMX_AllocateDVRBuffer");
+  secdmx_api.FreeDVRBuffer = dlsym(handle, "SECDMX_FreeDVRBuffer");
+  secdmx_api.AddOutputBuffer = dlsym(handle, "SECDMX_AddOutputBuffer");
+  secdmx_api.AddDVRPids = dlsym(handle, "SECDMX_AddDVRPids");
+  secdmx_api.RemoveOutputBuffer = dlsym(handle, "SECDMX_RemoveOutputBuffer");
+  secdmx_api.GetOutputBufferStatus = dlsym(handle, "SECDMX_GetOutputBufferStatus");
+  secdmx_api.ProcessData = dlsym(handle, "SECDMX_ProcessData");
+}
+
+int load_secdmx_api(void)
+{
+  pthread_once(&secdmx_once, secdmx_init_once);
+  return 0;
+}
+
+/*Queue the new data of the served outputs, called with the service lock*/
+static void secdmx_service_output(SecDmx_Service_t *svc, DVR_Bool_t advanced)
+{
+  Record_DeviceContext_t *p_ctx;
+  Record_SecDmxBuf_t *e;
+  size_t addr, len;
+  int64_t pad = 1;
+  int i;
+
+  for (i = 0; i < svc->user_cnt; i++) {
+    p_ctx = svc->users[i];
+    if (!advanced && !p_ctx->sec_pending)
+      continue;
+    /*a full queue leaves the data in the output buffer until the record thread catches up*/
+    if (p_ctx->sec_tail - p_ctx->sec_head >= SECDMX_QUEUE_SIZE) {
+      p_ctx->sec_pending = DVR_TRUE;
+      continue;
+    }
+    p_ctx->sec_pending = DVR_FALSE;
+    addr = len = 0;
+    if (secdmx_api.GetOutputBufferStatus(p_ctx->output_handle, &addr, &len) != DVR_SUCCESS || !len)
+      continue;
+    e = &p_ctx->sec_queue[p_ctx->sec_tail & (SECDMX_QUEUE_SIZE - 1)];
+    e->addr = addr;
+    e->len = len;
+    __sync_synchronize();
+    p_ctx->sec_tail++;
+    write(p_ctx->sec_evtfd, &pad, sizeof(pad));
   }
+}
+
+static void *secdmx_service_thread(void *arg)
+{
+  SecDmx_Service_t *svc = (SecDmx_Service_t *)arg;
+  struct pollfd fds[MAX_RECORD_DEVICE_COUNT + 1];
+  struct dvr_mem_info info;
+  size_t wp = 0;
+  DVR_Bool_t wp_valid = DVR_FALSE;
+  uint8_t drain[256];
+  int64_t pad;
+  int i, n, fd;
+
+  pthread_mutex_lock(&svc->lock);
+  while (!svc->quit) {
+    /*the dvr devices signal the data, the write pointer is checked on timeout too*/
+    n = 0;
+    for (i = 0; i < svc->user_cnt; i++) {
+      if (svc->users[i]->state != RECORD_DEVICE_STATE_STARTED)
+        continue;
+      fds[n].fd = svc->users[i]->fd;
+      fds[n].events = POLLIN;
+      fds[n].revents = 0;
+      n++;
+    }
+    fds[n].fd = svc->evtfd;
+    fds[n].events = POLLIN;
+    fds[n].revents = 0;
+    pthread_mutex_unlock(&svc->lock);
 
-  SECDMX_Init_Ptr = dlsym(handle, "SECDMX_Init");
-  SECDMX_Deinit_Ptr = dlsym(handle, "SECDMX_Deinit");
-  SECDMX_AllocateDVRBuffer_Ptr = dlsym(handle, "SECDMX_AllocateDVRBuffer");
-  SECDMX_FreeDVRBuffer_Ptr = dlsym(handle, "SECDMX_FreeDVRBuffer");
-  SECDMX_AddOutputBuffer_Ptr = dlsym(handle, "SECDMX_AddOutputBuffer");
-  SECDMX_AddDVRPids_Ptr = dlsym(handle, "SECDMX_AddDVRPids");
-  SECDMX_RemoveOutputBuffer_Ptr = dlsym(handle, "SECDMX_RemoveOutputBuffer");
-  SECDMX_GetOutputBufferStatus_Ptr = dlsym(handle, "SECDMX_GetOutputBufferStatus");
-  SECDMX_ProcessData_Ptr = dlsym(handle, "SECDMX_ProcessData");
+    poll(fds, n + 1, SECDMX_POLL_MS);
+    if (fds[n].revents & POLLIN)
+      read(svc->evtfd, &pad, sizeof(pad));
 
-  return 0;
+    pthread_mutex_lock(&svc->lock);
+    if (svc->quit)
+      break;
+
+    /*keep dvbcore's descriptors consumed, only the fds still served are read*/
+    fd = -1;
+    for (i = 0; i < svc->user_cnt; i++) {
+      Record_DeviceContext_t *p_ctx = svc->users[i];
+      int j;
+
+      if (p_ctx->state != RECORD_DEVICE_STATE_STARTED)
+        continue;
+      if (fd == -1)
+        fd = p_ctx->fd;
+      for (j = 0; j < n; j++) {
+        if (fds[j].fd == p_ctx->fd && (fds[j].revents & POLLIN)) {
+          while (read(p_ctx->fd, drain, sizeof(drain)) > 0)
+            ;
+          break;
+        }
+      }
+    }
+    if (fd == -1)
+      continue;
+
+    memset(&info, 0, sizeof(info));
+    if (ioctl(fd, DMX_GET_DVR_MEM, &info) != 0)
+      continue;
+    if (wp_valid && info.wp_offset == wp) {
+      /*no new data, only the outputs whose queue was full*/
+      secdmx_service_output(svc, DVR_FALSE);
+      continue;
+    }
+
+    DVR_TRACE_BEGIN("secdmx_process");
+    i = secdmx_api.ProcessData(svc->sid, info.wp_offset);
+    DVR_TRACE_END("secdmx_process");
+    if (i != DVR_SUCCESS) {
+      DVR_DEBUG(1, "%s, sid:%d ProcessData result:%#x", __func__, svc->sid, i);
+      continue;
+    }
+    wp = info.wp_offset;
+    wp_valid = DVR_TRUE;
+    secdmx_service_output(svc, DVR_TRUE);
+  }
+  svc->alive = DVR_FALSE;
+  svc->exited = DVR_TRUE;
+  pthread_cond_broadcast(&svc->cond);
+  pthread_mutex_unlock(&svc->lock);
+  return NULL;
+}
+
+/*Serve a recording with an output buffer, called with the record device lock*/
+static int secdmx_service_join(Record_DeviceContext_t *p_ctx)
+{
+  SecDmx_Service_t *svc = &secdmx_svc[p_ctx->fend_dev_id];
+
+  if (p_ctx->sec_evtfd != -1)
+    return DVR_SUCCESS;
+  DVR_RETURN_IF_FALSE(secdmx_api.ProcessData && secdmx_api.GetOutputBufferStatus);
+
+  pthread_mutex_lock(&svc->lock);
+  /*the last recording left, wait for the thread to exit before restarting it*/
+  while (svc->alive && svc->quit)
+    pthread_cond_wait(&svc->cond, &svc->lock);
+  if (svc->exited) {
+    pthread_join(svc->thread, NULL);
+    svc->exited = DVR_FALSE;
+  }
+  if (svc->evtfd == -1)
+    svc->evtfd = eventfd(0, EFD_NONBLOCK);
+  DVR_RETURN_IF_FALSE_WITH_UNLOCK(svc->evtfd != -1, &svc->lock);
+
+  p_ctx->sec_evtfd = eventfd(0, EFD_NONBLOCK);
+  DVR_RETURN_IF_FALSE_WITH_UNLOCK(p_ctx->sec_evtfd != -1, &svc->lock);
+  p_ctx->sec_head = p_ctx->sec_tail = 0;
+  p_ctx->sec_pending = DVR_FALSE;
+  svc->users[svc->user_cnt++] = p_ctx;
+
+  if (!svc->alive) {
+    svc->quit = DVR_FALSE;
+    if (pthread_create(&svc->thread, NULL, secdmx_service_thread, svc) != 0) {
+      DVR_DEBUG(1, "%s, create secdmx service thread failed", __func__);
+      svc->user_cnt--;
+      close(p_ctx->sec_evtfd);
+      p_ctx->sec_evtfd = -1;
+      pthread_mutex_unlock(&svc->lock);
+      return DVR_FAILURE;
+    }
+    svc->alive = DVR_TRUE;
+  } else {
+    int64_t pad = 1;
+    write(svc->evtfd, &pad, sizeof(pad));
+  }
+  pthread_mutex_unlock(&svc->lock);
+  return DVR_SUCCESS;
+}
+
+/*Stop serving a recording, before its output buffer and dvr device are released*/
+static void secdmx_service_leave(Record_DeviceContext_t *p_ctx)
+{
+  SecDmx_Service_t *svc;
+  int64_t pad = 1;
+  int i;
+
+  if (p_ctx->sec_evtfd == -1)
+    return;
+  svc = &secdmx_svc[p_ctx->fend_dev_id];
+
+  pthread_mutex_lock(&svc->lock);
+  for (i = 0; i < svc->user_cnt; i++) {
+    if (svc->users[i] == p_ctx) {
+      svc->users[i] = svc->users[--svc->user_cnt];
+      break;
+    }
+  }
+  if (!svc->user_cnt && svc->alive)
+    svc->quit = DVR_TRUE;
+  write(svc->evtfd, &pad, sizeof(pad));
+  pthread_mutex_unlock(&svc->lock);
+
+  close(p_ctx->sec_evtfd);
+  p_ctx->sec_evtfd = -1;
 }
 
 int add_dvr_pids(Record_DeviceContext_t *p_ctx)
@@ -127,8 +370,8 @@ int add_dvr_pids(Record_DeviceContext_t *p_ctx)
         DVR_DEBUG(0, "dvr pid:%#x, cnt:%#x", pids[cnt-1], cnt);
       }
     }
-    if (SECDMX_AddDVRPids_Ptr != NULL)
-      result = SECDMX_AddDVRPids_Ptr(p_ctx->output_handle, pids, cnt);
+    if (secdmx_api.AddDVRPids != NULL)
+      result = secdmx_api.AddDVRPids(p_ctx->output_handle, pids, cnt);
     DVR_RETURN_IF_FALSE(result == DVR_SUCCESS);
   }
 
@@ -141,8 +384,6 @@ int record_device_open(Record_DeviceHandle_t *p_handle, Record_DeviceOpenParams_
   int dev_no;
   char dev_name[32];
   int ret;
-  char buf[64];
-  char cmd[32];
   Record_DeviceContext_t *p_ctx;
 
   DVR_RETURN_IF_FALSE(p_handle);
@@ -163,6 +404,24 @@ int record_device_open(Record_DeviceHandle_t *p_handle, Record_DeviceOpenParams_
     p_ctx->streams[i].pid = DVR_INVALID_PID;
     p_ctx->streams[i].fid = -1;
   }
+  p_ctx->backend = params->backend;
+  p_ctx->soft = NULL;
+  p_ctx->sec_evtfd = -1;
+  if (p_ctx->backend != RECORD_DEVICE_BACKEND_DVB) {
+    /*Software backend, no dvr/demux device and no asyncfifo setting*/
+    ret = record_soft_open(&p_ctx->soft, params);
+    DVR_RETURN_IF_FALSE_WITH_UNLOCK(ret == DVR_SUCCESS, &p_ctx->lock);
+    p_ctx->fd = -1;
+    p_ctx->evtfd = -1;
+    p_ctx->dmx_dev_id = params->dmx_dev_id;
+    p_ctx->fend_dev_id = 0;
+    p_ctx->output_handle = (size_t)NULL;
+    p_ctx->dvr_buf = (size_t)NULL;
+    p_ctx->state = RECORD_DEVICE_STATE_OPENED;
+    *p_handle = p_ctx;
+    pthread_mutex_unlock(&p_ctx->lock);
+    return DVR_SUCCESS;
+  }
   /*Open dvr device*/
   memset(dev_name, 0, sizeof(dev_name));
   snprintf(dev_name, sizeof(dev_name), "/dev/dvb0.dvr%d", params->dmx_dev_id);
@@ -181,8 +440,8 @@ int record_device_open(Record_DeviceHandle_t *p_handle, Record_DeviceOpenParams_
   /*Configure flush size*/
   if (dvr_check_dmx_isNew() == 1) {
     /* initialize secure demux client */
-    if (SECDMX_Init_Ptr != NULL) {
-      ret = SECDMX_Init_Ptr();
+    if (secdmx_api.Init != NULL) {
+      ret = secdmx_api.Init();
       if (ret != DVR_SUCCESS) {
         DVR_DEBUG(1, "%s secure demux init failed:%d", __func__, ret);
       }
@@ -208,32 +467,10 @@ int record_device_open(Record_DeviceHandle_t *p_handle, Record_DeviceOpenParams_
           }
       }
   }
-  memset(buf, 0, sizeof(buf));
-  snprintf(buf, sizeof(buf), "/sys/class/stb/asyncfifo%d_flush_size", dev_no);
-  memset(cmd, 0, sizeof(cmd));
-  snprintf(cmd, sizeof(cmd), "%d", params->buf_size);
-  dvr_file_echo(buf, cmd);
-
-  /*Configure source*/
-  memset(buf, 0, sizeof(buf));
-  snprintf(buf, sizeof(buf), "/sys/class/stb/asyncfifo%d_source", dev_no);
-  memset(cmd, 0, sizeof(cmd));
-  snprintf(cmd, sizeof(cmd), "dmx%d", params->dmx_dev_id);
+  /*Configure flush size, source and non secure mode, unchanged values are not written*/
   p_ctx->dmx_dev_id = params->dmx_dev_id;
-  dvr_file_echo(buf, cmd);
-
-  /*Configure Non secure mode*/
-  memset(buf, 0, sizeof(buf));
-  snprintf(buf, sizeof(buf), "/sys/class/stb/asyncfifo%d_secure_enable", dev_no);
-  dvr_file_echo(buf, "0");
-
-  memset(buf, 0, sizeof(buf));
-  snprintf(buf, sizeof(buf), "/sys/class/stb/asyncfifo%d_secure_addr", dev_no);
-  dvr_file_echo(buf, "0");
-
-  memset(buf, 0, sizeof(buf));
-  snprintf(buf, sizeof(buf), "/sys/class/stb/asyncfifo%d_secure_addr_size", dev_no);
-  dvr_file_echo(buf, "0");
+  dvb_topology_set_asyncfifo(dev_no, params->dmx_dev_id, params->buf_size);
+  dvb_topology_set_asyncfifo_secure(dev_no, 0, 0, 0);
 
   if (params->fend_dev_id > MAX_FEND_DEVICE_COUNT -1) {
     DVR_DEBUG(0, "invalid frontend devicie id:%d, will use default.\n",
@@ -266,16 +503,26 @@ int record_device_close(Record_DeviceHandle_t handle)
 
   pthread_mutex_lock(&p_ctx->lock);
   DVR_RETURN_IF_FALSE_WITH_UNLOCK(p_ctx->state != RECORD_DEVICE_STATE_CLOSED, &p_ctx->lock);
+  if (p_ctx->backend != RECORD_DEVICE_BACKEND_DVB) {
+    record_soft_close(p_ctx->soft);
+    p_ctx->soft = NULL;
+    p_ctx->backend = RECORD_DEVICE_BACKEND_DVB;
+    p_ctx->fend_dev_id = -1;
+    p_ctx->state = RECORD_DEVICE_STATE_CLOSED;
+    pthread_mutex_unlock(&p_ctx->lock);
+    return DVR_SUCCESS;
+  }
+  secdmx_service_leave(p_ctx);
   close(p_ctx->fd);
   close(p_ctx->evtfd);
   if (dvr_check_dmx_isNew()) {
     if (p_ctx->output_handle) {
-      if (SECDMX_RemoveOutputBuffer_Ptr != NULL)
-        SECDMX_RemoveOutputBuffer_Ptr(p_ctx->output_handle);
+      if (secdmx_api.RemoveOutputBuffer != NULL)
+        secdmx_api.RemoveOutputBuffer(p_ctx->output_handle);
       p_ctx->output_handle = (size_t)NULL;
     }
     if (p_ctx->dvr_buf) {
-      if (SECDMX_FreeDVRBuffer_Ptr != NULL) {
+      if (secdmx_api.FreeDVRBuffer != NULL) {
 	for (i = 0; i < MAX_RECORD_DEVICE_COUNT; i++) {
 	  if (&record_ctx[i] != p_ctx &&
 	      record_ctx[i].fend_dev_id == p_ctx->fend_dev_id &&
@@ -284,7 +531,7 @@ int record_device_close(Record_DeviceHandle_t handle)
 	  }
 	}
 	if (i >= MAX_RECORD_DEVICE_COUNT) {
-          SECDMX_FreeDVRBuffer_Ptr(p_ctx->fend_dev_id);
+          secdmx_api.FreeDVRBuffer(p_ctx->fend_dev_id);
 	}
 	p_ctx->dvr_buf = (size_t)NULL;
       }
@@ -324,8 +571,17 @@ int record_device_add_pid(Record_DeviceHandle_t handle, int pid)
   DVR_RETURN_IF_FALSE_WITH_UNLOCK(i < DVR_MAX_RECORD_PIDS_COUNT, &p_ctx->lock);
   DVR_RETURN_IF_FALSE_WITH_UNLOCK(p_ctx->streams[i].pid == DVR_INVALID_PID, &p_ctx->lock);
 
-  p_ctx->streams[i].pid = pid;
   DVR_DEBUG(1, "%s add pid:%#x", __func__, pid);
+  if (p_ctx->backend != RECORD_DEVICE_BACKEND_DVB) {
+    ret = record_soft_add_pid(p_ctx->soft, pid);
+    if (ret == DVR_SUCCESS) {
+      p_ctx->streams[i].pid = pid;
+      p_ctx->streams[i].is_start = (p_ctx->state == RECORD_DEVICE_STATE_STARTED);
+    }
+    pthread_mutex_unlock(&p_ctx->lock);
+    return ret;
+  }
+  p_ctx->streams[i].pid = pid;
 	snprintf(dev_name, sizeof(dev_name), "/dev/dvb0.demux%d", p_ctx->dmx_dev_id);
   fd = open(dev_name, O_RDWR);
   if (fd == -1) {
@@ -389,6 +645,14 @@ int record_device_remove_pid(Record_DeviceHandle_t handle, int pid)
   DVR_RETURN_IF_FALSE_WITH_UNLOCK(i < DVR_MAX_RECORD_PIDS_COUNT, &p_ctx->lock);
   DVR_RETURN_IF_FALSE_WITH_UNLOCK(p_ctx->streams[i].pid == pid, &p_ctx->lock);
 
+  if (p_ctx->backend != RECORD_DEVICE_BACKEND_DVB) {
+    ret = record_soft_remove_pid(p_ctx->soft, pid);
+    p_ctx->streams[i].pid = DVR_INVALID_PID;
+    p_ctx->streams[i].is_start = DVR_FALSE;
+    pthread_mutex_unlock(&p_ctx->lock);
+    return ret;
+  }
+
   fd = p_ctx->streams[i].fid;
   DVR_RETURN_IF_FALSE_WITH_UNLOCK(fd != -1, &p_ctx->lock);
 
@@ -436,6 +700,18 @@ int record_device_start(Record_DeviceHandle_t handle)
     return DVR_FAILURE;
   }
 
+  if (p_ctx->backend != RECORD_DEVICE_BACKEND_DVB) {
+    ret = record_soft_start(p_ctx->soft);
+    DVR_RETURN_IF_FALSE_WITH_UNLOCK(ret == DVR_SUCCESS, &p_ctx->lock);
+    for (i = 0; i < DVR_MAX_RECORD_PIDS_COUNT; i++) {
+      if (p_ctx->streams[i].pid != DVR_INVALID_PID)
+        p_ctx->streams[i].is_start = DVR_TRUE;
+    }
+    p_ctx->state = RECORD_DEVICE_STATE_STARTED;
+    pthread_mutex_unlock(&p_ctx->lock);
+    return DVR_SUCCESS;
+  }
+
   //DVR_RETURN_IF_FALSE_WITH_UNLOCK(DVR_SUCCESS == add_dvr_pids(p_ctx), &p_ctx->lock);
   add_dvr_pids(p_ctx);
 
@@ -494,6 +770,21 @@ int record_device_stop(Record_DeviceHandle_t handle)
     return DVR_FAILURE;
   }
 
+  if (p_ctx->backend != RECORD_DEVICE_BACKEND_DVB) {
+    /*Match the demux path, stop drops all the pids*/
+    for (i = 0; i < DVR_MAX_RECORD_PIDS_COUNT; i++) {
+      if (p_ctx->streams[i].pid != DVR_INVALID_PID) {
+        record_soft_remove_pid(p_ctx->soft, p_ctx->streams[i].pid);
+        p_ctx->streams[i].pid = DVR_INVALID_PID;
+        p_ctx->streams[i].is_start = DVR_FALSE;
+      }
+    }
+    p_ctx->state = RECORD_DEVICE_STATE_STOPPED;
+    ret = record_soft_stop(p_ctx->soft);
+    pthread_mutex_unlock(&p_ctx->lock);
+    return ret;
+  }
+
   for (i = 0; i < DVR_MAX_RECORD_PIDS_COUNT; i++) {
     if (p_ctx->streams[i].fid != -1 &&
         p_ctx->streams[i].pid != DVR_INVALID_PID &&
@@ -531,6 +822,10 @@ ssize_t record_device_read(Record_DeviceHandle_t handle, void *buf, size_t len,
 
   p_ctx = (Record_DeviceContext_t *)handle;
   DVR_RETURN_IF_FALSE(p_ctx);
+  if (p_ctx->backend != RECORD_DEVICE_BACKEND_DVB) {
+    /*the soft device has its own lock, so stop can wake up the read*/
+    return record_soft_read(p_ctx->soft, buf, len, timeout);
+  }
   DVR_RETURN_IF_FALSE(p_ctx->fd != -1);
   DVR_RETURN_IF_FALSE(buf);
   DVR_RETURN_IF_FALSE(len);
@@ -568,46 +863,44 @@ ssize_t record_device_read(Record_DeviceHandle_t handle, void *buf, size_t len,
   return ret;
 }
 
-ssize_t record_device_read_ext(Record_DeviceHandle_t handle, size_t *buf, size_t *len)
+ssize_t record_device_read_ext(Record_DeviceHandle_t handle, size_t *buf, size_t *len, int timeout)
 {
   Record_DeviceContext_t *p_ctx;
-  int result;
-  int sid;
-  struct dvr_mem_info info;
+  Record_SecDmxBuf_t *e;
+  struct pollfd fds[2];
+  int64_t pad;
 
   p_ctx = (Record_DeviceContext_t *)handle;
   DVR_RETURN_IF_FALSE(p_ctx);
   DVR_RETURN_IF_FALSE(buf);
   DVR_RETURN_IF_FALSE(len);
-  DVR_RETURN_IF_FALSE(p_ctx->dvr_buf);
-  DVR_RETURN_IF_FALSE(p_ctx->output_handle);
+  DVR_RETURN_IF_FALSE(p_ctx->backend == RECORD_DEVICE_BACKEND_DVB);
+  DVR_RETURN_IF_FALSE(p_ctx->sec_evtfd != -1);
 
-  sid = p_ctx->fend_dev_id;
-  pthread_mutex_lock(&p_ctx->lock);
-
-  /* wp_offset is hw write pointer shared by multiple recordings under one sid,
-   * must use mutex for thread safe
-   */
-  pthread_mutex_lock(&secdmx_lock[sid]);
-  memset(&info, 0, sizeof(info));
-  result = ioctl(p_ctx->fd, DMX_GET_DVR_MEM, &info);
-  //DVR_DEBUG(1, "sid[%d] fd[%d] wp:%#x\n", sid, p_ctx->fd, info.wp_offset);
-  if (result == DVR_SUCCESS) {
-    if (SECDMX_ProcessData_Ptr != NULL)
-      result = SECDMX_ProcessData_Ptr(sid, info.wp_offset);
-  }
-  if (result) {
-    DVR_DEBUG(1, "result:%#x\n", result);
+  /*the updates are queued by the secure demux service of the sid, no lock needed*/
+  while (p_ctx->sec_head == p_ctx->sec_tail) {
+    if (p_ctx->state != RECORD_DEVICE_STATE_STARTED)
+      return DVR_FAILURE;
+    fds[0].fd = p_ctx->sec_evtfd;
+    fds[1].fd = p_ctx->evtfd;
+    fds[0].events = fds[1].events = POLLIN;
+    fds[0].revents = fds[1].revents = 0;
+    if (poll(fds, 2, timeout) <= 0)
+      return DVR_FAILURE;
+    if (fds[0].revents & POLLIN)
+      read(p_ctx->sec_evtfd, &pad, sizeof(pad));
+    if (fds[1].revents & POLLIN) {
+      /*stopped*/
+      read(p_ctx->evtfd, &pad, sizeof(pad));
+      return DVR_FAILURE;
+    }
   }
-  pthread_mutex_unlock(&secdmx_lock[sid]);
-
-  DVR_RETURN_IF_FALSE_WITH_UNLOCK(result == DVR_SUCCESS, &p_ctx->lock);
-  if (SECDMX_GetOutputBufferStatus_Ptr != NULL)
-    result = SECDMX_GetOutputBufferStatus_Ptr(p_ctx->output_handle, buf, len);
-  //DVR_DEBUG(1, "addr:%#x, len:%#x\n", *buf, *len);
-  DVR_RETURN_IF_FALSE_WITH_UNLOCK(result == DVR_SUCCESS, &p_ctx->lock);
-
-  pthread_mutex_unlock(&p_ctx->lock);
+  __sync_synchronize();
+  e = &p_ctx->sec_queue[p_ctx->sec_head & (SECDMX_QUEUE_SIZE - 1)];
+  *buf = e->addr;
+  *len = e->len;
+  __sync_synchronize();
+  p_ctx->sec_head++;
   return *len;
 }
 
@@ -615,13 +908,13 @@ int record_device_set_secure_buffer(Record_DeviceHandle_t handle, uint8_t *sec_b
 {
   Record_DeviceContext_t *p_ctx;
   int i;
-  char buf[64];
-  char cmd[32];
 
   p_ctx = (Record_DeviceContext_t *)handle;
   DVR_RETURN_IF_FALSE(p_ctx);
   DVR_RETURN_IF_FALSE(sec_buf);
   DVR_RETURN_IF_FALSE(len);
+  /*No secure path in the software backend*/
+  DVR_RETURN_IF_FALSE(p_ctx->backend == RECORD_DEVICE_BACKEND_DVB);
 
   for (i = 0; i < MAX_RECORD_DEVICE_COUNT; i++) {
     if (p_ctx == &record_ctx[i])
@@ -649,7 +942,7 @@ int record_device_set_secure_buffer(Record_DeviceHandle_t handle, uint8_t *sec_b
     memset(node, 0, sizeof(node));
     snprintf(node, sizeof(node), "/dev/dvb0.demux%d", p_ctx->dmx_dev_id);
     fd = open(node, O_RDONLY);
-    if (SECDMX_AllocateDVRBuffer_Ptr != NULL) {
+    if (secdmx_api.AllocateDVRBuffer != NULL) {
 	for (i = 0; i < MAX_RECORD_DEVICE_COUNT; i++) {
 	  if (record_ctx[i].state != RECORD_DEVICE_STATE_CLOSED &&
 	      &record_ctx[i] != p_ctx &&
@@ -659,7 +952,7 @@ int record_device_set_secure_buffer(Record_DeviceHandle_t handle, uint8_t *sec_b
 	  }
 	}
 	if (i >= MAX_RECORD_DEVICE_COUNT) {
-	  result = SECDMX_AllocateDVRBuffer_Ptr(sid, len, &dvr_buf);
+	  result = secdmx_api.AllocateDVRBuffer(sid, len, &dvr_buf);
 	  DVR_RETURN_IF_FALSE_WITH_UNLOCK(result == DVR_SUCCESS, &p_ctx->lock);
 	} else {
 	  dvr_buf = record_ctx[i].dvr_buf;
@@ -680,28 +973,17 @@ int record_device_set_secure_buffer(Record_DeviceHandle_t handle, uint8_t *sec_b
     {
       DVR_DEBUG(1, "record_device_set_secure_buffer ioctl sucesss DMX_SET_SEC_MEM: fd:%d, buf:%#x\n", fd, p_ctx->dvr_buf);
     }
-    if (SECDMX_AddOutputBuffer_Ptr != NULL)
-      result = SECDMX_AddOutputBuffer_Ptr(sid, (size_t)sec_buf, len, &op_handle);
+    if (secdmx_api.AddOutputBuffer != NULL)
+      result = secdmx_api.AddOutputBuffer(sid, (size_t)sec_buf, len, &op_handle);
     DVR_RETURN_IF_FALSE_WITH_UNLOCK(result == DVR_SUCCESS, &p_ctx->lock);
     p_ctx->output_handle = op_handle;
 
+    result = secdmx_service_join(p_ctx);
     pthread_mutex_unlock(&p_ctx->lock);
-    return DVR_SUCCESS;
+    return result;
   }
 
-  memset(buf, 0, sizeof(buf));
-  snprintf(buf, sizeof(buf), "/sys/class/stb/asyncfifo%d_secure_enable", i);
-  dvr_file_echo(buf, "1");
-
-  memset(buf, 0, sizeof(buf));
-  snprintf(buf, sizeof(buf), "/sys/class/stb/asyncfifo%d_secure_addr", i);
-  snprintf(cmd, sizeof(cmd), "%llu", (uint64_t)sec_buf);
-  dvr_file_echo(buf, cmd);
-
-  memset(buf, 0, sizeof(buf));
-  snprintf(buf, sizeof(buf), "/sys/class/stb/asyncfifo%d_secure_addr_size", i);
-  snprintf(cmd, sizeof(cmd), "%d", len);
-  dvr_file_echo(buf, cmd);
+  dvb_topology_set_asyncfifo_secure(i, 1, (uint64_t)(size_t)sec_buf, len);
 
   pthread_mutex_unlock(&p_ctx->lock);
   return DVR_SUCCESS;
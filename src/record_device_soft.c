@@ -0,0 +1,371 @@
+#define DVR_LOG_MODULE DVR_LOG_MODULE_RECORD
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <sys/eventfd.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "dvr_types.h"
+#include "record_device.h"
+#include "record_device_soft.h"
+#include "dvb_frontend_wrapper.h"
+
+#define SOFT_TS_PKT_SIZE      188
+#define SOFT_TS_NULL_PID      0x1fff
+#define SOFT_SRC_BUF_SIZE     (SOFT_TS_PKT_SIZE * 1024)
+#define SOFT_DEFAULT_BITRATE  (20 * 1000 * 1000)
+/*Max source bytes scanned per read, bounds the time a read holds the lock*/
+#define SOFT_MAX_SCAN_SIZE    (SOFT_TS_PKT_SIZE * 1024 * 16)
+#define SOFT_PCR_INTERVAL_MS  40
+/*Max wait of a read while the virtual frontend is not locked*/
+#define SOFT_LOCK_POLL_MS     20
+
+/**\brief Software record device context information*/
+typedef struct {
+  pthread_mutex_t               lock;                                  /**< Device lock*/
+  Record_DeviceBackend_t        backend;                               /**< File, synthetic or virtual frontend*/
+  int                           dmx_dev_id;                            /**< Demux device id*/
+  DVR_Bool_t                    is_start;                              /**< Device is started*/
+  int                           evtfd;                                 /**< eventfd for poll's exit*/
+  uint8_t                       pid_map[8192 / 8];                     /**< PID filter bitmap*/
+  uint16_t                      pids[DVR_MAX_RECORD_PIDS_COUNT];       /**< Filtered PIDs, in add order*/
+  uint8_t                       cc[DVR_MAX_RECORD_PIDS_COUNT];         /**< Synthetic continuity counters*/
+  int                           pid_cnt;                               /**< Filtered PID count*/
+  uint32_t                      bitrate;                               /**< Pacing bitrate, 0 is unpaced*/
+  uint64_t                      start_ms;                              /**< Monotonic time of start*/
+  uint64_t                      consumed;                              /**< Source bytes consumed since start*/
+  int                           src_fd;                                /**< TS source file*/
+  uint8_t                       *src_buf;                              /**< TS source read buffer*/
+  size_t                        src_len;                               /**< Valid bytes in src_buf*/
+  size_t                        src_pos;                               /**< Read position in src_buf*/
+  uint64_t                      syn_pkts;                              /**< Synthetic packets generated*/
+  uint64_t                      syn_pcr_ms;                            /**< Stream time of the last synthetic PCR*/
+  uint32_t                      syn_idx;                               /**< Synthetic round robin position*/
+  uint8_t                       syn_pkt[SOFT_TS_PKT_SIZE];             /**< Synthetic packet*/
+} Record_SoftDeviceContext_t;
+
+static uint64_t soft_get_ms(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static DVR_Bool_t soft_pid_is_set(Record_SoftDeviceContext_t *p_ctx, uint16_t pid)
+{
+  return (p_ctx->pid_map[pid >> 3] & (1 << (pid & 7))) ? DVR_TRUE : DVR_FALSE;
+}
+
+/*Return the next source packet of the file, rewinding on EOF,
+ *NULL after a whole pass of the file without a packet*/
+static uint8_t *soft_file_packet(Record_SoftDeviceContext_t *p_ctx)
+{
+  ssize_t ret;
+  DVR_Bool_t rewound = DVR_FALSE;
+
+  for (;;) {
+    /*resync on the sync byte*/
+    while (p_ctx->src_pos < p_ctx->src_len && p_ctx->src_buf[p_ctx->src_pos] != 0x47)
+      p_ctx->src_pos++;
+
+    if (p_ctx->src_len - p_ctx->src_pos >= SOFT_TS_PKT_SIZE) {
+      uint8_t *pkt = p_ctx->src_buf + p_ctx->src_pos;
+      p_ctx->src_pos += SOFT_TS_PKT_SIZE;
+      return pkt;
+    }
+
+    memmove(p_ctx->src_buf, p_ctx->src_buf + p_ctx->src_pos, p_ctx->src_len - p_ctx->src_pos);
+    p_ctx->src_len -= p_ctx->src_pos;
+    p_ctx->src_pos = 0;
+    ret = read(p_ctx->src_fd, p_ctx->src_buf + p_ctx->src_len, SOFT_SRC_BUF_SIZE - p_ctx->src_len);
+    if (ret > 0) {
+      p_ctx->src_len += ret;
+      continue;
+    }
+    if (ret < 0 && errno == EINTR)
+      continue;
+    if (ret < 0 || rewound) {
+      DVR_DEBUG(1, "%s, no packet in source file (%s)", __func__, ret < 0 ? strerror(errno) : "eof");
+      return NULL;
+    }
+    /*loop the source, dropping the trailing partial packet*/
+    lseek(p_ctx->src_fd, 0, SEEK_SET);
+    p_ctx->src_len = 0;
+    rewound = DVR_TRUE;
+  }
+}
+
+/*Generate the next synthetic packet, round robin on the filtered PIDs,
+ *the first PID carries a PCR every SOFT_PCR_INTERVAL_MS of stream time*/
+static uint8_t *soft_synthetic_packet(Record_SoftDeviceContext_t *p_ctx)
+{
+  uint8_t *pkt = p_ctx->syn_pkt;
+  uint32_t rate = p_ctx->bitrate ? p_ctx->bitrate : SOFT_DEFAULT_BITRATE;
+  uint64_t bits = p_ctx->syn_pkts * SOFT_TS_PKT_SIZE * 8;
+  uint64_t stream_ms = bits * 1000 / rate;
+  uint16_t pid = SOFT_TS_NULL_PID;
+  uint8_t cc = 0;
+  int idx = -1;
+
+  if (p_ctx->pid_cnt > 0) {
+    idx = p_ctx->syn_idx++ % p_ctx->pid_cnt;
+    pid = p_ctx->pids[idx];
+    cc = p_ctx->cc[idx]++ & 0x0f;
+  }
+
+  memset(pkt, 0xff, SOFT_TS_PKT_SIZE);
+  pkt[0] = 0x47;
+  pkt[1] = (pid >> 8) & 0x1f;
+  pkt[2] = pid & 0xff;
+  if (idx == 0 &&
+      (p_ctx->syn_pkts == 0 || stream_ms - p_ctx->syn_pcr_ms >= SOFT_PCR_INTERVAL_MS)) {
+    uint64_t pcr = bits * 90000 / rate;
+
+    pkt[3] = 0x30 | cc;
+    pkt[4] = 7;
+    pkt[5] = 0x10;
+    pkt[6] = (pcr >> 25) & 0xff;
+    pkt[7] = (pcr >> 17) & 0xff;
+    pkt[8] = (pcr >> 9) & 0xff;
+    pkt[9] = (pcr >> 1) & 0xff;
+    pkt[10] = ((pcr & 1) << 7) | 0x7e;
+    pkt[11] = 0;
+    p_ctx->syn_pcr_ms = stream_ms;
+  } else {
+    pkt[3] = 0x10 | cc;
+  }
+  p_ctx->syn_pkts++;
+  return pkt;
+}
+
+int record_soft_open(Record_SoftDeviceHandle_t *p_handle, Record_DeviceOpenParams_t *params)
+{
+  Record_SoftDeviceContext_t *p_ctx;
+  char fe_file[256];
+  const char *src_file = params ? params->src_file : NULL;
+  uint_t fe_bitrate = 0;
+
+  DVR_RETURN_IF_FALSE(p_handle);
+  DVR_RETURN_IF_FALSE(params);
+  DVR_RETURN_IF_FALSE(params->backend == RECORD_DEVICE_BACKEND_FILE ||
+      params->backend == RECORD_DEVICE_BACKEND_SYNTHETIC ||
+      params->backend == RECORD_DEVICE_BACKEND_FRONTEND);
+
+  if (params->backend == RECORD_DEVICE_BACKEND_FRONTEND) {
+    /*the TS of the channel the virtual frontend is tuned to*/
+    AML_FE_GetVirtualSource(params->dmx_dev_id, fe_file, sizeof(fe_file), &fe_bitrate);
+    src_file = fe_file[0] ? fe_file : NULL;
+  }
+
+  p_ctx = (Record_SoftDeviceContext_t *)calloc(1, sizeof(Record_SoftDeviceContext_t));
+  DVR_RETURN_IF_FALSE(p_ctx);
+
+  p_ctx->src_fd = -1;
+  if (params->backend != RECORD_DEVICE_BACKEND_SYNTHETIC) {
+    if (!src_file ||
+        (p_ctx->src_fd = open(src_file, O_RDONLY)) == -1) {
+      DVR_DEBUG(1, "%s cannot open \"%s\" (%s)", __func__,
+          src_file ? src_file : "null", strerror(errno));
+      free(p_ctx);
+      return DVR_FAILURE;
+    }
+    p_ctx->src_buf = (uint8_t *)malloc(SOFT_SRC_BUF_SIZE);
+    if (!p_ctx->src_buf) {
+      close(p_ctx->src_fd);
+      free(p_ctx);
+      return DVR_FAILURE;
+    }
+  }
+
+  p_ctx->evtfd = eventfd(0, EFD_NONBLOCK);
+  if (p_ctx->evtfd == -1) {
+    DVR_DEBUG(1, "%s eventfd failed (%s)", __func__, strerror(errno));
+    if (p_ctx->src_fd != -1)
+      close(p_ctx->src_fd);
+    free(p_ctx->src_buf);
+    free(p_ctx);
+    return DVR_FAILURE;
+  }
+  pthread_mutex_init(&p_ctx->lock, NULL);
+  p_ctx->backend = params->backend;
+  p_ctx->dmx_dev_id = params->dmx_dev_id;
+  p_ctx->bitrate = params->src_bitrate ? params->src_bitrate : fe_bitrate;
+  p_ctx->is_start = DVR_FALSE;
+  DVR_DEBUG(1, "%s backend:%d src:%s bitrate:%u", __func__, p_ctx->backend,
+      src_file ? src_file : "synthetic", p_ctx->bitrate);
+
+  *p_handle = p_ctx;
+  return DVR_SUCCESS;
+}
+
+int record_soft_close(Record_SoftDeviceHandle_t handle)
+{
+  Record_SoftDeviceContext_t *p_ctx = (Record_SoftDeviceContext_t *)handle;
+
+  DVR_RETURN_IF_FALSE(p_ctx);
+
+  close(p_ctx->evtfd);
+  if (p_ctx->src_fd != -1)
+    close(p_ctx->src_fd);
+  free(p_ctx->src_buf);
+  pthread_mutex_destroy(&p_ctx->lock);
+  free(p_ctx);
+  return DVR_SUCCESS;
+}
+
+int record_soft_add_pid(Record_SoftDeviceHandle_t handle, int pid)
+{
+  Record_SoftDeviceContext_t *p_ctx = (Record_SoftDeviceContext_t *)handle;
+
+  DVR_RETURN_IF_FALSE(p_ctx);
+  DVR_RETURN_IF_FALSE(pid >= 0 && pid < SOFT_TS_NULL_PID);
+
+  pthread_mutex_lock(&p_ctx->lock);
+  DVR_RETURN_IF_FALSE_WITH_UNLOCK(p_ctx->pid_cnt < DVR_MAX_RECORD_PIDS_COUNT, &p_ctx->lock);
+  DVR_RETURN_IF_FALSE_WITH_UNLOCK(!soft_pid_is_set(p_ctx, pid), &p_ctx->lock);
+  p_ctx->pid_map[pid >> 3] |= (1 << (pid & 7));
+  p_ctx->pids[p_ctx->pid_cnt] = pid;
+  p_ctx->cc[p_ctx->pid_cnt] = 0;
+  p_ctx->pid_cnt++;
+  pthread_mutex_unlock(&p_ctx->lock);
+  return DVR_SUCCESS;
+}
+
+int record_soft_remove_pid(Record_SoftDeviceHandle_t handle, int pid)
+{
+  Record_SoftDeviceContext_t *p_ctx = (Record_SoftDeviceContext_t *)handle;
+  int i;
+
+  DVR_RETURN_IF_FALSE(p_ctx);
+  DVR_RETURN_IF_FALSE(pid >= 0 && pid < SOFT_TS_NULL_PID);
+
+  pthread_mutex_lock(&p_ctx->lock);
+  DVR_RETURN_IF_FALSE_WITH_UNLOCK(soft_pid_is_set(p_ctx, pid), &p_ctx->lock);
+  p_ctx->pid_map[pid >> 3] &= ~(1 << (pid & 7));
+  for (i = 0; i < p_ctx->pid_cnt; i++) {
+    if (p_ctx->pids[i] == pid)
+      break;
+  }
+  for (; i < p_ctx->pid_cnt - 1; i++) {
+    p_ctx->pids[i] = p_ctx->pids[i + 1];
+    p_ctx->cc[i] = p_ctx->cc[i + 1];
+  }
+  p_ctx->pid_cnt--;
+  pthread_mutex_unlock(&p_ctx->lock);
+  return DVR_SUCCESS;
+}
+
+int record_soft_start(Record_SoftDeviceHandle_t handle)
+{
+  Record_SoftDeviceContext_t *p_ctx = (Record_SoftDeviceContext_t *)handle;
+  uint64_t pad;
+
+  DVR_RETURN_IF_FALSE(p_ctx);
+
+  pthread_mutex_lock(&p_ctx->lock);
+  /*drain a wakeup left by the previous stop*/
+  while (read(p_ctx->evtfd, &pad, sizeof(pad)) > 0)
+    ;
+  p_ctx->start_ms = soft_get_ms();
+  p_ctx->consumed = 0;
+  p_ctx->is_start = DVR_TRUE;
+  pthread_mutex_unlock(&p_ctx->lock);
+  return DVR_SUCCESS;
+}
+
+int record_soft_stop(Record_SoftDeviceHandle_t handle)
+{
+  Record_SoftDeviceContext_t *p_ctx = (Record_SoftDeviceContext_t *)handle;
+  uint64_t pad = 1;
+
+  DVR_RETURN_IF_FALSE(p_ctx);
+
+  pthread_mutex_lock(&p_ctx->lock);
+  p_ctx->is_start = DVR_FALSE;
+  /*wakeup the poll*/
+  write(p_ctx->evtfd, &pad, sizeof(pad));
+  pthread_mutex_unlock(&p_ctx->lock);
+  return DVR_SUCCESS;
+}
+
+ssize_t record_soft_read(Record_SoftDeviceHandle_t handle, void *buf, size_t len, int timeout)
+{
+  Record_SoftDeviceContext_t *p_ctx = (Record_SoftDeviceContext_t *)handle;
+  struct pollfd fds;
+  uint64_t elapsed, budget;
+  uint8_t *out = (uint8_t *)buf;
+  uint8_t *pkt;
+  size_t n = 0;
+
+  DVR_RETURN_IF_FALSE(p_ctx);
+  DVR_RETURN_IF_FALSE(buf);
+  DVR_RETURN_IF_FALSE(len >= SOFT_TS_PKT_SIZE);
+
+  if (p_ctx->backend == RECORD_DEVICE_BACKEND_FRONTEND &&
+      AML_FE_GetVirtualSource(p_ctx->dmx_dev_id, NULL, 0, NULL) != TUNER_STATE_LOCKED) {
+    /*nothing is received until the frontend locks, pacing restarts from the lock*/
+    memset(&fds, 0, sizeof(fds));
+    fds.fd = p_ctx->evtfd;
+    fds.events = POLLIN | POLLERR;
+    poll(&fds, 1, (timeout >= 0 && timeout < SOFT_LOCK_POLL_MS) ? timeout : SOFT_LOCK_POLL_MS);
+    pthread_mutex_lock(&p_ctx->lock);
+    p_ctx->start_ms = soft_get_ms();
+    p_ctx->consumed = 0;
+    pthread_mutex_unlock(&p_ctx->lock);
+    return DVR_FAILURE;
+  }
+
+  pthread_mutex_lock(&p_ctx->lock);
+  DVR_RETURN_IF_FALSE_WITH_UNLOCK(p_ctx->is_start, &p_ctx->lock);
+  if (p_ctx->bitrate) {
+    /*like the dvr flush size, wait until a full buffer of source is due*/
+    uint64_t due_ms = (p_ctx->consumed + len) * 8 * 1000 / p_ctx->bitrate;
+    elapsed = soft_get_ms() - p_ctx->start_ms;
+    if (due_ms > elapsed) {
+      uint64_t wait_ms = due_ms - elapsed;
+
+      if (timeout >= 0 && wait_ms > (uint64_t)timeout)
+        wait_ms = timeout;
+      pthread_mutex_unlock(&p_ctx->lock);
+      memset(&fds, 0, sizeof(fds));
+      fds.fd = p_ctx->evtfd;
+      fds.events = POLLIN | POLLERR;
+      poll(&fds, 1, (int)wait_ms);
+      pthread_mutex_lock(&p_ctx->lock);
+      DVR_RETURN_IF_FALSE_WITH_UNLOCK(p_ctx->is_start, &p_ctx->lock);
+    }
+    elapsed = soft_get_ms() - p_ctx->start_ms;
+    budget = elapsed * p_ctx->bitrate / 8 / 1000;
+    budget = (budget > p_ctx->consumed) ? budget - p_ctx->consumed : 0;
+    if (budget > SOFT_MAX_SCAN_SIZE)
+      budget = SOFT_MAX_SCAN_SIZE;
+  } else {
+    budget = SOFT_MAX_SCAN_SIZE;
+  }
+
+  while (budget >= SOFT_TS_PKT_SIZE && len - n >= SOFT_TS_PKT_SIZE) {
+    if (p_ctx->backend != RECORD_DEVICE_BACKEND_SYNTHETIC)
+      pkt = soft_file_packet(p_ctx);
+    else
+      pkt = soft_synthetic_packet(p_ctx);
+    if (!pkt)
+      break;
+    budget -= SOFT_TS_PKT_SIZE;
+    p_ctx->consumed += SOFT_TS_PKT_SIZE;
+    if (soft_pid_is_set(p_ctx, ((pkt[1] & 0x1f) << 8) | pkt[2])) {
+      memcpy(out + n, pkt, SOFT_TS_PKT_SIZE);
+      n += SOFT_TS_PKT_SIZE;
+    }
+  }
+  pthread_mutex_unlock(&p_ctx->lock);
+
+  return n ? (ssize_t)n : DVR_FAILURE;
+}
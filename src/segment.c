@@ -1,13 +1,21 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#define DVR_LOG_MODULE DVR_LOG_MODULE_SEGMENT
 #include <stdio.h>
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <fcntl.h>
 #include <string.h>
 #include <stdlib.h>
 #include <errno.h>
+#include <limits.h>
+#include <pthread.h>
 #include "dvr_types.h"
 #include "segment.h"
+#include "list.h"
 
 #define MAX_SEGMENT_FD_COUNT (128)
 #define MAX_SEGMENT_PATH_SIZE (DVR_MAX_LOCATION_SIZE + 32)
@@ -15,6 +23,62 @@
 #define PCR_RECORD_INTERVAL_MS (300)
 #define PTS_DISCONTINE_DEVIATION     (40)
 #define PTS_HEAD_DEVIATION     (40)
+#define MAX_SEGMENT_RING_COUNT (2)
+#define SEGMENT_DIRECT_ALIGN   (4096)
+#define MAX_SEGMENT_LIVE_COUNT (2)
+#define MAX_SEGMENT_LIVE_SPANS (4)
+#define MAX_SEGMENT_PROGRESS_COUNT (4)
+#define SEGMENT_DIRECT_BUF_SIZE (1024*1024)
+#define SEGMENT_INDEX_TAIL_SIZE (4096)
+
+/**\brief Timeshift ring storage, a preallocated data file split in slots, one segment per slot*/
+typedef struct {
+  char            location[DVR_MAX_LOCATION_SIZE];    /**< Record location, empty when the ring is free*/
+  uint32_t        nb_slots;                           /**< Number of slots*/
+  loff_t          slot_size;                          /**< Slot size in bytes*/
+  uint64_t        *slot_ids;                          /**< Segment id stored in each slot, ULLONG_MAX is free*/
+  loff_t          *slot_lens;                         /**< Valid data length of each slot*/
+  DVR_Bool_t      *slot_writing;                      /**< Slot is being recorded, it is not released until closed*/
+  uint32_t        *free_slots;                        /**< Slots free to record, the last one is taken first*/
+  uint32_t        nb_free;                            /**< Number of free slots*/
+} Segment_Ring_t;
+
+static Segment_Ring_t segment_rings[MAX_SEGMENT_RING_COUNT];
+static pthread_mutex_t segment_ring_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**\brief Live cache, the data last recorded in a location kept in memory for the timeshift player*/
+typedef struct {
+  char            location[DVR_MAX_LOCATION_SIZE];    /**< Record location, empty when the cache is free*/
+  uint8_t         *buf;                               /**< Data ring*/
+  size_t          size;                               /**< Data ring size*/
+  uint64_t        total;                              /**< Bytes written since the cache was created*/
+  uint64_t        span_ids[MAX_SEGMENT_LIVE_SPANS];   /**< Segments in the cache, oldest first*/
+  uint64_t        span_bases[MAX_SEGMENT_LIVE_SPANS]; /**< Stream position of the segment offset 0*/
+  uint64_t        span_starts[MAX_SEGMENT_LIVE_SPANS];/**< Stream position of the first cached byte of the segment*/
+  int             nb_spans;                           /**< Number of segments in the cache*/
+} Segment_LiveCache_t;
+
+static Segment_LiveCache_t segment_lives[MAX_SEGMENT_LIVE_COUNT];
+static pthread_mutex_t segment_live_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**\brief Progress of the segment being recorded in a location, published to its readers*/
+typedef struct {
+  char            location[MAX_SEGMENT_PATH_SIZE];    /**< Record location, empty when free*/
+  uint64_t        segment_id;                         /**< Segment being recorded*/
+  loff_t          offset;                             /**< Data written to the file*/
+  DVR_Bool_t      closed;                             /**< The segment is closed*/
+  uint32_t        seq;                                /**< Changes when a segment is opened or closed*/
+} Segment_Progress_t;
+
+static Segment_Progress_t segment_progress[MAX_SEGMENT_PROGRESS_COUNT];
+static pthread_mutex_t segment_progress_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t segment_progress_cond;
+static pthread_once_t segment_progress_once = PTHREAD_ONCE_INIT;
+static uint32_t segment_cancel_seq;
+
+/*Segments open for write in this process, never taken for interrupted ones*/
+static LIST_HEAD(segment_writers);
+static pthread_mutex_t segment_writer_lock = PTHREAD_MUTEX_INITIALIZER;
 
 
 /**\brief Segment context*/
@@ -29,6 +93,31 @@ typedef struct {
   uint64_t        cur_time;                           /**< Current time save in index file */
   uint64_t        segment_id;                         /**< Current segment ID */
   char            location[MAX_SEGMENT_PATH_SIZE];    /**< Current time save in index file */
+  Segment_OpenMode_t mode;                            /**< Segment open mode */
+  FILE            *crypto_fp;                         /**< Crypto period index file fd, opened on demand*/
+  DVR_CryptoPeriodEntry_t *periods;                   /**< Crypto periods loaded, use for read mode*/
+  int             nb_periods;                         /**< Number of crypto periods loaded*/
+  int             periods_size;                       /**< Crypto periods array size*/
+  int             ring;                               /**< Timeshift ring index, -1 when the segment has its own files*/
+  int             ring_slot;                          /**< Ring slot of the segment*/
+  loff_t          ts_base;                            /**< Start of the segment data in the ts file*/
+  loff_t          prealloc_size;                      /**< Preallocation extent size, 0 disables*/
+  loff_t          alloc_end;                          /**< End of the space preallocated, relative to ts_base*/
+  loff_t          writeback_size;                     /**< Write-behind range size, 0 syncs each write*/
+  loff_t          wb_start;                           /**< Start of the range being written back, file offset*/
+  loff_t          wb_end;                             /**< End of the range being written back, file offset*/
+  uint8_t         *direct_buf;                        /**< Aligned buffer of O_DIRECT writes, NULL when not used*/
+  size_t          direct_len;                         /**< Unaligned tail kept in direct_buf*/
+  Segment_AccessMode_t access_mode;                   /**< Read access pattern*/
+  loff_t          ra_window;                          /**< Read-ahead and drop-behind window*/
+  loff_t          ra_end;                             /**< End of the range advised to read ahead*/
+  loff_t          drop_pos;                           /**< Start of the range not yet dropped from the page cache*/
+  Segment_CacheStats_t cache_stats;                   /**< Page cache statistics*/
+  DVR_Bool_t      live;                               /**< The location has a live cache, use for write mode*/
+  uint64_t        time_base;                          /**< Time of the last index entry kept on append, the new entries continue from it*/
+  DVR_Bool_t      index_appended;                     /**< The index has entries before the first update, use for append mode*/
+  DVR_Bool_t      no_progress;                        /**< The progress is not published to the readers, use for write mode*/
+  struct list_head writer_head;                       /**< Node in segment_writers, use for write mode*/
 } Segment_Context_t;
 
 /**\brief Segment file type*/
@@ -37,6 +126,7 @@ typedef enum {
   SEGMENT_FILE_TYPE_INDEX,                    /**< Used for store index data*/
   SEGMENT_FILE_TYPE_DAT,                      /**< Used for store information data, such as duration etc*/
   SEGMENT_FILE_TYPE_ONGOING,                  /**< Used for store information data, such as duration etc*/
+  SEGMENT_FILE_TYPE_CRYPTO,                   /**< Used for store crypto period index*/
 } Segment_FileType_t;
 
 static void segment_get_fname(char fname[MAX_SEGMENT_PATH_SIZE],
@@ -61,6 +151,353 @@ static void segment_get_fname(char fname[MAX_SEGMENT_PATH_SIZE],
     strncpy(fname + offset, ".dat", 4);
   else if (type == SEGMENT_FILE_TYPE_ONGOING)
     strncpy(fname + offset, ".going", 6);
+  else if (type == SEGMENT_FILE_TYPE_CRYPTO)
+    memcpy(fname + offset, ".cpi", sizeof(".cpi"));
+}
+
+/*File name of a segment, ring segments use the data file of the ring and the files of their slot*/
+static void segment_get_slot_fname(char fname[MAX_SEGMENT_PATH_SIZE],
+    const char location[DVR_MAX_LOCATION_SIZE],
+    uint64_t segment_id,
+    int ring_slot,
+    Segment_FileType_t type)
+{
+  const char *ext = "";
+  int ret;
+
+  if (ring_slot < 0) {
+    segment_get_fname(fname, location, segment_id, type);
+    return;
+  }
+
+  memset(fname, 0, MAX_SEGMENT_PATH_SIZE);
+  if (type == SEGMENT_FILE_TYPE_TS) {
+    ret = snprintf(fname, MAX_SEGMENT_PATH_SIZE, "%s-ring.data", location);
+  } else {
+    if (type == SEGMENT_FILE_TYPE_INDEX)
+      ext = ".idx";
+    else if (type == SEGMENT_FILE_TYPE_DAT)
+      ext = ".dat";
+    else if (type == SEGMENT_FILE_TYPE_ONGOING)
+      ext = ".going";
+    else if (type == SEGMENT_FILE_TYPE_CRYPTO)
+      ext = ".cpi";
+    ret = snprintf(fname, MAX_SEGMENT_PATH_SIZE, "%s-ring-%03d%s", location, ring_slot, ext);
+  }
+  /*an empty name fails to open*/
+  if (ret < 0 || ret >= MAX_SEGMENT_PATH_SIZE) {
+    DVR_DEBUG(1, "%s, [%s] name too long", __func__, location);
+    fname[0] = 0;
+  }
+}
+
+/*Find the ring of a location, must be called with segment_ring_lock held*/
+static int segment_ring_find(const char *location)
+{
+  int i;
+
+  for (i = 0; i < MAX_SEGMENT_RING_COUNT; i++) {
+    if (segment_rings[i].location[0] && !strcmp(segment_rings[i].location, location))
+      return i;
+  }
+  return -1;
+}
+
+/*Check the ring slot still holds the segment, must be called with segment_ring_lock held*/
+static DVR_Bool_t segment_ring_valid(Segment_Context_t *p_ctx)
+{
+  Segment_Ring_t *ring = &segment_rings[p_ctx->ring];
+
+  return (ring->slot_ids && p_ctx->ring_slot < (int)ring->nb_slots
+      && ring->slot_ids[p_ctx->ring_slot] == p_ctx->segment_id) ? DVR_TRUE : DVR_FALSE;
+}
+
+/*Find the slot of a segment, -1 if not in the ring, must be called with segment_ring_lock held*/
+static int segment_ring_lookup(Segment_Ring_t *ring, uint64_t segment_id)
+{
+  uint32_t i;
+
+  for (i = 0; i < ring->nb_slots; i++) {
+    if (ring->slot_ids[i] == segment_id)
+      return i;
+  }
+  return -1;
+}
+
+static void segment_progress_init(void)
+{
+  pthread_condattr_t cattr;
+
+  pthread_condattr_init(&cattr);
+  pthread_condattr_setclock(&cattr, CLOCK_MONOTONIC);
+  pthread_cond_init(&segment_progress_cond, &cattr);
+  pthread_condattr_destroy(&cattr);
+}
+
+/*Find the progress of a location, must be called with segment_progress_lock held*/
+static int segment_progress_find(const char *location)
+{
+  int i;
+
+  for (i = 0; i < MAX_SEGMENT_PROGRESS_COUNT; i++) {
+    if (segment_progress[i].location[0] && !strcmp(segment_progress[i].location, location))
+      return i;
+  }
+  return -1;
+}
+
+/*Publish the progress of a segment being recorded and wake up its readers*/
+static void segment_progress_update(Segment_Context_t *p_ctx, loff_t offset, DVR_Bool_t closed)
+{
+  Segment_Progress_t *progress;
+  int i;
+
+  if (p_ctx->no_progress)
+    return;
+  pthread_once(&segment_progress_once, segment_progress_init);
+  pthread_mutex_lock(&segment_progress_lock);
+  i = segment_progress_find(p_ctx->location);
+  /*a new location takes a free entry, or one whose recording is over*/
+  for (i = (i >= 0) ? i : 0; i < MAX_SEGMENT_PROGRESS_COUNT; i++) {
+    if (!strcmp(segment_progress[i].location, p_ctx->location)
+        || !segment_progress[i].location[0] || segment_progress[i].closed)
+      break;
+  }
+  if (i == MAX_SEGMENT_PROGRESS_COUNT) {
+    pthread_mutex_unlock(&segment_progress_lock);
+    return;
+  }
+  progress = &segment_progress[i];
+  if (strcmp(progress->location, p_ctx->location))
+    strcpy(progress->location, p_ctx->location);
+  if (progress->segment_id != p_ctx->segment_id || progress->closed != closed || !offset)
+    progress->seq++;
+  progress->segment_id = p_ctx->segment_id;
+  progress->offset = offset;
+  progress->closed = closed;
+  pthread_cond_broadcast(&segment_progress_cond);
+  pthread_mutex_unlock(&segment_progress_lock);
+}
+
+/*Find the live cache of a location, must be called with segment_live_lock held*/
+static int segment_live_find(const char *location)
+{
+  int i;
+
+  for (i = 0; i < MAX_SEGMENT_LIVE_COUNT; i++) {
+    if (segment_lives[i].location[0] && !strcmp(segment_lives[i].location, location))
+      return i;
+  }
+  return -1;
+}
+
+/*Append the data written at a segment offset to the live cache*/
+static void segment_live_write(Segment_Context_t *p_ctx, loff_t offset, const uint8_t *buf, size_t count)
+{
+  Segment_LiveCache_t *live;
+  size_t pos, n;
+  int i;
+
+  pthread_mutex_lock(&segment_live_lock);
+  i = segment_live_find(p_ctx->location);
+  if (i < 0) {
+    pthread_mutex_unlock(&segment_live_lock);
+    p_ctx->live = DVR_FALSE;
+    return;
+  }
+  live = &segment_lives[i];
+
+  /*a new segment, or a jump in the current one, starts a new span*/
+  i = live->nb_spans - 1;
+  if (i < 0 || live->span_ids[i] != p_ctx->segment_id || live->span_bases[i] + offset != live->total) {
+    if (live->nb_spans == MAX_SEGMENT_LIVE_SPANS) {
+      memmove(live->span_ids, live->span_ids + 1, (MAX_SEGMENT_LIVE_SPANS - 1) * sizeof(uint64_t));
+      memmove(live->span_bases, live->span_bases + 1, (MAX_SEGMENT_LIVE_SPANS - 1) * sizeof(uint64_t));
+      memmove(live->span_starts, live->span_starts + 1, (MAX_SEGMENT_LIVE_SPANS - 1) * sizeof(uint64_t));
+      live->nb_spans--;
+    }
+    i = live->nb_spans++;
+    live->span_ids[i] = p_ctx->segment_id;
+    live->span_bases[i] = live->total - offset;
+    live->span_starts[i] = live->total;
+  }
+
+  /*only the last size bytes are kept*/
+  if (count > live->size) {
+    buf += count - live->size;
+    live->total += count - live->size;
+    count = live->size;
+  }
+  pos = live->total % live->size;
+  n = live->size - pos < count ? live->size - pos : count;
+  memcpy(live->buf + pos, buf, n);
+  memcpy(live->buf, buf + n, count - n);
+  live->total += count;
+  pthread_mutex_unlock(&segment_live_lock);
+}
+
+/*Read the data at a segment offset from the live cache, 0 if it is not cached*/
+static size_t segment_live_read(Segment_Context_t *p_ctx, loff_t offset, uint8_t *buf, size_t count)
+{
+  Segment_LiveCache_t *live;
+  uint64_t start, end, lower;
+  size_t pos, n;
+  int i;
+
+  pthread_mutex_lock(&segment_live_lock);
+  i = segment_live_find(p_ctx->location);
+  if (i < 0) {
+    pthread_mutex_unlock(&segment_live_lock);
+    return 0;
+  }
+  live = &segment_lives[i];
+
+  for (i = live->nb_spans - 1; i >= 0; i--) {
+    if (live->span_ids[i] == p_ctx->segment_id)
+      break;
+  }
+  if (i < 0) {
+    pthread_mutex_unlock(&segment_live_lock);
+    return 0;
+  }
+  start = live->span_bases[i] + offset;
+  end = (i == live->nb_spans - 1) ? live->total : live->span_starts[i + 1];
+  lower = live->total > live->size ? live->total - live->size : 0;
+  if (lower < live->span_starts[i])
+    lower = live->span_starts[i];
+  if (start < lower || start >= end) {
+    pthread_mutex_unlock(&segment_live_lock);
+    return 0;
+  }
+  if (count > end - start)
+    count = end - start;
+  pos = start % live->size;
+  n = live->size - pos < count ? live->size - pos : count;
+  memcpy(buf, live->buf + pos, n);
+  memcpy(buf + n, live->buf, count - n);
+  pthread_mutex_unlock(&segment_live_lock);
+  return count;
+}
+
+static loff_t segment_ts_seek(Segment_Context_t *p_ctx, loff_t offset)
+{
+  loff_t pos = lseek(p_ctx->ts_fd, p_ctx->ts_base + offset, SEEK_SET);
+
+  /*the read-ahead window restarts at the new position*/
+  p_ctx->ra_end = offset;
+  p_ctx->drop_pos = offset;
+  return pos == -1 ? -1 : pos - p_ctx->ts_base;
+}
+
+static loff_t segment_ts_tell(Segment_Context_t *p_ctx)
+{
+  loff_t pos = lseek(p_ctx->ts_fd, 0, SEEK_CUR);
+
+  return pos == -1 ? -1 : pos - p_ctx->ts_base + p_ctx->direct_len;
+}
+
+/*Sequential read, keep a window read ahead of the position and drop what is a window behind*/
+static void segment_readahead(Segment_Context_t *p_ctx, loff_t pos)
+{
+  loff_t start;
+
+  if (pos + p_ctx->ra_window / 2 > p_ctx->ra_end) {
+    start = p_ctx->ra_end > pos ? p_ctx->ra_end : pos;
+    posix_fadvise(p_ctx->ts_fd, p_ctx->ts_base + start, pos + p_ctx->ra_window - start, POSIX_FADV_WILLNEED);
+    p_ctx->cache_stats.willneed_bytes += pos + p_ctx->ra_window - start;
+    p_ctx->ra_end = pos + p_ctx->ra_window;
+  }
+  if (pos - p_ctx->drop_pos >= 2 * p_ctx->ra_window) {
+    posix_fadvise(p_ctx->ts_fd, p_ctx->ts_base + p_ctx->drop_pos, pos - p_ctx->ra_window - p_ctx->drop_pos,
+        POSIX_FADV_DONTNEED);
+    p_ctx->cache_stats.dontneed_bytes += pos - p_ctx->ra_window - p_ctx->drop_pos;
+    p_ctx->drop_pos = pos - p_ctx->ra_window;
+  }
+}
+
+/*Reserve the disk space of the data to be written, prealloc_size at a time*/
+static void segment_prealloc(Segment_Context_t *p_ctx, loff_t end)
+{
+  loff_t size;
+
+  if (end <= p_ctx->alloc_end)
+    return;
+  size = ((end - p_ctx->alloc_end + p_ctx->prealloc_size - 1) / p_ctx->prealloc_size) * p_ctx->prealloc_size;
+  if (fallocate(p_ctx->ts_fd, FALLOC_FL_KEEP_SIZE, p_ctx->ts_base + p_ctx->alloc_end, size) != 0) {
+    DVR_DEBUG(1, "%s, fallocate failed:%s, preallocation disabled", __func__, strerror(errno));
+    p_ctx->prealloc_size = 0;
+    return;
+  }
+  p_ctx->alloc_end += size;
+}
+
+/*Start the write-back of the data written since the last range, wait for the previous
+ range and drop it from the page cache, so recording does not fill the cache*/
+static void segment_writeback(Segment_Context_t *p_ctx, DVR_Bool_t flush)
+{
+  loff_t pos = lseek(p_ctx->ts_fd, 0, SEEK_CUR);
+
+  if (pos == -1)
+    return;
+  if (!flush && pos - p_ctx->wb_end < p_ctx->writeback_size)
+    return;
+
+  if (pos > p_ctx->wb_end)
+    sync_file_range(p_ctx->ts_fd, p_ctx->wb_end, pos - p_ctx->wb_end, SYNC_FILE_RANGE_WRITE);
+  if (flush)
+    p_ctx->wb_end = pos;
+  if (p_ctx->wb_end > p_ctx->wb_start) {
+    sync_file_range(p_ctx->ts_fd, p_ctx->wb_start, p_ctx->wb_end - p_ctx->wb_start,
+        SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+    posix_fadvise(p_ctx->ts_fd, p_ctx->wb_start, p_ctx->wb_end - p_ctx->wb_start, POSIX_FADV_DONTNEED);
+  }
+  p_ctx->wb_start = p_ctx->wb_end;
+  p_ctx->wb_end = pos;
+}
+
+/*O_DIRECT write, the data goes through the aligned buffer and only whole
+ SEGMENT_DIRECT_ALIGN blocks are written, the tail waits for the next write*/
+static ssize_t segment_direct_write(Segment_Context_t *p_ctx, const uint8_t *buf, size_t count)
+{
+  size_t left = count;
+  size_t n;
+  ssize_t ret;
+
+  while (left) {
+    n = SEGMENT_DIRECT_BUF_SIZE - p_ctx->direct_len;
+    if (n > left)
+      n = left;
+    memcpy(p_ctx->direct_buf + p_ctx->direct_len, buf, n);
+    p_ctx->direct_len += n;
+    buf += n;
+    left -= n;
+
+    n = p_ctx->direct_len & ~((size_t)SEGMENT_DIRECT_ALIGN - 1);
+    if (!n)
+      continue;
+    ret = write(p_ctx->ts_fd, p_ctx->direct_buf, n);
+    if (ret != (ssize_t)n) {
+      DVR_DEBUG_RL(1, 1000, "%s, write failed:%s", __func__, strerror(errno));
+      return -1;
+    }
+    p_ctx->direct_len -= n;
+    memmove(p_ctx->direct_buf, p_ctx->direct_buf + n, p_ctx->direct_len);
+  }
+  return count;
+}
+
+/*Write the unaligned tail of the O_DIRECT buffer through the page cache*/
+static void segment_direct_flush(Segment_Context_t *p_ctx)
+{
+  int flags;
+
+  if (!p_ctx->direct_len)
+    return;
+  flags = fcntl(p_ctx->ts_fd, F_GETFL);
+  fcntl(p_ctx->ts_fd, F_SETFL, flags & ~O_DIRECT);
+  if (write(p_ctx->ts_fd, p_ctx->direct_buf, p_ctx->direct_len) != (ssize_t)p_ctx->direct_len)
+    DVR_DEBUG_RL(1, 1000, "%s, write failed:%s", __func__, strerror(errno));
+  p_ctx->direct_len = 0;
 }
 
 static void segment_get_dirname(char dir_name[MAX_SEGMENT_PATH_SIZE],
@@ -80,6 +517,116 @@ static void segment_get_dirname(char dir_name[MAX_SEGMENT_PATH_SIZE],
     memcpy(dir_name, location, p - location);
 }
 
+/*Parse an index line, 0 if it is a complete entry*/
+static int segment_parse_index_line(const char *line, uint64_t *p_time, loff_t *p_offset)
+{
+  unsigned long long time;
+  long long offset;
+  char end;
+
+  if (sscanf(line, "{time=%llu, offset=%lld%c", &time, &offset, &end) != 3 || end != '}')
+    return -1;
+  *p_time = time;
+  *p_offset = offset;
+  return 0;
+}
+
+/*Drop the crypto periods past the data kept on append, they are in offset order*/
+static void segment_append_restore_crypto(Segment_Context_t *p_ctx, loff_t ts_size)
+{
+  char fname[MAX_SEGMENT_PATH_SIZE];
+  char buf[256];
+  long long offset;
+  long keep = 0;
+  FILE *fp;
+
+  segment_get_slot_fname(fname, p_ctx->location, p_ctx->segment_id, p_ctx->ring_slot, SEGMENT_FILE_TYPE_CRYPTO);
+  fp = fopen(fname, "r+");
+  if (!fp)
+    return;
+  while (fgets(buf, sizeof(buf), fp) != NULL) {
+    if (!strchr(buf, '\n') || sscanf(buf, "{offset=%lld,", &offset) != 1 || offset > ts_size)
+      break;
+    keep = ftell(fp);
+  }
+  ftruncate(fileno(fp), keep);
+  fclose(fp);
+}
+
+/*Restore the write state of an appended segment from the ends of its files.
+ *The ts data is cut to whole packets, at most resume_size bytes, the index is
+ *cut after its last complete entry inside the data, a torn write of a crash
+ *is dropped. Only the index tail is read, growing back until an entry is found.*/
+static int segment_append_restore(Segment_Context_t *p_ctx, loff_t resume_size)
+{
+  struct stat st;
+  loff_t ts_size, idx_size, win, start, keep = -1;
+  uint64_t time = 0;
+  loff_t offset;
+  char *buf = NULL, *p, *line, *end;
+  size_t len;
+
+  DVR_RETURN_IF_FALSE(fstat(p_ctx->ts_fd, &st) == 0);
+  ts_size = st.st_size;
+  if (resume_size >= 0 && resume_size < ts_size)
+    ts_size = resume_size;
+  ts_size -= ts_size % 188;
+  DVR_RETURN_IF_FALSE(ftruncate(p_ctx->ts_fd, ts_size) == 0);
+  DVR_RETURN_IF_FALSE(lseek(p_ctx->ts_fd, ts_size, SEEK_SET) == ts_size);
+
+  segment_append_restore_crypto(p_ctx, ts_size);
+
+  DVR_RETURN_IF_FALSE(fstat(fileno(p_ctx->index_fp), &st) == 0);
+  idx_size = st.st_size;
+  for (win = SEGMENT_INDEX_TAIL_SIZE; keep < 0; win *= 2) {
+    start = idx_size > win ? idx_size - win : 0;
+    len = idx_size - start;
+    p = (char *)realloc(buf, len + 1);
+    if (!p) {
+      free(buf);
+      return DVR_FAILURE;
+    }
+    buf = p;
+    /*read past the stream, its buffer would keep the cut tail*/
+    if (pread(fileno(p_ctx->index_fp), buf, len, start) != (ssize_t)len) {
+      free(buf);
+      return DVR_FAILURE;
+    }
+    buf[len] = 0;
+
+    /*walk the lines back, the first one of the window may be cut unless it starts the file*/
+    end = buf + len;
+    while (keep < 0) {
+      line = end;
+      while (line > buf && line[-1] != '\n')
+        line--;
+      if ((line > buf || !start)
+          && !segment_parse_index_line(line, &time, &offset) && offset <= ts_size)
+        keep = start + (line - buf) + strcspn(line, "}") + 1;
+      if (line == buf)
+        break;
+      end = line - 1;
+      *end = 0;
+    }
+    if (!start)
+      break;
+  }
+  free(buf);
+
+  if (keep < 0) {
+    keep = 0;
+    time = 0;
+  }
+  DVR_RETURN_IF_FALSE(ftruncate(fileno(p_ctx->index_fp), keep) == 0);
+  DVR_RETURN_IF_FALSE(fseeko(p_ctx->index_fp, keep, SEEK_SET) == 0);
+  p_ctx->time_base = time;
+  p_ctx->cur_time = time;
+  p_ctx->index_appended = keep ? DVR_TRUE : DVR_FALSE;
+  DVR_DEBUG(1, "%s, segment %llu resumes at size:%lld time:%llu", __func__,
+      p_ctx->segment_id, ts_size, time);
+  return DVR_SUCCESS;
+}
+
 int segment_open(Segment_OpenParams_t *params, Segment_Handle_t *p_handle)
 {
   Segment_Context_t *p_ctx;
@@ -88,6 +635,7 @@ int segment_open(Segment_OpenParams_t *params, Segment_Handle_t *p_handle)
   char dat_fname[MAX_SEGMENT_PATH_SIZE];
   char dir_name[MAX_SEGMENT_PATH_SIZE];
   char going_name[MAX_SEGMENT_PATH_SIZE];
+  char crypto_fname[MAX_SEGMENT_PATH_SIZE];
 
   DVR_RETURN_IF_FALSE(params);
   DVR_RETURN_IF_FALSE(p_handle);
@@ -97,18 +645,49 @@ int segment_open(Segment_OpenParams_t *params, Segment_Handle_t *p_handle)
   p_ctx = (void*)malloc(sizeof(Segment_Context_t));
   DVR_RETURN_IF_FALSE(p_ctx);
   memset(p_ctx, 0, sizeof(Segment_Context_t));
+  p_ctx->segment_id = params->segment_id;
+  p_ctx->no_progress = params->no_progress;
+  INIT_LIST_HEAD(&p_ctx->writer_head);
+
+  /*timeshift ring, a new segment takes a slot released by segment_delete,
+   *it is stored in its own files when none is free*/
+  pthread_mutex_lock(&segment_ring_lock);
+  p_ctx->ring = segment_ring_find(params->location);
+  p_ctx->ring_slot = -1;
+  if (p_ctx->ring >= 0) {
+    Segment_Ring_t *ring = &segment_rings[p_ctx->ring];
+    int slot = segment_ring_lookup(ring, params->segment_id);
+
+    if (params->mode != SEGMENT_MODE_READ && slot >= 0) {
+      /*a slot is rewritten from its start, it cannot be continued or recorded twice*/
+      pthread_mutex_unlock(&segment_ring_lock);
+      DVR_DEBUG(1, "%s, segment %llu is in the ring, can not write it", __func__, params->segment_id);
+      free(p_ctx);
+      *p_handle = NULL;
+      return DVR_FAILURE;
+    }
+    if (params->mode == SEGMENT_MODE_WRITE && ring->nb_free) {
+      slot = ring->free_slots[--ring->nb_free];
+      ring->slot_ids[slot] = params->segment_id;
+      ring->slot_lens[slot] = 0;
+      ring->slot_writing[slot] = DVR_TRUE;
+    } else if (params->mode == SEGMENT_MODE_WRITE) {
+      DVR_DEBUG(1, "%s, no free ring slot, segment %llu uses its own files", __func__, params->segment_id);
+    }
+    if (slot >= 0) {
+      p_ctx->ring_slot = slot;
+      p_ctx->ts_base = slot * ring->slot_size;
+    } else {
+      p_ctx->ring = -1;
+    }
+  }
+  pthread_mutex_unlock(&segment_ring_lock);
 
-  memset(ts_fname, 0, sizeof(ts_fname));
-  segment_get_fname(ts_fname, params->location, params->segment_id, SEGMENT_FILE_TYPE_TS);
-
-  memset(index_fname, 0, sizeof(index_fname));
-  segment_get_fname(index_fname, params->location, params->segment_id, SEGMENT_FILE_TYPE_INDEX);
-
-  memset(dat_fname, 0, sizeof(dat_fname));
-  segment_get_fname(dat_fname, params->location, params->segment_id, SEGMENT_FILE_TYPE_DAT);
-
-  memset(going_name, 0, sizeof(going_name));
-  segment_get_fname(going_name, params->location, params->segment_id, SEGMENT_FILE_TYPE_ONGOING);
+  segment_get_slot_fname(ts_fname, params->location, params->segment_id, p_ctx->ring_slot, SEGMENT_FILE_TYPE_TS);
+  segment_get_slot_fname(index_fname, params->location, params->segment_id, p_ctx->ring_slot, SEGMENT_FILE_TYPE_INDEX);
+  segment_get_slot_fname(dat_fname, params->location, params->segment_id, p_ctx->ring_slot, SEGMENT_FILE_TYPE_DAT);
+  segment_get_slot_fname(going_name, params->location, params->segment_id, p_ctx->ring_slot, SEGMENT_FILE_TYPE_ONGOING);
+  segment_get_slot_fname(crypto_fname, params->location, params->segment_id, p_ctx->ring_slot, SEGMENT_FILE_TYPE_CRYPTO);
 
   memset(dir_name, 0, sizeof(dir_name));
   segment_get_dirname(dir_name, params->location);
@@ -122,11 +701,42 @@ int segment_open(Segment_OpenParams_t *params, Segment_Handle_t *p_handle)
     p_ctx->index_fp = fopen(index_fname, "r");
     p_ctx->dat_fp = fopen(dat_fname, "r");
     p_ctx->ongoing_fp = NULL;
-  } else if (params->mode == SEGMENT_MODE_WRITE) {
-    p_ctx->ts_fd = open(ts_fname, O_CREAT | O_RDWR | O_TRUNC, 0644);
-    p_ctx->index_fp = fopen(index_fname, "w+");
-    p_ctx->dat_fp = fopen(dat_fname, "w+");
-    p_ctx->ongoing_fp = fopen(going_name, "w+");
+  } else if (params->mode == SEGMENT_MODE_WRITE || params->mode == SEGMENT_MODE_APPEND) {
+    /*the ring data file is preallocated, its slot files are rewritten in place*/
+    int flags = p_ctx->ring >= 0 ? O_RDWR : (O_CREAT | O_RDWR | O_TRUNC);
+    DVR_Bool_t append = params->mode == SEGMENT_MODE_APPEND ? DVR_TRUE : DVR_FALSE;
+
+    if (append)
+      flags = O_CREAT | O_RDWR;
+    /*the data end is not aligned on append, the first O_DIRECT write would fail*/
+    if (params->direct_io && !append && !(p_ctx->ts_base % SEGMENT_DIRECT_ALIGN)
+        && !posix_memalign((void **)&p_ctx->direct_buf, SEGMENT_DIRECT_ALIGN, SEGMENT_DIRECT_BUF_SIZE)) {
+      p_ctx->ts_fd = open(ts_fname, flags | O_DIRECT, 0644);
+      if (p_ctx->ts_fd == -1) {
+        DVR_DEBUG(1, "%s, O_DIRECT open failed:%s, use buffered io", __func__, strerror(errno));
+        free(p_ctx->direct_buf);
+        p_ctx->direct_buf = NULL;
+      }
+    }
+    if (!p_ctx->direct_buf)
+      p_ctx->ts_fd = open(ts_fname, flags, 0644);
+    p_ctx->prealloc_size = p_ctx->ring >= 0 ? 0 : params->prealloc_size;
+    p_ctx->writeback_size = p_ctx->direct_buf ? 0 : params->writeback_size;
+    p_ctx->wb_start = p_ctx->ts_base;
+    p_ctx->wb_end = p_ctx->ts_base;
+    pthread_mutex_lock(&segment_live_lock);
+    p_ctx->live = segment_live_find(params->location) >= 0 ? DVR_TRUE : DVR_FALSE;
+    pthread_mutex_unlock(&segment_live_lock);
+    p_ctx->index_fp = append ? fopen(index_fname, "r+") : NULL;
+    if (!p_ctx->index_fp)
+      p_ctx->index_fp = fopen(index_fname, "w+");
+    p_ctx->dat_fp = append ? fopen(dat_fname, "r+") : NULL;
+    if (!p_ctx->dat_fp)
+      p_ctx->dat_fp = fopen(dat_fname, "w+");
+    p_ctx->ongoing_fp = p_ctx->ring >= 0 ? NULL : fopen(going_name, "w+");
+    /*crypto period index is created on the first transition, drop a stale one*/
+    if (!append)
+      unlink(crypto_fname);
     p_ctx->first_pts = ULLONG_MAX;
     p_ctx->last_pts = ULLONG_MAX;
     p_ctx->last_record_pts = ULLONG_MAX;
@@ -149,12 +759,43 @@ int segment_open(Segment_OpenParams_t *params, Segment_Handle_t *p_handle)
       fclose(p_ctx->dat_fp);
     if (p_ctx->ongoing_fp)
       fclose(p_ctx->ongoing_fp);
+    if (p_ctx->direct_buf)
+      free(p_ctx->direct_buf);
+    if (p_ctx->ring >= 0 && params->mode == SEGMENT_MODE_WRITE) {
+      Segment_Ring_t *ring = &segment_rings[p_ctx->ring];
+
+      /*give the slot back*/
+      pthread_mutex_lock(&segment_ring_lock);
+      ring->slot_ids[p_ctx->ring_slot] = ULLONG_MAX;
+      ring->slot_writing[p_ctx->ring_slot] = DVR_FALSE;
+      ring->free_slots[ring->nb_free++] = p_ctx->ring_slot;
+      pthread_mutex_unlock(&segment_ring_lock);
+    }
     free(p_ctx);
     *p_handle = NULL;
     return DVR_FAILURE;
   }
-  p_ctx->segment_id = params->segment_id;
+  if (p_ctx->ring >= 0)
+    segment_ts_seek(p_ctx, 0);
+  p_ctx->mode = params->mode;
   strncpy(p_ctx->location, params->location, strlen(params->location));
+  if (p_ctx->mode == SEGMENT_MODE_APPEND) {
+    if (segment_append_restore(p_ctx, params->resume_size) != DVR_SUCCESS) {
+      DVR_DEBUG(1, "%s, restore segment %llu failed", __func__, params->segment_id);
+      p_ctx->mode = SEGMENT_MODE_WRITE;
+      segment_close(p_ctx);
+      *p_handle = NULL;
+      return DVR_FAILURE;
+    }
+    /*an appended segment is written the same way as a new one*/
+    p_ctx->mode = SEGMENT_MODE_WRITE;
+  }
+  if (p_ctx->mode == SEGMENT_MODE_WRITE) {
+    pthread_mutex_lock(&segment_writer_lock);
+    list_add(&p_ctx->writer_head, &segment_writers);
+    pthread_mutex_unlock(&segment_writer_lock);
+    segment_progress_update(p_ctx, segment_ts_tell(p_ctx), DVR_FALSE);
+  }
 
   //DVR_DEBUG(1, "%s, open file success p_ctx->location [%s]", __func__, p_ctx->location, params->mode);
   *p_handle = (Segment_Handle_t)p_ctx;
@@ -169,8 +810,31 @@ int segment_close(Segment_Handle_t handle)
   DVR_RETURN_IF_FALSE(p_ctx);
 
   if (p_ctx->ts_fd != -1) {
+    if (p_ctx->direct_buf) {
+      segment_direct_flush(p_ctx);
+      /*O_DIRECT writes are not synced one by one, the tail and the file size are synced here*/
+      fsync(p_ctx->ts_fd);
+      if (p_ctx->ring >= 0) {
+        loff_t end = segment_ts_tell(p_ctx);
+
+        pthread_mutex_lock(&segment_ring_lock);
+        if (segment_ring_valid(p_ctx) && end != -1)
+          segment_rings[p_ctx->ring].slot_lens[p_ctx->ring_slot] = end;
+        pthread_mutex_unlock(&segment_ring_lock);
+      }
+    }
+    if (p_ctx->writeback_size)
+      segment_writeback(p_ctx, DVR_TRUE);
+    /*give back the preallocated space past the end of the data*/
+    if (p_ctx->alloc_end)
+      ftruncate(p_ctx->ts_fd, lseek(p_ctx->ts_fd, 0, SEEK_CUR));
+    if (p_ctx->mode == SEGMENT_MODE_WRITE)
+      segment_progress_update(p_ctx, segment_ts_tell(p_ctx), DVR_TRUE);
     close(p_ctx->ts_fd);
   }
+  if (p_ctx->direct_buf) {
+    free(p_ctx->direct_buf);
+  }
 
   if (p_ctx->index_fp) {
     fclose(p_ctx->index_fp);
@@ -180,6 +844,26 @@ int segment_close(Segment_Handle_t handle)
     fclose(p_ctx->dat_fp);
   }
 
+  if (p_ctx->crypto_fp) {
+    fclose(p_ctx->crypto_fp);
+  }
+  if (p_ctx->periods) {
+    free(p_ctx->periods);
+  }
+
+  if (p_ctx->ring >= 0 && p_ctx->mode == SEGMENT_MODE_WRITE) {
+    pthread_mutex_lock(&segment_ring_lock);
+    if (segment_ring_valid(p_ctx))
+      segment_rings[p_ctx->ring].slot_writing[p_ctx->ring_slot] = DVR_FALSE;
+    pthread_mutex_unlock(&segment_ring_lock);
+  }
+
+  if (!list_empty(&p_ctx->writer_head)) {
+    pthread_mutex_lock(&segment_writer_lock);
+    list_del(&p_ctx->writer_head);
+    pthread_mutex_unlock(&segment_writer_lock);
+  }
+
   if (p_ctx->ongoing_fp != NULL) {
     fclose(p_ctx->ongoing_fp);
     char going_name[MAX_SEGMENT_PATH_SIZE];
@@ -201,7 +885,36 @@ ssize_t segment_read(Segment_Handle_t handle, void *buf, size_t count)
   DVR_RETURN_IF_FALSE(p_ctx);
   DVR_RETURN_IF_FALSE(buf);
   DVR_RETURN_IF_FALSE(p_ctx->ts_fd != -1);
+  if (p_ctx->ring >= 0) {
+    /*the slot has stale data after the recorded part, stop there*/
+    loff_t pos = segment_ts_tell(p_ctx);
+    loff_t left;
+
+    pthread_mutex_lock(&segment_ring_lock);
+    left = segment_ring_valid(p_ctx) ? segment_rings[p_ctx->ring].slot_lens[p_ctx->ring_slot] - pos : -1;
+    pthread_mutex_unlock(&segment_ring_lock);
+    DVR_RETURN_IF_FALSE(pos != -1 && left >= 0);
+    if ((loff_t)count > left)
+      count = left;
+  }
+  /*near the live edge the data is still in the live cache, no need to go to the file*/
+  if (p_ctx->mode == SEGMENT_MODE_READ && count) {
+    loff_t pos = segment_ts_tell(p_ctx);
+
+    len = pos != -1 ? segment_live_read(p_ctx, pos, buf, count) : 0;
+    if (len > 0) {
+      lseek(p_ctx->ts_fd, len, SEEK_CUR);
+      p_ctx->cache_stats.read_bytes += len;
+      p_ctx->cache_stats.live_bytes += len;
+      return len;
+    }
+  }
   len = read(p_ctx->ts_fd, buf, count);
+  if (len > 0) {
+    p_ctx->cache_stats.read_bytes += len;
+    if (p_ctx->access_mode == SEGMENT_ACCESS_SEQUENTIAL)
+      segment_readahead(p_ctx, segment_ts_tell(p_ctx));
+  }
   return len;
 }
 
@@ -213,8 +926,41 @@ ssize_t segment_write(Segment_Handle_t handle, void *buf, size_t count)
   DVR_RETURN_IF_FALSE(p_ctx);
   DVR_RETURN_IF_FALSE(buf);
   DVR_RETURN_IF_FALSE(p_ctx->ts_fd != -1);
-  len = write(p_ctx->ts_fd, buf, count);
-  fsync(p_ctx->ts_fd);
+  if (p_ctx->ring >= 0) {
+    loff_t pos = segment_ts_tell(p_ctx);
+
+    /*the slot is pinned until the segment is closed, it can not be taken by another one meanwhile*/
+    pthread_mutex_lock(&segment_ring_lock);
+    DVR_RETURN_IF_FALSE_WITH_UNLOCK(segment_ring_valid(p_ctx), &segment_ring_lock);
+    DVR_RETURN_IF_FALSE_WITH_UNLOCK(pos != -1 && pos + (loff_t)count <= segment_rings[p_ctx->ring].slot_size,
+        &segment_ring_lock);
+    pthread_mutex_unlock(&segment_ring_lock);
+  }
+  if (p_ctx->prealloc_size)
+    segment_prealloc(p_ctx, segment_ts_tell(p_ctx) + count);
+  if (p_ctx->direct_buf)
+    len = segment_direct_write(p_ctx, buf, count);
+  else
+    len = write(p_ctx->ts_fd, buf, count);
+  if (p_ctx->writeback_size)
+    segment_writeback(p_ctx, DVR_FALSE);
+  else if (!p_ctx->direct_buf)
+    fsync(p_ctx->ts_fd);
+  if (len > 0) {
+    /*the O_DIRECT tail is not in the file yet*/
+    loff_t end = segment_ts_tell(p_ctx) - p_ctx->direct_len;
+
+    /*cache before publishing the slot length, so the reader never finds data missing from both*/
+    if (p_ctx->live)
+      segment_live_write(p_ctx, end + p_ctx->direct_len - len, buf, len);
+    if (p_ctx->ring >= 0) {
+      pthread_mutex_lock(&segment_ring_lock);
+      if (segment_ring_valid(p_ctx))
+        segment_rings[p_ctx->ring].slot_lens[p_ctx->ring_slot] = end;
+      pthread_mutex_unlock(&segment_ring_lock);
+    }
+    segment_progress_update(p_ctx, end, DVR_FALSE);
+  }
   return len;
 }
 
@@ -230,33 +976,35 @@ int segment_update_pts_force(Segment_Handle_t handle, uint64_t pts, loff_t offse
 
   if (p_ctx->first_pts == ULLONG_MAX) {
     DVR_DEBUG(1, "%s first pcr:%llu", __func__, pts);
-    p_ctx->first_pts = pts;
+    /*an appended segment continues from its last index entry*/
+    p_ctx->first_pts = pts - p_ctx->time_base;
   }
   memset(buf, 0, sizeof(buf));
   if (p_ctx->last_pts == ULLONG_MAX) {
     /*Last pts is init value*/
-    sprintf(buf, "{time=%llu, offset=%lld}", pts - p_ctx->first_pts, offset);
+    sprintf(buf, "%s{time=%llu, offset=%lld}", p_ctx->index_appended ? "\n" : "",
+        pts - p_ctx->first_pts, offset);
     p_ctx->cur_time = pts - p_ctx->first_pts;
-  DVR_DEBUG(1, "%s force pcr:%llu -1", __func__, pts);
+  DVR_DEBUG(2, "%s force pcr:%llu -1", __func__, pts);
   } else {
     /*Last pts has valid value*/
     int diff = pts - p_ctx->last_pts;
     if ((diff > MAX_PTS_THRESHOLD) || (diff < 0)) {
       /*Current pts has a transition*/
-      DVR_DEBUG(1, "[%s]force update Current pts has a transition, [%llu, %llu, %llu]",__func__,
+      DVR_DEBUG_RL(1, 1000, "[%s]force update Current pts has a transition, [%llu, %llu, %llu]",__func__,
           p_ctx->first_pts, p_ctx->last_pts, pts);
       sprintf(buf, "\n{time=%llu, offset=%lld}", p_ctx->cur_time, offset);
     } else {
       /*This is a normal pts, record it*/
       p_ctx->cur_time += diff;
-      DVR_DEBUG(1, "%s force pcr:%llu -1 diff [%d]", __func__, pts, diff);
+      DVR_DEBUG(2, "%s force pcr:%llu -1 diff [%d]", __func__, pts, diff);
       sprintf(buf, "\n{time=%llu, offset=%lld}", p_ctx->cur_time, offset);
     }
   }
 
   record_diff = pts - p_ctx->last_record_pts;
   if (strlen(buf) > 0) {
-    DVR_DEBUG(1, "%s force pcr:%llu buf:%s", __func__, pts, buf);
+    DVR_DEBUG(2, "%s force pcr:%llu buf:%s", __func__, pts, buf);
     fputs(buf, p_ctx->index_fp);
     fflush(p_ctx->index_fp);
     fsync(fileno(p_ctx->index_fp));
@@ -279,20 +1027,22 @@ int segment_update_pts(Segment_Handle_t handle, uint64_t pts, loff_t offset)
 
   if (p_ctx->first_pts == ULLONG_MAX) {
     DVR_DEBUG(1, "%s first pcr:%llu", __func__, pts);
-    p_ctx->first_pts = pts;
+    /*an appended segment continues from its last index entry*/
+    p_ctx->first_pts = pts - p_ctx->time_base;
     //p_ctx->cur_time = p_ctx->cur_time + PTS_HEAD_DEVIATION;
   }
   memset(buf, 0, sizeof(buf));
   if (p_ctx->last_pts == ULLONG_MAX) {
     /*Last pts is init value*/
-    sprintf(buf, "{time=%llu, offset=%lld}", pts - p_ctx->first_pts, offset);
+    sprintf(buf, "%s{time=%llu, offset=%lld}", p_ctx->index_appended ? "\n" : "",
+        pts - p_ctx->first_pts, offset);
     p_ctx->cur_time = pts - p_ctx->first_pts;
   } else {
     /*Last pts has valid value*/
     int diff = pts - p_ctx->last_pts;
     if ((diff > MAX_PTS_THRESHOLD) || (diff < 0)) {
       /*Current pts has a transition*/
-      DVR_DEBUG(1, "Current pts has a transition, [%llu, %llu, %llu]",
+      DVR_DEBUG_RL(1, 1000, "Current pts has a transition, [%llu, %llu, %llu]",
           p_ctx->first_pts, p_ctx->last_pts, pts);
       p_ctx->last_record_pts = pts;
       //p_ctx->cur_time = p_ctx->cur_time + PTS_DISCONTINE_DEVIATION;
@@ -316,29 +1066,18 @@ int segment_update_pts(Segment_Handle_t handle, uint64_t pts, loff_t offset)
   return DVR_SUCCESS;
 }
 
-loff_t segment_seek(Segment_Handle_t handle, uint64_t time, int block_size)
+/*Find the ts offset of a time in the index, -1 if not found*/
+static loff_t segment_lookup_offset(Segment_Context_t *p_ctx, uint64_t time, int block_size)
 {
-  Segment_Context_t *p_ctx;
   char buf[256];
   char value[256];
   uint64_t pts = 0L;
   loff_t offset = 0;
   char *p1, *p2;
 
-  p_ctx = (Segment_Context_t *)handle;
-  DVR_RETURN_IF_FALSE(p_ctx);
-  DVR_RETURN_IF_FALSE(p_ctx->index_fp);
-  DVR_RETURN_IF_FALSE(p_ctx->ts_fd != -1);
-
-  if (time == 0) {
-    offset = 0;
-    DVR_DEBUG(1, "seek time=%llu, offset=%lld time--%llu\n", pts, offset, time);
-    DVR_RETURN_IF_FALSE(lseek(p_ctx->ts_fd, offset, SEEK_SET) != -1);
-    return offset;
-  }
-
   memset(buf, 0, sizeof(buf));
-  DVR_RETURN_IF_FALSE(fseek(p_ctx->index_fp, 0, SEEK_SET) != -1);
+  if (fseek(p_ctx->index_fp, 0, SEEK_SET) == -1)
+    return -1;
   int line = 0;
   while (fgets(buf, sizeof(buf), p_ctx->index_fp) != NULL) {
     line++;
@@ -370,7 +1109,6 @@ loff_t segment_seek(Segment_Handle_t handle, uint64_t time, int block_size)
         offset = offset - offset%block_size;
       }
       //DVR_DEBUG(1, "seek time=%llu, offset=%lld time--%llu line %d\n", pts, offset, time, line);
-      DVR_RETURN_IF_FALSE(lseek(p_ctx->ts_fd, offset, SEEK_SET) != -1);
       return offset;
     }
   }
@@ -379,11 +1117,33 @@ loff_t segment_seek(Segment_Handle_t handle, uint64_t time, int block_size)
       offset = offset - offset%block_size;
     }
     DVR_DEBUG(1, "seek time=%llu, offset=%lld time--%llu line %d end\n", pts, offset, time, line);
-    DVR_RETURN_IF_FALSE(lseek(p_ctx->ts_fd, offset, SEEK_SET) != -1);
     return offset;
   }
   DVR_DEBUG(1, "seek error line [%d]", line);
-  return DVR_FAILURE;
+  return -1;
+}
+
+loff_t segment_seek(Segment_Handle_t handle, uint64_t time, int block_size)
+{
+  Segment_Context_t *p_ctx;
+  loff_t offset = 0;
+
+  p_ctx = (Segment_Context_t *)handle;
+  DVR_RETURN_IF_FALSE(p_ctx);
+  DVR_RETURN_IF_FALSE(p_ctx->index_fp);
+  DVR_RETURN_IF_FALSE(p_ctx->ts_fd != -1);
+
+  if (time == 0) {
+    offset = 0;
+    DVR_DEBUG(1, "seek time=%llu, offset=%lld time--%llu\n", 0ULL, offset, time);
+    DVR_RETURN_IF_FALSE(segment_ts_seek(p_ctx, offset) != -1);
+    return offset;
+  }
+
+  offset = segment_lookup_offset(p_ctx, time, block_size);
+  DVR_RETURN_IF_FALSE(offset != -1);
+  DVR_RETURN_IF_FALSE(segment_ts_seek(p_ctx, offset) != -1);
+  return offset;
 }
 
 loff_t segment_tell_position(Segment_Handle_t handle)
@@ -393,10 +1153,29 @@ loff_t segment_tell_position(Segment_Handle_t handle)
   p_ctx = (Segment_Context_t *)handle;
   DVR_RETURN_IF_FALSE(p_ctx);
   DVR_RETURN_IF_FALSE(p_ctx->ts_fd != -1);
-  pos = lseek(p_ctx->ts_fd, 0, SEEK_CUR);
+  pos = segment_ts_tell(p_ctx);
   return pos;
 }
 
+loff_t segment_tell_room(Segment_Handle_t handle)
+{
+  Segment_Context_t *p_ctx;
+  loff_t pos, room = LLONG_MAX;
+
+  p_ctx = (Segment_Context_t *)handle;
+  DVR_RETURN_IF_FALSE(p_ctx);
+  DVR_RETURN_IF_FALSE(p_ctx->ts_fd != -1);
+  if (p_ctx->ring < 0)
+    return room;
+  pos = segment_ts_tell(p_ctx);
+  DVR_RETURN_IF_FALSE(pos != -1);
+  pthread_mutex_lock(&segment_ring_lock);
+  if (segment_ring_valid(p_ctx))
+    room = segment_rings[p_ctx->ring].slot_size - pos;
+  pthread_mutex_unlock(&segment_ring_lock);
+  return room;
+}
+
 uint64_t segment_tell_position_time(Segment_Handle_t handle, loff_t position)
 {
   Segment_Context_t *p_ctx;
@@ -470,7 +1249,7 @@ uint64_t segment_tell_current_time(Segment_Handle_t handle)
 
   memset(buf, 0, sizeof(buf));
   DVR_RETURN_IF_FALSE(fseek(p_ctx->index_fp, 0, SEEK_SET) != -1);
-  position = lseek(p_ctx->ts_fd, 0, SEEK_CUR);
+  position = segment_ts_tell(p_ctx);
   DVR_RETURN_IF_FALSE(position != -1);
 
   while (fgets(buf, sizeof(buf), p_ctx->index_fp) != NULL) {
@@ -520,7 +1299,7 @@ uint64_t segment_tell_total_time(Segment_Handle_t handle)
 
   memset(buf, 0, sizeof(buf));
   memset(last_buf, 0, sizeof(last_buf));
-  position = lseek(p_ctx->ts_fd, 0, SEEK_CUR);
+  position = segment_ts_tell(p_ctx);
   DVR_RETURN_IF_FALSE(position != -1);
 
   //DVR_RETURN_IF_FALSE(fseek(p_ctx->index_fp, -1000L, SEEK_END) != -1);
@@ -531,7 +1310,7 @@ uint64_t segment_tell_total_time(Segment_Handle_t handle)
   /* Save last line buffer */
   while (fgets(buf, sizeof(buf), p_ctx->index_fp) != NULL) {
     if (strlen(buf) <= 0) {
-      DVR_DEBUG(1, "read index buf is len 0");
+      DVR_DEBUG(2, "read index buf is len 0");
       continue;
     }
     memset(last_buf, 0, sizeof(last_buf));
@@ -596,7 +1375,7 @@ int segment_store_info(Segment_Handle_t handle, Segment_StoreInfo_t *p_info)
 
   /*Save segment duration*/
   memset(buf, 0, sizeof(buf));
-  DVR_DEBUG(1, "duration store:[%ld]", p_info->duration);
+  DVR_DEBUG(2, "duration store:[%ld]", p_info->duration);
   sprintf(buf, "duration=%ld\n", p_info->duration);
   fputs(buf, p_ctx->dat_fp);
 
@@ -610,7 +1389,17 @@ int segment_store_info(Segment_Handle_t handle, Segment_StoreInfo_t *p_info)
   sprintf(buf, "nb_packets=%d\n", p_info->nb_packets);
   fputs(buf, p_ctx->dat_fp);
 
+  /*Save stream summary, flags/video format/audio format*/
+  if (p_info->summary.flags) {
+    memset(buf, 0, sizeof(buf));
+    sprintf(buf, "summary=%u,%d,%d\n", p_info->summary.flags,
+        p_info->summary.video_format, p_info->summary.audio_format);
+    fputs(buf, p_ctx->dat_fp);
+  }
+
   fflush(p_ctx->dat_fp);
+  /*drop the end of a longer info written before*/
+  ftruncate(fileno(p_ctx->dat_fp), ftell(p_ctx->dat_fp));
   fsync(fileno(p_ctx->dat_fp));
   return DVR_SUCCESS;
 }
@@ -641,11 +1430,19 @@ int segment_load_info(Segment_Handle_t handle, Segment_StoreInfo_t *p_info)
   p1 = strstr(buf, "nb_pids=");
   DVR_RETURN_IF_FALSE(p1);
   p_info->nb_pids = strtoull(p1 + 8, NULL, 10);
+  if (p_info->nb_pids > DVR_MAX_RECORD_PIDS_COUNT) {
+    p_info->nb_pids = 0;
+    return DVR_FAILURE;
+  }
 
   /*Save pid information*/
   for (i = 0; i < p_info->nb_pids; i++) {
     p1 = fgets(buf, sizeof(buf), p_ctx->dat_fp);
-    DVR_RETURN_IF_FALSE(p1);
+    if (!p1 || !strchr(buf, '}')) {
+      /*a torn info only has the whole pids read*/
+      p_info->nb_pids = i;
+      return DVR_FAILURE;
+    }
     memset(value, 0, sizeof(value));
     if ((p1 = strstr(buf, "pid="))) {
       DVR_RETURN_IF_FALSE(p1);
@@ -691,6 +1488,18 @@ int segment_load_info(Segment_Handle_t handle, Segment_StoreInfo_t *p_info)
   DVR_RETURN_IF_FALSE(p1);
   p_info->nb_packets = strtoull(p1 + 11, NULL, 10);
 
+  /*Load stream summary, not in the segments of older versions*/
+  memset(&p_info->summary, 0, sizeof(p_info->summary));
+  p1 = fgets(buf, sizeof(buf), p_ctx->dat_fp);
+  if (p1 && (p1 = strstr(buf, "summary="))) {
+    /*some segments were saved with the flags only*/
+    p_info->summary.video_format = -1;
+    p_info->summary.audio_format = -1;
+    if (sscanf(p1 + 8, "%u,%d,%d", &p_info->summary.flags,
+          &p_info->summary.video_format, &p_info->summary.audio_format) < 1)
+      memset(&p_info->summary, 0, sizeof(p_info->summary));
+  }
+
   return DVR_SUCCESS;
 }
 
@@ -701,6 +1510,26 @@ int segment_delete(const char *location, uint64_t segment_id)
 
   DVR_RETURN_IF_FALSE(location);
 
+  /*ring segments only release their slot, the files are reused*/
+  pthread_mutex_lock(&segment_ring_lock);
+  ret = segment_ring_find(location);
+  if (ret >= 0) {
+    Segment_Ring_t *ring = &segment_rings[ret];
+    int slot = segment_ring_lookup(ring, segment_id);
+
+    if (slot >= 0) {
+      /*a slot being recorded is pinned*/
+      DVR_RETURN_IF_FALSE_WITH_UNLOCK(!ring->slot_writing[slot], &segment_ring_lock);
+      ring->slot_ids[slot] = ULLONG_MAX;
+      ring->slot_lens[slot] = 0;
+      ring->free_slots[ring->nb_free++] = slot;
+      pthread_mutex_unlock(&segment_ring_lock);
+      DVR_DEBUG(1, "%s, ring segment %llu released", __func__, segment_id);
+      return DVR_SUCCESS;
+    }
+  }
+  pthread_mutex_unlock(&segment_ring_lock);
+
   /*delete ts file*/
   memset(fname, 0, sizeof(fname));
   segment_get_fname(fname, location, segment_id, SEGMENT_FILE_TYPE_TS);
@@ -722,6 +1551,11 @@ int segment_delete(const char *location, uint64_t segment_id)
   DVR_DEBUG(1, "%s, [%s] return:%s", __func__, fname, strerror(errno));
   DVR_RETURN_IF_FALSE(ret == 0);
 
+  /*delete crypto period index file, it only exists for scrambled records*/
+  memset(fname, 0, sizeof(fname));
+  segment_get_fname(fname, location, segment_id, SEGMENT_FILE_TYPE_CRYPTO);
+  unlink(fname);
+
   return DVR_SUCCESS;
 }
 
@@ -731,16 +1565,198 @@ int segment_ongoing(Segment_Handle_t handle)
   p_ctx = (Segment_Context_t *)handle;
   struct stat mstat;
 
+  /*recorded in this process, no need to check the file*/
+  pthread_once(&segment_progress_once, segment_progress_init);
+  pthread_mutex_lock(&segment_progress_lock);
+  int i = segment_progress_find(p_ctx->location);
+  if (i >= 0 && (segment_progress[i].segment_id == p_ctx->segment_id || !segment_progress[i].closed)) {
+    DVR_Bool_t ongoing = (segment_progress[i].segment_id == p_ctx->segment_id && !segment_progress[i].closed);
+
+    pthread_mutex_unlock(&segment_progress_lock);
+    return ongoing ? DVR_SUCCESS : DVR_FAILURE;
+  }
+  pthread_mutex_unlock(&segment_progress_lock);
+
+  if (p_ctx->ring >= 0) {
+    DVR_Bool_t writing;
+
+    pthread_mutex_lock(&segment_ring_lock);
+    writing = segment_ring_valid(p_ctx) ? segment_rings[p_ctx->ring].slot_writing[p_ctx->ring_slot] : DVR_FALSE;
+    pthread_mutex_unlock(&segment_ring_lock);
+    return writing ? DVR_SUCCESS : DVR_FAILURE;
+  }
+
   char going_name[MAX_SEGMENT_PATH_SIZE];
   memset(going_name, 0, sizeof(going_name));
   segment_get_fname(going_name, p_ctx->location, p_ctx->segment_id, SEGMENT_FILE_TYPE_ONGOING);
   int ret = stat(going_name, &mstat);
-  DVR_DEBUG(1, "segment check ongoing  [%s] ret [%d]", going_name, ret);
+  DVR_DEBUG(2, "segment check ongoing  [%s] ret [%d]", going_name, ret);
   if (ret != 0) {
     return DVR_FAILURE;
   }
   return DVR_SUCCESS;
 }
+
+int segment_recover(const char *location, uint64_t segment_id)
+{
+  Segment_OpenParams_t params;
+  Segment_Handle_t handle;
+  Segment_Context_t *p_ctx;
+  Segment_StoreInfo_t info;
+  char fname[MAX_SEGMENT_PATH_SIZE];
+  int ret;
+
+  DVR_RETURN_IF_FALSE(location);
+  DVR_RETURN_IF_FALSE(strlen(location) < DVR_MAX_LOCATION_SIZE);
+
+  /*only a segment left with its ongoing marker and its data needs it*/
+  segment_get_fname(fname, location, segment_id, SEGMENT_FILE_TYPE_ONGOING);
+  if (access(fname, F_OK) == -1)
+    return DVR_SUCCESS;
+  segment_get_fname(fname, location, segment_id, SEGMENT_FILE_TYPE_TS);
+  if (access(fname, F_OK) == -1)
+    return DVR_SUCCESS;
+
+  /*a segment being recorded in this process is not interrupted*/
+  ret = 0;
+  pthread_mutex_lock(&segment_writer_lock);
+  list_for_each_entry(p_ctx, &segment_writers, writer_head) {
+    if (p_ctx->segment_id == segment_id && !strcmp(p_ctx->location, location)) {
+      ret = 1;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&segment_writer_lock);
+  if (ret)
+    return DVR_SUCCESS;
+  pthread_mutex_lock(&segment_ring_lock);
+  ret = segment_ring_find(location) >= 0;
+  pthread_mutex_unlock(&segment_ring_lock);
+  if (ret)
+    return DVR_SUCCESS;
+
+  /*the append open cuts the data and the index after their last whole entries*/
+  memset(&params, 0, sizeof(params));
+  strncpy(params.location, location, sizeof(params.location) - 1);
+  params.segment_id = segment_id;
+  params.mode = SEGMENT_MODE_APPEND;
+  params.resume_size = -1;
+  params.no_progress = DVR_TRUE;
+  DVR_RETURN_IF_FALSE(segment_open(&params, &handle) == DVR_SUCCESS);
+  p_ctx = (Segment_Context_t *)handle;
+
+  /*the info may be stale or torn, keep its pids and recompute the rest*/
+  memset(&info, 0, sizeof(info));
+  if (segment_load_info(handle, &info) != DVR_SUCCESS)
+    DVR_DEBUG(1, "%s, segment %llu info is torn, pids:%d", __func__, segment_id, info.nb_pids);
+  info.id = segment_id;
+  info.size = segment_ts_tell(p_ctx);
+  info.nb_packets = info.size / 188;
+  info.duration = p_ctx->index_appended ? p_ctx->time_base : 0;
+
+  ret = segment_store_info(handle, &info);
+  DVR_DEBUG(1, "%s, segment [%s-%llu] recovered, size:%zu duration:%ld ret:%d", __func__,
+      location, segment_id, info.size, info.duration, ret);
+  /*closing removes the ongoing marker*/
+  segment_close(handle);
+  return ret;
+}
+int segment_update_crypto_period(Segment_Handle_t handle, DVR_CryptoPeriodEntry_t *p_entry)
+{
+  Segment_Context_t *p_ctx;
+  char fname[MAX_SEGMENT_PATH_SIZE];
+
+  p_ctx = (Segment_Context_t *)handle;
+  DVR_RETURN_IF_FALSE(p_ctx);
+  DVR_RETURN_IF_FALSE(p_entry);
+  DVR_RETURN_IF_FALSE(p_ctx->mode == SEGMENT_MODE_WRITE);
+
+  if (!p_ctx->crypto_fp) {
+    segment_get_slot_fname(fname, p_ctx->location, p_ctx->segment_id, p_ctx->ring_slot, SEGMENT_FILE_TYPE_CRYPTO);
+    /*an appended segment keeps the periods recorded before, a new one has none*/
+    p_ctx->crypto_fp = fopen(fname, "a+");
+    DVR_RETURN_IF_FALSE(p_ctx->crypto_fp);
+  }
+
+  fprintf(p_ctx->crypto_fp, "{offset=%lld, type=%d, parity=%d}\n",
+      (long long)p_entry->offset, (int)p_entry->filter_type, (int)p_entry->parity);
+  fflush(p_ctx->crypto_fp);
+  return DVR_SUCCESS;
+}
+
+/*Load the crypto periods appended since the last call, the index grows while timeshifting*/
+static void segment_load_crypto_periods(Segment_Context_t *p_ctx)
+{
+  char fname[MAX_SEGMENT_PATH_SIZE];
+  char buf[256];
+  long pos;
+  long long offset;
+  int type, parity;
+  DVR_CryptoPeriodEntry_t *periods;
+
+  if (!p_ctx->crypto_fp) {
+    segment_get_slot_fname(fname, p_ctx->location, p_ctx->segment_id, p_ctx->ring_slot, SEGMENT_FILE_TYPE_CRYPTO);
+    p_ctx->crypto_fp = fopen(fname, "r");
+    if (!p_ctx->crypto_fp)
+      return;
+  }
+
+  clearerr(p_ctx->crypto_fp);
+  for (;;) {
+    pos = ftell(p_ctx->crypto_fp);
+    if (!fgets(buf, sizeof(buf), p_ctx->crypto_fp))
+      break;
+    if (!strchr(buf, '\n')) {
+      /*partial line, the writer has not finished it*/
+      fseek(p_ctx->crypto_fp, pos, SEEK_SET);
+      break;
+    }
+    if (sscanf(buf, "{offset=%lld, type=%d, parity=%d}", &offset, &type, &parity) != 3)
+      continue;
+    if (p_ctx->nb_periods == p_ctx->periods_size) {
+      int size = p_ctx->periods_size ? p_ctx->periods_size * 2 : 64;
+      periods = realloc(p_ctx->periods, size * sizeof(DVR_CryptoPeriodEntry_t));
+      if (!periods)
+        break;
+      p_ctx->periods = periods;
+      p_ctx->periods_size = size;
+    }
+    p_ctx->periods[p_ctx->nb_periods].offset = offset;
+    p_ctx->periods[p_ctx->nb_periods].filter_type = (DVR_CryptoFilterType_t)type;
+    p_ctx->periods[p_ctx->nb_periods].parity = (DVR_CryptoParity_t)parity;
+    p_ctx->nb_periods++;
+  }
+}
+
+int segment_get_crypto_periods(Segment_Handle_t handle, loff_t offset, DVR_CryptoPeriodEntry_t *entries, int max)
+{
+  Segment_Context_t *p_ctx;
+  int cur_audio = -1, cur_video = -1;
+  int i, n = 0;
+
+  p_ctx = (Segment_Context_t *)handle;
+  DVR_RETURN_IF_FALSE(p_ctx);
+  DVR_RETURN_IF_FALSE(entries);
+  DVR_RETURN_IF_FALSE(p_ctx->mode != SEGMENT_MODE_WRITE);
+
+  segment_load_crypto_periods(p_ctx);
+
+  /*entries are in offset order, find the period in force for audio and video*/
+  for (i = 0; i < p_ctx->nb_periods && p_ctx->periods[i].offset <= offset; i++) {
+    if (p_ctx->periods[i].filter_type == DVR_CRYPTO_FILTER_TYPE_AUDIO)
+      cur_audio = i;
+    else
+      cur_video = i;
+  }
+  if (cur_audio >= 0 && n < max)
+    entries[n++] = p_ctx->periods[cur_audio];
+  if (cur_video >= 0 && n < max)
+    entries[n++] = p_ctx->periods[cur_video];
+  for (; i < p_ctx->nb_periods && n < max; i++)
+    entries[n++] = p_ctx->periods[i];
+  return n;
+}
+
 loff_t segment_dump_pts(Segment_Handle_t handle)
 {
   Segment_Context_t *p_ctx;
@@ -784,3 +1800,302 @@ loff_t segment_dump_pts(Segment_Handle_t handle)
 
   return 0;
 }
+
+int segment_ring_create(const char *location, uint32_t nb_slots, loff_t slot_size)
+{
+  Segment_Ring_t *ring = NULL;
+  char fname[MAX_SEGMENT_PATH_SIZE];
+  int fd;
+  int ret;
+  uint32_t i;
+
+  DVR_RETURN_IF_FALSE(location && strlen(location) < DVR_MAX_LOCATION_SIZE);
+  DVR_RETURN_IF_FALSE(nb_slots > 1 && slot_size > 0);
+  /*keep the slots aligned for O_DIRECT*/
+  slot_size = (slot_size + SEGMENT_DIRECT_ALIGN - 1) & ~((loff_t)SEGMENT_DIRECT_ALIGN - 1);
+
+  pthread_mutex_lock(&segment_ring_lock);
+  DVR_RETURN_IF_FALSE_WITH_UNLOCK(segment_ring_find(location) < 0, &segment_ring_lock);
+  for (i = 0; i < MAX_SEGMENT_RING_COUNT; i++) {
+    if (!segment_rings[i].location[0]) {
+      ring = &segment_rings[i];
+      break;
+    }
+  }
+  DVR_RETURN_IF_FALSE_WITH_UNLOCK(ring, &segment_ring_lock);
+
+  /*reserve the whole ring once, recording then overwrites it without allocating blocks*/
+  segment_get_slot_fname(fname, location, 0, 0, SEGMENT_FILE_TYPE_TS);
+  fd = open(fname, O_CREAT | O_RDWR, 0644);
+  DVR_RETURN_IF_FALSE_WITH_UNLOCK(fd != -1, &segment_ring_lock);
+  ret = posix_fallocate(fd, 0, (loff_t)nb_slots * slot_size);
+  if (ret != 0) {
+    DVR_DEBUG(1, "%s, fallocate [%s] failed:%s", __func__, fname, strerror(ret));
+    ret = ftruncate(fd, (loff_t)nb_slots * slot_size);
+  }
+  close(fd);
+  DVR_RETURN_IF_FALSE_WITH_UNLOCK(ret == 0, &segment_ring_lock);
+
+  ring->slot_ids = (uint64_t *)malloc(nb_slots * sizeof(uint64_t));
+  ring->slot_lens = (loff_t *)calloc(nb_slots, sizeof(loff_t));
+  ring->slot_writing = (DVR_Bool_t *)calloc(nb_slots, sizeof(DVR_Bool_t));
+  ring->free_slots = (uint32_t *)malloc(nb_slots * sizeof(uint32_t));
+  if (!ring->slot_ids || !ring->slot_lens || !ring->slot_writing || !ring->free_slots) {
+    free(ring->slot_ids);
+    free(ring->slot_lens);
+    free(ring->slot_writing);
+    free(ring->free_slots);
+    memset(ring, 0, sizeof(Segment_Ring_t));
+    pthread_mutex_unlock(&segment_ring_lock);
+    unlink(fname);
+    return DVR_FAILURE;
+  }
+  for (i = 0; i < nb_slots; i++) {
+    ring->slot_ids[i] = ULLONG_MAX;
+    ring->free_slots[i] = nb_slots - 1 - i;
+  }
+  ring->nb_free = nb_slots;
+  ring->nb_slots = nb_slots;
+  ring->slot_size = slot_size;
+  strncpy(ring->location, location, sizeof(ring->location) - 1);
+  pthread_mutex_unlock(&segment_ring_lock);
+
+  DVR_DEBUG(1, "%s, [%s] slots:%u slot_size:%lld", __func__, fname, nb_slots, (long long)slot_size);
+  return DVR_SUCCESS;
+}
+
+int segment_ring_destroy(const char *location)
+{
+  Segment_Ring_t *ring;
+  char fname[MAX_SEGMENT_PATH_SIZE];
+  uint32_t i, nb_slots;
+  int idx;
+
+  DVR_RETURN_IF_FALSE(location);
+
+  pthread_mutex_lock(&segment_ring_lock);
+  idx = segment_ring_find(location);
+  DVR_RETURN_IF_FALSE_WITH_UNLOCK(idx >= 0, &segment_ring_lock);
+  ring = &segment_rings[idx];
+  nb_slots = ring->nb_slots;
+  /*the slots being recorded are pinned, their writer uses the ring*/
+  for (i = 0; i < nb_slots; i++)
+    DVR_RETURN_IF_FALSE_WITH_UNLOCK(!ring->slot_writing[i], &segment_ring_lock);
+  free(ring->slot_ids);
+  free(ring->slot_lens);
+  free(ring->slot_writing);
+  free(ring->free_slots);
+  memset(ring, 0, sizeof(Segment_Ring_t));
+  pthread_mutex_unlock(&segment_ring_lock);
+
+  segment_get_slot_fname(fname, location, 0, 0, SEGMENT_FILE_TYPE_TS);
+  unlink(fname);
+  for (i = 0; i < nb_slots; i++) {
+    segment_get_slot_fname(fname, location, 0, i, SEGMENT_FILE_TYPE_INDEX);
+    unlink(fname);
+    segment_get_slot_fname(fname, location, 0, i, SEGMENT_FILE_TYPE_DAT);
+    unlink(fname);
+    segment_get_slot_fname(fname, location, 0, i, SEGMENT_FILE_TYPE_CRYPTO);
+    unlink(fname);
+  }
+
+  DVR_DEBUG(1, "%s, [%s] destroyed", __func__, location);
+  return DVR_SUCCESS;
+}
+
+int segment_set_access_mode(Segment_Handle_t handle, Segment_AccessMode_t mode, loff_t window)
+{
+  Segment_Context_t *p_ctx;
+  loff_t pos;
+  int advice;
+
+  p_ctx = (Segment_Context_t *)handle;
+  DVR_RETURN_IF_FALSE(p_ctx);
+  DVR_RETURN_IF_FALSE(p_ctx->ts_fd != -1);
+  DVR_RETURN_IF_FALSE(mode == SEGMENT_ACCESS_NORMAL || window > 0);
+
+  if (mode == SEGMENT_ACCESS_SEQUENTIAL)
+    advice = POSIX_FADV_SEQUENTIAL;
+  else if (mode == SEGMENT_ACCESS_RANDOM)
+    advice = POSIX_FADV_RANDOM;
+  else
+    advice = POSIX_FADV_NORMAL;
+  /*ring segments only advise their slot*/
+  posix_fadvise(p_ctx->ts_fd, p_ctx->ts_base, p_ctx->ring >= 0 ? segment_rings[p_ctx->ring].slot_size : 0, advice);
+
+  p_ctx->access_mode = mode;
+  p_ctx->ra_window = window;
+  pos = segment_ts_tell(p_ctx);
+  if (pos != -1) {
+    p_ctx->ra_end = pos;
+    p_ctx->drop_pos = pos;
+  }
+  return DVR_SUCCESS;
+}
+
+int segment_prefetch(Segment_Handle_t handle, uint64_t time, size_t len)
+{
+  Segment_Context_t *p_ctx;
+  loff_t offset;
+
+  p_ctx = (Segment_Context_t *)handle;
+  DVR_RETURN_IF_FALSE(p_ctx);
+  DVR_RETURN_IF_FALSE(p_ctx->index_fp);
+  DVR_RETURN_IF_FALSE(p_ctx->ts_fd != -1);
+
+  offset = time ? segment_lookup_offset(p_ctx, time, 0) : 0;
+  DVR_RETURN_IF_FALSE(offset != -1);
+  posix_fadvise(p_ctx->ts_fd, p_ctx->ts_base + offset, len, POSIX_FADV_WILLNEED);
+  p_ctx->cache_stats.willneed_bytes += len;
+  p_ctx->cache_stats.prefetch_count++;
+  return DVR_SUCCESS;
+}
+
+int segment_get_cache_stats(Segment_Handle_t handle, Segment_CacheStats_t *p_stats)
+{
+  Segment_Context_t *p_ctx;
+
+  p_ctx = (Segment_Context_t *)handle;
+  DVR_RETURN_IF_FALSE(p_ctx);
+  DVR_RETURN_IF_FALSE(p_stats);
+
+  memcpy(p_stats, &p_ctx->cache_stats, sizeof(Segment_CacheStats_t));
+  return DVR_SUCCESS;
+}
+
+loff_t segment_get_cached_size(Segment_Handle_t handle)
+{
+  Segment_Context_t *p_ctx;
+  struct stat st;
+  loff_t len, cached = 0;
+  long page = sysconf(_SC_PAGESIZE);
+  unsigned char *vec;
+  void *addr;
+  size_t i, nb_pages;
+
+  p_ctx = (Segment_Context_t *)handle;
+  DVR_RETURN_IF_FALSE(p_ctx);
+  DVR_RETURN_IF_FALSE(p_ctx->ts_fd != -1);
+
+  if (p_ctx->ring >= 0) {
+    pthread_mutex_lock(&segment_ring_lock);
+    len = segment_ring_valid(p_ctx) ? segment_rings[p_ctx->ring].slot_lens[p_ctx->ring_slot] : 0;
+    pthread_mutex_unlock(&segment_ring_lock);
+  } else {
+    DVR_RETURN_IF_FALSE(fstat(p_ctx->ts_fd, &st) == 0);
+    len = st.st_size;
+  }
+  if (len <= 0)
+    return 0;
+
+  /*mapping the file only reserves address space, mincore reports the resident pages*/
+  addr = mmap(NULL, len, PROT_READ, MAP_SHARED, p_ctx->ts_fd, p_ctx->ts_base);
+  DVR_RETURN_IF_FALSE(addr != MAP_FAILED);
+  nb_pages = (len + page - 1) / page;
+  vec = (unsigned char *)malloc(nb_pages);
+  if (vec && mincore(addr, len, vec) == 0) {
+    for (i = 0; i < nb_pages; i++) {
+      if (vec[i] & 1)
+        cached += page;
+    }
+  }
+  if (vec)
+    free(vec);
+  munmap(addr, len);
+  return cached > len ? len : cached;
+}
+
+int segment_live_cache_create(const char *location, size_t size)
+{
+  Segment_LiveCache_t *live = NULL;
+  int i;
+
+  DVR_RETURN_IF_FALSE(location && strlen(location) < DVR_MAX_LOCATION_SIZE);
+  DVR_RETURN_IF_FALSE(size > 0);
+
+  pthread_mutex_lock(&segment_live_lock);
+  DVR_RETURN_IF_FALSE_WITH_UNLOCK(segment_live_find(location) < 0, &segment_live_lock);
+  for (i = 0; i < MAX_SEGMENT_LIVE_COUNT; i++) {
+    if (!segment_lives[i].location[0]) {
+      live = &segment_lives[i];
+      break;
+    }
+  }
+  DVR_RETURN_IF_FALSE_WITH_UNLOCK(live, &segment_live_lock);
+  live->buf = (uint8_t *)malloc(size);
+  DVR_RETURN_IF_FALSE_WITH_UNLOCK(live->buf, &segment_live_lock);
+  live->size = size;
+  live->total = 0;
+  live->nb_spans = 0;
+  strncpy(live->location, location, sizeof(live->location) - 1);
+  pthread_mutex_unlock(&segment_live_lock);
+
+  DVR_DEBUG(1, "%s, [%s] size:%zu", __func__, location, size);
+  return DVR_SUCCESS;
+}
+
+int segment_live_cache_destroy(const char *location)
+{
+  int i;
+
+  DVR_RETURN_IF_FALSE(location);
+
+  pthread_mutex_lock(&segment_live_lock);
+  i = segment_live_find(location);
+  DVR_RETURN_IF_FALSE_WITH_UNLOCK(i >= 0, &segment_live_lock);
+  free(segment_lives[i].buf);
+  memset(&segment_lives[i], 0, sizeof(Segment_LiveCache_t));
+  pthread_mutex_unlock(&segment_live_lock);
+
+  DVR_DEBUG(1, "%s, [%s] destroyed", __func__, location);
+  return DVR_SUCCESS;
+}
+
+int segment_wait_data(const char *location, uint64_t segment_id, loff_t offset, int timeout)
+{
+  Segment_Progress_t *progress;
+  struct timespec ts;
+  uint32_t seq, cancel_seq;
+  int i;
+
+  DVR_RETURN_IF_FALSE(location);
+
+  pthread_once(&segment_progress_once, segment_progress_init);
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  ts.tv_sec += timeout / 1000;
+  ts.tv_nsec += (timeout % 1000) * 1000000;
+  if (ts.tv_nsec >= 1000000000) {
+    ts.tv_sec++;
+    ts.tv_nsec -= 1000000000;
+  }
+
+  /*no writer in this process is a normal result, do not log it*/
+  pthread_mutex_lock(&segment_progress_lock);
+  i = segment_progress_find(location);
+  if (i < 0) {
+    pthread_mutex_unlock(&segment_progress_lock);
+    return DVR_FAILURE;
+  }
+  progress = &segment_progress[i];
+  seq = progress->seq;
+  cancel_seq = segment_cancel_seq;
+  /*data already there, else wait for data, a segment change or close*/
+  while (!(progress->segment_id == segment_id && progress->offset > offset)
+      && progress->seq == seq && segment_cancel_seq == cancel_seq
+      && !strcmp(progress->location, location)) {
+    if (pthread_cond_timedwait(&segment_progress_cond, &segment_progress_lock, &ts) != 0)
+      break;
+  }
+  pthread_mutex_unlock(&segment_progress_lock);
+  return DVR_SUCCESS;
+}
+
+int segment_wait_cancel(void)
+{
+  pthread_once(&segment_progress_once, segment_progress_init);
+  pthread_mutex_lock(&segment_progress_lock);
+  segment_cancel_seq++;
+  pthread_cond_broadcast(&segment_progress_cond);
+  pthread_mutex_unlock(&segment_progress_lock);
+  return DVR_SUCCESS;
+}
@@ -0,0 +1,517 @@
+/**
+  * \page aml_scan_test
+  * \section Introduction
+  * test code with AML_SCAN_xxxx and AML_FE_SetSec APIs on virtual frontends,
+  * it runs without tuner hardware.
+  * It checks:
+  * \li the scan time on 1, 2 and 3 tuners
+  * \li the satellite switch commands sent by a DVB-S scan on 2 tuners
+  * \li the satellite switch time of a first, repeated and band change target
+  *
+  * \section Usage
+  *
+  * \code
+  *   am_scan_test [dir=path] [lock=lock_delay_ms]
+  * \endcode
+  * \li dir: directory of the generated TS file, /data/local/tmp by default
+  * \li lock: lock delay of the virtual frontends, 200ms by default
+  *
+  * The test prints the measured times and returns 0 if all the checks pass.
+  *
+  * \endsection
+  */
+
+/***************************************************************************
+  * Copyright (c) 2014 Amlogic, Inc. All rights reserved.
+  *
+  * This source code is subject to the terms and conditions defined in the
+  * file 'LICENSE' which is part of this source code package.
+  *
+  * Description:
+  */
+/**\file
+  * \brief channel scan and satellite switch test code
+  ***************************************************************************/
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "frontend.h"
+#include "dvb_frontend_wrapper.h"
+#include "dvb_scan.h"
+
+#define TS_PKT_SIZE 188
+#define FREQ_COUNT 6
+#define SEC_TUNERS 2
+#define MAX_EVENTS 64
+/*the DiSEqC bus idle time waited by AML_FE_SetSec*/
+#define SEC_SETTLE_US 15000
+/*time a scan may take on top of the lock delays, the tables of the TS file*/
+#define SCAN_SLACK_MS 100
+
+static char ts_path[256];
+static int lock_delay = 200;
+static int failures;
+
+/*frequencies of the DVB-S scan, each tuner takes the next one free*/
+static const struct {
+  dmd_polarization_t polarization;
+  int high_band;
+  dmd_diseqc_port_t port;
+} sec_plan[FREQ_COUNT] = {
+  {DMD_PLR_HORIZONTAL, 1, DMD_DISEQC_PORTA},
+  {DMD_PLR_HORIZONTAL, 1, DMD_DISEQC_PORTA},
+  {DMD_PLR_HORIZONTAL, 0, DMD_DISEQC_PORTA},
+  {DMD_PLR_VERTICAL,   0, DMD_DISEQC_PORTB},
+  {DMD_PLR_VERTICAL,   0, DMD_DISEQC_PORTB},
+  {DMD_PLR_VERTICAL,   1, DMD_DISEQC_PORTB},
+};
+
+/*frequencies scanned by each tuner, in order*/
+static int tuner_freqs[SEC_TUNERS][FREQ_COUNT];
+static int tuner_freq_count[SEC_TUNERS];
+
+static void check(int ok, const char *what)
+{
+  printf("%s: %s\n", ok ? "PASS" : "FAIL", what);
+  if (!ok)
+    failures++;
+}
+
+static uint64_t get_ms(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000;
+}
+
+static uint32_t crc32_mpeg(const uint8_t *data, int len)
+{
+  uint32_t crc = 0xffffffff;
+  int i;
+
+  while (len--) {
+    crc ^= (uint32_t)*data++ << 24;
+    for (i = 0; i < 8; i++)
+      crc = (crc & 0x80000000) ? (crc << 1) ^ 0x04c11db7 : (crc << 1);
+  }
+  return crc;
+}
+
+/*packetize a section, its CRC is appended*/
+static void write_section(int fd, uint16_t pid, uint8_t *sec, int len)
+{
+  static uint8_t cc[0x2000];
+  uint8_t pkt[TS_PKT_SIZE];
+  uint32_t crc = crc32_mpeg(sec, len);
+  int off = 0, hdr, n;
+
+  sec[len++] = crc >> 24;
+  sec[len++] = crc >> 16;
+  sec[len++] = crc >> 8;
+  sec[len++] = crc;
+  while (off < len) {
+    memset(pkt, 0xff, sizeof(pkt));
+    pkt[0] = 0x47;
+    pkt[1] = (off ? 0 : 0x40) | (pid >> 8);
+    pkt[2] = pid;
+    pkt[3] = 0x10 | (cc[pid]++ & 0x0f);
+    hdr = 4;
+    if (!off)
+      pkt[hdr++] = 0; /*pointer field*/
+    n = TS_PKT_SIZE - hdr;
+    if (n > len - off)
+      n = len - off;
+    memcpy(pkt + hdr, sec + off, n);
+    off += n;
+    write(fd, pkt, sizeof(pkt));
+  }
+}
+
+static int make_section(uint8_t *sec, int table_id, int ext, const uint8_t *body, int len)
+{
+  int section_len = 5 + len + 4;
+
+  sec[0] = table_id;
+  sec[1] = 0xb0 | (section_len >> 8);
+  sec[2] = section_len;
+  sec[3] = ext >> 8;
+  sec[4] = ext;
+  sec[5] = 0xc1 | (3 << 1);
+  sec[6] = 0;
+  sec[7] = 0;
+  memcpy(sec + 8, body, len);
+  return 8 + len;
+}
+
+/*a transponder with 2 services, the PAT, PMTs and SDT repeated 3 times*/
+static int make_ts(void)
+{
+  static const uint8_t pat[] = {0x00, 0x00, 0xe0, 0x10, 0x00, 0x01, 0xe1, 0x00, 0x00, 0x02, 0xe1, 0x01};
+  static const uint8_t pmt1[] = {0xe2, 0x00, 0xf0, 0x00, 0x1b, 0xe2, 0x00, 0xf0, 0x00, 0x0f, 0xe2, 0x01, 0xf0, 0x00};
+  static const uint8_t pmt2[] = {0xe3, 0x00, 0xf0, 0x00, 0x02, 0xe3, 0x00, 0xf0, 0x00};
+  static const char *names[] = {"ChanOne", "ChanTwo"};
+  uint8_t sec[1024], body[512], null_pkt[TS_PKT_SIZE];
+  int fd, rep, i, len, name_len;
+
+  fd = open(ts_path, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+  if (fd == -1) {
+    printf("can not create %s\n", ts_path);
+    return -1;
+  }
+  memset(null_pkt, 0xff, sizeof(null_pkt));
+  null_pkt[0] = 0x47;
+  null_pkt[1] = 0x1f;
+  null_pkt[2] = 0xff;
+  null_pkt[3] = 0x10;
+  for (rep = 0; rep < 3; rep++) {
+    write_section(fd, 0x0000, sec, make_section(sec, 0x00, 0x1234, pat, sizeof(pat)));
+    write_section(fd, 0x0100, sec, make_section(sec, 0x02, 1, pmt1, sizeof(pmt1)));
+    write_section(fd, 0x0101, sec, make_section(sec, 0x02, 2, pmt2, sizeof(pmt2)));
+    len = 0;
+    body[len++] = 0x00; /*original_network_id*/
+    body[len++] = 0x22;
+    body[len++] = 0xff;
+    for (i = 0; i < 2; i++) {
+      name_len = strlen(names[i]);
+      body[len++] = 0;
+      body[len++] = i + 1;
+      body[len++] = 0xfc;
+      body[len++] = 0x80;
+      body[len++] = 2 + 3 + name_len;
+      body[len++] = 0x48; /*service descriptor*/
+      body[len++] = 3 + name_len;
+      body[len++] = 1;
+      body[len++] = 0;
+      body[len++] = name_len;
+      memcpy(body + len, names[i], name_len);
+      len += name_len;
+    }
+    write_section(fd, 0x0011, sec, make_section(sec, 0x42, 0x1234, body, len));
+    for (i = 0; i < 200; i++)
+      write(fd, null_pkt, sizeof(null_pkt));
+  }
+  close(fd);
+  return 0;
+}
+
+static int open_tuners(dvb_scan_params_t *params, int count)
+{
+  dmd_virtual_desc_t desc;
+  int i;
+
+  for (i = 0; i < count; i++) {
+    memset(&desc, 0, sizeof(desc));
+    desc.lock_delay = lock_delay;
+    desc.dmx_dev_id = i;
+    desc.ts_file = ts_path;
+    desc.signal.strength = 100;
+    if (AML_FE_OpenVirtual(&desc, &params->frontend_fd[i]) != DVB_SUCCESS) {
+      printf("open virtual frontend %d failed\n", i);
+      while (i--)
+        AML_FE_Colse(params->frontend_fd[i]);
+      return -1;
+    }
+    params->dmx_dev_id[i] = i;
+  }
+  params->tuner_count = count;
+  return 0;
+}
+
+static void close_tuners(dvb_scan_params_t *params)
+{
+  int i;
+
+  for (i = 0; i < params->tuner_count; i++)
+    AML_FE_Colse(params->frontend_fd[i]);
+}
+
+static void scan_cb(const dvb_scan_result_t *result, void *user_data)
+{
+  int *locked = (int *)user_data;
+
+  if (result->status == TUNER_STATE_LOCKED && result->complete && result->service_count == 2)
+    (*locked)++;
+  if (result->tuner < SEC_TUNERS && tuner_freq_count[result->tuner] < FREQ_COUNT)
+    tuner_freqs[result->tuner][tuner_freq_count[result->tuner]++] = result->index;
+}
+
+static uint64_t run_scan(dvb_scan_params_t *params, int *locked)
+{
+  dvb_scan_handle_t handle;
+  uint64_t start = get_ms();
+
+  *locked = 0;
+  params->lock_timeout = lock_delay + 1000;
+  params->table_timeout = 1000;
+  params->cb = scan_cb;
+  params->user_data = locked;
+  if (AML_SCAN_Start(params, &handle) != DVB_SUCCESS)
+    return 0;
+  AML_SCAN_Wait(handle, -1);
+  AML_SCAN_Stop(handle);
+  return get_ms() - start;
+}
+
+/*the frequencies are shared by the tuners, the scan takes about ceil(freqs / tuners) lock delays*/
+static void test_scan_time(void)
+{
+  dvb_scan_freq_t freqs[FREQ_COUNT];
+  dvb_scan_params_t params;
+  char what[128];
+  uint64_t ms, expect;
+  int tuners, i, locked;
+
+  memset(freqs, 0, sizeof(freqs));
+  for (i = 0; i < FREQ_COUNT; i++) {
+    freqs[i].delivery = DVB_SCAN_DVB_C;
+    freqs[i].desc.cable.frequency = 474000 + i * 8000;
+    freqs[i].desc.cable.symbol_rate = 6875;
+    freqs[i].desc.cable.modulation = DMD_MOD_64QAM;
+  }
+  for (tuners = 1; tuners <= 3; tuners++) {
+    memset(&params, 0, sizeof(params));
+    if (open_tuners(&params, tuners) != 0) {
+      failures++;
+      return;
+    }
+    params.freqs = freqs;
+    params.freq_count = FREQ_COUNT;
+    ms = run_scan(&params, &locked);
+    close_tuners(&params);
+
+    expect = (uint64_t)(FREQ_COUNT + tuners - 1) / tuners * lock_delay;
+    printf("scan %d freqs on %d tuners: %llu ms, %d complete\n", FREQ_COUNT, tuners,
+        (unsigned long long)ms, locked);
+    snprintf(what, sizeof(what), "%d tuners scan in [%llu, %llu) ms with all transponders complete",
+        tuners, (unsigned long long)expect, (unsigned long long)(expect + SCAN_SLACK_MS));
+    check(locked == FREQ_COUNT && ms >= expect && ms < expect + SCAN_SLACK_MS, what);
+  }
+}
+
+/*the cached equipment state of a tuner, -1 is unknown*/
+typedef struct {
+  int voltage;
+  int tone;
+  int committed;
+} sec_state_t;
+
+/*append the commands AML_FE_SetSec sends from a state to a target*/
+static void expect_switch(sec_state_t *st, int index, dmd_sec_event_t *events, int *count)
+{
+  int voltage, tone, committed;
+  dmd_sec_event_t *e;
+
+  voltage = (sec_plan[index].polarization == DMD_PLR_HORIZONTAL) ? SEC_VOLTAGE_18 : SEC_VOLTAGE_13;
+  tone = sec_plan[index].high_band ? SEC_TONE_ON : SEC_TONE_OFF;
+  committed = 0xf0 | ((sec_plan[index].port - DMD_DISEQC_PORTA) << 2)
+    | (voltage == SEC_VOLTAGE_18 ? 0x02 : 0) | (sec_plan[index].high_band ? 0x01 : 0);
+
+  if (st->voltage != voltage) {
+    e = &events[(*count)++];
+    e->type = DMD_SEC_EVENT_VOLTAGE;
+    e->value = voltage;
+    st->voltage = voltage;
+  }
+  if (st->committed != committed) {
+    if (st->tone != SEC_TONE_OFF) {
+      e = &events[(*count)++];
+      e->type = DMD_SEC_EVENT_TONE;
+      e->value = SEC_TONE_OFF;
+      st->tone = SEC_TONE_OFF;
+    }
+    e = &events[(*count)++];
+    e->type = DMD_SEC_EVENT_DISEQC;
+    e->msg[0] = 0xe0;
+    e->msg[1] = 0x10;
+    e->msg[2] = 0x38;
+    e->msg[3] = committed;
+    e->msg_len = 4;
+    st->committed = committed;
+  }
+  if (st->tone != tone) {
+    e = &events[(*count)++];
+    e->type = DMD_SEC_EVENT_TONE;
+    e->value = tone;
+    st->tone = tone;
+  }
+}
+
+static void print_timeline(const dmd_sec_event_t *events, int count)
+{
+  static const char *types[] = {"voltage", "tone", "diseqc"};
+  int i, j;
+
+  for (i = 0; i < count; i++) {
+    printf("  +%6llu us %-7s", (unsigned long long)(events[i].time_us - events[0].time_us), types[events[i].type]);
+    if (events[i].type == DMD_SEC_EVENT_DISEQC) {
+      for (j = 0; j < events[i].msg_len; j++)
+        printf(" %02x", events[i].msg[j]);
+    } else {
+      printf(" %u", events[i].value);
+    }
+    printf("\n");
+  }
+}
+
+/*a DVB-S scan on 2 tuners, each tuner only sends what its previous frequency did not set*/
+static void test_scan_switch(void)
+{
+  dvb_scan_freq_t freqs[FREQ_COUNT];
+  dvb_scan_params_t params;
+  dmd_sec_event_t events[MAX_EVENTS], expected[MAX_EVENTS];
+  sec_state_t state;
+  char what[128];
+  int i, t, count, nb_expected, locked, same, settled;
+
+  memset(freqs, 0, sizeof(freqs));
+  for (i = 0; i < FREQ_COUNT; i++) {
+    freqs[i].delivery = DVB_SCAN_DVB_S;
+    freqs[i].desc.sate.frequency = 1100000 + i * 40000;
+    freqs[i].desc.sate.symbol_rate = 27500;
+    freqs[i].desc.sate.modulation_system = DMD_MODSYS_DVBS;
+    freqs[i].desc.sate.modulation = DMD_MOD_QPSK;
+    freqs[i].desc.sate.fec_rate = DMD_FEC_ALL;
+    freqs[i].desc.sate.polarization = sec_plan[i].polarization;
+    freqs[i].sec.high_band = sec_plan[i].high_band;
+    freqs[i].sec.port = sec_plan[i].port;
+  }
+  memset(tuner_freq_count, 0, sizeof(tuner_freq_count));
+  memset(&params, 0, sizeof(params));
+  if (open_tuners(&params, SEC_TUNERS) != 0) {
+    failures++;
+    return;
+  }
+  params.freqs = freqs;
+  params.freq_count = FREQ_COUNT;
+  run_scan(&params, &locked);
+  check(locked == FREQ_COUNT, "DVB-S scan on 2 tuners with all transponders complete");
+
+  for (t = 0; t < SEC_TUNERS; t++) {
+    count = MAX_EVENTS;
+    if (AML_FE_GetVirtualTimeline(params.frontend_fd[t], events, &count) != DVB_SUCCESS)
+      count = 0;
+    printf("tuner %d scanned", t);
+    for (i = 0; i < tuner_freq_count[t]; i++)
+      printf(" %d", tuner_freqs[t][i]);
+    printf(", %d commands\n", count);
+    print_timeline(events, count);
+
+    memset(&state, -1, sizeof(state));
+    memset(expected, 0, sizeof(expected));
+    nb_expected = 0;
+    for (i = 0; i < tuner_freq_count[t]; i++)
+      expect_switch(&state, tuner_freqs[t][i], expected, &nb_expected);
+    same = (count == nb_expected);
+    for (i = 0; same && i < count; i++) {
+      same = events[i].type == expected[i].type
+        && (events[i].type == DMD_SEC_EVENT_DISEQC ?
+          (events[i].msg_len == expected[i].msg_len && !memcmp(events[i].msg, expected[i].msg, events[i].msg_len)) :
+          events[i].value == expected[i].value);
+    }
+    snprintf(what, sizeof(what), "tuner %d sends the %d switch commands of its frequencies", t, nb_expected);
+    check(same, what);
+
+    /*a message waits for the bus to settle, and so does the tone after it*/
+    settled = 1;
+    for (i = 1; i < count; i++) {
+      if ((events[i].type == DMD_SEC_EVENT_DISEQC || events[i - 1].type == DMD_SEC_EVENT_DISEQC)
+          && events[i].time_us - events[i - 1].time_us < SEC_SETTLE_US)
+        settled = 0;
+    }
+    snprintf(what, sizeof(what), "tuner %d waits %d us around the DiSEqC messages", t, SEC_SETTLE_US);
+    check(settled, what);
+  }
+  close_tuners(&params);
+}
+
+static uint64_t timed_switch(int fd, const dmd_sec_target_t *target, int *count)
+{
+  dmd_sec_event_t events[MAX_EVENTS];
+  uint64_t start = get_ms(), ms;
+
+  AML_FE_SetSec(fd, target);
+  ms = get_ms() - start;
+  *count = MAX_EVENTS;
+  if (AML_FE_GetVirtualTimeline(fd, events, count) != DVB_SUCCESS)
+    *count = -1;
+  return ms;
+}
+
+/*first switch: voltage, tone off, message, settle, tone on;
+  band change: tone off, message; repeated target: nothing*/
+static void test_switch_time(void)
+{
+  dmd_virtual_desc_t desc;
+  dmd_sec_target_t target;
+  uint64_t ms;
+  int fd, count;
+
+  memset(&desc, 0, sizeof(desc));
+  desc.dmx_dev_id = -1;
+  if (AML_FE_OpenVirtual(&desc, &fd) != DVB_SUCCESS) {
+    printf("open virtual frontend failed\n");
+    failures++;
+    return;
+  }
+  memset(&target, 0, sizeof(target));
+  target.polarization = DMD_PLR_HORIZONTAL;
+  target.high_band = 1;
+  target.port = DMD_DISEQC_PORTB;
+
+  ms = timed_switch(fd, &target, &count);
+  printf("first switch: %llu ms, %d commands\n", (unsigned long long)ms, count);
+  check(count == 4 && ms >= 30 && ms < 40, "first switch sends 4 commands in [30, 40) ms");
+
+  ms = timed_switch(fd, &target, &count);
+  printf("repeated target: %llu ms, %d commands\n", (unsigned long long)ms, count);
+  check(count == 0 && ms < 5, "repeated target sends nothing in less than 5 ms");
+
+  target.high_band = 0;
+  ms = timed_switch(fd, &target, &count);
+  printf("band change: %llu ms, %d commands\n", (unsigned long long)ms, count);
+  check(count == 2 && ms >= 15 && ms < 25, "band change sends 2 commands in [15, 25) ms");
+
+  target.polarization = DMD_PLR_NONE;
+  ms = timed_switch(fd, &target, &count);
+  printf("no polarization: %llu ms, %d commands\n", (unsigned long long)ms, count);
+  check(count == 1 && ms < 5, "no polarization only switches the supply off");
+
+  AML_FE_Colse(fd);
+}
+
+int main(int argc, char **argv)
+{
+  const char *dir = "/data/local/tmp";
+  int i;
+
+  for (i = 1; i < argc; i++) {
+    if (!strncmp(argv[i], "dir=", 4))
+      dir = argv[i] + 4;
+    else if (!strncmp(argv[i], "lock=", 5))
+      sscanf(argv[i], "lock=%i", &lock_delay);
+    else {
+      printf("Usage: %s [dir=path] [lock=lock_delay_ms]\n", argv[0]);
+      return 0;
+    }
+  }
+  if (snprintf(ts_path, sizeof(ts_path), "%s/am_scan_test.ts", dir) >= (int)sizeof(ts_path)) {
+    printf("dir too long: %s\n", dir);
+    return -1;
+  }
+  if (make_ts() != 0)
+    return -1;
+
+  test_scan_time();
+  test_scan_switch();
+  test_switch_time();
+
+  unlink(ts_path);
+  printf("%s, %d failures\n", failures ? "FAILED" : "PASSED", failures);
+  return failures ? -1 : 0;
+}
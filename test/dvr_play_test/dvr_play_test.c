@@ -19,6 +19,7 @@
 #include <string.h>
 #include <stdlib.h>
 
+#include "AmTsPlayer.h"
 #include "dvr_playback.h"
 
 static void display_usage(void)
@@ -152,7 +153,7 @@ int main(int argc, char **argv)
   DVR_PlaybackOpenParams_t params;
   params.dmx_dev_id = dmx;
   params.block_size = bsize;
-  params.player_handle = device_handle;
+  params.player_handle = (DVR_PlaybackSinkHandle_t)device_handle;
 
   printf("open dvr playback device\r\n");
   dvr_playback_open(&handle, &params);
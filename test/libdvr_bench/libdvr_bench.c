@@ -0,0 +1,563 @@
+/**
+ * \page libdvr_bench
+ * \section Introduction
+ * Benchmarks of the libdvr record, index, seek and library operations.
+ * The results are written as JSON so that they can be compared per change.
+ * It measures:
+ * \li segment_write at various block sizes
+ * \li segment_update_pts index writing
+ * \li segment_seek/segment_tell_position_time on 1h/4h recordings
+ * \li dvr_segment_get_list/dvr_segment_get_info over 1000 segments
+ * \li wrapper record event dispatch, fed by the synthetic record device
+ *
+ * \section Usage
+ * \code
+ *   libdvr_bench [dir=path] [out=file] [only=name] [dur=s]
+ * \endcode
+ * \li dir   working directory, default /data/dvr_bench
+ * \li out   JSON output file, default stdout
+ * \li only  run only the benchmarks whose name starts with it
+ * \li dur   seconds of the wrapper dispatch run, default 5
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "dvr_types.h"
+#include "segment.h"
+#include "dvr_segment.h"
+#include "dvr_wrapper.h"
+#include "record_device.h"
+
+#define BENCH_TS_PKT_SIZE       188
+#define BENCH_SEGMENT_COUNT     1000
+#define BENCH_SEEK_COUNT        200
+#define BENCH_INDEX_INTERVAL_MS 300
+#define BENCH_BITRATE           (8 * 1000 * 1000)
+#define BENCH_MAX_EVENTS        4096
+
+#define INF(fmt, ...)       fprintf(stderr, fmt, ## __VA_ARGS__)
+
+/**\brief Latency samples of one benchmark*/
+typedef struct {
+  uint64_t  *ns;        /**< samples in ns*/
+  uint32_t  cnt;        /**< number of samples*/
+  uint32_t  max;        /**< capacity*/
+} Bench_Samples_t;
+
+static char bench_dir[DVR_MAX_LOCATION_SIZE / 2] = "/data/dvr_bench";
+static const char *bench_only = NULL;
+static int bench_dur = 5;
+static FILE *bench_out = NULL;
+static int bench_results = 0;
+
+static uint64_t bench_now_ns(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int bench_samples_init(Bench_Samples_t *s, uint32_t max)
+{
+  s->ns = (uint64_t *)malloc(sizeof(uint64_t) * max);
+  s->cnt = 0;
+  s->max = max;
+  return s->ns ? 0 : -1;
+}
+
+static void bench_samples_add(Bench_Samples_t *s, uint64_t ns)
+{
+  if (s->cnt < s->max)
+    s->ns[s->cnt++] = ns;
+}
+
+static void bench_samples_free(Bench_Samples_t *s)
+{
+  free(s->ns);
+  s->ns = NULL;
+  s->cnt = s->max = 0;
+}
+
+static int bench_cmp_u64(const void *a, const void *b)
+{
+  uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+  return (x > y) - (x < y);
+}
+
+static double bench_pct_us(Bench_Samples_t *s, int pct)
+{
+  uint32_t i;
+
+  if (!s->cnt)
+    return 0;
+  i = (uint32_t)((uint64_t)(s->cnt - 1) * pct / 100);
+  return s->ns[i] / 1000.0;
+}
+
+static int bench_enabled(const char *name)
+{
+  return !bench_only || !strncmp(name, bench_only, strlen(bench_only));
+}
+
+/*Emit one result object, extra is a preformatted JSON fragment or NULL*/
+static void bench_report(const char *name, Bench_Samples_t *s, const char *extra)
+{
+  uint64_t total = 0;
+  uint32_t i;
+
+  qsort(s->ns, s->cnt, sizeof(uint64_t), bench_cmp_u64);
+  for (i = 0; i < s->cnt; i++)
+    total += s->ns[i];
+
+  fprintf(bench_out, "%s\n    {\"name\": \"%s\", \"count\": %u", bench_results ? "," : "", name, s->cnt);
+  if (extra)
+    fprintf(bench_out, ", %s", extra);
+  fprintf(bench_out, ", \"latency_us\": {\"mean\": %.1f, \"p50\": %.1f, \"p90\": %.1f, \"p99\": %.1f, \"max\": %.1f}}",
+      s->cnt ? total / 1000.0 / s->cnt : 0,
+      bench_pct_us(s, 50), bench_pct_us(s, 90), bench_pct_us(s, 99), bench_pct_us(s, 100));
+  bench_results++;
+  INF("%-40s count:%-6u p50:%.1fus p99:%.1fus\n", name, s->cnt, bench_pct_us(s, 50), bench_pct_us(s, 99));
+}
+
+static void bench_location(char *location, const char *name)
+{
+  memset(location, 0, DVR_MAX_LOCATION_SIZE);
+  snprintf(location, DVR_MAX_LOCATION_SIZE, "%s/%s", bench_dir, name);
+}
+
+static int bench_open_segment(const char *location, uint64_t id, Segment_OpenMode_t mode, Segment_Handle_t *p_handle)
+{
+  Segment_OpenParams_t params;
+
+  memset(&params, 0, sizeof(params));
+  if (snprintf(params.location, sizeof(params.location), "%s", location) >= (int)sizeof(params.location)) {
+    INF("location too long: %s\n", location);
+    return DVR_FAILURE;
+  }
+  params.segment_id = id;
+  params.mode = mode;
+  return segment_open(&params, p_handle);
+}
+
+static void bench_fill_ts(uint8_t *buf, size_t len)
+{
+  size_t i;
+
+  memset(buf, 0xff, len);
+  for (i = 0; i + BENCH_TS_PKT_SIZE <= len; i += BENCH_TS_PKT_SIZE) {
+    buf[i] = 0x47;
+    buf[i + 1] = 0x01;
+    buf[i + 2] = 0x00;
+    buf[i + 3] = 0x10 | ((i / BENCH_TS_PKT_SIZE) & 0x0f);
+  }
+}
+
+static void bench_segment_write(void)
+{
+  static const size_t block_sizes[] = {
+    BENCH_TS_PKT_SIZE * 64, 64 * 1024, 256 * 1024, BENCH_TS_PKT_SIZE * 1024 * 30
+  };
+  const size_t total = 32 * 1024 * 1024;
+  char location[DVR_MAX_LOCATION_SIZE];
+  char name[64], extra[128];
+  Segment_Handle_t handle;
+  Bench_Samples_t s;
+  uint8_t *buf;
+  uint64_t t, start;
+  size_t i, n, done;
+
+  if (!bench_enabled("segment_write"))
+    return;
+  bench_location(location, "write");
+  for (i = 0; i < sizeof(block_sizes) / sizeof(block_sizes[0]); i++) {
+    buf = (uint8_t *)malloc(block_sizes[i]);
+    n = total / block_sizes[i] + 1;
+    if (!buf || bench_samples_init(&s, n) ||
+        bench_open_segment(location, 0, SEGMENT_MODE_WRITE, &handle) != DVR_SUCCESS) {
+      INF("segment_write: setup failed\n");
+      free(buf);
+      bench_samples_free(&s);
+      return;
+    }
+    bench_fill_ts(buf, block_sizes[i]);
+    start = bench_now_ns();
+    for (done = 0; done < total; done += block_sizes[i]) {
+      t = bench_now_ns();
+      if (segment_write(handle, buf, block_sizes[i]) != (ssize_t)block_sizes[i])
+        break;
+      bench_samples_add(&s, bench_now_ns() - t);
+    }
+    t = bench_now_ns() - start;
+    segment_close(handle);
+    segment_delete(location, 0);
+
+    snprintf(name, sizeof(name), "segment_write/%zu", block_sizes[i]);
+    snprintf(extra, sizeof(extra), "\"block_size\": %zu, \"throughput_mbps\": %.2f",
+        block_sizes[i], t ? done * 8.0 * 1000 / t : 0);
+    bench_report(name, &s, extra);
+    bench_samples_free(&s);
+    free(buf);
+  }
+}
+
+static void bench_segment_update_pts(void)
+{
+  const uint32_t count = 3000;
+  char location[DVR_MAX_LOCATION_SIZE];
+  Segment_Handle_t handle;
+  Bench_Samples_t s;
+  uint64_t t;
+  uint32_t i;
+
+  if (!bench_enabled("segment_update_pts"))
+    return;
+  bench_location(location, "pts");
+  if (bench_samples_init(&s, count) ||
+      bench_open_segment(location, 0, SEGMENT_MODE_WRITE, &handle) != DVR_SUCCESS) {
+    INF("segment_update_pts: setup failed\n");
+    bench_samples_free(&s);
+    return;
+  }
+  /*PCR every 40ms at the bench bitrate, like record_do_pcr_index*/
+  for (i = 0; i < count; i++) {
+    t = bench_now_ns();
+    segment_update_pts(handle, (uint64_t)i * 40, (loff_t)i * (BENCH_BITRATE / 8 / 25));
+    bench_samples_add(&s, bench_now_ns() - t);
+  }
+  segment_close(handle);
+  segment_delete(location, 0);
+  bench_report("segment_update_pts", &s, NULL);
+  bench_samples_free(&s);
+}
+
+/*Build a recording of the given duration, index written in the segment format*/
+static int bench_make_recording(const char *location, uint32_t hours)
+{
+  char fname[DVR_MAX_LOCATION_SIZE + 32];
+  uint64_t dur_ms = (uint64_t)hours * 3600 * 1000;
+  uint64_t ms;
+  loff_t offset = 0;
+  FILE *fp;
+  int fd;
+
+  snprintf(fname, sizeof(fname), "%s-%04d.idx", location, 0);
+  fp = fopen(fname, "w");
+  if (!fp)
+    return -1;
+  for (ms = 0; ms <= dur_ms; ms += BENCH_INDEX_INTERVAL_MS) {
+    offset = (loff_t)(ms * (BENCH_BITRATE / 8) / 1000);
+    offset -= offset % BENCH_TS_PKT_SIZE;
+    fprintf(fp, "%s{time=%llu, offset=%lld}", ms ? "\n" : "",
+        (unsigned long long)ms, (long long)offset);
+  }
+  fclose(fp);
+
+  snprintf(fname, sizeof(fname), "%s-%04d.dat", location, 0);
+  fp = fopen(fname, "w");
+  if (!fp)
+    return -1;
+  fprintf(fp, "id=0\nnb_pids=0\nduration=%llu\nsize=%lld\nnb_packets=%lld\n",
+      (unsigned long long)dur_ms, (long long)offset, (long long)offset / BENCH_TS_PKT_SIZE);
+  fclose(fp);
+
+  /*sparse ts file, only the size matters*/
+  snprintf(fname, sizeof(fname), "%s-%04d.ts", location, 0);
+  fd = open(fname, O_CREAT | O_RDWR | O_TRUNC, 0644);
+  if (fd == -1)
+    return -1;
+  if (ftruncate(fd, offset) == -1) {
+    close(fd);
+    return -1;
+  }
+  close(fd);
+  return 0;
+}
+
+static void bench_segment_seek(void)
+{
+  static const uint32_t hours[] = {1, 4};
+  char location[DVR_MAX_LOCATION_SIZE];
+  char name[64], extra[64];
+  Segment_Handle_t handle;
+  Bench_Samples_t s_seek, s_tell;
+  uint64_t t, dur_ms, size;
+  uint32_t i, h;
+
+  if (!bench_enabled("segment_seek") && !bench_enabled("segment_tell_position_time"))
+    return;
+  srand(1);
+  for (h = 0; h < sizeof(hours) / sizeof(hours[0]); h++) {
+    snprintf(name, sizeof(name), "seek%uh", hours[h]);
+    bench_location(location, name);
+    dur_ms = (uint64_t)hours[h] * 3600 * 1000;
+    size = dur_ms * (BENCH_BITRATE / 8) / 1000;
+    if (bench_make_recording(location, hours[h]) ||
+        bench_open_segment(location, 0, SEGMENT_MODE_READ, &handle) != DVR_SUCCESS) {
+      INF("segment_seek: setup failed\n");
+      segment_delete(location, 0);
+      return;
+    }
+    bench_samples_init(&s_seek, BENCH_SEEK_COUNT);
+    bench_samples_init(&s_tell, BENCH_SEEK_COUNT);
+    for (i = 0; i < BENCH_SEEK_COUNT; i++) {
+      uint64_t target = ((uint64_t)rand() << 16 ^ rand()) % dur_ms + 1;
+      loff_t pos = (loff_t)((((uint64_t)rand() << 16 ^ rand()) % size));
+
+      t = bench_now_ns();
+      segment_seek(handle, target, BENCH_TS_PKT_SIZE);
+      bench_samples_add(&s_seek, bench_now_ns() - t);
+
+      t = bench_now_ns();
+      segment_tell_position_time(handle, pos);
+      bench_samples_add(&s_tell, bench_now_ns() - t);
+    }
+    segment_close(handle);
+    segment_delete(location, 0);
+
+    snprintf(extra, sizeof(extra), "\"duration_h\": %u", hours[h]);
+    if (bench_enabled("segment_seek")) {
+      snprintf(name, sizeof(name), "segment_seek/%uh", hours[h]);
+      bench_report(name, &s_seek, extra);
+    }
+    if (bench_enabled("segment_tell_position_time")) {
+      snprintf(name, sizeof(name), "segment_tell_position_time/%uh", hours[h]);
+      bench_report(name, &s_tell, extra);
+    }
+    bench_samples_free(&s_seek);
+    bench_samples_free(&s_tell);
+  }
+}
+
+static void bench_segment_list(void)
+{
+  char location[DVR_MAX_LOCATION_SIZE];
+  char fname[DVR_MAX_LOCATION_SIZE + 16];
+  DVR_RecordSegmentInfo_t info;
+  Segment_Handle_t handle;
+  Bench_Samples_t s;
+  uint64_t *ids;
+  uint64_t t;
+  uint32_t i, nb;
+  uint8_t pkt[BENCH_TS_PKT_SIZE];
+
+  if (!bench_enabled("dvr_segment_get"))
+    return;
+  bench_location(location, "list");
+  ids = (uint64_t *)malloc(sizeof(uint64_t) * BENCH_SEGMENT_COUNT);
+  if (!ids)
+    return;
+  bench_fill_ts(pkt, sizeof(pkt));
+  for (i = 0; i < BENCH_SEGMENT_COUNT; i++) {
+    if (bench_open_segment(location, i, SEGMENT_MODE_WRITE, &handle) != DVR_SUCCESS) {
+      INF("dvr_segment_get: setup failed\n");
+      free(ids);
+      dvr_segment_del_by_location(location);
+      return;
+    }
+    segment_write(handle, pkt, sizeof(pkt));
+    segment_update_pts(handle, 0, 0);
+    memset(&info, 0, sizeof(info));
+    info.id = i;
+    info.nb_pids = 2;
+    info.pids[0].pid = 0x100;
+    info.pids[0].type = DVR_STREAM_TYPE_VIDEO << 24;
+    info.pids[1].pid = 0x101;
+    info.pids[1].type = DVR_STREAM_TYPE_AUDIO << 24;
+    info.duration = 1000;
+    info.size = sizeof(pkt);
+    info.nb_packets = 1;
+    segment_store_info(handle, &info);
+    segment_close(handle);
+    ids[i] = i;
+  }
+  dvr_segment_link(location, BENCH_SEGMENT_COUNT, ids);
+  free(ids);
+
+  /*list file path*/
+  bench_samples_init(&s, 50);
+  for (i = 0; i < 50; i++) {
+    t = bench_now_ns();
+    if (dvr_segment_get_list(location, &nb, &ids) == DVR_SUCCESS)
+      free(ids);
+    bench_samples_add(&s, bench_now_ns() - t);
+  }
+  bench_report("dvr_segment_get_list/list_file", &s, "\"segments\": 1000");
+  bench_samples_free(&s);
+
+  bench_samples_init(&s, BENCH_SEGMENT_COUNT);
+  for (i = 0; i < BENCH_SEGMENT_COUNT; i++) {
+    t = bench_now_ns();
+    dvr_segment_get_info(location, i, &info);
+    bench_samples_add(&s, bench_now_ns() - t);
+  }
+  bench_report("dvr_segment_get_info", &s, "\"segments\": 1000");
+  bench_samples_free(&s);
+
+  /*no list file, scan the directory*/
+  snprintf(fname, sizeof(fname), "%s.list", location);
+  unlink(fname);
+  bench_samples_init(&s, 10);
+  for (i = 0; i < 10; i++) {
+    t = bench_now_ns();
+    if (dvr_segment_get_list(location, &nb, &ids) == DVR_SUCCESS)
+      free(ids);
+    bench_samples_add(&s, bench_now_ns() - t);
+  }
+  bench_report("dvr_segment_get_list/scan", &s, "\"segments\": 1000");
+  bench_samples_free(&s);
+
+  dvr_segment_del_by_location(location);
+}
+
+/**\brief Wrapper dispatch run state*/
+typedef struct {
+  pthread_mutex_t   lock;
+  uint64_t          start_ns;
+  uint32_t          cnt;
+  uint64_t          at_ns[BENCH_MAX_EVENTS];
+  uint64_t          size[BENCH_MAX_EVENTS];
+} Bench_Dispatch_t;
+
+static Bench_Dispatch_t bench_dispatch;
+
+static DVR_Result_t bench_record_event(DVR_RecordEvent_t event, void *params, void *userdata)
+{
+  DVR_WrapperRecordStatus_t *status = (DVR_WrapperRecordStatus_t *)params;
+  Bench_Dispatch_t *d = (Bench_Dispatch_t *)userdata;
+  uint64_t now = bench_now_ns();
+
+  if (event != DVR_RECORD_EVENT_STATUS || !status)
+    return DVR_SUCCESS;
+  pthread_mutex_lock(&d->lock);
+  if (d->cnt < BENCH_MAX_EVENTS) {
+    d->at_ns[d->cnt] = now;
+    d->size[d->cnt] = status->info.size;
+    d->cnt++;
+  }
+  pthread_mutex_unlock(&d->lock);
+  return DVR_SUCCESS;
+}
+
+static void bench_wrapper_dispatch(void)
+{
+  const uint32_t bitrate = 80 * 1000 * 1000;
+  DVR_WrapperRecordOpenParams_t open_params;
+  DVR_WrapperRecordStartParams_t start_params;
+  DVR_WrapperRecord_t rec;
+  Bench_Samples_t s_int, s_lag;
+  Bench_Dispatch_t *d = &bench_dispatch;
+  char extra[128];
+  uint32_t i;
+
+  if (!bench_enabled("wrapper_event_dispatch"))
+    return;
+  memset(d, 0, sizeof(*d));
+  pthread_mutex_init(&d->lock, NULL);
+
+  memset(&open_params, 0, sizeof(open_params));
+  bench_location(open_params.location, "wrapper");
+  open_params.segment_size = 1024LL * 1024 * 1024;
+  open_params.event_fn = bench_record_event;
+  open_params.event_userdata = d;
+  open_params.flush_size = BENCH_TS_PKT_SIZE * 64;
+  open_params.dev_backend = RECORD_DEVICE_BACKEND_SYNTHETIC;
+  open_params.dev_src_bitrate = bitrate;
+  if (dvr_wrapper_open_record(&rec, &open_params) != DVR_SUCCESS) {
+    INF("wrapper_event_dispatch: open record failed\n");
+    return;
+  }
+
+  memset(&start_params, 0, sizeof(start_params));
+  start_params.pids_info.nb_pids = 2;
+  start_params.pids_info.pids[0].pid = 0x100;
+  start_params.pids_info.pids[0].type = DVR_STREAM_TYPE_VIDEO << 24;
+  start_params.pids_info.pids[1].pid = 0x101;
+  start_params.pids_info.pids[1].type = DVR_STREAM_TYPE_AUDIO << 24;
+  d->start_ns = bench_now_ns();
+  if (dvr_wrapper_start_record(rec, &start_params) != DVR_SUCCESS) {
+    INF("wrapper_event_dispatch: start record failed\n");
+    dvr_wrapper_close_record(rec);
+    return;
+  }
+  sleep(bench_dur);
+  dvr_wrapper_stop_record(rec);
+  dvr_wrapper_close_record(rec);
+  dvr_segment_del_by_location(open_params.location);
+
+  /*The synthetic source is paced, so the time a status size was produced is
+   *known, the lag is source production to wrapper callback*/
+  pthread_mutex_lock(&d->lock);
+  bench_samples_init(&s_int, d->cnt);
+  bench_samples_init(&s_lag, d->cnt);
+  for (i = 0; i < d->cnt; i++) {
+    uint64_t due = d->start_ns + d->size[i] * 8 * 1000000000ULL / bitrate;
+
+    if (i)
+      bench_samples_add(&s_int, d->at_ns[i] - d->at_ns[i - 1]);
+    bench_samples_add(&s_lag, d->at_ns[i] > due ? d->at_ns[i] - due : 0);
+  }
+  snprintf(extra, sizeof(extra), "\"bitrate\": %u, \"events_per_s\": %.1f",
+      bitrate, bench_dur ? (double)d->cnt / bench_dur : 0);
+  pthread_mutex_unlock(&d->lock);
+
+  bench_report("wrapper_event_dispatch/interval", &s_int, extra);
+  bench_report("wrapper_event_dispatch/lag", &s_lag, extra);
+  bench_samples_free(&s_int);
+  bench_samples_free(&s_lag);
+}
+
+int main(int argc, char **argv)
+{
+  const char *out = NULL;
+  int i;
+
+  for (i = 1; i < argc; i++) {
+    if (!strncmp(argv[i], "dir=", 4)) {
+      if (snprintf(bench_dir, sizeof(bench_dir), "%s", argv[i] + 4) >= (int)sizeof(bench_dir)) {
+        INF("dir too long: %s\n", argv[i] + 4);
+        return -1;
+      }
+    } else if (!strncmp(argv[i], "out=", 4))
+      out = argv[i] + 4;
+    else if (!strncmp(argv[i], "only=", 5))
+      bench_only = argv[i] + 5;
+    else if (!strncmp(argv[i], "dur=", 4))
+      sscanf(argv[i], "dur=%i", &bench_dur);
+    else {
+      INF("Usage: %s [dir=path] [out=file] [only=name] [dur=s]\n", argv[0]);
+      return -1;
+    }
+  }
+
+  if (access(bench_dir, F_OK) == -1 && mkdir(bench_dir, 0755) == -1) {
+    INF("cannot create %s (%s)\n", bench_dir, strerror(errno));
+    return -1;
+  }
+  bench_out = out ? fopen(out, "w") : stdout;
+  if (!bench_out) {
+    INF("cannot open %s (%s)\n", out, strerror(errno));
+    return -1;
+  }
+
+  fprintf(bench_out, "{\n  \"suite\": \"libdvr_bench\",\n  \"results\": [");
+  bench_segment_write();
+  bench_segment_update_pts();
+  bench_segment_seek();
+  bench_segment_list();
+  bench_wrapper_dispatch();
+  fprintf(bench_out, "\n  ]\n}\n");
+
+  if (bench_out != stdout)
+    fclose(bench_out);
+  return 0;
+}